@@ -29,6 +29,8 @@
 static int	make_subpackage(const char *prodname, const char *directory,
 		                const char *platname, dist_t *dist,
 			        const char *subpackage);
+static void	remove_subpackage(const char *prodname, const char *directory,
+		                  const char *subpackage);
 
 
 /*
@@ -43,17 +45,45 @@ make_bsd(const char     *prodname,	/* I - Product short name */
 	 struct utsname *platform)	/* I - Platform information */
 {
   int		i;			/* Looping var */
+  int		status;			/* Exit status */
 
 
-  if (make_subpackage(prodname, directory, platname, dist, NULL))
-    return (1);
+ /*
+  * Stage each package; the pkg_create commands run in the background so
+  * the next subpackage can be staged while the previous one is built...
+  */
 
-  for (i = 0; i < dist->num_subpackages; i ++)
-    if (make_subpackage(prodname, directory, platname, dist,
-                        dist->subpackages[i]))
-      return (1);
+  status = make_subpackage(prodname, directory, platname, dist, NULL);
 
-  return (0);
+  for (i = 0; i < dist->num_subpackages && !status; i ++)
+    status = make_subpackage(prodname, directory, platname, dist,
+                             dist->subpackages[i]);
+
+ /*
+  * Wait for the pkg_create commands to finish...
+  */
+
+  stats_phase("build");
+
+  if (wait_commands())
+    status = 1;
+
+ /*
+  * Remove temporary files...
+  */
+
+  if (!KeepFiles)
+  {
+    if (Verbosity)
+      puts("Removing temporary distribution files...");
+
+    remove_subpackage(prodname, directory, NULL);
+
+    for (i = 0; i < dist->num_subpackages; i ++)
+      remove_subpackage(prodname, directory, dist->subpackages[i]);
+  }
+
+  return (status);
 }
 
 
@@ -80,12 +110,19 @@ make_subpackage(
   char		*old_user,		/* Old owner UID */
 		*old_group;		/* Old group ID */
   int		old_mode;		/* Old permissions */
-  file_t	*file;			/* Current distribution file */
+  fileindex_t	*fileindex;		/* File index for subpackage */
+  file_t	**fileptr,		/* Pointer into file index */
+		*file;			/* Current distribution file */
   command_t	*c;			/* Current command */
   depend_t	*d;			/* Current dependency */
-  struct passwd	*pwd;			/* Pointer to user record */
-  struct group	*grp;			/* Pointer to group record */
+  uid_t		uid;			/* User ID */
+  gid_t		gid;			/* Group ID */
   char		current[1024];		/* Current directory */
+  char		*argv[13];		/* pkg_create command */
+#ifdef __OpenBSD__
+  char		absdir[1024],		/* Absolute output directory */
+		buildroot[1024];	/* Absolute build root */
+#endif /* __OpenBSD__ */
 
 
   getcwd(current, sizeof(current));
@@ -98,6 +135,8 @@ make_subpackage(
   if (Verbosity)
     printf("Creating %s *BSD pkg distribution...\n", prodfull);
 
+  fileindex = get_index(dist, subpackage);
+
   if (dist->release[0])
   {
     if (platname[0])
@@ -116,6 +155,8 @@ make_subpackage(
   * Write the descr file for pkg...
   */
 
+  stats_phase("scripts");
+
   if (Verbosity)
     printf("Creating %s.descr file...\n", prodfull);
 
@@ -240,25 +281,31 @@ make_subpackage(
             break;
       }
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (tolower(file->type) == 'd' && file->subpackage == subpackage)
-    {
-     /*
-      * We create and update directories as postinstall commands to
-      * avoid a bug in the FreeBSD pkg_delete command.
-      */
+  for (i = fileindex->num_types[INDEX_DIR],
+           fileptr = fileindex->types[INDEX_DIR];
+       i > 0;
+       i --, fileptr ++)
+  {
+    file = *fileptr;
 
-      fprintf(fp, "@exec mkdir -p %s\n", file->dst);
-      fprintf(fp, "@exec chown %s:%s %s\n", file->user, file->group,
-              file->dst);
-      fprintf(fp, "@exec chmod %04o %s\n", file->mode, file->dst);
-    }
+   /*
+    * We create and update directories as postinstall commands to
+    * avoid a bug in the FreeBSD pkg_delete command.
+    */
+
+    fprintf(fp, "@exec mkdir -p %s\n", file->dst);
+    fprintf(fp, "@exec chown %s:%s %s\n", file->user, file->group,
+            file->dst);
+    fprintf(fp, "@exec chmod %04o %s\n", file->mode, file->dst);
+  }
 
-  for (i = dist->num_files, file = dist->files, old_mode = 0, old_user = "",
-           old_group = "";
+  for (i = fileindex->num_files, fileptr = fileindex->files, old_mode = 0,
+           old_user = "", old_group = "";
        i > 0;
-       i --, file ++)
+       i --, fileptr ++)
   {
+    file = *fileptr;
+
    /*
     * The FreeBSD pkg_delete command (at least) doesn't like creating
     * and deleting directories.  I don't know if other BSD's have the
@@ -266,7 +313,7 @@ make_subpackage(
     * postinstall script...
     */
 
-    if (tolower(file->type) == 'd' || file->subpackage != subpackage)
+    if (tolower(file->type) == 'd')
       continue;
 
     if (file->mode != old_mode)
@@ -300,11 +347,11 @@ make_subpackage(
   * everything else...
   */
 
-  for (i = dist->num_files, file = dist->files + i - 1;
+  for (i = fileindex->num_types[INDEX_DIR],
+           fileptr = fileindex->types[INDEX_DIR] + i - 1;
        i > 0;
-       i --, file --)
-    if (tolower(file->type) == 'd' && file->subpackage == subpackage)
-      qprintf(fp, "@dirrm %s\n", file->dst + 1);
+       i --, fileptr --)
+    qprintf(fp, "@dirrm %s\n", (*fileptr)->dst + 1);
 
   fclose(fp);
 
@@ -312,23 +359,23 @@ make_subpackage(
   * Copy the files over...
   */
 
+  stats_phase("stage");
+
   if (Verbosity)
     puts("Copying temporary distribution files...");
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
+  for (i = fileindex->num_files, fileptr = fileindex->files;
+       i > 0;
+       i --, fileptr ++)
   {
-    if (file->subpackage != subpackage)
-      continue;
+    file = *fileptr;
 
    /*
     * Find the username and groupname IDs...
     */
 
-    pwd = getpwnam(file->user);
-    grp = getgrnam(file->group);
-
-    endpwent();
-    endgrent();
+    uid = get_user_id(file->user, 0);
+    gid = get_group_id(file->group, 0);
 
    /*
     * Copy the file or make the directory or make the symlink as needed...
@@ -344,8 +391,8 @@ make_subpackage(
 	  if (Verbosity > 1)
 	    printf("%s -> %s...\n", file->src, filename);
 
-	  if (copy_file(filename, file->src, file->mode, pwd ? pwd->pw_uid : 0,
-			grp ? grp->gr_gid : 0))
+	  if (copy_file(filename, file->src, file->mode, uid, gid,
+			file))
 	    return (1);
           break;
       case 'i' :
@@ -356,8 +403,8 @@ make_subpackage(
 	  if (Verbosity > 1)
 	    printf("%s -> %s...\n", file->src, filename);
 
-	  if (copy_file(filename, file->src, file->mode, pwd ? pwd->pw_uid : 0,
-			grp ? grp->gr_gid : 0))
+	  if (copy_file(filename, file->src, file->mode, uid, gid,
+			file))
 	    return (1);
           break;
       case 'd' :
@@ -367,8 +414,7 @@ make_subpackage(
 	  if (Verbosity > 1)
 	    printf("Directory %s...\n", filename);
 
-          make_directory(filename, file->mode, pwd ? pwd->pw_uid : 0,
-			 grp ? grp->gr_gid : 0);
+          make_directory(filename, file->mode, uid, gid);
           break;
       case 'l' :
           snprintf(filename, sizeof(filename), "%s/%s.buildroot%s",
@@ -386,65 +432,100 @@ make_subpackage(
   * Build the distribution...
   */
 
+  stats_phase("build");
+
   if (Verbosity)
     printf("Building %s *BSD pkg binary distribution...\n", prodfull);
 
 #ifdef __OpenBSD__
-  if (run_command(NULL, "pkg_create -p / -B %s/%s.buildroot "
-                        "-c %s "
-			"-d %s "
-                        "-f %s "
-			"%s.tgz",
-                  directory, prodfull,
-		  commentname,
-		  descrname,
-		  plistname,
-		  name))
-    return (1);
+ /*
+  * OpenBSD names the package after the output file, so create it in the
+  * output directory using absolute paths for the other files...
+  */
 
-  if (run_command(NULL, "mv %s.tgz %s", name, directory))
-    return (1);
-#elif defined(__FreeBSD__)
-  if (run_command(NULL, "/usr/sbin/pkg_create -p / "
-                        "-c %s "
-			"-d %s "
-                        "-f %s "
-			"%s/%s.tbz",
-		  commentname,
-		  descrname,
-		  plistname,
-		  directory, name))
+  if (directory[0] == '/')
+    strlcpy(absdir, directory, sizeof(absdir));
+  else
+    snprintf(absdir, sizeof(absdir), "%s/%s", current, directory);
+
+  snprintf(buildroot, sizeof(buildroot), "%s/%s.buildroot", absdir, prodfull);
+  snprintf(commentname, sizeof(commentname), "%s/%s.comment", absdir, prodfull);
+  snprintf(descrname, sizeof(descrname), "%s/%s.descr", absdir, prodfull);
+  snprintf(plistname, sizeof(plistname), "%s/%s.plist", absdir, prodfull);
+  snprintf(filename, sizeof(filename), "%s.tgz", name);
+
+  argv[0]  = "pkg_create";
+  argv[1]  = "-p";
+  argv[2]  = "/";
+  argv[3]  = "-B";
+  argv[4]  = buildroot;
+  argv[5]  = "-c";
+  argv[6]  = commentname;
+  argv[7]  = "-d";
+  argv[8]  = descrname;
+  argv[9]  = "-f";
+  argv[10] = plistname;
+  argv[11] = filename;
+  argv[12] = NULL;
+
+  if (start_argv(directory, argv))
     return (1);
 #else
-  if (run_command(NULL, "pkg_create -p / "
-                        "-c %s "
-			"-d %s "
-                        "-f %s "
-			"%s/%s.tgz",
-		  commentname,
-		  descrname,
-		  plistname,
-		  directory, name))
+#  ifdef __FreeBSD__
+  snprintf(filename, sizeof(filename), "%s/%s.tbz", directory, name);
+  argv[0] = "/usr/sbin/pkg_create";
+#  else
+  snprintf(filename, sizeof(filename), "%s/%s.tgz", directory, name);
+  argv[0] = "pkg_create";
+#  endif /* __FreeBSD__ */
+  argv[1] = "-p";
+  argv[2] = "/";
+  argv[3] = "-c";
+  argv[4] = commentname;
+  argv[5] = "-d";
+  argv[6] = descrname;
+  argv[7] = "-f";
+  argv[8] = plistname;
+  argv[9] = filename;
+  argv[10] = NULL;
+
+  if (start_argv(NULL, argv))
     return (1);
 #endif /* __OpenBSD__ */
 
- /*
-  * Remove temporary files...
-  */
+  return (0);
+}
 
-  if (!KeepFiles)
-  {
-    if (Verbosity)
-      puts("Removing temporary distribution files...");
 
-    snprintf(filename, sizeof(filename), "%s/%s.buildroot", directory,
-             prodfull);
-    unlink_directory(filename);
+/*
+ * 'remove_subpackage()' - Remove the temporary files for a subpackage.
+ */
 
-    unlink(plistname);
-    unlink(commentname);
-    unlink(descrname);
-  }
+static void
+remove_subpackage(const char *prodname,	/* I - Product short name */
+                  const char *directory,/* I - Directory for distribution files */
+		  const char *subpackage)
+					/* I - Subpackage name */
+{
+  char		prodfull[1024],		/* Full subpackage name */
+		filename[1024];		/* File to remove */
 
-  return (0);
+
+  if (subpackage)
+    snprintf(prodfull, sizeof(prodfull), "%s-%s", prodname, subpackage);
+  else
+    strlcpy(prodfull, prodname, sizeof(prodfull));
+
+  snprintf(filename, sizeof(filename), "%s/%s.buildroot", directory,
+           prodfull);
+  unlink_directory(filename);
+
+  snprintf(filename, sizeof(filename), "%s/%s.plist", directory, prodfull);
+  unlink(filename);
+
+  snprintf(filename, sizeof(filename), "%s/%s.comment", directory, prodfull);
+  unlink(filename);
+
+  snprintf(filename, sizeof(filename), "%s/%s.descr", directory, prodfull);
+  unlink(filename);
 }
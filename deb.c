@@ -29,7 +29,10 @@
 static int	make_subpackage(const char *prodname, const char *directory,
 		                const char *platname, dist_t *dist,
 		                struct utsname *platform,
-				const char *subpackage);
+				const char *subpackage, contents_t *contents);
+static void	remove_subpackage(const char *prodname, const char *directory,
+		                  const char *platname, dist_t *dist,
+				  const char *subpackage);
 
 
 /*
@@ -47,19 +50,55 @@ make_deb(const char     *prodname,	/* I - Product short name */
   tarf_t	*tarfile;		/* Distribution tar file */
   char		name[1024],		/* Full product name */
 		filename[1024];		/* File to archive */
+  contents_t	contents;		/* Files copied so far */
+  int		status;			/* Exit status */
 
 
  /* Debian packages use "amd64" instead of "x86_64" for the architecture... */
   if (!strcmp(platname, "x86_64"))
     platname = "amd64";
 
-  if (make_subpackage(prodname, directory, platname, dist, platform, NULL))
-    return (1);
+ /*
+  * Build the main package and subpackages, hard linking identical files
+  * across the subpackage directories...
+  */
 
-  for (i = 0; i < dist->num_subpackages; i ++)
-    if (make_subpackage(prodname, directory, platname, dist, platform,
-                        dist->subpackages[i]))
-      return (1);
+  memset(&contents, 0, sizeof(contents));
+
+  status = make_subpackage(prodname, directory, platname, dist, platform,
+                           NULL, &contents);
+
+  for (i = 0; i < dist->num_subpackages && !status; i ++)
+    status = make_subpackage(prodname, directory, platname, dist, platform,
+                             dist->subpackages[i], &contents);
+
+  free_contents(&contents);
+
+ /*
+  * Wait for the "dpkg --build" commands to finish...
+  */
+
+  stats_phase("build");
+
+  if (wait_commands())
+    status = 1;
+
+ /*
+  * Remove the temporary subpackage directories now that nothing links to
+  * them...
+  */
+
+  if (!KeepFiles)
+  {
+    remove_subpackage(prodname, directory, platname, dist, NULL);
+
+    for (i = 0; i < dist->num_subpackages; i ++)
+      remove_subpackage(prodname, directory, platname, dist,
+                        dist->subpackages[i]);
+  }
+
+  if (status)
+    return (1);
 
  /*
   * Build a compressed tar file to hold all of the subpackages...
@@ -67,6 +106,8 @@ make_deb(const char     *prodname,	/* I - Product short name */
 
   if (dist->num_subpackages)
   {
+    stats_phase("archive");
+
    /*
     * Figure out the full name of the distribution...
     */
@@ -153,8 +194,10 @@ make_subpackage(const char     *prodname,
                 dist_t         *dist,	/* I - Distribution information */
 	        struct utsname *platform,
 					/* I - Platform information */
-		const char     *subpackage)
+		const char     *subpackage,
 					/* I - Subpackage */
+		contents_t     *contents)
+					/* I - Files copied so far */
 {
   int			i, j;		/* Looping vars */
   const char		*header;	/* Dependency header string */
@@ -164,9 +207,12 @@ make_subpackage(const char     *prodname,
 			filename[1024];	/* Destination filename */
   command_t		*c;		/* Current command */
   depend_t		*d;		/* Current dependency */
-  file_t		*file;		/* Current distribution file */
-  struct passwd		*pwd;		/* Pointer to user record */
-  struct group		*grp;		/* Pointer to group record */
+  fileindex_t		*fileindex;	/* File index for subpackage */
+  file_t		**fileptr,	/* Pointer into file index */
+			*file;		/* Current distribution file */
+  uid_t			uid;		/* User ID */
+  gid_t			gid;		/* Group ID */
+  char			*argv[4];	/* dpkg command */
   static const char	*depends[] =	/* Dependency names */
 			{
 			  "Depends:",
@@ -204,10 +250,14 @@ make_subpackage(const char     *prodname,
   if (Verbosity)
     printf("Creating Debian %s distribution...\n", name);
 
+  fileindex = get_index(dist, subpackage);
+
  /*
   * Write the control file for DPKG...
   */
 
+  stats_phase("scripts");
+
   if (Verbosity)
     puts("Creating control file...");
 
@@ -343,9 +393,7 @@ make_subpackage(const char     *prodname,
       break;
 
   if (!i)
-    for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-      if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-        break;
+    i = fileindex->num_types[INDEX_INIT];
 
   if (i)
   {
@@ -369,17 +417,21 @@ make_subpackage(const char     *prodname,
       if (c->type == COMMAND_POST_INSTALL && c->subpackage == subpackage)
         fprintf(fp, "%s\n", c->command);
 
-    for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-      if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-      {
-       /*
-        * Debian's update-rc.d has changed over the years; current practice is
-        * to let update-rc.d choose the runlevels and ordering...
-        */
+    for (i = fileindex->num_types[INDEX_INIT],
+             fileptr = fileindex->types[INDEX_INIT];
+         i > 0;
+	 i --, fileptr ++)
+    {
+      file = *fileptr;
 
-        fprintf(fp, "update-rc.d %s defaults\n", file->dst);
-        fprintf(fp, "/etc/init.d/%s start\n", file->dst);
-      }
+     /*
+      * Debian's update-rc.d has changed over the years; current practice is
+      * to let update-rc.d choose the runlevels and ordering...
+      */
+
+      fprintf(fp, "update-rc.d %s defaults\n", file->dst);
+      fprintf(fp, "/etc/init.d/%s start\n", file->dst);
+    }
 
     fclose(fp);
   }
@@ -393,9 +445,7 @@ make_subpackage(const char     *prodname,
       break;
 
   if (!i)
-    for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-      if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-        break;
+    i = fileindex->num_types[INDEX_INIT];
 
   if (i)
   {
@@ -419,9 +469,11 @@ make_subpackage(const char     *prodname,
       if (c->type == COMMAND_PRE_REMOVE && c->subpackage == subpackage)
         fprintf(fp, "%s\n", c->command);
 
-    for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-      if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-        fprintf(fp, "/etc/init.d/%s stop\n", file->dst);
+    for (i = fileindex->num_types[INDEX_INIT],
+             fileptr = fileindex->types[INDEX_INIT];
+         i > 0;
+	 i --, fileptr ++)
+      fprintf(fp, "/etc/init.d/%s stop\n", (*fileptr)->dst);
 
     fclose(fp);
   }
@@ -435,9 +487,7 @@ make_subpackage(const char     *prodname,
       break;
 
   if (!i)
-    for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-      if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-        break;
+    i = fileindex->num_types[INDEX_INIT];
 
   if (i)
   {
@@ -461,13 +511,15 @@ make_subpackage(const char     *prodname,
       if (c->type == COMMAND_POST_REMOVE && c->subpackage == subpackage)
 	fprintf(fp, "%s\n", c->command);
 
-    for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-      if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-      {
-        fputs("if [ purge = \"$1\" ]; then\n", fp);
-        fprintf(fp, "	update-rc.d %s remove\n", file->dst);
-        fputs("fi\n", fp);
-      }
+    for (i = fileindex->num_types[INDEX_INIT],
+             fileptr = fileindex->types[INDEX_INIT];
+         i > 0;
+	 i --, fileptr ++)
+    {
+      fputs("if [ purge = \"$1\" ]; then\n", fp);
+      fprintf(fp, "	update-rc.d %s remove\n", (*fileptr)->dst);
+      fputs("fi\n", fp);
+    }
 
     fclose(fp);
   }
@@ -487,11 +539,17 @@ make_subpackage(const char     *prodname,
     return (1);
   }
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (tolower(file->type) == 'c' && file->subpackage == subpackage)
+  for (i = fileindex->num_files, fileptr = fileindex->files;
+       i > 0;
+       i --, fileptr ++)
+  {
+    file = *fileptr;
+
+    if (tolower(file->type) == 'c')
       fprintf(fp, "%s\n", file->dst);
-    else if (tolower(file->type) == 'i' && file->subpackage == subpackage)
+    else if (tolower(file->type) == 'i')
       fprintf(fp, "/etc/init.d/%s\n", file->dst);
+  }
 
   fclose(fp);
 
@@ -499,23 +557,23 @@ make_subpackage(const char     *prodname,
   * Copy the files over...
   */
 
+  stats_phase("stage");
+
   if (Verbosity)
     puts("Copying temporary distribution files...");
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
+  for (i = fileindex->num_files, fileptr = fileindex->files;
+       i > 0;
+       i --, fileptr ++)
   {
-    if (file->subpackage != subpackage)
-      continue;
+    file = *fileptr;
 
    /*
     * Find the username and groupname IDs...
     */
 
-    pwd = getpwnam(file->user);
-    grp = getgrnam(file->group);
-
-    endpwent();
-    endgrent();
+    uid = get_user_id(file->user, 0);
+    gid = get_group_id(file->group, 0);
 
    /*
     * Copy the file or make the directory or make the symlink as needed...
@@ -531,8 +589,9 @@ make_subpackage(const char     *prodname,
 	  if (Verbosity > 1)
 	    printf("%s -> %s...\n", file->src, filename);
 
-	  if (copy_file(filename, file->src, file->mode, pwd ? pwd->pw_uid : 0,
-			grp ? grp->gr_gid : 0))
+	  if (copy_dist_file(filename, file, file->mode,
+	                     uid, gid,
+			     contents))
 	    return (1);
           break;
       case 'i' :
@@ -542,8 +601,8 @@ make_subpackage(const char     *prodname,
 	  if (Verbosity > 1)
 	    printf("%s -> %s...\n", file->src, filename);
 
-	  if (copy_file(filename, file->src, file->mode, pwd ? pwd->pw_uid : 0,
-			grp ? grp->gr_gid : 0))
+	  if (copy_file(filename, file->src, file->mode, uid, gid,
+			file))
 	    return (1);
           break;
       case 'd' :
@@ -553,8 +612,7 @@ make_subpackage(const char     *prodname,
 	  if (Verbosity > 1)
 	    printf("Directory %s...\n", filename);
 
-          make_directory(filename, file->mode, pwd ? pwd->pw_uid : 0,
-			 grp ? grp->gr_gid : 0);
+          make_directory(filename, file->mode, uid, gid);
           break;
       case 'l' :
           snprintf(filename, sizeof(filename), "%s/%s%s", directory, name,
@@ -569,27 +627,105 @@ make_subpackage(const char     *prodname,
   }
 
  /*
-  * Build the distribution from the spec file...
+  * Write the md5sums file for DPKG using the digests computed while the
+  * files were copied...
   */
 
   if (Verbosity)
-    printf("Building Debian %s binary distribution...\n", name);
+    puts("Creating md5sums...");
+
+  snprintf(filename, sizeof(filename), "%s/%s/DEBIAN/md5sums", directory, name);
 
-  if (run_command(directory, "dpkg --build %s", name))
+  if ((fp = fopen(filename, "w")) == NULL)
+  {
+    fprintf(stderr, "epm: Unable to create md5sums file \"%s\": %s\n", filename, strerror(errno));
     return (1);
+  }
+
+  for (i = fileindex->num_files, fileptr = fileindex->files;
+       i > 0;
+       i --, fileptr ++)
+  {
+    file = *fileptr;
+
+    if (!file->md5[0])
+      continue;
+
+    if (tolower(file->type) == 'i')
+      fprintf(fp, "%s  etc/init.d/%s\n", file->md5, file->dst);
+    else if (tolower(file->type) == 'c' || tolower(file->type) == 'f')
+      fprintf(fp, "%s  %s\n", file->md5,
+	      file->dst[0] == '/' ? file->dst + 1 : file->dst);
+  }
+
+  fclose(fp);
 
  /*
-  * Remove temporary files...
+  * Build the distribution from the staged files; the command runs in the
+  * background and make_deb() waits for it...
   */
 
-  if (!KeepFiles)
-  {
-    if (Verbosity)
-      printf("Removing temporary %s distribution files...\n", name);
+  stats_phase("build");
 
-    snprintf(filename, sizeof(filename), "%s/%s", directory, name);
-    unlink_directory(filename);
-  }
+  if (Verbosity)
+    printf("Building Debian %s binary distribution...\n", name);
+
+  argv[0] = "dpkg";
+  argv[1] = "--build";
+  argv[2] = name;
+  argv[3] = NULL;
+
+  if (start_argv(directory, argv))
+    return (1);
 
   return (0);
 }
+
+
+/*
+ * 'remove_subpackage()' - Remove the temporary files for a subpackage.
+ */
+
+static void
+remove_subpackage(const char *prodname,
+					/* I - Product short name */
+                  const char *directory,
+					/* I - Directory for distribution files */
+                  const char *platname,
+					/* I - Platform name */
+                  dist_t     *dist,	/* I - Distribution information */
+		  const char *subpackage)
+					/* I - Subpackage */
+{
+  char		prodfull[255],		/* Full name of product */
+		name[1024],		/* Full product name */
+		filename[1024];		/* Temporary directory */
+
+
+  if (subpackage)
+    snprintf(prodfull, sizeof(prodfull), "%s-%s", prodname, subpackage);
+  else
+    strlcpy(prodfull, prodname, sizeof(prodfull));
+
+  if (dist->release[0])
+    snprintf(name, sizeof(name), "%s-%s-%s", prodfull, dist->version,
+             dist->release);
+  else
+    snprintf(name, sizeof(name), "%s-%s", prodfull, dist->version);
+
+  if (platname[0])
+  {
+    strlcat(name, "-", sizeof(name));
+    strlcat(name, platname, sizeof(name));
+  }
+
+  snprintf(filename, sizeof(filename), "%s/%s", directory, name);
+
+  if (access(filename, F_OK))
+    return;
+
+  if (Verbosity)
+    printf("Removing temporary %s distribution files...\n", name);
+
+  unlink_directory(filename);
+}
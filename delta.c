@@ -0,0 +1,538 @@
+/*
+ * Binary delta functions for the ESP Package Manager (EPM).
+ *
+ * Copyright 2020 by Michael R Sweet
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Delta files start with a text header containing the size and SHA-256
+ * digest of the old and new files:
+ *
+ *     EPM delta 1
+ *     old-size old-sha256
+ *     new-size new-sha256
+ *
+ * followed by a series of binary instructions:
+ *
+ *     'A' length bytes     - Add the following bytes to the new file
+ *     'C' offset length    - Copy bytes from the old file
+ *     'E'                  - End of delta
+ *
+ * Offsets and lengths are unsigned numbers stored 7 bits at a time, least
+ * significant bits first, with the high bit set on all but the last byte.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "epm.h"
+#include <fcntl.h>
+
+
+/*
+ * Local macros...
+ */
+
+#define DELTA_BLOCK	32		/* Size of matched blocks */
+#define DELTA_PRIME	16777619U	/* Rolling hash multiplier */
+
+
+/*
+ * Local functions...
+ */
+
+static void	delta_add(FILE *fp, const unsigned char *data, size_t length);
+static unsigned	delta_hash(const unsigned char *data);
+static void	delta_number(FILE *fp, unsigned long long number);
+static unsigned char *delta_read(const char *filename, size_t *length,
+		                 file_t *digests);
+
+
+/*
+ * 'delta_apply()' - Apply a delta to a file.
+ *
+ * The old file and the new file are verified against the SHA-256 digests
+ * in the delta; on error the new file is removed.
+ */
+
+int					/* O - 0 on success, -1 on error */
+delta_apply(const char *oldfile,	/* I - Old file */
+            const char *deltafile,	/* I - Delta file */
+	    const char *newfile)	/* I - New file */
+{
+  unsigned char	*olddata,		/* Old file contents */
+		*delta,			/* Delta contents */
+		*ptr,			/* Pointer into delta */
+		*end;			/* End of delta */
+  size_t	oldlen,			/* Length of old file */
+		deltalen;		/* Length of delta */
+  unsigned long long oldsize,		/* Old size from header */
+		newsize,		/* New size from header */
+		number[2];		/* Offset and length */
+  char		oldsha256[65],		/* Old digest from header */
+		newsha256[65];		/* New digest from header */
+  int		i,			/* Looping var */
+		shift,			/* Bit shift for numbers */
+		op,			/* Current instruction */
+		status,			/* Return status */
+		werror;			/* Write error? */
+  FILE		*fp;			/* New file */
+  digest_t	digest;			/* Digest of new file */
+  file_t	digests;		/* Digest strings */
+
+
+  if ((delta = delta_read(deltafile, &deltalen, NULL)) == NULL)
+    return (-1);
+
+ /*
+  * Read the header...
+  */
+
+  end = delta + deltalen;
+
+  if (deltalen < 13 || memcmp(delta, "EPM delta 1\n", 12) ||
+      (ptr = memchr(delta + 12, '\n', deltalen - 12)) == NULL ||
+      (ptr = memchr(ptr + 1, '\n', (size_t)(end - ptr - 1))) == NULL ||
+      sscanf((char *)delta + 12, "%llu%64s%llu%64s", &oldsize, oldsha256,
+             &newsize, newsha256) != 4)
+  {
+    fprintf(stderr, "epm: Bad delta file \"%s\".\n", deltafile);
+    free(delta);
+    return (-1);
+  }
+
+  ptr ++;
+
+ /*
+  * Verify the old file...
+  */
+
+  if ((olddata = delta_read(oldfile, &oldlen, &digests)) == NULL)
+  {
+    free(delta);
+    return (-1);
+  }
+
+  if (oldlen != oldsize || strcmp(digests.sha256, oldsha256))
+  {
+    fprintf(stderr, "epm: \"%s\" does not match the version being patched.\n",
+            oldfile);
+    free(delta);
+    free(olddata);
+    return (-1);
+  }
+
+ /*
+  * Write the new file...
+  */
+
+  if ((fp = fopen(newfile, "wb")) == NULL)
+  {
+    fprintf(stderr, "epm: Unable to create \"%s\": %s\n", newfile,
+            strerror(errno));
+    free(delta);
+    free(olddata);
+    return (-1);
+  }
+
+  IOStats.files_written ++;
+
+  digest_init(&digest);
+
+  status = -1;
+  werror = 0;
+
+  while (ptr < end)
+  {
+    if ((op = *ptr++) == 'E')
+    {
+      status = 0;
+      break;
+    }
+
+    for (i = 0; i < (op == 'C' ? 2 : 1); i ++)
+    {
+      for (number[i] = 0, shift = 0; ptr < end && shift < 64; shift += 7)
+      {
+        number[i] |= (unsigned long long)(*ptr & 127) << shift;
+
+	if (!(*ptr++ & 128))
+	  break;
+      }
+    }
+
+    if (op == 'A' && number[0] <= (unsigned long long)(end - ptr))
+    {
+      if (fwrite(ptr, 1, (size_t)number[0], fp) != (size_t)number[0])
+      {
+        werror = 1;
+	break;
+      }
+
+      digest_update(&digest, ptr, (size_t)number[0]);
+      ptr += number[0];
+    }
+    else if (op == 'C' && number[0] <= oldlen &&
+             number[1] <= oldlen - number[0])
+    {
+      if (fwrite(olddata + number[0], 1, (size_t)number[1], fp) !=
+              (size_t)number[1])
+      {
+        werror = 1;
+	break;
+      }
+
+      digest_update(&digest, olddata + number[0], (size_t)number[1]);
+    }
+    else
+      break;
+  }
+
+  free(delta);
+  free(olddata);
+
+  if (ferror(fp))
+    werror = 1;
+
+  if (fclose(fp))
+    werror = 1;
+
+  IOStats.bytes_written += (off_t)digest.length;
+
+  digest_finish(&digest, &digests);
+
+  if (werror)
+  {
+    fprintf(stderr, "epm: Unable to write \"%s\": %s\n", newfile,
+            strerror(errno));
+    status = -1;
+  }
+  else if (status)
+    fprintf(stderr, "epm: Bad delta file \"%s\".\n", deltafile);
+  else if (digest.length != newsize || strcmp(digests.sha256, newsha256))
+  {
+    fprintf(stderr, "epm: Patched \"%s\" does not match the new version.\n",
+            oldfile);
+    status = -1;
+  }
+
+  if (status)
+    unlink(newfile);
+
+  return (status);
+}
+
+
+/*
+ * 'delta_create()' - Create a delta between two files.
+ *
+ * The old file is indexed in fixed-size blocks, and a rolling hash of the
+ * new file is used to find matching blocks which are then extended in both
+ * directions.  After a mismatch the old file is also checked at the same
+ * relative position, so small in-place changes only cost the changed
+ * bytes plus one block.
+ */
+
+off_t					/* O - Size of delta or -1 on error */
+delta_create(const char *oldfile,	/* I - Old file */
+             const char *newfile,	/* I - New file */
+	     const char *deltafile)	/* I - Delta file */
+{
+  unsigned char	*olddata,		/* Old file contents */
+		*newdata;		/* New file contents */
+  size_t	oldlen,			/* Length of old file */
+		newlen,			/* Length of new file */
+		pos,			/* Position in new file */
+		start,			/* Start of pending bytes */
+		match,			/* Matching offset in old file */
+		length,			/* Length of match */
+		next;			/* Next expected offset in old file */
+  size_t	*table;			/* Block hash table */
+  unsigned	mask,			/* Hash table mask */
+		hash,			/* Rolling hash */
+		power;			/* Multiplier for outgoing byte */
+  int		i;			/* Looping var */
+  file_t	olddigests,		/* Old file digests */
+		newdigests;		/* New file digests */
+  FILE		*fp;			/* Delta file */
+  off_t		size;			/* Size of delta */
+
+
+  if ((olddata = delta_read(oldfile, &oldlen, &olddigests)) == NULL)
+    return (-1);
+
+  if ((newdata = delta_read(newfile, &newlen, &newdigests)) == NULL)
+  {
+    free(olddata);
+    return (-1);
+  }
+
+ /*
+  * Index the blocks in the old file...
+  */
+
+  for (mask = 1023; mask < oldlen / DELTA_BLOCK * 2 && mask < 0x3fffffff;)
+    mask = mask * 2 + 1;
+
+  if ((table = malloc(((size_t)mask + 1) * sizeof(size_t))) == NULL)
+  {
+    fputs("epm: Out of memory.\n", stderr);
+    free(olddata);
+    free(newdata);
+    return (-1);
+  }
+
+  memset(table, 255, ((size_t)mask + 1) * sizeof(size_t));
+
+  for (pos = 0; pos + DELTA_BLOCK <= oldlen; pos += DELTA_BLOCK)
+  {
+    hash = delta_hash(olddata + pos) & mask;
+
+    if (table[hash] == (size_t)-1)
+      table[hash] = pos;
+  }
+
+ /*
+  * Then write the delta...
+  */
+
+  if ((fp = fopen(deltafile, "wb")) == NULL)
+  {
+    fprintf(stderr, "epm: Unable to create \"%s\": %s\n", deltafile,
+            strerror(errno));
+    free(table);
+    free(olddata);
+    free(newdata);
+    return (-1);
+  }
+
+  IOStats.files_written ++;
+
+  fprintf(fp, "EPM delta 1\n%llu %s\n%llu %s\n",
+          (unsigned long long)oldlen, olddigests.sha256,
+	  (unsigned long long)newlen, newdigests.sha256);
+
+  for (i = 0, power = 1; i < (DELTA_BLOCK - 1); i ++)
+    power *= DELTA_PRIME;
+
+  start = 0;
+  next  = 0;
+  pos   = 0;
+  hash  = newlen >= DELTA_BLOCK ? delta_hash(newdata) : 0;
+
+  while (pos + DELTA_BLOCK <= newlen)
+  {
+   /*
+    * See if the old file matches at the same relative position or at an
+    * indexed block...
+    */
+
+    match = next + (pos - start);
+
+    if (match + DELTA_BLOCK > oldlen ||
+        memcmp(olddata + match, newdata + pos, DELTA_BLOCK))
+    {
+      match = table[hash & mask];
+
+      if (match != (size_t)-1 &&
+          memcmp(olddata + match, newdata + pos, DELTA_BLOCK))
+        match = (size_t)-1;
+    }
+
+    if (match == (size_t)-1)
+    {
+     /*
+      * No match, roll the hash forward one byte...
+      */
+
+      if (pos + DELTA_BLOCK < newlen)
+        hash = (hash - newdata[pos] * power) * DELTA_PRIME +
+	       newdata[pos + DELTA_BLOCK];
+
+      pos ++;
+      continue;
+    }
+
+   /*
+    * Extend the match backwards and forwards...
+    */
+
+    while (pos > start && match > 0 && newdata[pos - 1] == olddata[match - 1])
+    {
+      pos --;
+      match --;
+    }
+
+    for (length = DELTA_BLOCK;
+         pos + length < newlen && match + length < oldlen &&
+	     newdata[pos + length] == olddata[match + length];
+	 length ++);
+
+    delta_add(fp, newdata + start, pos - start);
+
+    putc('C', fp);
+    delta_number(fp, match);
+    delta_number(fp, length);
+
+    pos   += length;
+    start = pos;
+    next  = match + length;
+
+    if (pos + DELTA_BLOCK <= newlen)
+      hash = delta_hash(newdata + pos);
+  }
+
+  delta_add(fp, newdata + start, newlen - start);
+
+  putc('E', fp);
+
+  size = ftell(fp);
+
+  if (fclose(fp))
+    size = -1;
+  else
+    IOStats.bytes_written += size;
+
+  free(table);
+  free(olddata);
+  free(newdata);
+
+  if (size < 0)
+  {
+    fprintf(stderr, "epm: Unable to write \"%s\": %s\n", deltafile,
+            strerror(errno));
+    unlink(deltafile);
+  }
+
+  return (size);
+}
+
+
+/*
+ * 'delta_add()' - Write an add instruction.
+ */
+
+static void
+delta_add(FILE                *fp,	/* I - Delta file */
+          const unsigned char *data,	/* I - Bytes to add */
+	  size_t              length)	/* I - Number of bytes */
+{
+  if (length == 0)
+    return;
+
+  putc('A', fp);
+  delta_number(fp, length);
+  fwrite(data, 1, length, fp);
+}
+
+
+/*
+ * 'delta_hash()' - Compute the hash of a block.
+ */
+
+static unsigned				/* O - Hash value */
+delta_hash(const unsigned char *data)	/* I - Block */
+{
+  int		i;			/* Looping var */
+  unsigned	hash;			/* Hash value */
+
+
+  for (i = 0, hash = 0; i < DELTA_BLOCK; i ++)
+    hash = hash * DELTA_PRIME + data[i];
+
+  return (hash);
+}
+
+
+/*
+ * 'delta_number()' - Write a number.
+ */
+
+static void
+delta_number(FILE               *fp,	/* I - Delta file */
+             unsigned long long number)	/* I - Number */
+{
+  while (number > 127)
+  {
+    putc((int)(number & 127) | 128, fp);
+    number >>= 7;
+  }
+
+  putc((int)number, fp);
+}
+
+
+/*
+ * 'delta_read()' - Read a file into memory.
+ */
+
+static unsigned char *			/* O - File contents or NULL on error */
+delta_read(const char *filename,	/* I - File to read */
+           size_t     *length,		/* O - Length of file */
+	   file_t     *digests)		/* O - Digests of file or NULL */
+{
+  int		fd;			/* File descriptor */
+  struct stat	fileinfo;		/* File information */
+  unsigned char	*data;			/* File contents */
+  size_t	pos;			/* Position in file */
+  ssize_t	bytes;			/* Bytes read */
+  digest_t	digest;			/* Digest state */
+
+
+  IOStats.stat_calls ++;
+
+  if ((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &fileinfo))
+  {
+    fprintf(stderr, "epm: Unable to open \"%s\": %s\n", filename,
+            strerror(errno));
+
+    if (fd >= 0)
+      close(fd);
+
+    return (NULL);
+  }
+
+  if ((data = malloc((size_t)fileinfo.st_size + 1)) == NULL)
+  {
+    fputs("epm: Out of memory.\n", stderr);
+    close(fd);
+    return (NULL);
+  }
+
+  for (pos = 0; pos < (size_t)fileinfo.st_size; pos += (size_t)bytes)
+    if ((bytes = read(fd, data + pos, (size_t)fileinfo.st_size - pos)) <= 0)
+    {
+      fprintf(stderr, "epm: Unable to read \"%s\": %s\n", filename,
+              bytes < 0 ? strerror(errno) : "Short read");
+      close(fd);
+      free(data);
+      return (NULL);
+    }
+
+  close(fd);
+
+  IOStats.files_read ++;
+  IOStats.bytes_read += fileinfo.st_size;
+
+  *length = pos;
+
+  if (digests)
+  {
+    digest_init(&digest);
+    digest_update(&digest, data, pos);
+    digest_finish(&digest, digests);
+  }
+
+  return (data);
+}
@@ -0,0 +1,408 @@
+/*
+ * Content digest functions for the ESP Package Manager (EPM).
+ *
+ * Copyright 2020 by Michael R Sweet
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "epm.h"
+
+
+/*
+ * Local macros...
+ */
+
+#define ROTL(x,n)	((((x) << (n)) | ((x) >> (32 - (n)))) & 0xffffffff)
+#define ROTR(x,n)	((((x) >> (n)) | ((x) << (32 - (n)))) & 0xffffffff)
+
+
+/*
+ * Local globals...
+ */
+
+static const unsigned	md5_k[64] =	/* MD5 sine constants */
+{
+  0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+  0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+  0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+  0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+  0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+  0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+  0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+  0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+  0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+  0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+  0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+  0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+  0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+  0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+  0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+  0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+static const int	md5_s[64] =	/* MD5 per-round shift amounts */
+{
+  7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+  5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+  4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+  6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+static const unsigned	sha256_k[64] =	/* SHA-256 round constants */
+{
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+/*
+ * Local functions...
+ */
+
+static void	md5_block(unsigned *state, const unsigned char *block);
+static void	sha256_block(unsigned *state, const unsigned char *block);
+
+
+/*
+ * 'digest_file()' - Compute the digests of a file's source data.
+ *
+ * Files that already have digests (because they were computed while the
+ * file was staged or archived) are not read again.
+ */
+
+int					/* O - 0 on success, -1 on failure */
+digest_file(file_t *file)		/* I - File to digest */
+{
+  FILE		*fp;			/* Source file */
+  char		buffer[8192];		/* Read buffer */
+  size_t	bytes;			/* Number of bytes read */
+  digest_t	digest;			/* Digest state */
+
+
+  if (file->sha256[0])
+    return (0);
+
+  if ((fp = fopen(file->src, "rb")) == NULL)
+  {
+    fprintf(stderr, "epm: Unable to open \"%s\" -\n     %s\n", file->src,
+            strerror(errno));
+    return (-1);
+  }
+
+  IOStats.files_read ++;
+
+  digest_init(&digest);
+
+  while ((bytes = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+  {
+    digest_update(&digest, buffer, bytes);
+    IOStats.bytes_read += bytes;
+  }
+
+  fclose(fp);
+
+  digest_finish(&digest, file);
+
+  return (0);
+}
+
+
+/*
+ * 'digest_finish()' - Finish a digest and store the hex strings in a file.
+ */
+
+void
+digest_finish(digest_t *digest,		/* I - Digest state */
+              file_t   *file)		/* I - File to update */
+{
+  int			i;		/* Looping var */
+  unsigned long long	bits;		/* Length in bits */
+  unsigned char		trailer[8];	/* Length trailer */
+  static const char	*hex = "0123456789abcdef";
+					/* Hex digits */
+
+
+ /*
+  * Pad the message to 56 bytes mod 64 and then add the length in bits...
+  */
+
+  bits = digest->length * 8;
+
+  digest->buffer[digest->used ++] = 0x80;
+
+  if (digest->used > 56)
+  {
+    memset(digest->buffer + digest->used, 0, 64 - digest->used);
+    md5_block(digest->md5, digest->buffer);
+    sha256_block(digest->sha256, digest->buffer);
+    digest->used = 0;
+  }
+
+  memset(digest->buffer + digest->used, 0, 56 - digest->used);
+
+  for (i = 0; i < 8; i ++)
+    trailer[i] = (unsigned char)(bits >> (8 * i));
+
+ /*
+  * The two algorithms need different trailers for the same padded data...
+  */
+
+  memcpy(digest->buffer + 56, trailer, 8);
+  md5_block(digest->md5, digest->buffer);
+
+  for (i = 0; i < 8; i ++)
+    digest->buffer[63 - i] = trailer[i];
+  sha256_block(digest->sha256, digest->buffer);
+
+ /*
+  * Format the digests as hex strings...
+  */
+
+  for (i = 0; i < 16; i ++)
+  {
+    unsigned char byte = (unsigned char)(digest->md5[i / 4] >> (8 * (i & 3)));
+
+    file->md5[2 * i]     = hex[byte >> 4];
+    file->md5[2 * i + 1] = hex[byte & 15];
+  }
+  file->md5[32] = '\0';
+
+  for (i = 0; i < 32; i ++)
+  {
+    unsigned char byte = (unsigned char)(digest->sha256[i / 4] >>
+                                         (8 * (3 - (i & 3))));
+
+    file->sha256[2 * i]     = hex[byte >> 4];
+    file->sha256[2 * i + 1] = hex[byte & 15];
+  }
+  file->sha256[64] = '\0';
+}
+
+
+/*
+ * 'digest_init()' - Initialize a digest.
+ */
+
+void
+digest_init(digest_t *digest)		/* I - Digest state */
+{
+  digest->md5[0] = 0x67452301;
+  digest->md5[1] = 0xefcdab89;
+  digest->md5[2] = 0x98badcfe;
+  digest->md5[3] = 0x10325476;
+
+  digest->sha256[0] = 0x6a09e667;
+  digest->sha256[1] = 0xbb67ae85;
+  digest->sha256[2] = 0x3c6ef372;
+  digest->sha256[3] = 0xa54ff53a;
+  digest->sha256[4] = 0x510e527f;
+  digest->sha256[5] = 0x9b05688c;
+  digest->sha256[6] = 0x1f83d9ab;
+  digest->sha256[7] = 0x5be0cd19;
+
+  digest->used   = 0;
+  digest->length = 0;
+}
+
+
+/*
+ * 'digest_update()' - Add data to a digest.
+ */
+
+void
+digest_update(digest_t   *digest,	/* I - Digest state */
+              const void *data,		/* I - Data */
+	      size_t     bytes)		/* I - Number of bytes */
+{
+  const unsigned char	*ptr;		/* Pointer into data */
+  size_t		count;		/* Bytes to copy */
+
+
+  ptr = (const unsigned char *)data;
+
+  digest->length += bytes;
+
+  if (digest->used > 0)
+  {
+   /*
+    * Fill the partial block first...
+    */
+
+    if ((count = 64 - digest->used) > bytes)
+      count = bytes;
+
+    memcpy(digest->buffer + digest->used, ptr, count);
+    digest->used += count;
+    ptr          += count;
+    bytes        -= count;
+
+    if (digest->used < 64)
+      return;
+
+    md5_block(digest->md5, digest->buffer);
+    sha256_block(digest->sha256, digest->buffer);
+    digest->used = 0;
+  }
+
+  for (; bytes >= 64; ptr += 64, bytes -= 64)
+  {
+    md5_block(digest->md5, ptr);
+    sha256_block(digest->sha256, ptr);
+  }
+
+  if (bytes > 0)
+  {
+    memcpy(digest->buffer, ptr, bytes);
+    digest->used = bytes;
+  }
+}
+
+
+/*
+ * 'md5_block()' - Run a 64-byte block through MD5.
+ */
+
+static void
+md5_block(unsigned            *state,	/* I - MD5 state */
+          const unsigned char *block)	/* I - 64-byte block */
+{
+  int		i,			/* Looping var */
+		k;			/* Message word index */
+  unsigned	w[16],			/* Message words */
+		a, b, c, d,		/* Working variables */
+		f, t;			/* Temporaries */
+
+
+  for (i = 0; i < 16; i ++)
+    w[i] = (unsigned)block[4 * i] | ((unsigned)block[4 * i + 1] << 8) |
+           ((unsigned)block[4 * i + 2] << 16) |
+	   ((unsigned)block[4 * i + 3] << 24);
+
+  a = state[0];
+  b = state[1];
+  c = state[2];
+  d = state[3];
+
+  for (i = 0; i < 64; i ++)
+  {
+    if (i < 16)
+    {
+      f = (b & c) | (~b & d);
+      k = i;
+    }
+    else if (i < 32)
+    {
+      f = (d & b) | (~d & c);
+      k = (5 * i + 1) & 15;
+    }
+    else if (i < 48)
+    {
+      f = b ^ c ^ d;
+      k = (3 * i + 5) & 15;
+    }
+    else
+    {
+      f = c ^ (b | ~d);
+      k = (7 * i) & 15;
+    }
+
+    t = (a + f + md5_k[i] + w[k]) & 0xffffffff;
+    a = d;
+    d = c;
+    c = b;
+    b = (b + ROTL(t, md5_s[i])) & 0xffffffff;
+  }
+
+  state[0] = (state[0] + a) & 0xffffffff;
+  state[1] = (state[1] + b) & 0xffffffff;
+  state[2] = (state[2] + c) & 0xffffffff;
+  state[3] = (state[3] + d) & 0xffffffff;
+}
+
+
+/*
+ * 'sha256_block()' - Run a 64-byte block through SHA-256.
+ */
+
+static void
+sha256_block(unsigned            *state,/* I - SHA-256 state */
+             const unsigned char *block)/* I - 64-byte block */
+{
+  int		i;			/* Looping var */
+  unsigned	w[64],			/* Message schedule */
+		a, b, c, d,		/* Working variables */
+		e, f, g, h,
+		t1, t2;			/* Temporaries */
+
+
+  for (i = 0; i < 16; i ++)
+    w[i] = ((unsigned)block[4 * i] << 24) |
+           ((unsigned)block[4 * i + 1] << 16) |
+           ((unsigned)block[4 * i + 2] << 8) | (unsigned)block[4 * i + 3];
+
+  for (; i < 64; i ++)
+    w[i] = (w[i - 16] +
+            (ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+	    w[i - 7] +
+	    (ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10))) &
+	   0xffffffff;
+
+  a = state[0];
+  b = state[1];
+  c = state[2];
+  d = state[3];
+  e = state[4];
+  f = state[5];
+  g = state[6];
+  h = state[7];
+
+  for (i = 0; i < 64; i ++)
+  {
+    t1 = (h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) +
+          ((e & f) ^ (~e & g)) + sha256_k[i] + w[i]) & 0xffffffff;
+    t2 = ((ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) +
+          ((a & b) ^ (a & c) ^ (b & c))) & 0xffffffff;
+    h  = g;
+    g  = f;
+    f  = e;
+    e  = (d + t1) & 0xffffffff;
+    d  = c;
+    c  = b;
+    b  = a;
+    a  = (t1 + t2) & 0xffffffff;
+  }
+
+  state[0] = (state[0] + a) & 0xffffffff;
+  state[1] = (state[1] + b) & 0xffffffff;
+  state[2] = (state[2] + c) & 0xffffffff;
+  state[3] = (state[3] + d) & 0xffffffff;
+  state[4] = (state[4] + e) & 0xffffffff;
+  state[5] = (state[5] + f) & 0xffffffff;
+  state[6] = (state[6] + g) & 0xffffffff;
+  state[7] = (state[7] + h) & 0xffffffff;
+}
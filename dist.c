@@ -38,6 +38,8 @@ extern int	gethostname(char *, size_t);
 
 static int	compare_files(const file_t *f0, const file_t *f1);
 static void	expand_name(char *buffer, char *name, size_t bufsize, int warn);
+static int	find_index(dist_t *dist, const char *subpkg);
+static void	free_index(dist_t *dist);
 static char	*get_file(const char *filename, char *buffer, size_t size);
 static char	*get_inline(const char *term, FILE *fp, char *buffer,
 		            size_t size);
@@ -45,7 +47,9 @@ static char	*get_line(char *buffer, int size, FILE *fp,
 		          struct utsname *platform, const char *format,
 			  int *skip);
 static char	*get_string(char **src, char *dst, size_t dstsize);
+static void	index_dist(dist_t *dist);
 static int	patmatch(const char *, const char *);
+static void	put_string(FILE *fp, const char *s);
 static int	sort_subpackages(char **a, char **b);
 static void	update_architecture(char *buffer, size_t bufsize);
 
@@ -332,6 +336,12 @@ add_file(dist_t     *dist,		/* I - Distribution */
   file_t	*file;			/* New file */
 
 
+ /*
+  * Adding a file moves the files array, so drop any file index...
+  */
+
+  free_index(dist);
+
   if (dist->num_files == 0)
     dist->files = (file_t *)malloc(sizeof(file_t));
   else
@@ -424,6 +434,8 @@ free_dist(dist_t *dist)			/* I - Distribution to free */
   int	i;				/* Looping var */
 
 
+  free_index(dist);
+
   if (dist->num_files > 0)
     free(dist->files);
 
@@ -457,6 +469,25 @@ free_dist(dist_t *dist)			/* I - Distribution to free */
 
 
 
+/*
+ * 'get_index()' - Get the file index for a subpackage.
+ *
+ * The index is built by sort_dist_files() and lists the subpackage's files
+ * in sorted order, both by partition (/usr or not) and by type, so the
+ * backends only visit the files they need.
+ */
+
+fileindex_t *				/* O - File index */
+get_index(dist_t     *dist,		/* I - Distribution */
+          const char *subpackage)	/* I - Subpackage name or NULL */
+{
+  if (!dist->indices)
+    index_dist(dist);
+
+  return (dist->indices + find_index(dist, subpackage));
+}
+
+
 /*
  * 'getoption()' - Get an option from a file.
  */
@@ -750,11 +781,14 @@ read_dist(const char     *filename,	/* I - Main distribution list file */
   int		skip;			/* 1 = skip files, 0 = archive files */
   dist_t	*dist;			/* Distribution data */
   file_t	*file;			/* Distribution file */
-  struct stat	fileinfo;		/* File information */
+  struct stat	fileinfo,		/* File information */
+		listinfo;		/* List file information */
   DIR		*dir;			/* Directory */
   DIRENT	*dent;			/* Directory entry */
   struct passwd	*pwd;			/* Password entry */
-  const char	*subpkg;		/* Subpackage */
+  const char	*subpkg,		/* Subpackage */
+		*sha256,		/* SHA-256 digest from options */
+		*size;			/* File size from options */
 
 
  /*
@@ -1100,6 +1134,7 @@ read_dist(const char     *filename,	/* I - Main distribution list file */
 	    while ((dent = readdir(dir)) != NULL)
 	    {
 	      strlcpy(temp, dent->d_name, sizeof(src) - (size_t)(temp - src));
+	      IOStats.stat_calls ++;
 	      if (stat(src, &fileinfo))
 	        continue; /* Skip files we can't read */
 
@@ -1139,6 +1174,24 @@ read_dist(const char     *filename,	/* I - Main distribution list file */
 	  strlcpy(file->user, user, sizeof(file->user));
 	  strlcpy(file->group, group, sizeof(file->group));
 	  strlcpy(file->options, options, sizeof(file->options));
+
+         /*
+	  * Use the digest from "mkepmlist --hash" if the file still has the
+	  * recorded size and was last modified before the list was written...
+	  */
+
+          if (tolower(type) != 'd' && type != 'R' &&
+	      (size = get_option(file, "size", NULL)) != NULL &&
+	      !stat(file->src, &fileinfo) &&
+	      strtoll(size, NULL, 10) == (long long)fileinfo.st_size &&
+	      !fstat(fileno(listfiles[listlevel]), &listinfo) &&
+	      fileinfo.st_mtime < listinfo.st_mtime &&
+	      (sha256 = get_option(file, "sha256", NULL)) != NULL &&
+	      strlen(sha256) == 64)
+	  {
+	    IOStats.stat_calls ++;
+	    strlcpy(file->sha256, sha256, sizeof(file->sha256));
+	  }
 	}
       }
     }
@@ -1193,6 +1246,8 @@ sort_dist_files(dist_t *dist)		/* I - Distribution to sort */
   * Remove duplicates...
   */
 
+  free_index(dist);
+
   for (i = dist->num_files - 1, file = dist->files; i > 0; i --, file ++)
     if (!strcmp(file[0].dst, file[1].dst))
     {
@@ -1218,11 +1273,21 @@ sort_dist_files(dist_t *dist)		/* I - Distribution to sort */
 		file[0].type, file[0].mode, file[0].user, file[0].group, file[0].src,
 		file[1].type, file[1].mode, file[1].user, file[1].group, file[1].src);
     }
+
+ /*
+  * Index the sorted files...
+  */
+
+  index_dist(dist);
 }
 
 
 /*
  * 'write_dist()' - Write a distribution list file...
+ *
+ * The new list file is written to a temporary file and then renamed, so
+ * readers never see a partial list.  The old list file is kept as
+ * "filename.list.O".
  */
 
 int					/* O - 0 on success, -1 on failure */
@@ -1232,6 +1297,7 @@ write_dist(const char *listname,	/* I - File to write to */
   int		i;			/* Looping var */
   int		is_inline;		/* Inline text? */
   char		listbck[1024],		/* Backup filename */
+		listtmp[1024],		/* Temporary filename */
 		*ptr;			/* Pointer into command string */
   FILE		*listfile;		/* Output file */
   file_t	*file;			/* Current file entry */
@@ -1258,22 +1324,14 @@ write_dist(const char *listname,	/* I - File to write to */
 
 
  /*
-  * Make a backup of the list file...
+  * Open a temporary list file...
   */
 
   snprintf(listbck, sizeof(listbck), "%s.O", listname);
+  snprintf(listtmp, sizeof(listtmp), "%s.N%d", listname, (int)getpid());
 
-  rename(listname, listbck);
-
- /*
-  * Open the list file...
-  */
-
-  if ((listfile = fopen(listname, "w")) == NULL)
-  {
-    rename(listbck, listname);
+  if ((listfile = fopen(listtmp, "w")) == NULL)
     return (-1);
-  }
 
  /*
   * Write the list file...
@@ -1382,17 +1440,47 @@ write_dist(const char *listname,	/* I - File to write to */
       fprintf(listfile, "%%subpackage %s\n", subpkg ? subpkg : "");
     }
 
-    fprintf(listfile, "%c %04o %s %s %s %s",
-	    file->type, file->mode, file->user, file->group,
-	    file->dst, file->src);
+    fprintf(listfile, "%c %04o %s %s ",
+	    file->type, file->mode, file->user, file->group);
+    put_string(listfile, file->dst);
+
+    if (file->src[0])
+    {
+      putc(' ', listfile);
+      put_string(listfile, file->src);
+    }
 
     if (file->options[0])
-      fprintf(listfile, "%s\n", file->options);
-    else
-      putc('\n', listfile);
+    {
+      putc(' ', listfile);
+      put_string(listfile, file->options);
+    }
+
+    putc('\n', listfile);
+  }
+
+  if (fclose(listfile))
+  {
+    unlink(listtmp);
+    return (-1);
   }
 
-  return (fclose(listfile));
+ /*
+  * Make a backup of the list file and replace it...
+  */
+
+  unlink(listbck);
+
+  if (link(listname, listbck) && errno != ENOENT)
+    rename(listname, listbck);
+
+  if (rename(listtmp, listname))
+  {
+    unlink(listtmp);
+    return (-1);
+  }
+
+  return (0);
 }
 
 
@@ -1487,6 +1575,47 @@ expand_name(char   *buffer,		/* O - Output string */
 }
 
 
+/*
+ * 'find_index()' - Find the index number for a subpackage.
+ */
+
+static int				/* O - Index number (0 for main package) */
+find_index(dist_t     *dist,		/* I - Distribution */
+           const char *subpkg)		/* I - Subpackage name or NULL */
+{
+  char	**match;			/* Matching subpackage */
+
+
+  if (!subpkg || dist->num_subpackages == 0)
+    return (0);
+
+  match = bsearch(&subpkg, dist->subpackages, (size_t)dist->num_subpackages,
+                  sizeof(char *),
+		  (int (*)(const void *, const void *))sort_subpackages);
+
+  return (match ? (int)(match - dist->subpackages) + 1 : 0);
+}
+
+
+/*
+ * 'free_index()' - Free the file index for a distribution.
+ */
+
+static void
+free_index(dist_t *dist)		/* I - Distribution */
+{
+  if (dist->indices)
+  {
+    free(dist->indices);
+    free(dist->index_files);
+
+    dist->num_indices = 0;
+    dist->indices     = NULL;
+    dist->index_files = NULL;
+  }
+}
+
+
 /*
  * 'get_file()' - Read a file into a string...
  */
@@ -2186,6 +2315,113 @@ get_string(char   **src,		/* IO - Source string */
 }
 
 
+/*
+ * 'index_dist()' - Build the per-subpackage file index.
+ *
+ * A first pass counts the files in each subpackage, partition, and type,
+ * and a second pass fills in the pointers.  All of the pointer lists share
+ * one allocation of three pointers per file.
+ */
+
+static void
+index_dist(dist_t *dist)		/* I - Distribution */
+{
+  int		i, j;			/* Looping vars */
+  file_t	*file,			/* Current file */
+		**ptr;			/* Current pointer */
+  fileindex_t	*index;			/* Current index */
+  int		*numbers;		/* Index number for each file */
+  const char	*type;			/* Type character */
+  static const char types[] = "cdfilr";	/* Types in INDEX_ order */
+
+
+  free_index(dist);
+
+  dist->num_indices = dist->num_subpackages + 1;
+
+  if ((dist->indices = calloc((size_t)dist->num_indices,
+                              sizeof(fileindex_t))) == NULL ||
+      (dist->index_files = calloc((size_t)dist->num_files * 3 + 1,
+                                  sizeof(file_t *))) == NULL ||
+      (numbers = calloc((size_t)dist->num_files + 1, sizeof(int))) == NULL)
+  {
+    perror("epm: Out of memory indexing files");
+    exit(1);
+  }
+
+  for (i = 1; i < dist->num_indices; i ++)
+    dist->indices[i].subpackage = dist->subpackages[i - 1];
+
+ /*
+  * Count the files...
+  */
+
+  for (i = 0, file = dist->files; i < dist->num_files; i ++, file ++)
+  {
+    numbers[i] = find_index(dist, file->subpackage);
+    index      = dist->indices + numbers[i];
+
+    index->num_files ++;
+    index->num_parts[strncmp(file->dst, "/usr", 4) == 0] ++;
+
+    if (isupper(file->type & 255))
+      index->num_patches ++;
+
+    if (file->type && (type = strchr(types, tolower(file->type))) != NULL)
+      index->num_types[type - types] ++;
+  }
+
+ /*
+  * Carve up the pointer array...
+  */
+
+  for (i = 0, index = dist->indices, ptr = dist->index_files;
+       i < dist->num_indices;
+       i ++, index ++)
+  {
+    index->files = ptr;
+    ptr += index->num_files;
+
+    for (j = 0; j < INDEX_PARTS; j ++)
+    {
+      index->parts[j] = ptr;
+      ptr += index->num_parts[j];
+    }
+
+    for (j = 0; j < INDEX_TYPES; j ++)
+    {
+      index->types[j] = ptr;
+      ptr += index->num_types[j];
+    }
+
+    index->num_files = 0;
+    memset(index->num_parts, 0, sizeof(index->num_parts));
+    memset(index->num_types, 0, sizeof(index->num_types));
+  }
+
+ /*
+  * Fill in the pointers in sorted order...
+  */
+
+  for (i = 0, file = dist->files; i < dist->num_files; i ++, file ++)
+  {
+    index = dist->indices + numbers[i];
+    j     = strncmp(file->dst, "/usr", 4) == 0;
+
+    index->files[index->num_files ++]  = file;
+    index->parts[j][index->num_parts[j] ++] = file;
+
+    if (file->type && (type = strchr(types, tolower(file->type))) != NULL)
+    {
+      j = (int)(type - types);
+      index->types[j][index->num_types[j] ++] = file;
+    }
+  }
+
+  free(numbers);
+}
+
+
 /*
  * 'patmatch()' - Pattern matching...
  */
@@ -2302,6 +2538,26 @@ patmatch(const char *s,			/* I - String to match against */
 }
 
 
+/*
+ * 'put_string()' - Write a string to a list file, quoting as needed.
+ */
+
+static void
+put_string(FILE       *fp,		/* I - List file */
+           const char *s)		/* I - String */
+{
+  for (; *s; s ++)
+  {
+    if (*s == '\\' || isspace(*s & 255))
+      putc('\\', fp);
+    else if (*s == '$')
+      putc('$', fp);
+
+    putc(*s, fp);
+  }
+}
+
+
 /*
  * 'sort_subpackages()' - Compare two subpackage names.
  */
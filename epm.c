@@ -29,9 +29,11 @@
 int		CompressFiles = EPM_COMPRESS;
 const char	*DataDir = EPM_DATADIR;
 int		KeepFiles = 0;
+const char	*PatchFrom = NULL;
 const char	*SetupProgram = EPM_LIBDIR "/setup";
 const char	*SoftwareDir = EPM_SOFTWARE;
 const char	*UninstProgram = EPM_LIBDIR "/uninst";
+const char	*UnpackProgram = NULL;
 int		Verbosity = 0;
 
 
@@ -67,6 +69,9 @@ main(int  argc,				/* I - Number of command-line args */
   dist_t	*dist;			/* Software distribution */
   int		format;			/* Distribution format */
   int		show_depend;		/* Show dependencies */
+  int		manifest;		/* Write a manifest file */
+  const char	*patch_manifest;	/* Previous release manifest */
+  int		stats;			/* Show build statistics (-1 = no, 0 = table, 1 = JSON) */
   static char	*formats[] =		/* Distribution format strings */
 		{
 		  "portable",
@@ -87,6 +92,15 @@ main(int  argc,				/* I - Number of command-line args */
 
   get_platform(&platform);
 
+ /*
+  * Run as many external commands at once as there are processors...
+  */
+
+#ifdef _SC_NPROCESSORS_ONLN
+  if ((MaxJobs = (int)sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+    MaxJobs = 1;
+#endif /* _SC_NPROCESSORS_ONLN */
+
  /*
   * Check arguments...
   */
@@ -107,6 +121,9 @@ main(int  argc,				/* I - Number of command-line args */
   listname[0]  = '\0';
   directory[0] = '\0';
   show_depend  = 0;
+  manifest     = 0;
+  patch_manifest = NULL;
+  stats        = -1;
 
   for (i = 1; i < argc; i ++)
     if (argv[i][0] == '-')
@@ -194,6 +211,28 @@ main(int  argc,				/* I - Number of command-line args */
 	    strip = 0;
 	    break;
 
+        case 'j' : /* Number of concurrent commands */
+	    if (argv[i][2])
+	      temp = argv[i] + 2;
+	    else
+	    {
+	      i ++;
+	      if (i >= argc)
+	      {
+	        puts("epm: Expected number of jobs.");
+	        usage();
+	      }
+
+	      temp = argv[i];
+	    }
+
+	    if ((MaxJobs = atoi(temp)) < 1)
+	    {
+	      printf("epm: Bad number of jobs \"%s\".\n", temp);
+	      usage();
+	    }
+	    break;
+
         case 'k' : /* Keep intermediate files */
 	    KeepFiles = 1;
 	    break;
@@ -265,8 +304,28 @@ main(int  argc,				/* I - Number of command-line args */
 	    }
 	    else if (!strcmp(argv[i], "--depend"))
 	      show_depend = 1;
+	    else if (!strcmp(argv[i], "--group-file"))
+	    {
+	      i ++;
+	      if (i < argc)
+	      {
+	        if (load_ids(NULL, argv[i]))
+		  return (1);
+	      }
+	      else
+	      {
+		puts("epm: Expected group file.");
+		usage();
+	      }
+	    }
 	    else if (!strcmp(argv[i], "--keep-files"))
 	      KeepFiles = 1;
+	    else if (!strcmp(argv[i], "--manifest"))
+	      manifest = 1;
+	    else if (!strcmp(argv[i], "--stats"))
+	      stats = 0;
+	    else if (!strcmp(argv[i], "--stats=json"))
+	      stats = 1;
 	    else if (!strcmp(argv[i], "--output-dir"))
 	    {
 	      i ++;
@@ -278,6 +337,42 @@ main(int  argc,				/* I - Number of command-line args */
 		usage();
 	      }
 	    }
+	    else if (!strcmp(argv[i], "--passwd-file"))
+	    {
+	      i ++;
+	      if (i < argc)
+	      {
+	        if (load_ids(argv[i], NULL))
+		  return (1);
+	      }
+	      else
+	      {
+		puts("epm: Expected password file.");
+		usage();
+	      }
+	    }
+	    else if (!strcmp(argv[i], "--patch-from"))
+	    {
+	      i ++;
+	      if (i < argc)
+	        PatchFrom = argv[i];
+	      else
+	      {
+		puts("epm: Expected previous release directory.");
+		usage();
+	      }
+	    }
+	    else if (!strcmp(argv[i], "--patch-manifest"))
+	    {
+	      i ++;
+	      if (i < argc)
+	        patch_manifest = argv[i];
+	      else
+	      {
+		puts("epm: Expected previous release manifest.");
+		usage();
+	      }
+	    }
 	    else if (!strcmp(argv[i], "--setup-image"))
 	    {
 	      i ++;
@@ -333,6 +428,17 @@ main(int  argc,				/* I - Number of command-line args */
 		usage();
 	      }
 	    }
+	    else if (!strcmp(argv[i], "--unpack-program"))
+	    {
+	      i ++;
+	      if (i < argc)
+	        UnpackProgram = argv[i];
+	      else
+	      {
+		puts("epm: Expected unpack program.");
+		usage();
+	      }
+	    }
 	    else if (!strcmp(argv[i], "--version"))
 	    {
 	      info();
@@ -383,6 +489,19 @@ main(int  argc,				/* I - Number of command-line args */
   if (!listname[0])
     snprintf(listname, sizeof(listname), "%s.list", prodname);
 
+  if (PatchFrom && (format != PACKAGE_PORTABLE || !UnpackProgram))
+  {
+    puts("epm: Binary patches require the portable format and an unpack "
+         "program.");
+    return (1);
+  }
+
+  if (patch_manifest && format != PACKAGE_PORTABLE)
+  {
+    puts("epm: Patches from a manifest require the portable format.");
+    return (1);
+  }
+
  /*
   * Format the build directory and platform name strings...
   */
@@ -437,6 +556,8 @@ main(int  argc,				/* I - Number of command-line args */
   * Read the distribution...
   */
 
+  stats_phase("read");
+
   if ((dist = read_dist(listname, &platform, formats[format])) == NULL)
     return (1);
 
@@ -489,9 +610,25 @@ main(int  argc,				/* I - Number of command-line args */
     if (Verbosity)
       puts("Stripping executables in distribution...");
 
+    stats_phase("strip");
     strip_execs(dist);
   }
 
+ /*
+  * Compute the patch files from the previous release as needed...
+  */
+
+  if (patch_manifest)
+  {
+    if (Verbosity)
+      printf("Comparing distribution with %s...\n", patch_manifest);
+
+    stats_phase("patch");
+
+    if (patch_dist(dist, patch_manifest))
+      return (1);
+  }
+
  /*
   * Make build directory...
   */
@@ -508,6 +645,8 @@ main(int  argc,				/* I - Number of command-line args */
     setup = NULL;
   }
 
+  stats_phase("package");
+
   switch (format)
   {
     case PACKAGE_PORTABLE :
@@ -539,6 +678,23 @@ main(int  argc,				/* I - Number of command-line args */
 	break;
   }
 
+ /*
+  * Write the manifest as needed...
+  */
+
+  if (!i && manifest)
+  {
+    stats_phase("manifest");
+    i = write_manifest(prodname, directory, platname, dist) != 0;
+  }
+
+ /*
+  * Show build statistics as needed...
+  */
+
+  if (stats >= 0)
+    stats_report(stdout, stats);
+
  /*
   * All done!
   */
@@ -615,6 +771,8 @@ usage(void)
   puts("    Don't strip executables in distributions.");
   puts("-f {bsd,deb,macos,macos-signed,native,portable,rpm,rpm-signed}");
   puts("    Set distribution format.");
+  puts("-j jobs");
+  puts("    Run up to the specified number of external commands at once.");
   puts("-k");
   puts("    Keep intermediate files (spec files, etc.)");
   puts("-m name");
@@ -641,20 +799,39 @@ usage(void)
 #endif /* EPM_COMPRESS == 1 */
   puts("--data-dir /foo/bar/directory");
   puts("    Use the named setup data file directory instead of " EPM_DATADIR ".");
+  puts("--group-file /foo/bar/group");
+  puts("    Look up group IDs in the named group file before the local groups.");
   puts("--help");
   puts("    Show this usage message.");
   puts("--keep-files");
   puts("    Keep temporary distribution files in the output directory.");
+  puts("--manifest");
+  puts("    Write a manifest with the type, permissions, owner, size, and SHA-256");
+  puts("    digest of every file in the distribution.");
   puts("--output-dir /foo/bar/directory");
   puts("    Enable the setup GUI and use \"setup.xpm\" for the setup image.");
+  puts("--passwd-file /foo/bar/passwd");
+  puts("    Look up user IDs in the named password file before the local users.");
+  puts("--patch-from /foo/bar/directory");
+  puts("    Patch files using binary deltas from the previous release in the");
+  puts("    named directory.");
+  puts("--patch-manifest filename.manifest");
+  puts("    Patch the files that changed since the previous release with the");
+  puts("    named manifest.");
   puts("--setup-image setup.xpm");
   puts("    Enable the setup GUI and use \"setup.xpm\" for the setup image.");
   puts("--setup-program /foo/bar/setup");
   puts("    Use the named setup program instead of " EPM_LIBDIR "/setup.");
   puts("--setup-types setup.types");
   puts("    Include the named setup.types file with the distribution.");
+  puts("--stats");
+  puts("    Show the time, CPU, and I/O used by each build phase.");
+  puts("--stats=json");
+  puts("    Show the build phase statistics as JSON.");
   puts("--uninstalll-program /foo/bar/uninst");
   puts("    Use the named uninstall program instead of " EPM_LIBDIR "/uninst.");
+  puts("--unpack-program /foo/bar/epmunpack");
+  puts("    Include the named installer runtime with portable distributions.");
   puts("--version");
   puts("    Show EPM version.");
 
@@ -129,6 +129,28 @@ enum
   DEPEND_PROVIDES			/* This product provides */
 };
 
+/*
+ * File index partitions and types...
+ */
+
+enum
+{
+  INDEX_ROOT,				/* Files outside /usr */
+  INDEX_USR,				/* Files under /usr */
+  INDEX_PARTS				/* Number of partitions */
+};
+
+enum
+{
+  INDEX_CONFIG,				/* Config files (c/C) */
+  INDEX_DIR,				/* Directories (d/D) */
+  INDEX_FILE,				/* Regular files (f/F) */
+  INDEX_INIT,				/* Init scripts (i/I) */
+  INDEX_LINK,				/* Symbolic links (l/L) */
+  INDEX_REMOVE,				/* Removed files (R) */
+  INDEX_TYPES				/* Number of types */
+};
+
 
 /*
  * Structures...
@@ -158,12 +180,6 @@ typedef union				/**** TAR record format ****/
   }	header;
 } tar_t;
 
-typedef struct				/**** TAR file ****/
-{
-  FILE		*file;			/* File to write to */
-  int		blocks,			/* Number of blocks written */
-		compressed;		/* Compressed output? */
-} tarf_t;
 
 typedef struct				/**** File to install ****/
 {
@@ -175,8 +191,44 @@ typedef struct				/**** File to install ****/
 		dst[512],		/* Destination path */
 		options[256];		/* File options */
   const char	*subpackage;		/* Sub-package name */
+  char		md5[33],		/* MD5 digest of contents */
+		sha256[65];		/* SHA-256 digest of contents */
 } file_t;
 
+typedef struct content_s		/**** Written file contents ****/
+{
+  struct content_s *next;		/* Next contents in hash bucket */
+  off_t		size;			/* Size of contents */
+  file_t	*file;			/* File with digests and ownership */
+  char		*path;			/* Archive or staging path */
+} content_t;
+
+typedef struct				/**** Index of written contents ****/
+{
+  int		num_contents,		/* Number of contents */
+		num_buckets;		/* Number of hash buckets */
+  content_t	**buckets;		/* Hash buckets */
+} contents_t;
+
+typedef struct				/**** Content digest state ****/
+{
+  unsigned	md5[4],			/* MD5 state */
+		sha256[8];		/* SHA-256 state */
+  unsigned char	buffer[64];		/* Partial block */
+  size_t	used;			/* Bytes in partial block */
+  unsigned long long length;		/* Total bytes hashed */
+} digest_t;
+
+typedef struct				/**** TAR file ****/
+{
+  FILE		*file;			/* File to write to */
+  int		blocks,			/* Number of blocks written */
+		compressed;		/* Compressed output? */
+  contents_t	contents;		/* Files already archived */
+  off_t		remaining;		/* Bytes left in member being read */
+  void		(*progress)(void);	/* Called as data is extracted or NULL */
+} tarf_t;
+
 typedef struct				/**** Install/Patch/Remove Commands ****/
 {
   int		type;			/* Command type */
@@ -200,6 +252,18 @@ typedef struct				/**** Description Structure ****/
   const char	*subpackage;		/* Sub-package name */
 } description_t;
 
+typedef struct				/**** File index for a subpackage ****/
+{
+  const char	*subpackage;		/* Sub-package name */
+  int		num_files,		/* Number of files */
+		num_patches,		/* Number of patch files */
+		num_parts[INDEX_PARTS],	/* Number of files in each partition */
+		num_types[INDEX_TYPES];	/* Number of files of each type */
+  file_t	**files,		/* Files in sorted order */
+		**parts[INDEX_PARTS],	/* Files in each partition */
+		**types[INDEX_TYPES];	/* Files of each type */
+} fileindex_t;
+
 typedef struct				/**** Distribution Structure ****/
 {
   char		product[256],		/* Product name */
@@ -222,8 +286,38 @@ typedef struct				/**** Distribution Structure ****/
   depend_t	*depends;		/* Dependencies */
   int		num_files;		/* Number of files */
   file_t	*files;			/* Files */
+  int		num_indices;		/* Number of file indices */
+  fileindex_t	*indices;		/* File indices (main package first) */
+  file_t	**index_files;		/* File pointers for indices */
 } dist_t;
 
+typedef struct				/**** Disk space for a directory ****/
+{
+  char		dst[256];		/* Destination directory */
+  long		inodes;			/* Number of files, directories, and links */
+  long long	kbytes[2];		/* Size using 1k and 4k blocks */
+} space_t;
+
+typedef struct				/**** Disk space on a filesystem ****/
+{
+  char		mount[256];		/* Mount point */
+  dev_t		device;			/* Device number */
+  long long	needed,			/* Space needed in kbytes */
+		available;		/* Space available in kbytes */
+  long		inodes,			/* Inodes needed */
+		free_inodes;		/* Inodes available or -1 if unknown */
+} fsspace_t;
+
+typedef struct				/**** I/O Counters ****/
+{
+  long		files_read,		/* Number of files read */
+		files_written,		/* Number of files written */
+		stat_calls,		/* Number of stat() calls */
+		commands;		/* Number of commands run */
+  long long	bytes_read,		/* Number of bytes read */
+		bytes_written;		/* Number of bytes written */
+} iostats_t;
+
 
 /*
  * Globals...
@@ -231,10 +325,14 @@ typedef struct				/**** Distribution Structure ****/
 
 extern int		CompressFiles;	/* Compress package files? */
 extern const char	*DataDir;	/* Directory for setup data files */
+extern iostats_t	IOStats;	/* I/O counters */
 extern int		KeepFiles;	/* Keep intermediate files? */
+extern int		MaxJobs;	/* Maximum number of concurrent commands */
+extern const char	*PatchFrom;	/* Previous release for binary patches */
 extern const char	*SetupProgram;	/* Setup program */
 extern const char	*SoftwareDir;	/* Software directory path */
 extern const char	*UninstProgram;	/* Uninstall program */
+extern const char	*UnpackProgram;	/* Installer runtime or NULL */
 extern int		Verbosity;	/* Be verbose? */
 
 
@@ -245,22 +343,49 @@ extern int		Verbosity;	/* Be verbose? */
 extern void	add_command(dist_t *dist, FILE *fp, int type,
 		            const char *command, const char *subpkg,
                             const char *section);
+extern content_t *add_content(contents_t *contents, file_t *file,
+		            off_t size, const char *path);
 extern void	add_depend(dist_t *dist, int type, const char *line,
 		           const char *subpkg);
 extern void	add_description(dist_t *dist, FILE *fp, const char *description,
 		                const char *subpkg);
 extern file_t	*add_file(dist_t *dist, const char *subpkg);
+extern void	add_space(int *num_spaces, space_t **spaces, const char *dst,
+		          long inodes, long long kbytes1, long long kbytes4);
 extern char	*add_subpackage(dist_t *dist, const char *subpkg);
+extern int	copy_dist_file(const char *dst, file_t *file, mode_t mode,
+		               uid_t owner, gid_t group,
+			       contents_t *contents);
 extern int	copy_file(const char *dst, const char *src,
-		          mode_t mode, uid_t owner, gid_t group);
+		          mode_t mode, uid_t owner, gid_t group,
+			  file_t *file);
+extern int	delta_apply(const char *oldfile, const char *deltafile,
+		            const char *newfile);
+extern off_t	delta_create(const char *oldfile, const char *newfile,
+		             const char *deltafile);
+extern void	digest_finish(digest_t *digest, file_t *file);
+extern int	digest_file(file_t *file);
+extern void	digest_init(digest_t *digest);
+extern void	digest_update(digest_t *digest, const void *data,
+		              size_t bytes);
+extern content_t *find_content(contents_t *contents, file_t *file,
+		             off_t size, const char *path);
 extern char	*find_subpackage(dist_t *dist, const char *subpkg);
+extern void	free_contents(contents_t *contents);
 extern void	free_dist(dist_t *dist);
+extern int	get_fsspace(int num_spaces, space_t *spaces, fsspace_t **fs);
+extern fileindex_t *get_index(dist_t *dist, const char *subpackage);
 extern const char *get_option(file_t *file, const char *name, const char *defval);
+extern gid_t	get_group_id(const char *name, gid_t defid);
+extern const char *get_group_name(gid_t gid);
 extern void	get_platform(struct utsname *platform);
 extern const char *get_runlevels(file_t *file, const char *deflevels);
 extern int	get_start(file_t *file, int defstart);
 extern int	get_stop(file_t *file, int defstop);
+extern uid_t	get_user_id(const char *name, uid_t defid);
+extern const char *get_user_name(uid_t uid);
 extern int	get_vernumber(const char *version);
+extern int	load_ids(const char *passwd, const char *group);
 extern int	make_bsd(const char *prodname, const char *directory,
 		         const char *platname, dist_t *dist,
 			 struct utsname *platform);
@@ -282,24 +407,30 @@ extern int	make_rpm(int format, const char *prodname, const char *directory,
 			 struct utsname *platform, const char *setup,
 			 const char *types);
 extern dist_t	*new_dist(void);
+extern int	patch_dist(dist_t *dist, const char *filename);
 extern int	qprintf(FILE *fp, const char *format, ...);
 extern dist_t	*read_dist(const char *filename, struct utsname *platform,
 		           const char *format);
-extern int	run_command(const char *directory, const char *command, ...)
-#    ifdef __GNUC__
-__attribute__ ((__format__ (__printf__, 2, 3)))
-#    endif /* __GNUC__ */
-;
+extern int	run_argv(const char *directory, char *argv[]);
 extern void	sort_dist_files(dist_t *dist);
+extern int	start_argv(const char *directory, char *argv[]);
+extern void	stats_phase(const char *name);
+extern void	stats_report(FILE *fp, int json);
 extern void	strip_execs(dist_t *dist);
 extern int	tar_close(tarf_t *tar);
 extern int	tar_directory(tarf_t *tar, const char *srcpath,
 		              const char *dstpath);
-extern int	tar_file(tarf_t *tar, const char *filename);
+extern int	tar_dist_file(tarf_t *tar, file_t *file, off_t size,
+		              time_t mtime, const char *pathname);
+extern int	tar_extract(tarf_t *tar, const char *dst, mode_t mode);
+extern int	tar_file(tarf_t *tar, const char *filename, file_t *file);
 extern int	tar_header(tarf_t *tar, int type, mode_t mode, off_t size,
 		           time_t mtime, const char *user, const char *group,
 			   const char *pathname, const char *linkname);
+extern int	tar_next(tarf_t *tar, tar_t *record, char *pathname,
+		         size_t pathsize);
 extern tarf_t	*tar_open(const char *filename, int compress);
+extern tarf_t	*tar_open_read(const char *filename);
 extern int	tar_package(tarf_t *tar, const char *ext,
 		            const char *prodname, const char *directory,
 		            const char *platname, dist_t *dist,
@@ -308,7 +439,10 @@ extern int	unlink_directory(const char *directory);
 extern int	unlink_package(const char *ext, const char *prodname,
 		               const char *directory, const char *platname,
 			       dist_t *dist, const char *subpackage);
+extern int	wait_commands(void);
 extern int	write_dist(const char *listname, dist_t *dist);
+extern int	write_manifest(const char *prodname, const char *directory,
+		               const char *platname, dist_t *dist);
 
 
 #  ifdef __cplusplus
@@ -0,0 +1,851 @@
+/*
+ * Benchmark program for the ESP Package Manager (EPM).
+ *
+ * Copyright 2020 by Michael R Sweet
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "epm.h"
+#include <sys/time.h>
+#include <sys/resource.h>
+
+
+/*
+ * Local constants...
+ */
+
+#define FILES_PER_DIR	32		/* Files in each source directory */
+#define MAX_DEPTH	8		/* Maximum include depth */
+#define MAX_FORMATS	4		/* Maximum number of backends */
+#define MAX_RESULTS	16		/* Maximum number of results */
+
+
+/*
+ * Local types...
+ */
+
+typedef struct				/**** Benchmark parameters ****/
+{
+  int		num_files,		/* Number of files */
+		min_size,		/* Minimum file size */
+		max_size,		/* Maximum file size */
+		glob_density,		/* Percentage of directories using globs */
+		num_subpackages,	/* Number of subpackages */
+		depth,			/* Include depth */
+		repeat;			/* Number of runs per benchmark */
+  unsigned	seed;			/* Random number seed */
+  long long	total_size;		/* Total size of files */
+} params_t;
+
+typedef struct				/**** Benchmark result ****/
+{
+  const char	*name;			/* Name of benchmark */
+  int		runs;			/* Number of runs */
+  double	min,			/* Minimum wall clock time */
+		max,			/* Maximum wall clock time */
+		total,			/* Total wall clock time */
+		cpu;			/* Total CPU time */
+} result_t;
+
+
+/*
+ * Globals...
+ */
+
+int		CompressFiles = EPM_COMPRESS;
+const char	*DataDir = EPM_DATADIR;
+int		KeepFiles = 0;
+const char	*PatchFrom = NULL;
+const char	*SetupProgram = EPM_LIBDIR "/setup";
+const char	*SoftwareDir = EPM_SOFTWARE;
+const char	*UninstProgram = EPM_LIBDIR "/uninst";
+const char	*UnpackProgram = NULL;
+int		Verbosity = 0;
+
+
+/*
+ * Local globals...
+ */
+
+static unsigned	random_state;		/* Random number state */
+static int	num_results = 0;	/* Number of results */
+static result_t	results[MAX_RESULTS];	/* Results */
+
+
+/*
+ * Local functions...
+ */
+
+static void	bench_copy(const char *workdir, dist_t *dist, result_t *r);
+static int	bench_format(const char *workdir, const char *listname,
+		             struct utsname *platform, const char *format,
+			     params_t *params);
+static void	bench_tar(const char *workdir, dist_t *dist, result_t *r);
+static int	generate(const char *workdir, params_t *params,
+		         char *listname, size_t listsize);
+static double	get_cpu(void);
+static double	get_time(void);
+static unsigned	get_random(void);
+static result_t	*new_result(const char *name);
+static void	record_result(result_t *r, double wall, double cpu);
+static void	shuffle_files(dist_t *dist);
+static void	usage(void);
+static void	write_json(FILE *fp, params_t *params, const char **formats,
+		           int num_formats);
+
+
+/*
+ * 'main()' - Generate a synthetic distribution and time the packaging code.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line arguments */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i, j;			/* Looping vars */
+  params_t	params;			/* Benchmark parameters */
+  const char	*formats[MAX_FORMATS];	/* Backends to time */
+  int		num_formats = 0;	/* Number of backends */
+  const char	*outfile = NULL,	/* Output file */
+		*workdir = NULL;	/* Work directory */
+  char		tempdir[256],		/* Temporary work directory */
+		listname[1024];		/* Main list file */
+  int		generate_only = 0,	/* Only generate the tree? */
+		keep = 0;		/* Keep the work directory? */
+  struct utsname platform;		/* Platform information */
+  dist_t	*dist;			/* Distribution */
+  result_t	*r;			/* Current result */
+  double	start, cpu;		/* Start times */
+  FILE		*fp;			/* Output file */
+
+
+ /*
+  * Parse command-line...
+  */
+
+  memset(&params, 0, sizeof(params));
+  params.num_files       = 1000;
+  params.min_size        = 0;
+  params.max_size        = 65536;
+  params.glob_density    = 10;
+  params.num_subpackages = 2;
+  params.depth           = 1;
+  params.repeat          = 3;
+  params.seed            = 1;
+
+  for (i = 1; i < argc; i ++)
+  {
+    if (!strcmp(argv[i], "-d") && (i + 1) < argc)
+    {
+      params.depth = atoi(argv[++ i]);
+      if (params.depth < 0 || params.depth > MAX_DEPTH)
+        usage();
+    }
+    else if (!strcmp(argv[i], "-f") && (i + 1) < argc)
+    {
+      if (num_formats >= MAX_FORMATS)
+        usage();
+
+      formats[num_formats ++] = argv[++ i];
+    }
+    else if (!strcmp(argv[i], "-g") && (i + 1) < argc)
+    {
+      params.glob_density = atoi(argv[++ i]);
+      if (params.glob_density < 0 || params.glob_density > 100)
+        usage();
+    }
+    else if (!strcmp(argv[i], "-k"))
+      keep = 1;
+    else if (!strcmp(argv[i], "-n") && (i + 1) < argc)
+    {
+      if ((params.num_files = atoi(argv[++ i])) < 1)
+        usage();
+    }
+    else if (!strcmp(argv[i], "-o") && (i + 1) < argc)
+      outfile = argv[++ i];
+    else if (!strcmp(argv[i], "-p") && (i + 1) < argc)
+    {
+      if ((params.num_subpackages = atoi(argv[++ i])) < 0)
+        usage();
+    }
+    else if (!strcmp(argv[i], "-r") && (i + 1) < argc)
+    {
+      if ((params.repeat = atoi(argv[++ i])) < 1)
+        usage();
+    }
+    else if (!strcmp(argv[i], "-s") && (i + 1) < argc)
+    {
+      i ++;
+      if (sscanf(argv[i], "%d-%d", &params.min_size, &params.max_size) != 2 ||
+          params.min_size < 0 || params.max_size < params.min_size)
+        usage();
+    }
+    else if (!strcmp(argv[i], "-S") && (i + 1) < argc)
+      params.seed = (unsigned)strtoul(argv[++ i], NULL, 10);
+    else if (!strcmp(argv[i], "-G") && (i + 1) < argc)
+    {
+      generate_only = 1;
+      workdir       = argv[++ i];
+    }
+    else if (!strcmp(argv[i], "-w") && (i + 1) < argc)
+      workdir = argv[++ i];
+    else
+      usage();
+  }
+
+  if (num_formats == 0)
+    formats[num_formats ++] = "portable";
+
+ /*
+  * Create the synthetic tree and list files...
+  */
+
+  if (workdir)
+  {
+    if (make_directory(workdir, 0755, getuid(), getgid()))
+      return (1);
+  }
+  else
+  {
+    strlcpy(tempdir, "/tmp/epmbenchXXXXXX", sizeof(tempdir));
+    if (!mkdtemp(tempdir))
+    {
+      fprintf(stderr, "epmbench: Unable to create work directory: %s\n",
+              strerror(errno));
+      return (1);
+    }
+
+    workdir = tempdir;
+  }
+
+  if (generate(workdir, &params, listname, sizeof(listname)))
+    return (1);
+
+  if (generate_only)
+  {
+    puts(listname);
+    return (0);
+  }
+
+  get_platform(&platform);
+
+ /*
+  * Time read_dist()...
+  */
+
+  r = new_result("read_dist");
+
+  for (i = 0; i < params.repeat; i ++)
+  {
+    start = get_time();
+    cpu   = get_cpu();
+
+    if ((dist = read_dist(listname, &platform, "portable")) == NULL)
+      return (1);
+
+    record_result(r, get_time() - start, get_cpu() - cpu);
+    free_dist(dist);
+  }
+
+ /*
+  * Time sort_dist_files(), copy_file(), and tar_header()/tar_file() on
+  * the same distribution...
+  */
+
+  if ((dist = read_dist(listname, &platform, "portable")) == NULL)
+    return (1);
+
+  r = new_result("sort_dist_files");
+
+  for (i = 0; i < params.repeat; i ++)
+  {
+    shuffle_files(dist);
+
+    start = get_time();
+    cpu   = get_cpu();
+
+    sort_dist_files(dist);
+
+    record_result(r, get_time() - start, get_cpu() - cpu);
+  }
+
+  r = new_result("copy_file");
+
+  for (i = 0; i < params.repeat; i ++)
+    bench_copy(workdir, dist, r);
+
+  r = new_result("tar_file");
+
+  for (i = 0; i < params.repeat; i ++)
+    bench_tar(workdir, dist, r);
+
+  free_dist(dist);
+
+ /*
+  * Time each backend...
+  */
+
+  for (j = 0; j < num_formats; j ++)
+    if (bench_format(workdir, listname, &platform, formats[j], &params))
+      return (1);
+
+ /*
+  * Write the results...
+  */
+
+  if (outfile)
+  {
+    if ((fp = fopen(outfile, "w")) == NULL)
+    {
+      fprintf(stderr, "epmbench: Unable to create \"%s\": %s\n", outfile,
+              strerror(errno));
+      return (1);
+    }
+  }
+  else
+    fp = stdout;
+
+  write_json(fp, &params, formats, num_formats);
+
+  if (fp != stdout)
+    fclose(fp);
+
+  if (!keep)
+    unlink_directory(workdir);
+
+  return (0);
+}
+
+
+/*
+ * 'bench_copy()' - Time copying all of the files in a distribution.
+ */
+
+static void
+bench_copy(const char *workdir,		/* I - Work directory */
+           dist_t     *dist,		/* I - Distribution */
+	   result_t   *r)		/* I - Result */
+{
+  int		i;			/* Looping var */
+  file_t	*file;			/* Current file */
+  char		copydir[1024],		/* Copy directory */
+		filename[1024];		/* Destination filename */
+  double	start, cpu;		/* Start times */
+
+
+  snprintf(copydir, sizeof(copydir), "%s/copy", workdir);
+
+  start = get_time();
+  cpu   = get_cpu();
+
+  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
+    if (tolower(file->type) == 'f')
+    {
+      snprintf(filename, sizeof(filename), "%s%s", copydir, file->dst);
+      copy_file(filename, file->src, 0, -1, -1, NULL);
+    }
+
+  record_result(r, get_time() - start, get_cpu() - cpu);
+
+  unlink_directory(copydir);
+}
+
+
+/*
+ * 'bench_format()' - Time building a distribution in the named format.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+bench_format(const char     *workdir,	/* I - Work directory */
+             const char     *listname,	/* I - Main list file */
+             struct utsname *platform,	/* I - Platform information */
+             const char     *format,	/* I - Distribution format */
+	     params_t       *params)	/* I - Benchmark parameters */
+{
+  int		i;			/* Looping var */
+  int		status;			/* Status of backend */
+  dist_t	*dist;			/* Distribution */
+  result_t	*r;			/* Result */
+  char		name[256],		/* Result name */
+		*rname,			/* Copy of result name */
+		outdir[1024];		/* Output directory */
+  double	start, cpu;		/* Start times */
+
+
+  snprintf(name, sizeof(name), "make_%s", format);
+  if ((rname = strdup(name)) == NULL)
+    return (-1);
+
+  r = new_result(rname);
+
+  snprintf(outdir, sizeof(outdir), "%s/%s", workdir, format);
+
+  for (i = 0; i < params->repeat; i ++)
+  {
+    if ((dist = read_dist(listname, platform, format)) == NULL)
+      return (-1);
+
+    make_directory(outdir, 0755, getuid(), getgid());
+
+    start = get_time();
+    cpu   = get_cpu();
+
+    if (!strcmp(format, "portable"))
+      status = make_portable("bench", outdir, "", dist, platform, NULL, NULL);
+    else if (!strcmp(format, "deb"))
+      status = make_deb("bench", outdir, "", dist, platform);
+    else if (!strcmp(format, "rpm"))
+      status = make_rpm(PACKAGE_RPM, "bench", outdir, "", dist, platform,
+                        NULL, NULL);
+    else if (!strcmp(format, "bsd"))
+      status = make_bsd("bench", outdir, "", dist, platform);
+    else
+    {
+      fprintf(stderr, "epmbench: Unsupported format \"%s\".\n", format);
+      free_dist(dist);
+      return (-1);
+    }
+
+    record_result(r, get_time() - start, get_cpu() - cpu);
+
+    free_dist(dist);
+    unlink_directory(outdir);
+
+    if (status)
+    {
+      fprintf(stderr, "epmbench: Unable to build %s distribution.\n", format);
+      return (-1);
+    }
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'bench_tar()' - Time archiving all of the files in a distribution.
+ */
+
+static void
+bench_tar(const char *workdir,		/* I - Work directory */
+          dist_t     *dist,		/* I - Distribution */
+	  result_t   *r)		/* I - Result */
+{
+  int		i;			/* Looping var */
+  file_t	*file;			/* Current file */
+  tarf_t	*tar;			/* Tar file */
+  char		filename[1024];		/* Tar filename */
+  struct stat	fileinfo;		/* File information */
+  double	start, cpu;		/* Start times */
+
+
+  snprintf(filename, sizeof(filename), "%s/bench.tar", workdir);
+
+  start = get_time();
+  cpu   = get_cpu();
+
+  if ((tar = tar_open(filename, 0)) == NULL)
+    return;
+
+  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
+    if (tolower(file->type) == 'f' && !stat(file->src, &fileinfo))
+    {
+      if (tar_header(tar, TAR_NORMAL, file->mode, fileinfo.st_size,
+                     fileinfo.st_mtime, file->user, file->group,
+		     file->dst, NULL) ||
+          tar_file(tar, file->src, NULL))
+        break;
+    }
+
+  tar_close(tar);
+
+  record_result(r, get_time() - start, get_cpu() - cpu);
+
+  unlink(filename);
+}
+
+
+/*
+ * 'generate()' - Generate a synthetic source tree and list files.
+ *
+ * Files are spread over directories of FILES_PER_DIR files.  Each directory
+ * belongs to one subpackage and is listed either file by file or, for
+ * "glob_density" percent of the directories, with a single wildcard line.
+ * Directories are spread evenly over a chain of "depth" included list
+ * files.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+generate(const char *workdir,		/* I - Work directory */
+         params_t   *params,		/* I - Benchmark parameters */
+	 char       *listname,		/* O - Main list file */
+	 size_t     listsize)		/* I - Size of list file buffer */
+{
+  int		i, j,			/* Looping vars */
+		num_dirs,		/* Number of directories */
+		dir,			/* Current directory */
+		level,			/* Current include level */
+		nfiles,			/* Files in directory */
+		subpkg,			/* Subpackage number */
+		glob,			/* List directory with a wildcard? */
+		size;			/* File size */
+  int		lmin, lmax;		/* Log2 of size range */
+  char		srcdir[1024],		/* Source directory */
+		filename[1024];		/* Filename */
+  FILE		*lists[MAX_DEPTH + 1],	/* List files */
+		*fp;			/* Data file */
+  unsigned char	buffer[8192];		/* Data buffer */
+
+
+  random_state = params->seed;
+
+ /*
+  * Create the list files...
+  */
+
+  for (level = 0; level <= params->depth; level ++)
+  {
+    if (level)
+      snprintf(filename, sizeof(filename), "%s/bench-%d.list", workdir, level);
+    else
+      snprintf(filename, sizeof(filename), "%s/bench.list", workdir);
+
+    if ((lists[level] = fopen(filename, "w")) == NULL)
+    {
+      fprintf(stderr, "epmbench: Unable to create \"%s\": %s\n", filename,
+              strerror(errno));
+
+      while (level > 0)
+        fclose(lists[-- level]);
+
+      return (-1);
+    }
+
+    if (!level)
+      strlcpy(listname, filename, listsize);
+  }
+
+  fputs("%product EPM Benchmark\n", lists[0]);
+  fputs("%copyright 2020 by Nobody\n", lists[0]);
+  fputs("%vendor Nobody\n", lists[0]);
+  fprintf(lists[0], "%%license %s/LICENSE\n", workdir);
+  fputs("%description Synthetic distribution for benchmarking EPM.\n", lists[0]);
+  fputs("%version 1.0\n", lists[0]);
+
+  for (i = 1; i <= params->num_subpackages; i ++)
+    fprintf(lists[0], "%%subpackage sub%d\n"
+                      "%%description Benchmark subpackage %d.\n", i, i);
+
+  snprintf(filename, sizeof(filename), "%s/LICENSE", workdir);
+  if ((fp = fopen(filename, "w")) == NULL)
+  {
+    fprintf(stderr, "epmbench: Unable to create \"%s\": %s\n", filename,
+            strerror(errno));
+    return (-1);
+  }
+
+  fputs("Synthetic license file for benchmarking EPM.\n", fp);
+  fclose(fp);
+
+ /*
+  * Create the source files with a log-uniform size distribution: pick a
+  * power of 2 between the minimum and maximum and then a size within it...
+  */
+
+  for (lmin = 0; (params->min_size + 1) >> (lmin + 1); lmin ++);
+  for (lmax = 0; (params->max_size + 1) >> (lmax + 1); lmax ++);
+
+  num_dirs = (params->num_files + FILES_PER_DIR - 1) / FILES_PER_DIR;
+
+  params->total_size = 0;
+
+  for (dir = 0; dir < num_dirs; dir ++)
+  {
+    level  = dir % (params->depth + 1);
+    subpkg = dir % (params->num_subpackages + 1);
+    nfiles = params->num_files - dir * FILES_PER_DIR;
+    if (nfiles > FILES_PER_DIR)
+      nfiles = FILES_PER_DIR;
+
+    snprintf(srcdir, sizeof(srcdir), "%s/src/d%04d", workdir, dir);
+    if (make_directory(srcdir, 0755, getuid(), getgid()))
+      break;
+
+    if (subpkg)
+      fprintf(lists[level], "%%subpackage sub%d\n", subpkg);
+    else
+      fputs("%subpackage\n", lists[level]);
+
+    fprintf(lists[level], "d 0755 root sys /opt/bench/d%04d -\n", dir);
+
+    if ((glob = (int)(get_random() % 100) < params->glob_density) != 0)
+      fprintf(lists[level], "f 0644 root sys /opt/bench/d%04d/ %s/*.dat\n",
+              dir, srcdir);
+
+    for (i = 0; i < nfiles; i ++)
+    {
+      snprintf(filename, sizeof(filename), "%s/f%02d.dat", srcdir, i);
+
+      if ((fp = fopen(filename, "wb")) == NULL)
+      {
+        fprintf(stderr, "epmbench: Unable to create \"%s\": %s\n", filename,
+	        strerror(errno));
+        break;
+      }
+
+      j    = lmin + (int)(get_random() % (unsigned)(lmax - lmin + 1));
+      size = (1 << j) - 1 + (int)((get_random() << 15 | get_random()) %
+                                  (unsigned)(1 << j));
+
+      if (size < params->min_size)
+        size = params->min_size;
+      else if (size > params->max_size)
+        size = params->max_size;
+
+      params->total_size += size;
+
+      while (size > 0)
+      {
+        for (j = 0; j < (int)sizeof(buffer) && j < size; j ++)
+	  buffer[j] = (unsigned char)get_random();
+
+	fwrite(buffer, 1, (size_t)j, fp);
+	size -= j;
+      }
+
+      fclose(fp);
+
+      if (!glob)
+        fprintf(lists[level], "f 0644 root sys /opt/bench/d%04d/f%02d.dat %s\n",
+                dir, i, filename);
+    }
+  }
+
+ /*
+  * Chain the include files and close them...
+  */
+
+  for (level = params->depth; level >= 0; level --)
+  {
+    if (level < params->depth)
+      fprintf(lists[level], "%%include %s/bench-%d.list\n", workdir, level + 1);
+
+    fclose(lists[level]);
+  }
+
+  return (dir < num_dirs ? -1 : 0);
+}
+
+
+/*
+ * 'get_cpu()' - Get the CPU time used by this process and its children.
+ */
+
+static double				/* O - CPU time in seconds */
+get_cpu(void)
+{
+  struct rusage	self,			/* Usage for this process */
+		children;		/* Usage for child processes */
+
+
+  getrusage(RUSAGE_SELF, &self);
+  getrusage(RUSAGE_CHILDREN, &children);
+
+  return (self.ru_utime.tv_sec + 0.000001 * self.ru_utime.tv_usec +
+          self.ru_stime.tv_sec + 0.000001 * self.ru_stime.tv_usec +
+          children.ru_utime.tv_sec + 0.000001 * children.ru_utime.tv_usec +
+          children.ru_stime.tv_sec + 0.000001 * children.ru_stime.tv_usec);
+}
+
+
+/*
+ * 'get_random()' - Get a pseudo-random number.
+ *
+ * A simple LCG keeps the generated trees identical across platforms for
+ * the same seed.
+ */
+
+static unsigned				/* O - Random number */
+get_random(void)
+{
+  random_state = random_state * 1103515245 + 12345;
+
+  return ((random_state >> 16) & 0x7fff);
+}
+
+
+/*
+ * 'get_time()' - Get the current wall clock time.
+ */
+
+static double				/* O - Time in seconds */
+get_time(void)
+{
+  struct timeval	tv;		/* Current time */
+
+
+  gettimeofday(&tv, NULL);
+
+  return (tv.tv_sec + 0.000001 * tv.tv_usec);
+}
+
+
+/*
+ * 'new_result()' - Add a new benchmark result.
+ */
+
+static result_t *			/* O - New result */
+new_result(const char *name)		/* I - Name of benchmark */
+{
+  result_t	*r;			/* New result */
+
+
+  if (num_results >= MAX_RESULTS)
+  {
+    fputs("epmbench: Too many results.\n", stderr);
+    exit(1);
+  }
+
+  r = results + num_results;
+  num_results ++;
+
+  memset(r, 0, sizeof(result_t));
+  r->name = name;
+
+  return (r);
+}
+
+
+/*
+ * 'record_result()' - Record a single benchmark run.
+ */
+
+static void
+record_result(result_t *r,		/* I - Result */
+              double   wall,		/* I - Wall clock time */
+	      double   cpu)		/* I - CPU time */
+{
+  if (!r->runs || wall < r->min)
+    r->min = wall;
+  if (!r->runs || wall > r->max)
+    r->max = wall;
+
+  r->total += wall;
+  r->cpu   += cpu;
+  r->runs ++;
+}
+
+
+/*
+ * 'shuffle_files()' - Shuffle the files in a distribution.
+ */
+
+static void
+shuffle_files(dist_t *dist)		/* I - Distribution */
+{
+  int		i, j;			/* Looping vars */
+  file_t	temp;			/* Swap file */
+
+
+  for (i = dist->num_files - 1; i > 0; i --)
+  {
+    j = (int)((get_random() << 15 | get_random()) % (unsigned)(i + 1));
+
+    temp            = dist->files[i];
+    dist->files[i]  = dist->files[j];
+    dist->files[j]  = temp;
+  }
+}
+
+
+/*
+ * 'usage()' - Show command-line usage instructions.
+ */
+
+static void
+usage(void)
+{
+  puts(EPM_VERSION);
+  puts("Usage: epmbench [options]");
+  puts("Options:");
+  puts("-d depth");
+  puts("    Spread the files over this many levels of %include (0 to 8, default 1).");
+  puts("-f {bsd,deb,portable,rpm}");
+  puts("    Time the named backend; may be repeated (default portable).");
+  puts("-g percent");
+  puts("    List this percentage of directories using wildcards (default 10).");
+  puts("-G directory");
+  puts("    Only generate the source tree and list files in the directory.");
+  puts("-k");
+  puts("    Keep the work directory.");
+  puts("-n files");
+  puts("    Generate this many files (default 1000).");
+  puts("-o filename.json");
+  puts("    Write the results to the named file instead of the standard output.");
+  puts("-p subpackages");
+  puts("    Spread the files over this many subpackages (default 2).");
+  puts("-r runs");
+  puts("    Run each benchmark this many times (default 3).");
+  puts("-s min-max");
+  puts("    Use file sizes from min to max bytes (default 0-65536).");
+  puts("-S seed");
+  puts("    Seed for the generated file sizes and contents (default 1).");
+  puts("-w directory");
+  puts("    Use the named work directory instead of a temporary one.");
+
+  exit(1);
+}
+
+
+/*
+ * 'write_json()' - Write the results as JSON.
+ */
+
+static void
+write_json(FILE       *fp,		/* I - Output file */
+           params_t   *params,		/* I - Benchmark parameters */
+	   const char **formats,	/* I - Backends */
+	   int        num_formats)	/* I - Number of backends */
+{
+  int		i;			/* Looping var */
+  result_t	*r;			/* Current result */
+
+
+  fputs("{\n", fp);
+  fprintf(fp, "  \"version\": \"%s\",\n", EPM_VERSION);
+  fprintf(fp, "  \"parameters\": { \"files\": %d, \"min_size\": %d, "
+              "\"max_size\": %d, \"total_size\": %lld, \"glob_density\": %d, "
+	      "\"subpackages\": %d, \"depth\": %d, \"runs\": %d, "
+	      "\"seed\": %u, \"formats\": [",
+          params->num_files, params->min_size, params->max_size,
+	  params->total_size, params->glob_density, params->num_subpackages,
+	  params->depth, params->repeat, params->seed);
+
+  for (i = 0; i < num_formats; i ++)
+    fprintf(fp, "%s\"%s\"", i ? ", " : "", formats[i]);
+
+  fputs("] },\n", fp);
+  fputs("  \"results\": [\n", fp);
+
+  for (i = 0, r = results; i < num_results; i ++, r ++)
+    fprintf(fp, "    { \"name\": \"%s\", \"runs\": %d, \"min\": %.6f, "
+                "\"mean\": %.6f, \"max\": %.6f, \"cpu\": %.6f }%s\n",
+            r->name, r->runs, r->min, r->runs ? r->total / r->runs : 0.0,
+	    r->max, r->runs ? r->cpu / r->runs : 0.0,
+	    (i + 1) < num_results ? "," : "");
+
+  fputs("  ]\n}\n", fp);
+}
@@ -20,6 +20,7 @@
  */
 
 #include "epm.h"
+#include <fcntl.h>
 
 
 /*
@@ -29,21 +30,47 @@
 int		Verbosity = 0;
 
 
+/*
+ * Local types...
+ */
+
+typedef struct				/**** Hashed index of destination paths ****/
+{
+  int		num_buckets,		/* Number of hash buckets */
+		num_files;		/* Number of files in index */
+  int		*buckets;		/* File numbers + 1 or 0 if empty */
+} dstindex_t;
+
+
 /*
  * Local functions...
  */
 
-static file_t	*find_file(dist_t *dist, const char *dst);
+static int	apply_records(dist_t *dist, dstindex_t *index, FILE *fp);
+static file_t	*find_file(dist_t *dist, dstindex_t *index, const char *dst);
+static unsigned	hash_dst(const char *dst);
+static void	index_files(dist_t *dist, dstindex_t *index);
 static void	info(void);
+static int	lock_journal(const char *journalname, int create);
+static file_t	*new_file(dist_t *dist, dstindex_t *index, const char *dst);
 static void	usage(void)
 #ifdef __GNUC__
 __attribute__((__noreturn__))
 #endif /* __GNUC__ */
 ;
+static int	write_file(FILE *fp, int op, const char *src, const char *dst,
+		           int mode, const char *user, const char *group);
 
 
 /*
  * 'main()' - Add or replace files, directories, and symlinks.
+ *
+ * Each request is turned into install records that are either appended
+ * to the list file's journal ("--journal") or applied to the list file
+ * right away.  "--commit" applies the journal to the list file.
+ *
+ * The journal file is locked while it is appended to or applied, so any
+ * number of epminstall processes can run at the same time.
  */
 
 int				/* O - Exit status */
@@ -52,20 +79,26 @@ main(int  argc,			/* I - Number of command-line arguments */
 {
   int		i;		/* Looping var */
   int		mode,		/* Permissions */
-		directories;	/* Installing directories? */
+		directories,	/* Installing directories? */
+		journal,	/* Append to the journal? */
+		commit,		/* Commit the journal? */
+		status,		/* Exit status */
+		jfd;		/* Journal file */
+  ssize_t	bytes;		/* Bytes read */
   char		*user,		/* Owner */
 		*group,		/* Group */
 		*listname,	/* List filename */
 		*src,		/* Source filename */
 		dst[1024],	/* Destination filename */
-		linkname[1024];	/* Symlink name */
-  ssize_t	linklen;	/* Length of symlink */
+		journalname[1024];/* Journal filename */
   int		num_files;	/* Number of files to install */
-  char		*files[1000];	/* Files to install */
-  struct stat	fileinfo;	/* File information */
+  char		**files;	/* Files to install */
+  FILE		*fp,		/* Install records */
+		*jfp;		/* Journal records */
   dist_t	*dist;		/* Distribution */
-  file_t	*file;		/* File in distribution */
+  dstindex_t	index;		/* Index of destination paths */
   struct utsname platform;	/* Platform information */
+  struct stat	jinfo;		/* Journal file information */
 
 
  /*
@@ -77,10 +110,18 @@ main(int  argc,			/* I - Number of command-line arguments */
   user        = "root";
   group       = "sys";
   directories = 0;
+  journal     = 0;
+  commit      = 0;
 
   if ((listname = getenv("EPMLIST")) == NULL)
     listname = "epm.list";
 
+  if ((files = calloc((size_t)argc, sizeof(char *))) == NULL)
+  {
+    perror("epminstall: Unable to allocate memory");
+    return (1);
+  }
+
   for (i = 1; i < argc; i ++)
     if (strcmp(argv[i], "-b") == 0)
       continue;
@@ -114,6 +155,10 @@ main(int  argc,			/* I - Number of command-line arguments */
     }
     else if (strcmp(argv[i], "-s") == 0)
       continue;
+    else if (strcmp(argv[i], "--commit") == 0)
+      commit = 1;
+    else if (strcmp(argv[i], "--journal") == 0)
+      journal = 1;
     else if (strcmp(argv[i], "--list-file") == 0)
     {
       i ++;
@@ -124,147 +169,81 @@ main(int  argc,			/* I - Number of command-line arguments */
     }
     else if (argv[i][0] == '-')
       usage();
-    else if (num_files < (sizeof(files) / sizeof(files[0])))
-    {
-      files[num_files] = argv[i];
-      num_files ++;
-    }
     else
-    {
-      fputs("epminstall: Too many filenames on command-line!\n", stderr);
-      usage();
-    }
-
-  if (num_files == 0 || (num_files < 2 && !directories))
-    usage();
-
-  get_platform(&platform);
+      files[num_files ++] = argv[i];
 
-  if ((dist = read_dist(listname, &platform, "")) == NULL)
+  if (commit)
   {
-    fprintf(stderr, "epminstall: Unable to read list file \"%s\": %s\n",
-            listname, strerror(errno));
-    return (1);
+    if (num_files > 0 || journal)
+      usage();
   }
+  else if (num_files == 0 || (num_files < 2 && !directories))
+    usage();
 
- /*
-  * Check to see if we are installing files or directories...
-  */
-
-  if (directories)
-  {
-    if (!mode)
-      mode = 0755;
-
-    for (i = 0; i < num_files; i ++)
-    {
-     /*
-      * Copy the directory name into a new file entry, which is cleared
-      * by add_file()...
-      */
-
-      if ((file = find_file(dist, files[i])) == NULL)
-        file = add_file(dist, NULL);
+  snprintf(journalname, sizeof(journalname), "%s.journal", listname);
 
-      file->type = 'd';
-      file->mode = mode & 07777;
-      strlcpy(file->user, user, sizeof(file->user));
-      strlcpy(file->group, group, sizeof(file->group));
-      strlcpy(file->dst, files[i], sizeof(file->dst));
-      strlcpy(file->src, "-", sizeof(file->src));
-    }
-  }
+  if (commit)
+    fp = NULL;
   else
   {
    /*
-    * Check to see if we have 1 or more files and a directory or
-    * a source and destination file...
+    * Write install records to a temporary file...
     */
 
-    if (num_files == 2)
+    if ((fp = tmpfile()) == NULL)
     {
-      file = find_file(dist, files[1]);
+      perror("epminstall: Unable to create temporary file");
+      return (1);
+    }
 
-      if (file == NULL || file->type != 'd')
-      {
-        if (!file)
-	  file = add_file(dist, NULL);
+    status = 0;
 
-        if (stat(files[0], &fileinfo))
-	{
-	  fprintf(stderr, "epminstall: Unable to stat \"%s\": %s\n",
-	          files[0], strerror(errno));
-          fileinfo.st_mode = mode;
-        }
+    if (directories)
+    {
+      if (!mode)
+	mode = 0755;
 
-        if (S_ISLNK(fileinfo.st_mode))
+      for (i = 0; i < num_files; i ++)
+      {
+        if (strpbrk(files[i], "\t\n"))
 	{
-	  file->type = 'l';
-
-	  if ((linklen = readlink(files[0], linkname, sizeof(linkname) - 1)) < 0)
-	  {
-	    fprintf(stderr, "epminstall: Unable to read symlink \"%s\": %s\n",
-	            files[0], strerror(errno));
-            files[0] = "BROKEN-LINK";
-	  }
-	  else
-	  {
-	    linkname[linklen] = '\0';
-	    files[0]          = linkname;
-	  }
+	  fprintf(stderr, "epminstall: Bad directory name \"%s\"!\n", files[i]);
+	  status = 1;
+	  break;
 	}
-	else
-	  file->type = 'f';
 
-        if (mode)
-	  file->mode = mode & 07777;
-	else if (fileinfo.st_mode & 0111)
-	  file->mode = 0755;
-	else
-	  file->mode = 0644;
-
-	strlcpy(file->user, user, sizeof(file->user));
-	strlcpy(file->group, group, sizeof(file->group));
-	strlcpy(file->dst, files[1], sizeof(file->dst));
-	strlcpy(file->src, files[0], sizeof(file->src));
+	fprintf(fp, "d\t%o\t%s\t%s\t%s\n", mode & 07777, user, group,
+	        files[i]);
       }
-      else
-        num_files --;
     }
+    else if (num_files == 2)
+    {
+     /*
+      * Install a source file as a destination file or in a destination
+      * directory...
+      */
 
-    if (num_files != 2)
+      status = write_file(fp, 'F', files[0], files[1], mode, user, group);
+    }
+    else
     {
-      if (num_files > 1)
-        num_files --;
+     /*
+      * Install one or more files in the installation directory...
+      */
 
-      if ((file = find_file(dist, files[num_files])) == NULL)
-      {
-       /*
-        * Add the installation directory to the file list...
-	*/
-
-	file = add_file(dist, NULL);
-
-	file->type = 'd';
-	file->mode = 0755;
-	strlcpy(file->user, user, sizeof(file->user));
-	strlcpy(file->group, group, sizeof(file->group));
-	strlcpy(file->dst, files[num_files], sizeof(file->dst));
-	strlcpy(file->src, "-", sizeof(file->src));
-      }
-      else if (file->type != 'd')
+      num_files --;
+
+      if (strpbrk(files[num_files], "\t\n"))
       {
-        fprintf(stderr, "epminstall: Destination path \"%s\" is not a directory!\n",
+	fprintf(stderr, "epminstall: Bad directory name \"%s\"!\n",
 	        files[num_files]);
-        return (1);
+	status = 1;
       }
+      else
+	fprintf(fp, "x\t%s\t%s\t%s\n", user, group, files[num_files]);
 
-      for (i = 0; i < num_files; i ++)
+      for (i = 0; i < num_files && !status; i ++)
       {
-       /*
-	* Add/update the file in the distribution...
-	*/
-
         if ((src = strrchr(files[i], '/')) != NULL)
 	  src ++;
 	else
@@ -272,48 +251,122 @@ main(int  argc,			/* I - Number of command-line arguments */
 
         snprintf(dst, sizeof(dst), "%s/%s", files[num_files], src);
 
-	if ((file = find_file(dist, dst)) == NULL)
-          file = add_file(dist, NULL);
+	status = write_file(fp, 'f', files[i], dst, mode, user, group);
+      }
+    }
 
-        if (stat(files[i], &fileinfo))
-	{
-	  fprintf(stderr, "epminstall: Unable to stat \"%s\": %s\n",
-	          files[i], strerror(errno));
-          fileinfo.st_mode = mode;
-        }
+    if (status)
+    {
+      fclose(fp);
+      return (1);
+    }
 
-        if (S_ISLNK(fileinfo.st_mode))
-	{
-	  file->type = 'l';
-
-	  if ((linklen = readlink(files[i], linkname, sizeof(linkname) - 1)) < 0)
-	  {
-	    fprintf(stderr, "epminstall: Unable to read symlink \"%s\": %s\n",
-	            files[i], strerror(errno));
-            files[i] = "BROKEN-LINK";
-	  }
-	  else
-	  {
-	    linkname[linklen] = '\0';
-	    files[i]          = linkname;
-	  }
-	}
-	else
-	  file->type = 'f';
+    rewind(fp);
+  }
 
-        if (mode)
-	  file->mode = mode & 07777;
-	else if (fileinfo.st_mode & 0111)
-	  file->mode = 0755;
-	else
-	  file->mode = 0644;
+ /*
+  * Lock the journal...
+  */
+
+  if ((jfd = lock_journal(journalname, !commit)) < 0)
+  {
+    if (commit && errno == ENOENT)
+      return (0);			/* Nothing to commit */
+
+    fprintf(stderr, "epminstall: Unable to open journal file \"%s\": %s\n",
+	    journalname, strerror(errno));
+
+    if (fp)
+      fclose(fp);
 
-	strlcpy(file->user, user, sizeof(file->user));
-	strlcpy(file->group, group, sizeof(file->group));
-	strlcpy(file->dst, dst, sizeof(file->dst));
-	strlcpy(file->src, files[i], sizeof(file->src));
+    return (1);
+  }
+
+  if (journal)
+  {
+   /*
+    * Append the install records to the journal...
+    */
+
+    while ((bytes = (ssize_t)fread(dst, 1, sizeof(dst), fp)) > 0)
+      if (write(jfd, dst, (size_t)bytes) != bytes)
+      {
+	fprintf(stderr, "epminstall: Unable to write journal file \"%s\": %s\n",
+		journalname, strerror(errno));
+        status = 1;
+	break;
       }
+
+    fclose(fp);
+
+    if (close(jfd) && !status)
+    {
+      fprintf(stderr, "epminstall: Unable to write journal file \"%s\": %s\n",
+	      journalname, strerror(errno));
+      status = 1;
     }
+
+    return (status);
+  }
+
+ /*
+  * Apply the journal and any new install records to the list file...
+  */
+
+  lseek(jfd, 0, SEEK_SET);
+
+  if ((jfp = fdopen(jfd, "r")) == NULL)
+  {
+    fprintf(stderr, "epminstall: Unable to read journal file \"%s\": %s\n",
+	    journalname, strerror(errno));
+
+    if (fp)
+      fclose(fp);
+
+    close(jfd);
+    return (1);
+  }
+
+  get_platform(&platform);
+
+  if ((dist = read_dist(listname, &platform, "")) == NULL)
+  {
+    fprintf(stderr, "epminstall: Unable to read list file \"%s\": %s\n",
+            listname, strerror(errno));
+
+    if (fp)
+      fclose(fp);
+
+   /*
+    * Don't leave behind an empty journal that was only created for the
+    * lock...
+    */
+
+    if (!commit && !fstat(fileno(jfp), &jinfo) && jinfo.st_size == 0)
+      unlink(journalname);
+
+    fclose(jfp);
+    return (1);
+  }
+
+  memset(&index, 0, sizeof(index));
+
+  status = apply_records(dist, &index, jfp);
+
+  if (fp)
+  {
+    if (!status)
+      status = apply_records(dist, &index, fp);
+
+    fclose(fp);
+  }
+
+  free(index.buckets);
+
+  if (status)
+  {
+    fclose(jfp);
+    return (1);
   }
 
  /*
@@ -328,11 +381,19 @@ main(int  argc,			/* I - Number of command-line arguments */
 
   if (write_dist(listname, dist))
   {
-    fprintf(stderr, "epminstall: Unable to read list file \"%s\": %s\n",
+    fprintf(stderr, "epminstall: Unable to write list file \"%s\": %s\n",
             listname, strerror(errno));
+    fclose(jfp);
     return (1);
   }
 
+ /*
+  * Remove the journal before unlocking it...
+  */
+
+  unlink(journalname);
+  fclose(jfp);
+
  /*
   * Return with no errors...
   */
@@ -341,26 +402,205 @@ main(int  argc,			/* I - Number of command-line arguments */
 }
 
 
+/*
+ * 'apply_records()' - Apply install records to a distribution.
+ *
+ * Each record is a line of tab-separated fields:
+ *
+ *     d mode user group directory
+ *     x user group directory
+ *     f type mode user group dst src
+ *     F type mode user group dst name src
+ *
+ * "d" adds a directory, "x" adds an installation directory unless it is
+ * already listed, "f" adds a file, and "F" adds a file that is installed in
+ * "dst" if that is a listed directory.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+apply_records(dist_t     *dist,		/* I - Distribution */
+              dstindex_t *index,	/* I - Index of destination paths */
+	      FILE       *fp)		/* I - Install records */
+{
+  int		num_fields;		/* Number of fields */
+  char		line[4096],		/* Line from file */
+		*fields[8],		/* Fields */
+		*ptr,			/* Pointer into line */
+		dst[1024];		/* Destination path */
+  file_t	*file;			/* File in distribution */
+  int		linenum;		/* Line number */
+
+
+  for (linenum = 1; fgets(line, sizeof(line), fp); linenum ++)
+  {
+   /*
+    * Split the line into fields...
+    */
+
+    if ((ptr = strchr(line, '\n')) != NULL)
+      *ptr = '\0';
+
+    for (num_fields = 1, fields[0] = ptr = line; (ptr = strchr(ptr, '\t')) != NULL && num_fields < 8;)
+    {
+      *ptr++ = '\0';
+      fields[num_fields ++] = ptr;
+    }
+
+    if ((line[0] == 'd' && num_fields == 5) ||
+        (line[0] == 'x' && num_fields == 4))
+    {
+     /*
+      * Directory...
+      */
+
+      if ((file = find_file(dist, index, fields[num_fields - 1])) == NULL)
+        file = new_file(dist, index, fields[num_fields - 1]);
+      else if (line[0] == 'x')
+      {
+        if (file->type == 'd')
+	  continue;
+
+        fprintf(stderr, "epminstall: Destination path \"%s\" is not a directory!\n",
+	        file->dst);
+        return (-1);
+      }
+
+      file->type = 'd';
+      file->mode = line[0] == 'd' ? (mode_t)strtol(fields[1], NULL, 8) : 0755;
+      strlcpy(file->user, fields[num_fields - 3], sizeof(file->user));
+      strlcpy(file->group, fields[num_fields - 2], sizeof(file->group));
+      strlcpy(file->src, "-", sizeof(file->src));
+    }
+    else if ((line[0] == 'f' && num_fields == 7) ||
+             (line[0] == 'F' && num_fields == 8))
+    {
+     /*
+      * File or symlink...
+      */
+
+      file = find_file(dist, index, fields[5]);
+
+      if (line[0] == 'F' && file && file->type == 'd')
+      {
+        snprintf(dst, sizeof(dst), "%s/%s", fields[5], fields[6]);
+	file = find_file(dist, index, dst);
+      }
+      else
+        strlcpy(dst, fields[5], sizeof(dst));
+
+      if (!file)
+        file = new_file(dist, index, dst);
+
+      file->type = fields[1][0];
+      file->mode = (mode_t)strtol(fields[2], NULL, 8);
+      strlcpy(file->user, fields[3], sizeof(file->user));
+      strlcpy(file->group, fields[4], sizeof(file->group));
+      strlcpy(file->src, fields[num_fields - 1], sizeof(file->src));
+    }
+    else
+    {
+      fprintf(stderr, "epminstall: Bad install record on line %d.\n", linenum);
+      return (-1);
+    }
+  }
+
+  return (0);
+}
+
+
 /*
  * 'find_file()' - Find a file in the distribution...
  */
 
 static file_t *			/* O - File entry or NULL */
 find_file(dist_t     *dist,	/* I - Distribution to search */
+          dstindex_t *index,	/* I - Index of destination paths */
           const char *dst)	/* I - Destination filename */
 {
-  int		i;		/* Looping var */
+  int		bucket;		/* Current bucket */
   file_t	*file;		/* Current file */
 
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (strcmp(file->dst, dst) == 0)
+  if (!index->buckets || index->num_files != dist->num_files)
+    index_files(dist, index);
+
+  for (bucket = (int)(hash_dst(dst) % (unsigned)index->num_buckets);
+       index->buckets[bucket];
+       bucket = (bucket + 1) % index->num_buckets)
+  {
+    file = dist->files + index->buckets[bucket] - 1;
+
+    if (!strcmp(file->dst, dst))
       return (file);
+  }
 
   return (NULL);
 }
 
 
+/*
+ * 'hash_dst()' - Compute the hash of a destination path.
+ */
+
+static unsigned				/* O - Hash value */
+hash_dst(const char *dst)		/* I - Destination path */
+{
+  unsigned	hash;			/* Hash value */
+
+
+  for (hash = 5381; *dst; dst ++)
+    hash = hash * 33 + (unsigned char)*dst;
+
+  return (hash);
+}
+
+
+/*
+ * 'index_files()' - Add new files to the index of destination paths.
+ *
+ * The index is rebuilt when it is more than half full.  The first of any
+ * duplicate destination paths is used, like the list file order.
+ */
+
+static void
+index_files(dist_t     *dist,		/* I - Distribution */
+            dstindex_t *index)		/* I - Index of destination paths */
+{
+  int		i,			/* Looping var */
+		bucket;			/* Current bucket */
+  file_t	*file;			/* Current file */
+
+
+  if (dist->num_files * 2 >= index->num_buckets)
+  {
+    free(index->buckets);
+
+    index->num_buckets = dist->num_files * 4 + 64;
+    index->num_files   = 0;
+
+    if ((index->buckets = calloc((size_t)index->num_buckets, sizeof(int))) == NULL)
+    {
+      perror("epminstall: Unable to allocate memory");
+      exit(1);
+    }
+  }
+
+  for (i = index->num_files, file = dist->files + i; i < dist->num_files; i ++, file ++)
+  {
+    for (bucket = (int)(hash_dst(file->dst) % (unsigned)index->num_buckets);
+         index->buckets[bucket];
+	 bucket = (bucket + 1) % index->num_buckets)
+      if (!strcmp(dist->files[index->buckets[bucket] - 1].dst, file->dst))
+        break;
+
+    if (!index->buckets[bucket])
+      index->buckets[bucket] = i + 1;
+  }
+
+  index->num_files = dist->num_files;
+}
+
+
 /*
  * 'info()' - Show the EPM copyright and license.
  */
@@ -379,6 +619,75 @@ info(void)
 }
 
 
+/*
+ * 'lock_journal()' - Open and lock the journal file.
+ *
+ * Since the journal is removed when it is applied, the lock is retried if
+ * the file was removed while waiting for it.  The lock is held until the
+ * returned file descriptor is closed, and POSIX locks are also released if
+ * any other descriptor for the journal is closed.
+ */
+
+static int				/* O - File descriptor or -1 on error */
+lock_journal(const char *journalname,	/* I - Journal filename */
+             int        create)		/* I - Create the journal? */
+{
+  int		fd;			/* File descriptor */
+  struct flock	lock;			/* Lock information */
+  struct stat	fdinfo,			/* Information for open file */
+		fileinfo;		/* Information for filename */
+
+
+  for (;;)
+  {
+    if ((fd = open(journalname, O_RDWR | O_APPEND | (create ? O_CREAT : 0), 0644)) < 0)
+      return (-1);
+
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type   = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+
+    while (fcntl(fd, F_SETLKW, &lock))
+    {
+      if (errno != EINTR)
+      {
+        close(fd);
+	return (-1);
+      }
+    }
+
+    if (!fstat(fd, &fdinfo) && !stat(journalname, &fileinfo) &&
+        fdinfo.st_dev == fileinfo.st_dev && fdinfo.st_ino == fileinfo.st_ino)
+      return (fd);
+
+    close(fd);
+  }
+}
+
+
+/*
+ * 'new_file()' - Add a new file to the distribution.
+ */
+
+static file_t *				/* O - New file */
+new_file(dist_t     *dist,		/* I - Distribution */
+         dstindex_t *index,		/* I - Index of destination paths */
+         const char *dst)		/* I - Destination path */
+{
+  file_t	*file;			/* New file */
+
+
+  file = add_file(dist, NULL);
+
+  memset(file, 0, sizeof(file_t));
+  strlcpy(file->dst, dst, sizeof(file->dst));
+
+  index_files(dist, index);
+
+  return (file);
+}
+
+
 /*
  * 'usage()' - Show command-line usage instructions.
  */
@@ -398,6 +707,88 @@ usage(void)
   puts("    Set permissions of installed file(s).");
   puts("-u owner");
   puts("    Set owner of installed file(s).");
+  puts("--commit");
+  puts("    Apply the journal to the list file.");
+  puts("--journal");
+  puts("    Add file(s) to the journal instead of the list file.");
+  puts("--list-file filename.list");
+  puts("    Set the list file to update.");
 
   exit(1);
 }
+
+
+/*
+ * 'write_file()' - Write an install record for a file or symlink.
+ */
+
+static int				/* O - 0 on success, 1 on error */
+write_file(FILE       *fp,		/* I - Install records */
+           int        op,		/* I - Record type ('f' or 'F') */
+	   const char *src,		/* I - Source file */
+	   const char *dst,		/* I - Destination file or directory */
+	   int        mode,		/* I - Permissions or 0 */
+	   const char *user,		/* I - Owner */
+	   const char *group)		/* I - Group */
+{
+  struct stat	fileinfo;		/* File information */
+  int		type;			/* File type */
+  char		linkname[1024];		/* Symlink name */
+  ssize_t	linklen;		/* Length of symlink */
+  const char	*name;			/* Filename */
+
+
+  if (strpbrk(src, "\t\n") || strpbrk(dst, "\t\n"))
+  {
+    fprintf(stderr, "epminstall: Bad filename \"%s\"!\n",
+            strpbrk(src, "\t\n") ? src : dst);
+    return (1);
+  }
+
+  if ((name = strrchr(src, '/')) != NULL)
+    name ++;
+  else
+    name = src;
+
+  if (stat(src, &fileinfo))
+  {
+    fprintf(stderr, "epminstall: Unable to stat \"%s\": %s\n",
+	    src, strerror(errno));
+    fileinfo.st_mode = (mode_t)mode;
+  }
+
+  if (S_ISLNK(fileinfo.st_mode))
+  {
+    type = 'l';
+
+    if ((linklen = readlink(src, linkname, sizeof(linkname) - 1)) < 0)
+    {
+      fprintf(stderr, "epminstall: Unable to read symlink \"%s\": %s\n",
+	      src, strerror(errno));
+      src = "BROKEN-LINK";
+    }
+    else
+    {
+      linkname[linklen] = '\0';
+      src               = linkname;
+    }
+  }
+  else
+    type = 'f';
+
+  if (mode)
+    mode &= 07777;
+  else if (fileinfo.st_mode & 0111)
+    mode = 0755;
+  else
+    mode = 0644;
+
+  if (op == 'F')
+    fprintf(fp, "F\t%c\t%o\t%s\t%s\t%s\t%s\t%s\n", type, mode, user,
+            group, dst, name, src);
+  else
+    fprintf(fp, "f\t%c\t%o\t%s\t%s\t%s\t%s\n", type, mode, user, group,
+            dst, src);
+
+  return (0);
+}
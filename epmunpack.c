@@ -0,0 +1,1345 @@
+/*
+ * Portable installer runtime for the ESP Package Manager (EPM).
+ *
+ * Copyright 2020 by Michael R Sweet
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "epm.h"
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <utime.h>
+
+
+/*
+ * Local types...
+ */
+
+typedef struct				/**** File list entry ****/
+{
+  int		type;			/* Type of file ('c', 'f', or 'l') */
+  char		sum[65];		/* SHA-256 digest of config file */
+  char		*path;			/* Destination path */
+} entry_t;
+
+typedef struct				/**** Array of staged paths ****/
+{
+  int		num_paths,		/* Number of paths */
+		alloc_paths;		/* Allocated paths */
+  char		**paths;		/* Paths */
+} paths_t;
+
+
+/*
+ * Global variable used by library functions...
+ */
+
+int		Verbosity = 0;
+
+
+/*
+ * Local globals...
+ */
+
+static int	num_entries = 0;	/* Number of file list entries */
+static entry_t	*entries = NULL;	/* File list entries */
+static int	num_old = 0;		/* Number of old file list entries */
+static entry_t	*old_entries = NULL;	/* Old file list entries */
+static int	progress_files = 0;	/* Number of files processed */
+static int	progress_sent = 0;	/* Number of files reported */
+static off_t	progress_bytes = 0;	/* Number of bytes reported */
+static struct timeval progress_time;	/* Time of last progress record */
+static int	show_progress = 0;	/* Write progress records? */
+
+
+/*
+ * Local functions...
+ */
+
+static int	add_path(paths_t *paths, const char *path);
+static int	check_space(const char *filename);
+static int	commit(paths_t *paths);
+static int	compare_entries(const void *a, const void *b);
+static entry_t	*find_entry(int num, entry_t *list, const char *path);
+static void	free_paths(paths_t *paths, int remove);
+static void	get_ids(const char *user, const char *group, uid_t *uid,
+		        gid_t *gid);
+static void	info(void);
+static int	install_configs(void);
+static int	is_unchanged(const char *path, const char *sum);
+static int	load_list(const char *filename, int *num, entry_t **list);
+static int	patch(const char *filename, int rootonly);
+static void	progress(const char *phase, int flush);
+static void	progress_cb(void);
+static int	read_paths(paths_t *paths, FILE *fp);
+static void	remove_old(void);
+static void	sync_paths(paths_t *paths);
+static int	unpack(const char *filename, paths_t *paths);
+static void	usage(void)
+#ifdef __GNUC__
+__attribute__((__noreturn__))
+#endif /* __GNUC__ */
+;
+
+
+/*
+ * 'main()' - Unpack the software archives of a portable distribution.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line arguments */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i, j;			/* Looping vars */
+  const char	*listname,		/* File list */
+		*oldname;		/* Old file list */
+  int		num_archives;		/* Number of archives */
+  const char	*archives[2];		/* Archives to unpack */
+  FILE		*lists[2];		/* Staged files from each archive */
+  paths_t	staged;			/* Staged files */
+  pid_t		pid;			/* Child process ID */
+  int		status,			/* Exit status of child */
+		errors;			/* Number of errors */
+  int		deltas,			/* Apply binary patches? */
+		rootonly;		/* Skip files in /usr? */
+
+
+ /*
+  * Parse the command-line arguments...
+  */
+
+  listname     = NULL;
+  oldname      = NULL;
+  num_archives = 0;
+  deltas       = 0;
+  rootonly     = 0;
+
+  if (getenv("EPM_PROGRESS"))
+  {
+    show_progress = 1;
+    gettimeofday(&progress_time, NULL);
+  }
+
+  for (i = 1; i < argc; i ++)
+    if (!strcmp(argv[i], "-d"))
+      deltas = 1;
+    else if (!strcmp(argv[i], "-o"))
+    {
+      i ++;
+      if (i >= argc)
+        usage();
+
+      oldname = argv[i];
+    }
+    else if (!strcmp(argv[i], "-s"))
+    {
+      i ++;
+      if (i >= argc)
+        usage();
+
+      return (check_space(argv[i]) ? 1 : 0);
+    }
+    else if (!strcmp(argv[i], "-r"))
+      rootonly = 1;
+    else if (!strcmp(argv[i], "-t"))
+      return (0);
+    else if (!strcmp(argv[i], "-v"))
+      Verbosity ++;
+    else if (!strcmp(argv[i], "--version"))
+    {
+      info();
+      return (0);
+    }
+    else if (argv[i][0] == '-')
+      usage();
+    else if (!listname)
+      listname = argv[i];
+    else if (num_archives < (int)(sizeof(archives) / sizeof(archives[0])))
+      archives[num_archives ++] = argv[i];
+    else
+    {
+      fputs("epmunpack: Too many archives on command-line!\n", stderr);
+      usage();
+    }
+
+  if (!listname)
+    usage();
+
+  if (deltas)
+  {
+    if (num_archives)
+      usage();
+
+    return (patch(listname, rootonly) ? 1 : 0);
+  }
+
+  if (load_list(listname, &num_entries, &entries))
+    return (1);
+
+  if (oldname && load_list(oldname, &num_old, &old_entries))
+    return (1);
+
+ /*
+  * Unpack the archives, each in its own process when there is more than
+  * one so that the / and /usr archives are decompressed in parallel...
+  */
+
+  errors = 0;
+
+  memset(&staged, 0, sizeof(staged));
+
+  if (num_archives == 1)
+  {
+    if (unpack(archives[0], &staged))
+      errors ++;
+  }
+  else if (num_archives > 1)
+  {
+    for (i = 0; i < num_archives; i ++)
+    {
+      if ((lists[i] = tmpfile()) == NULL)
+      {
+        fprintf(stderr, "epmunpack: Unable to create temporary file: %s\n",
+	        strerror(errno));
+        errors ++;
+	continue;
+      }
+
+      if ((pid = fork()) == 0)
+      {
+        paths_t	child;			/* Files staged by child */
+
+
+        memset(&child, 0, sizeof(child));
+
+        if (unpack(archives[i], &child))
+	  exit(1);
+
+        for (j = 0; j < child.num_paths; j ++)
+	  fwrite(child.paths[j], strlen(child.paths[j]) + 1, 1, lists[i]);
+
+        exit(fflush(lists[i]) ? 1 : 0);
+      }
+      else if (pid < 0)
+      {
+        fprintf(stderr, "epmunpack: Unable to fork: %s\n", strerror(errno));
+
+        if (unpack(archives[i], &staged))
+	  errors ++;
+      }
+    }
+
+    while ((pid = wait(&status)) != 0)
+    {
+      if (pid < 0)
+      {
+        if (errno == EINTR)
+	  continue;
+
+        break;
+      }
+
+      if (status)
+        errors ++;
+    }
+
+    for (i = 0; i < num_archives; i ++)
+      if (lists[i])
+      {
+        if (read_paths(&staged, lists[i]))
+	  errors ++;
+
+        fclose(lists[i]);
+      }
+  }
+
+ /*
+  * Move the staged files into place or throw them away...
+  */
+
+  if (errors)
+    free_paths(&staged, 1);
+  else if (commit(&staged))
+    errors ++;
+  else
+    remove_old();
+
+ /*
+  * Install the new config files that don't exist yet...
+  */
+
+  if (!errors && install_configs())
+    errors ++;
+
+  return (errors ? 1 : 0);
+}
+
+
+/*
+ * 'add_path()' - Add a staged path to an array.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+add_path(paths_t    *paths,		/* I - Array of paths */
+         const char *path)		/* I - Destination path */
+{
+  char	**temp;				/* New array */
+
+
+  if (paths->num_paths >= paths->alloc_paths)
+  {
+    if ((temp = realloc(paths->paths, (size_t)(paths->alloc_paths + 64) *
+                                      sizeof(char *))) == NULL)
+    {
+      perror("epmunpack: Out of memory");
+      return (-1);
+    }
+
+    paths->paths       = temp;
+    paths->alloc_paths += 64;
+  }
+
+  if ((paths->paths[paths->num_paths] = strdup(path)) == NULL)
+  {
+    perror("epmunpack: Out of memory");
+    return (-1);
+  }
+
+  paths->num_paths ++;
+
+  return (0);
+}
+
+
+/*
+ * 'check_space()' - Check the disk space needed by an install or patch script.
+ *
+ * The space needed in each directory is read from the "#%space" lines in
+ * the script header.
+ */
+
+static int				/* O - 0 if there is room, -1 otherwise */
+check_space(const char *filename)	/* I - Install or patch script */
+{
+  FILE		*fp;			/* Script file */
+  char		line[1024],		/* Line from script */
+		dst[256];		/* Destination directory */
+  long		inodes;			/* Number of inodes */
+  long long	kbytes1,		/* Size using 1k blocks */
+		kbytes4;		/* Size using 4k blocks */
+  int		i,			/* Looping var */
+		num_spaces,		/* Number of directories */
+		num_fs,			/* Number of filesystems */
+		status;			/* Return status */
+  space_t	*spaces;		/* Space needed in directories */
+  fsspace_t	*fs;			/* Filesystems */
+
+
+  if ((fp = fopen(filename, "r")) == NULL)
+  {
+    fprintf(stderr, "epmunpack: Unable to open \"%s\": %s\n", filename,
+            strerror(errno));
+    return (-1);
+  }
+
+  num_spaces = 0;
+  spaces     = NULL;
+
+  while (fgets(line, sizeof(line), fp) && line[0] == '#')
+    if (sscanf(line, "#%%space %255s%ld%lld%lld", dst, &inodes, &kbytes1,
+               &kbytes4) == 4)
+      add_space(&num_spaces, &spaces, dst, inodes, kbytes1, kbytes4);
+
+  fclose(fp);
+
+  if ((num_fs = get_fsspace(num_spaces, spaces, &fs)) < 0)
+  {
+    fputs("WARNING: Unable to determine available disk space; "
+          "installing blindly...\n", stderr);
+    free(spaces);
+    return (0);
+  }
+
+  for (i = 0, status = 0; i < num_fs; i ++)
+  {
+    if (Verbosity)
+      printf("%s: %lld kbytes needed, %lld kbytes available.\n", fs[i].mount,
+             fs[i].needed, fs[i].available);
+
+    if (fs[i].needed > fs[i].available ||
+        (fs[i].free_inodes >= 0 && fs[i].inodes > fs[i].free_inodes))
+    {
+      if (!status)
+        puts("Not enough free disk space for software:");
+
+      if (fs[i].needed > fs[i].available)
+	printf("You need %lld kbytes in %s but only have %lld kbytes "
+	       "available.\n", fs[i].needed, fs[i].mount, fs[i].available);
+      else
+	printf("You need %ld files in %s but only have %ld available.\n",
+	       fs[i].inodes, fs[i].mount, fs[i].free_inodes);
+
+      status = -1;
+    }
+  }
+
+  free(spaces);
+  free(fs);
+
+  return (status);
+}
+
+
+/*
+ * 'commit()' - Move staged files into place.
+ *
+ * Each existing file is first linked to its backup name so that the
+ * destination never disappears, and then the staged file is renamed over
+ * it.  Files in the file list keep their "filename.O" backup for the
+ * removal script while other backups are removed once every file is in
+ * place.  Files installed by the old version already have their original
+ * backed up, so those backups are left alone.  If a file cannot be
+ * replaced, the files that were already replaced are restored from their
+ * backups.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+commit(paths_t *paths)			/* I - Staged files */
+{
+  int		i;			/* Looping var */
+  int		fd,			/* Directory file descriptor */
+		linked;			/* Status of backup link */
+  char		*path,			/* Destination path */
+		*kinds,			/* Kind of backup for each path */
+		staged[1024],		/* Staged file */
+		backup[1024],		/* Backup file */
+		target[1024],		/* Symlink target */
+		dir[1024],		/* Directory of path */
+		lastdir[1024],		/* Last directory synced */
+		*slash;			/* Last slash in directory */
+  ssize_t	bytes;			/* Length of symlink target */
+  struct stat	fileinfo;		/* Existing file information */
+  entry_t	*entry;			/* Matching file list entry */
+
+
+  if (paths->num_paths == 0)
+    return (0);
+
+  if ((kinds = calloc((size_t)paths->num_paths, 1)) == NULL)
+  {
+    perror("epmunpack: Out of memory");
+    free_paths(paths, 1);
+    return (-1);
+  }
+
+  for (i = 0; i < paths->num_paths; i ++)
+  {
+    path = paths->paths[i];
+
+    snprintf(staged, sizeof(staged), "%s.epmnew", path);
+
+    if (!lstat(path, &fileinfo) && !S_ISDIR(fileinfo.st_mode))
+    {
+     /*
+      * Back up the existing file...
+      */
+
+      if ((entry = find_entry(num_old, old_entries, path)) != NULL &&
+          entry->type != 'c')
+        kinds[i] = 'T';			/* Keep the original backup */
+      else if ((entry = find_entry(num_entries, entries, path)) != NULL &&
+               entry->type != 'c')
+        kinds[i] = 'O';
+      else
+        kinds[i] = 'T';
+
+      snprintf(backup, sizeof(backup), kinds[i] == 'O' ? "%s.O" : "%s.epmold",
+               path);
+      unlink(backup);
+
+      if (S_ISLNK(fileinfo.st_mode))
+      {
+        if ((bytes = readlink(path, target, sizeof(target) - 1)) < 0)
+	  linked = -1;
+	else
+	{
+	  target[bytes] = '\0';
+	  linked        = symlink(target, backup);
+	}
+      }
+      else
+        linked = link(path, backup);
+
+      if (linked && rename(path, backup))
+      {
+	fprintf(stderr, "epmunpack: Unable to back up \"%s\": %s\n", path,
+		strerror(errno));
+        kinds[i] = '\0';
+	break;
+      }
+    }
+
+    if (rename(staged, path))
+    {
+      fprintf(stderr, "epmunpack: Unable to install \"%s\": %s\n", path,
+              strerror(errno));
+
+      if (kinds[i])
+        rename(backup, path);
+
+      break;
+    }
+
+    progress_files ++;
+    progress("committing", 0);
+  }
+
+  progress("committing", 1);
+
+  if (i < paths->num_paths)
+  {
+   /*
+    * Roll back the files that have already been replaced...
+    */
+
+    while (i > 0)
+    {
+      i --;
+
+      path = paths->paths[i];
+
+      if (kinds[i])
+      {
+	snprintf(backup, sizeof(backup),
+	         kinds[i] == 'O' ? "%s.O" : "%s.epmold", path);
+        rename(backup, path);
+      }
+      else
+        unlink(path);
+    }
+
+    free(kinds);
+    free_paths(paths, 1);
+
+    return (-1);
+  }
+
+ /*
+  * Remove the temporary backups and flush the directory entries...
+  */
+
+  lastdir[0] = '\0';
+
+  for (i = 0; i < paths->num_paths; i ++)
+  {
+    path = paths->paths[i];
+
+    if (kinds[i] == 'T')
+    {
+      snprintf(backup, sizeof(backup), "%s.epmold", path);
+      unlink(backup);
+    }
+
+    strlcpy(dir, path, sizeof(dir));
+    if ((slash = strrchr(dir, '/')) != NULL)
+      *slash = '\0';
+
+    if (!dir[0] || !strcmp(dir, lastdir))
+      continue;
+
+    strlcpy(lastdir, dir, sizeof(lastdir));
+
+    if ((fd = open(dir, O_RDONLY)) >= 0)
+    {
+      fsync(fd);
+      close(fd);
+    }
+  }
+
+  free(kinds);
+  free_paths(paths, 0);
+
+  return (0);
+}
+
+
+/*
+ * 'compare_entries()' - Compare the paths of two file list entries.
+ */
+
+static int				/* O - Result of comparison */
+compare_entries(const void *a,		/* I - First entry */
+                const void *b)		/* I - Second entry */
+{
+  return (strcmp(((const entry_t *)a)->path, ((const entry_t *)b)->path));
+}
+
+
+/*
+ * 'find_entry()' - Find a file list entry for a path.
+ */
+
+static entry_t *				/* O - Entry or NULL */
+find_entry(int        num,		/* I - Number of entries */
+           entry_t    *list,		/* I - Sorted file list entries */
+	   const char *path)		/* I - Path to look up */
+{
+  entry_t	key;			/* Lookup key */
+
+
+  if (num <= 0)
+    return (NULL);
+
+  key.path = (char *)path;
+
+  return ((entry_t *)bsearch(&key, list, (size_t)num, sizeof(entry_t),
+                             compare_entries));
+}
+
+
+/*
+ * 'free_paths()' - Free an array of staged paths.
+ */
+
+static void
+free_paths(paths_t *paths,		/* I - Array of paths */
+           int     remove)		/* I - Remove the staged files? */
+{
+  int	i;				/* Looping var */
+  char	staged[1024];			/* Staged file */
+
+
+  for (i = 0; i < paths->num_paths; i ++)
+  {
+    if (remove)
+    {
+      snprintf(staged, sizeof(staged), "%s.epmnew", paths->paths[i]);
+      unlink(staged);
+    }
+
+    free(paths->paths[i]);
+  }
+
+  free(paths->paths);
+
+  memset(paths, 0, sizeof(paths_t));
+}
+
+
+/*
+ * 'get_ids()' - Get the user and group IDs for a file.
+ *
+ * When not running as root the IDs are -1 so the ownership is unchanged.
+ */
+
+static void
+get_ids(const char *user,		/* I - User name */
+        const char *group,		/* I - Group name */
+	uid_t      *uid,		/* O - User ID */
+	gid_t      *gid)		/* O - Group ID */
+{
+  if (geteuid())
+  {
+    *uid = (uid_t)-1;
+    *gid = (gid_t)-1;
+    return;
+  }
+
+  *uid = get_user_id(user, 0);
+  *gid = get_group_id(group, 0);
+}
+
+
+/*
+ * 'info()' - Show the EPM copyright and license.
+ */
+
+static void
+info(void)
+{
+  puts(EPM_VERSION);
+  puts("Copyright 1999-2020 by Michael R Sweet.");
+  puts("");
+  puts("EPM is free software and comes with ABSOLUTELY NO WARRANTY; for details");
+  puts("see the GNU General Public License in the file COPYING or at");
+  puts("\"http://www.fsf.org/gpl.html\".  Report all problems to");
+  puts("\"https://github.com/michaelrsweet/epm/issues\".");
+  puts("");
+}
+
+
+/*
+ * 'install_configs()' - Install new config files.
+ *
+ * Missing config files are copied from the new "filename.N" file.  Config
+ * files that still match the digest shipped with the old version were not
+ * changed locally, so they are replaced with the new defaults.  Otherwise
+ * the local file is kept and the new defaults stay in "filename.N".
+ */
+
+static int				/* O - 0 on success, -1 on error */
+install_configs(void)
+{
+  int		i;			/* Looping var */
+  entry_t	*entry,			/* Current entry */
+		*old;			/* Old entry */
+  char		newname[1024],		/* New config file */
+		tempname[1024];		/* Temporary config file */
+  struct stat	newinfo;		/* New config file information */
+
+
+  for (i = num_entries, entry = entries; i > 0; i --, entry ++)
+  {
+    if (entry->type != 'c')
+      continue;
+
+    if (!access(entry->path, F_OK))
+    {
+     /*
+      * Only replace config files that are unchanged from the old defaults...
+      */
+
+      if ((old = find_entry(num_old, old_entries, entry->path)) == NULL ||
+          old->type != 'c' || !old->sum[0] || !strcmp(old->sum, entry->sum) ||
+	  !is_unchanged(entry->path, old->sum))
+        continue;
+    }
+
+    snprintf(newname, sizeof(newname), "%s.N", entry->path);
+
+    if (lstat(newname, &newinfo))
+      continue;
+
+    if (Verbosity)
+      printf("%s -> %s...\n", newname, entry->path);
+
+    snprintf(tempname, sizeof(tempname), "%s.epmnew", entry->path);
+
+    if (copy_file(tempname, newname, newinfo.st_mode & 07777,
+                  geteuid() ? (uid_t)-1 : newinfo.st_uid,
+		  geteuid() ? (gid_t)-1 : newinfo.st_gid, NULL))
+      return (-1);
+
+    if (rename(tempname, entry->path))
+    {
+      fprintf(stderr, "epmunpack: Unable to install \"%s\": %s\n",
+              entry->path, strerror(errno));
+      unlink(tempname);
+      return (-1);
+    }
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'is_unchanged()' - Check whether a config file matches a digest.
+ */
+
+static int				/* O - 1 if unchanged, 0 otherwise */
+is_unchanged(const char *path,		/* I - Config file */
+             const char *sum)		/* I - SHA-256 digest */
+{
+  file_t	file;			/* File to digest */
+
+
+  memset(&file, 0, sizeof(file));
+  strlcpy(file.src, path, sizeof(file.src));
+
+  return (!digest_file(&file) && !strcmp(file.sha256, sum));
+}
+
+
+/*
+ * 'load_list()' - Load the nul-separated list of installed files.
+ *
+ * Each entry is the file type ('c', 'f', or 'l') followed by the path.
+ * Config files may also have the SHA-256 digest of their contents between
+ * the type and the path.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+load_list(const char *filename,		/* I - File list */
+          int        *num,		/* O - Number of entries */
+	  entry_t    **list)		/* O - Entries */
+{
+  int		fd;			/* File descriptor */
+  struct stat	fileinfo;		/* File information */
+  char		*data,			/* File list data */
+		*ptr,			/* Pointer into data */
+		*path,			/* Pointer to path */
+		*end;			/* End of data */
+  ssize_t	bytes;			/* Bytes read */
+  size_t	count;			/* Number of entries */
+  entry_t	*entry;			/* Current entry */
+
+
+  if ((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &fileinfo))
+  {
+    fprintf(stderr, "epmunpack: Unable to open \"%s\": %s\n", filename,
+            strerror(errno));
+
+    if (fd >= 0)
+      close(fd);
+
+    return (-1);
+  }
+
+  if ((data = malloc((size_t)fileinfo.st_size + 1)) == NULL)
+  {
+    perror("epmunpack: Out of memory");
+    close(fd);
+    return (-1);
+  }
+
+  for (ptr = data, end = data + fileinfo.st_size; ptr < end; ptr += bytes)
+    if ((bytes = read(fd, ptr, (size_t)(end - ptr))) <= 0)
+    {
+      fprintf(stderr, "epmunpack: Unable to read \"%s\": %s\n", filename,
+              bytes < 0 ? strerror(errno) : "Short read");
+      close(fd);
+      free(data);
+      return (-1);
+    }
+
+  close(fd);
+
+  *end = '\0';
+
+ /*
+  * Count the entries, one per nul-terminated string...
+  */
+
+  for (ptr = data, count = 1; ptr < end; ptr ++)
+    if (!*ptr)
+      count ++;
+
+  if ((*list = calloc(count, sizeof(entry_t))) == NULL)
+  {
+    perror("epmunpack: Out of memory");
+    free(data);
+    return (-1);
+  }
+
+ /*
+  * Split the entries and sort them by path for lookups...
+  */
+
+  for (ptr = data; ptr < end; ptr += strlen(ptr) + 1)
+  {
+    if (!ptr[0] || (path = strchr(ptr, '/')) == NULL)
+      continue;
+
+    entry       = *list + *num;
+    entry->type = ptr[0];
+    entry->path = path;
+
+    if (ptr[0] == 'c' && (path - ptr) == 65)
+      strlcpy(entry->sum, ptr + 1, sizeof(entry->sum));
+    else if ((path - ptr) != 1)
+      continue;
+
+    (*num) ++;
+  }
+
+  if (*num > 1)
+    qsort(*list, (size_t)*num, sizeof(entry_t), compare_entries);
+
+  return (0);
+}
+
+
+/*
+ * 'patch()' - Apply the binary patches in an archive.
+ *
+ * Each patched file is written to "filename.epmnew" and verified, and the
+ * new files only replace the old ones once all of the patches have been
+ * applied successfully.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+patch(const char *filename,		/* I - Archive of binary patches */
+      int        rootonly)		/* I - Skip files in /usr? */
+{
+  tarf_t	*tar;			/* Archive */
+  tar_t		record;			/* Header record */
+  int		status,			/* Status of tar_next() */
+		errors;			/* Number of errors */
+  paths_t	paths;			/* Patched files */
+  char		path[1024],		/* Destination path */
+		deltaname[1024],	/* Delta file */
+		newname[1024];		/* New file */
+  mode_t	mode;			/* Permissions */
+  uid_t		uid;			/* Owner */
+  gid_t		gid;			/* Group */
+  struct utimbuf times;			/* Modification time */
+
+
+  if ((tar = tar_open_read(filename)) == NULL)
+  {
+    fprintf(stderr, "epmunpack: Unable to open \"%s\": %s\n", filename,
+            strerror(errno));
+    return (-1);
+  }
+
+  errors = 0;
+
+  memset(&paths, 0, sizeof(paths));
+
+  while ((status = tar_next(tar, &record, path, sizeof(path))) > 0)
+  {
+    if (rootonly && !strncmp(path, "/usr/", 5))
+      continue;
+
+    mode          = (mode_t)strtol(record.header.mode, NULL, 8) & 07777;
+    times.actime  = times.modtime = (time_t)strtol(record.header.mtime, NULL,
+                                                   8);
+
+    get_ids(record.header.uname, record.header.gname, &uid, &gid);
+
+    if (Verbosity)
+      puts(path);
+
+    snprintf(deltaname, sizeof(deltaname), "%s.epmdelta", path);
+    snprintf(newname, sizeof(newname), "%s.epmnew", path);
+
+    if (tar_extract(tar, deltaname, 0600))
+    {
+      errors ++;
+      break;
+    }
+
+    if (delta_apply(path, deltaname, newname))
+    {
+      unlink(deltaname);
+      errors ++;
+      continue;
+    }
+
+    unlink(deltaname);
+
+    if (uid != (uid_t)-1 && chown(newname, uid, gid))
+    {
+      fprintf(stderr, "epmunpack: Unable to set owner of \"%s\": %s\n",
+              path, strerror(errno));
+      unlink(newname);
+      errors ++;
+      continue;
+    }
+
+    chmod(newname, mode);
+    utime(newname, &times);
+
+    if (add_path(&paths, path))
+    {
+      unlink(newname);
+      errors ++;
+      break;
+    }
+
+    progress_files ++;
+    progress("patching", 0);
+  }
+
+  progress("patching", 1);
+
+  if (tar_close(tar) || status < 0)
+  {
+    fprintf(stderr, "epmunpack: Unable to read \"%s\".\n", filename);
+    errors ++;
+  }
+
+ /*
+  * Replace the old files or remove the new ones...
+  */
+
+  if (errors)
+  {
+    free_paths(&paths, 1);
+    return (-1);
+  }
+
+  sync_paths(&paths);
+
+  return (commit(&paths));
+}
+
+
+/*
+ * 'progress()' - Write a progress record for the installer GUI.
+ *
+ * Records are only written when the EPM_PROGRESS environment variable is
+ * set, and look like "#%progress phase bytes files".  The bytes and files
+ * are counted since the previous record so that the records from the
+ * processes unpacking each archive can simply be added up.  Records are
+ * written at most 4 times a second unless "flush" is set.
+ */
+
+static void
+progress(const char *phase,		/* I - Current phase */
+         int        flush)		/* I - Write any remaining counts? */
+{
+  struct timeval curtime;		/* Current time */
+
+
+  if (!show_progress)
+    return;
+
+  gettimeofday(&curtime, NULL);
+
+  if (!flush && (curtime.tv_sec - progress_time.tv_sec) * 1000000 +
+                curtime.tv_usec - progress_time.tv_usec < 250000)
+    return;
+
+  if (IOStats.bytes_written != progress_bytes ||
+      progress_files != progress_sent)
+  {
+    printf("#%%progress %s %lld %d\n", phase,
+           (long long)(IOStats.bytes_written - progress_bytes),
+	   progress_files - progress_sent);
+    fflush(stdout);
+
+    progress_bytes = IOStats.bytes_written;
+    progress_sent  = progress_files;
+  }
+
+  progress_time = curtime;
+}
+
+
+/*
+ * 'progress_cb()' - Report progress while extracting a file.
+ */
+
+static void
+progress_cb(void)
+{
+  progress("extracting", 0);
+}
+
+
+/*
+ * 'read_paths()' - Read a nul-separated list of staged paths.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+read_paths(paths_t *paths,		/* I - Array of paths */
+           FILE    *fp)			/* I - List of paths */
+{
+  int	ch;				/* Current character */
+  char	path[1024],			/* Path */
+	*ptr;				/* Pointer into path */
+
+
+  rewind(fp);
+
+  for (ptr = path; (ch = getc(fp)) != EOF;)
+  {
+    if (ch)
+    {
+      if (ptr < (path + sizeof(path) - 1))
+        *ptr++ = (char)ch;
+      continue;
+    }
+
+    *ptr = '\0';
+    ptr  = path;
+
+    if (add_path(paths, path))
+      return (-1);
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'remove_old()' - Remove the files of the old version that were not
+ *                  replaced.
+ *
+ * Like the removal script, the original file is restored from its
+ * "filename.O" backup, and config files are only removed if they still
+ * match the digest shipped with the old version.
+ */
+
+static void
+remove_old(void)
+{
+  int		i;			/* Looping var */
+  entry_t	*entry;			/* Current old entry */
+  char		backup[1024];		/* Backup file */
+
+
+  for (i = num_old, entry = old_entries; i > 0; i --, entry ++)
+  {
+    if (find_entry(num_entries, entries, entry->path))
+      continue;
+
+    if (entry->type == 'c')
+    {
+      if (entry->sum[0] && is_unchanged(entry->path, entry->sum))
+        unlink(entry->path);
+
+      snprintf(backup, sizeof(backup), "%s.N", entry->path);
+      unlink(backup);
+      continue;
+    }
+
+    if (Verbosity)
+      printf("Removing %s...\n", entry->path);
+
+    unlink(entry->path);
+
+    snprintf(backup, sizeof(backup), "%s.O", entry->path);
+    rename(backup, entry->path);
+  }
+}
+
+
+/*
+ * 'sync_paths()' - Flush staged files to disk.
+ *
+ * This is done once an archive has been extracted so that the data is
+ * already being written back while the remaining files are unpacked.
+ */
+
+static void
+sync_paths(paths_t *paths)		/* I - Array of paths */
+{
+  int		i;			/* Looping var */
+  int		fd;			/* File descriptor */
+  char		staged[1024];		/* Staged file */
+  struct stat	fileinfo;		/* File information */
+
+
+  for (i = 0; i < paths->num_paths; i ++)
+  {
+    snprintf(staged, sizeof(staged), "%s.epmnew", paths->paths[i]);
+
+    if (lstat(staged, &fileinfo) || !S_ISREG(fileinfo.st_mode))
+      continue;
+
+    if ((fd = open(staged, O_RDONLY)) >= 0)
+    {
+      fsync(fd);
+      close(fd);
+    }
+  }
+}
+
+
+/*
+ * 'unpack()' - Unpack a software archive into staging files.
+ *
+ * Files and links are extracted to "filename.epmnew" in the destination
+ * directory so that commit() can rename them into place on the same
+ * filesystem.  Directories are created directly.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+unpack(const char *filename,		/* I - Archive to unpack */
+       paths_t    *paths)		/* I - Staged files */
+{
+  tarf_t	*tar;			/* Archive */
+  tar_t		record;			/* Header record */
+  int		status;			/* Status of tar_next() */
+  char		path[1024],		/* Destination path */
+		staged[1024],		/* Staged file */
+		linkname[1024],		/* Staged hard link target */
+		*slash;			/* Last slash in path */
+  mode_t	mode;			/* Permissions */
+  uid_t		uid;			/* Owner */
+  gid_t		gid;			/* Group */
+  struct utimbuf times;			/* Modification time */
+
+
+  if ((tar = tar_open_read(filename)) == NULL)
+  {
+    fprintf(stderr, "epmunpack: Unable to open \"%s\": %s\n", filename,
+            strerror(errno));
+    return (-1);
+  }
+
+  tar->progress = progress_cb;
+  staged[0]     = '\0';
+
+  while ((status = tar_next(tar, &record, path, sizeof(path))) > 0)
+  {
+    mode          = (mode_t)strtol(record.header.mode, NULL, 8) & 07777;
+    times.actime  = times.modtime = (time_t)strtol(record.header.mtime, NULL,
+                                                   8);
+
+    get_ids(record.header.uname, record.header.gname, &uid, &gid);
+
+    if (Verbosity)
+      puts(path);
+
+    if (record.header.linkflag == TAR_DIR)
+    {
+      if ((slash = path + strlen(path) - 1) > path && *slash == '/')
+        *slash = '\0';
+
+      make_directory(path, mode, uid, gid);
+      chmod(path, mode);
+      if (uid != (uid_t)-1 && chown(path, uid, gid))
+      {
+        fprintf(stderr, "epmunpack: Unable to set owner of \"%s\": %s\n",
+	        path, strerror(errno));
+	goto error;
+      }
+      continue;
+    }
+
+   /*
+    * Make sure the parent directory exists...
+    */
+
+    if ((slash = strrchr(path, '/')) != NULL && slash > path)
+    {
+      *slash = '\0';
+      if (access(path, F_OK))
+        make_directory(path, 0755, (uid_t)-1, (gid_t)-1);
+      *slash = '/';
+    }
+
+   /*
+    * Then create the new file next to the existing one...
+    */
+
+    snprintf(staged, sizeof(staged), "%s.epmnew", path);
+    unlink(staged);
+
+    switch (record.header.linkflag)
+    {
+      case TAR_NORMAL :
+      case TAR_OLDNORMAL :
+      case TAR_CONTIG :
+          if (tar_extract(tar, staged, mode))
+	    goto error;
+
+          if (uid != (uid_t)-1 && chown(staged, uid, gid))
+	  {
+	    fprintf(stderr, "epmunpack: Unable to set owner of \"%s\": %s\n",
+	            path, strerror(errno));
+	    goto error;
+	  }
+
+	  chmod(staged, mode);
+	  utime(staged, &times);
+          break;
+
+      case TAR_LINK :
+          snprintf(linkname, sizeof(linkname), "%s.epmnew",
+	           record.header.linkname);
+
+          if (link(linkname, staged) &&
+	      link(record.header.linkname, staged))
+	  {
+	    fprintf(stderr, "epmunpack: Unable to link \"%s\" to \"%s\": %s\n",
+	            path, record.header.linkname, strerror(errno));
+	    goto error;
+	  }
+          break;
+
+      case TAR_SYMLINK :
+          if (symlink(record.header.linkname, staged))
+	  {
+	    fprintf(stderr, "epmunpack: Unable to create symlink \"%s\": %s\n",
+	            path, strerror(errno));
+	    goto error;
+	  }
+
+          if (uid != (uid_t)-1 && lchown(staged, uid, gid))
+	  {
+	    fprintf(stderr, "epmunpack: Unable to set owner of \"%s\": %s\n",
+	            path, strerror(errno));
+	    goto error;
+	  }
+          break;
+
+      default :
+          fprintf(stderr, "epmunpack: Skipping unsupported file \"%s\".\n",
+	          path);
+          continue;
+    }
+
+    if (add_path(paths, path))
+    {
+      unlink(staged);
+      goto error;
+    }
+
+    progress_files ++;
+    progress("extracting", 0);
+  }
+
+  progress("extracting", 1);
+
+  if (tar_close(tar) || status < 0)
+  {
+    fprintf(stderr, "epmunpack: Unable to read \"%s\".\n", filename);
+    free_paths(paths, 1);
+    return (-1);
+  }
+
+  sync_paths(paths);
+
+  return (0);
+
+ /*
+  * If we get here there was an error extracting a file...
+  */
+
+  error:
+
+  tar_close(tar);
+  unlink(staged);
+  free_paths(paths, 1);
+
+  return (-1);
+}
+
+
+/*
+ * 'usage()' - Show command-line usage instructions.
+ */
+
+static void
+usage(void)
+{
+  info();
+
+  puts("Usage: epmunpack [options] product.files [product.sw] [product.ss]");
+  puts("       epmunpack [options] -d [-r] product.psd");
+  puts("       epmunpack [options] -s product.install");
+  puts("Options:");
+  puts("-d");
+  puts("    Apply the binary patches in the named archive.");
+  puts("-o product.files");
+  puts("    Replace the files of the old version in the named file list.");
+  puts("-r");
+  puts("    Only apply binary patches to files outside of /usr.");
+  puts("-s script");
+  puts("    Check the disk space needed by the named install or patch script.");
+  puts("-t");
+  puts("    Test that epmunpack runs on this system.");
+  puts("-v");
+  puts("    Be verbose.");
+
+  exit(1);
+}
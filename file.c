@@ -22,6 +22,144 @@
 #include "epm.h"
 
 
+/*
+ * Local functions...
+ */
+
+static int	compare_srcs(file_t **a, file_t **b);
+static int	same_tree(const char *a, const char *b);
+
+
+/*
+ * 'add_content()' - Add written file contents to an index.
+ */
+
+content_t *				/* O - New contents or NULL on error */
+add_content(contents_t *contents,	/* I - Contents index */
+            file_t     *file,		/* I - File that was written */
+	    off_t      size,		/* I - Size of file */
+	    const char *path)		/* I - Archive or staging path */
+{
+  int		i;			/* Looping var */
+  content_t	*content,		/* New contents */
+		*next,			/* Next contents */
+		**buckets;		/* New hash buckets */
+  int		num_buckets;		/* New number of buckets */
+
+
+ /*
+  * Grow the hash table as needed...
+  */
+
+  if (contents->num_contents >= 2 * contents->num_buckets)
+  {
+    num_buckets = contents->num_buckets ? 4 * contents->num_buckets : 1024;
+
+    if ((buckets = calloc((size_t)num_buckets, sizeof(content_t *))) == NULL)
+      return (NULL);
+
+    for (i = 0; i < contents->num_buckets; i ++)
+      for (content = contents->buckets[i]; content; content = next)
+      {
+        next          = content->next;
+	content->next = buckets[content->size % num_buckets];
+
+	buckets[content->size % num_buckets] = content;
+      }
+
+    free(contents->buckets);
+
+    contents->buckets     = buckets;
+    contents->num_buckets = num_buckets;
+  }
+
+ /*
+  * Add the new contents...
+  */
+
+  if ((content = calloc(1, sizeof(content_t))) == NULL)
+    return (NULL);
+
+  if ((content->path = strdup(path)) == NULL)
+  {
+    free(content);
+    return (NULL);
+  }
+
+  content->size = size;
+  content->file = file;
+  content->next = contents->buckets[size % contents->num_buckets];
+
+  contents->buckets[size % contents->num_buckets] = content;
+  contents->num_contents ++;
+
+  return (content);
+}
+
+
+/*
+ * 'copy_dist_file()' - Copy a distribution file, linking to identical
+ *                      contents that have already been copied.
+ */
+
+int					/* O - 0 on success, -1 on failure */
+copy_dist_file(const char *dst,		/* I - Destination file */
+               file_t     *file,	/* I - Distribution file */
+               mode_t     mode,		/* I - Permissions */
+	       uid_t      owner,	/* I - Owner ID */
+	       gid_t      group,	/* I - Group ID */
+	       contents_t *contents)	/* I - Contents already copied or NULL */
+{
+  struct stat	fileinfo;		/* Source file information */
+  content_t	*content;		/* Matching contents */
+  char		buffer[1024],		/* Destination directory */
+		*slash;			/* Pointer to trailing slash */
+
+
+  if (!contents)
+    return (copy_file(dst, file->src, mode, owner, group, file));
+
+  IOStats.stat_calls ++;
+
+  if (stat(file->src, &fileinfo))
+  {
+    fprintf(stderr, "epm: Unable to stat \"%s\" -\n     %s\n", file->src,
+            strerror(errno));
+    return (-1);
+  }
+
+  if ((content = find_content(contents, file, fileinfo.st_size, NULL)) != NULL)
+  {
+   /*
+    * Same contents, permissions, and ownership - hard link to the copy we
+    * already made...
+    */
+
+    strlcpy(buffer, dst, sizeof(buffer));
+    if ((slash = strrchr(buffer, '/')) != NULL)
+      *slash = '\0';
+
+    if (access(buffer, F_OK))
+      make_directory(buffer, 0755, owner, group);
+
+    if (!link(content->path, dst))
+    {
+      if (Verbosity > 1)
+        printf("%s == %s...\n", dst, content->path);
+
+      return (0);
+    }
+  }
+
+  if (copy_file(dst, file->src, mode, owner, group, file))
+    return (-1);
+
+  add_content(contents, file, fileinfo.st_size, dst);
+
+  return (0);
+}
+
+
 /*
  * 'copy_file()' - Copy a file.
  */
@@ -31,13 +169,15 @@ copy_file(const char *dst,		/* I - Destination file */
           const char *src,		/* I - Source file */
           mode_t     mode,		/* I - Permissions */
 	  uid_t      owner,		/* I - Owner ID */
-	  gid_t      group)		/* I - Group ID */
+	  gid_t      group,		/* I - Group ID */
+	  file_t     *distfile)		/* I - Distribution file to digest or NULL */
 {
   FILE		*dstfile,		/* Destination file */
 		*srcfile;		/* Source file */
   char		buffer[8192];		/* Copy buffer */
   char		*slash;			/* Pointer to trailing slash */
   size_t	bytes;			/* Number of bytes read/written */
+  digest_t	digest;			/* Content digest */
 
 
  /*
@@ -72,11 +212,22 @@ copy_file(const char *dst,		/* I - Destination file */
     return (-1);
   }
 
+  IOStats.files_read ++;
+  IOStats.files_written ++;
+
  /*
-  * Copy from src to dst...
+  * Copy from src to dst, computing the content digests as we go so the
+  * backends never need to read the file a second time...
   */
 
+  if (distfile)
+    digest_init(&digest);
+
   while ((bytes = fread(buffer, 1, sizeof(buffer), srcfile)) > 0)
+  {
+    if (distfile)
+      digest_update(&digest, buffer, bytes);
+
     if (fwrite(buffer, 1, bytes, dstfile) < bytes)
     {
       fprintf(stderr, "epm: Unable to write to \"%s\" -\n     %s\n", dst,
@@ -89,6 +240,10 @@ copy_file(const char *dst,		/* I - Destination file */
       return (-1);
     }
 
+    IOStats.bytes_read    += bytes;
+    IOStats.bytes_written += bytes;
+  }
+
  /*
   * Close files, change permissions, and return...
   */
@@ -96,6 +251,9 @@ copy_file(const char *dst,		/* I - Destination file */
   fclose(srcfile);
   fclose(dstfile);
 
+  if (distfile)
+    digest_finish(&digest, distfile);
+
   if (mode)
     chmod(dst, mode);
   if (owner != (uid_t)-1 && group != (gid_t)-1)
@@ -105,6 +263,81 @@ copy_file(const char *dst,		/* I - Destination file */
 }
 
 
+/*
+ * 'find_content()' - Find identical contents that were already written.
+ *
+ * Candidates are matched by size first, so a file is only read to compute
+ * its digests when another file of the same size has been written.  The
+ * permissions and ownership must also match since hard links share them.
+ * If "path" is not NULL, only contents under the same top-level directory
+ * tree are matched so that links do not cross likely mount points.
+ */
+
+content_t *				/* O - Matching contents or NULL */
+find_content(contents_t *contents,	/* I - Contents index */
+             file_t     *file,		/* I - File to look up */
+	     off_t      size,		/* I - Size of file */
+	     const char *path)		/* I - Destination path or NULL */
+{
+  content_t	*content;		/* Current contents */
+
+
+  if (!contents->num_buckets || size == 0)
+    return (NULL);
+
+  for (content = contents->buckets[size % contents->num_buckets];
+       content;
+       content = content->next)
+  {
+    if (content->size != size || content->file->mode != file->mode ||
+        strcmp(content->file->user, file->user) ||
+        strcmp(content->file->group, file->group) ||
+	!content->file->sha256[0])
+      continue;
+
+    if (path && !same_tree(content->path, path))
+      continue;
+
+    if (digest_file(file))
+      return (NULL);
+
+    if (!strcmp(content->file->sha256, file->sha256))
+      return (content);
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * 'free_contents()' - Free a contents index.
+ */
+
+void
+free_contents(contents_t *contents)	/* I - Contents index */
+{
+  int		i;			/* Looping var */
+  content_t	*content,		/* Current contents */
+		*next;			/* Next contents */
+
+
+  for (i = 0; i < contents->num_buckets; i ++)
+    for (content = contents->buckets[i]; content; content = next)
+    {
+      next = content->next;
+
+      free(content->path);
+      free(content);
+    }
+
+  free(contents->buckets);
+
+  contents->num_contents = 0;
+  contents->num_buckets  = 0;
+  contents->buckets      = NULL;
+}
+
+
 /*
  * 'make_directory()' - Make a directory.
  */
@@ -195,14 +428,22 @@ strip_execs(dist_t *dist)		/* I - Distribution to strip... */
   file_t	*file;			/* Software file */
   FILE		*fp;			/* File pointer */
   char		header[4];		/* File header... */
+  int		num_execs;		/* Number of executables */
+  file_t	**execs;		/* Executables to strip */
+  char		*argv[3];		/* Strip command */
 
 
  /*
-  * Loop through the distribution files and strip any executable
-  * files.
+  * Loop through the distribution files and find any executable files.
   */
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
+  if ((execs = calloc((size_t)dist->num_files + 1, sizeof(file_t *))) == NULL)
+  {
+    perror("epm: Unable to allocate memory for executables");
+    exit(1);
+  }
+
+  for (i = dist->num_files, file = dist->files, num_execs = 0; i > 0; i --, file ++)
     if (tolower(file->type) == 'f' && (file->mode & 0111) &&
         strstr(file->options, "nostrip()") == NULL)
     {
@@ -218,7 +459,10 @@ strip_execs(dist_t *dist)		/* I - Distribution to strip... */
 	*/
 
         if (fread(header, 1, sizeof(header) - 1, fp) == 0)
+	{
+	  fclose(fp);
 	  continue;
+	}
 
 	header[sizeof(header) - 1] = '\0';
 
@@ -245,12 +489,35 @@ strip_execs(dist_t *dist)		/* I - Distribution to strip... */
         exit(1);
       }
 
-     /*
-      * Strip executables...
-      */
-
-      run_command(NULL, EPM_STRIP " %s", file->src);
+      execs[num_execs ++] = file;
     }
+
+ /*
+  * Strip executables, running up to MaxJobs strip commands at a time.  Sort
+  * by source file so that a file listed more than once is only stripped
+  * once - two strip commands writing the same file would corrupt it...
+  */
+
+  if (num_execs > 1)
+    qsort(execs, (size_t)num_execs, sizeof(file_t *),
+          (int (*)(const void *, const void *))compare_srcs);
+
+  argv[0] = EPM_STRIP;
+  argv[2] = NULL;
+
+  for (i = 0; i < num_execs; i ++)
+  {
+    if (i > 0 && !strcmp(execs[i - 1]->src, execs[i]->src))
+      continue;
+
+    argv[1] = execs[i]->src;
+
+    start_argv(NULL, argv);
+  }
+
+  wait_commands();
+
+  free(execs);
 }
 
 
@@ -411,3 +678,38 @@ unlink_package(const char *ext,		/* I - Package filename extension */
   else
     return (0);
 }
+
+
+/*
+ * 'compare_srcs()' - Compare the source filenames of two files.
+ */
+
+static int				/* O - Result of comparison */
+compare_srcs(file_t **a,		/* I - First file */
+             file_t **b)		/* I - Second file */
+{
+  return (strcmp((*a)->src, (*b)->src));
+}
+
+
+/*
+ * 'same_tree()' - Determine whether two paths share the same top-level tree.
+ *
+ * The paths must be in the same directory or share the first two directory
+ * components ("/opt/product", "/usr/local", etc.), since those are where
+ * separate filesystems are usually mounted.
+ */
+
+static int				/* O - 1 if same tree, 0 otherwise */
+same_tree(const char *a,		/* I - First path */
+          const char *b)		/* I - Second path */
+{
+  int	slashes;			/* Number of slashes seen */
+
+
+  for (slashes = 0; *a && *a == *b; a ++, b ++)
+    if (*a == '/' && ++ slashes > 2)
+      return (1);
+
+  return (!strchr(a, '/') && !strchr(b, '/'));
+}
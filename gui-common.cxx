@@ -24,6 +24,42 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+
+
+//
+// Local types...
+//
+
+struct gui_index_t			//// Distribution hash index
+{
+  const gui_dist_t	*d;		// Distributions
+  int			num_d;		// Number of distributions
+  unsigned		generation;	// Generation of distributions
+  int			num_slots;	// Number of hash slots
+  int			*slots;		// Distribution for each slot or -1
+  unsigned		*hashes;	// Hash for each slot
+};
+
+
+//
+// Local globals...
+//
+
+static gui_index_t	Indices[4];	// Hash indices
+static int		NextIndex = 0;	// Next hash index to replace
+static unsigned		Generation = 0;	// Incremented when distributions change
+
+
+//
+// Local functions...
+//
+
+static unsigned	gui_hash_name(const char *name);
+static void	gui_index_dists(gui_index_t *index, int num_d,
+		                const gui_dist_t *d);
+static void	gui_read_header(gui_dist_t *d, const char *filename);
+static double	gui_time(void);
 
 
 //
@@ -93,69 +129,309 @@ gui_add_dist(int        *num_d,		// IO - Number of distributions
 
   memset(temp, 0, sizeof(gui_dist_t));
 
+  gui_changed_dists();
+
   return (temp);
 }
 
 
+//
+// 'gui_add_info()' - Add information from a "#%" line to a distribution.
+//
+
+void
+gui_add_info(gui_dist_t *d,		// I - Distribution
+             const char *line)		// I - "#%" line without newline
+{
+  int	lowver, hiver;			// Version numbers for dependencies
+  char	product[64];			// Product name
+
+
+  if (!strncmp(line, "#%product ", 10))
+    strncpy(d->name, line + 10, sizeof(d->name) - 1);
+  else if (!strncmp(line, "#%version ", 10))
+    sscanf(line + 10, "%31s%d", d->version, &(d->vernumber));
+  else if (!strncmp(line, "#%rootsize ", 11))
+    d->rootsize = atoi(line + 11);
+  else if (!strncmp(line, "#%usrsize ", 10))
+    d->usrsize = atoi(line + 10);
+  else if (!strncmp(line, "#%space ", 8))
+    gui_add_space(d, line + 8);
+  else if (!strncmp(line, "#%incompat ", 11) ||
+           !strncmp(line, "#%requires ", 11))
+  {
+    lowver = 0;
+    hiver  = 0;
+
+    if (sscanf(line + 11, "%63s%*s%d%*s%d", product, &lowver, &hiver) > 0)
+      gui_add_depend(d, (line[2] == 'i') ? DEPEND_INCOMPAT : DEPEND_REQUIRES,
+                     product, lowver, hiver);
+  }
+}
+
+
+//
+// 'gui_add_space()' - Add the space needed in a destination directory.
+//
+
+void
+gui_add_space(gui_dist_t *d,		// I - Distribution
+              const char *line)		// I - "#%space" line arguments
+{
+  char		dst[256];		// Destination directory
+  long		inodes;			// Number of inodes
+  long long	kbytes1,		// Size using 1k blocks
+		kbytes4;		// Size using 4k blocks
+
+
+  if (sscanf(line, "%255s%ld%lld%lld", dst, &inodes, &kbytes1, &kbytes4) == 4)
+    add_space(&(d->num_spaces), &(d->spaces), dst, inodes, kbytes1, kbytes4);
+}
+
+
+//
+// 'gui_changed_dists()' - Note that distributions have been changed.
+//
+// This must be called after sorting or removing distributions so that
+// gui_find_dist() does not use an out-of-date hash index.
+// gui_add_dist() calls it automatically.
+//
+
+void
+gui_changed_dists(void)
+{
+  Generation ++;
+}
+
+
 //
 // 'gui_find_dist()' - Find a distribution.
 //
+// Larger arrays are looked up using a hash index that is rebuilt whenever
+// gui_changed_dists() has been called since it was built.
+//
 
 gui_dist_t *				// O - Pointer to distribution or NULL
 gui_find_dist(const char *name,		// I - Distribution name
               int        num_d,		// I - Number of distributions
 	      gui_dist_t *d)		// I - Distributions
 {
-  while (num_d > 0)
+  int		i;			// Looping var
+  int		slot;			// Current slot
+  unsigned	hash;			// Hash of name
+  gui_index_t	*index;			// Hash index
+
+
+  if (num_d < 16)
   {
-    if (!strcmp(name, d->product))
-      return (d);
+    while (num_d > 0)
+    {
+      if (!strcmp(name, d->product))
+	return (d);
+
+      d ++;
+      num_d --;
+    }
 
-    d ++;
-    num_d --;
+    return (NULL);
   }
 
+  // Find or build the index for these distributions...
+  for (i = 0, index = Indices; i < (int)(sizeof(Indices) / sizeof(Indices[0])); i ++, index ++)
+    if (index->d == d && index->num_d == num_d)
+      break;
+
+  if (i >= (int)(sizeof(Indices) / sizeof(Indices[0])))
+  {
+    index     = Indices + NextIndex;
+    NextIndex = (NextIndex + 1) % (int)(sizeof(Indices) / sizeof(Indices[0]));
+
+    gui_index_dists(index, num_d, d);
+  }
+  else if (index->generation != Generation)
+    gui_index_dists(index, num_d, d);
+
+  // Look up the name...
+  hash = gui_hash_name(name);
+
+  for (slot = (int)(hash & (unsigned)(index->num_slots - 1));
+       (i = index->slots[slot]) >= 0;
+       slot = (slot + 1) & (index->num_slots - 1))
+    if (index->hashes[slot] == hash && !strcmp(d[i].product, name))
+      return (d + i);
+
   return (NULL);
 }
 
 
+//
+// 'gui_format_progress()' - Format a progress label.
+//
+// The label shows the current phase, throughput, and estimated time
+// remaining once there is enough progress to estimate them.
+//
+
+double					// O - Percent done
+gui_format_progress(const gui_progress_t *p,	// I - Progress
+                    const char           *title,	// I - Title for label
+		    char                 *buffer,	// O - Label buffer
+		    size_t               bufsize)	// I - Size of label buffer
+{
+  double	percent,		// Percent done
+		elapsed,		// Elapsed time in seconds
+		rate;			// Bytes or files per second
+  int		remaining;		// Seconds remaining
+  char		ratestr[32];		// Rate string
+
+
+  if (p->total > 0 && p->done < p->total)
+    percent = 100.0 * p->done / p->total;
+  else if (p->total > 0)
+    percent = 100.0;
+  else
+    percent = 0.0;
+
+  elapsed = gui_time() - p->start;
+
+  if (elapsed < 1.0 || p->done <= 0 || !p->phase[0])
+  {
+    snprintf(buffer, bufsize, "%s...", title);
+    return (percent);
+  }
+
+  rate = p->done / elapsed;
+
+  if (p->use_files)
+    snprintf(ratestr, sizeof(ratestr), "%.0f files/s", rate);
+  else if (rate >= 1048576.0)
+    snprintf(ratestr, sizeof(ratestr), "%.1f MB/s", rate / 1048576.0);
+  else
+    snprintf(ratestr, sizeof(ratestr), "%.0f kB/s", rate / 1024.0);
+
+  if (p->done < p->total)
+    remaining = (int)((p->total - p->done) / rate + 0.5);
+  else
+    remaining = 0;
+
+  snprintf(buffer, bufsize, "%s: %s, %.0f%%, %s, %d:%02d remaining", title,
+           p->phase, percent, ratestr, remaining / 60, remaining % 60);
+
+  return (percent);
+}
+
+
 //
 // 'gui_get_installed()' - Get a list of installed software products.
 //
+// The software inventory file (EPM_SOFTWARE "/.index") that is maintained
+// by the installation scripts is used for all products whose removal
+// script is not newer than the inventory; other removal scripts are read
+// directly.  RPM packages are loaded separately using
+// gui_get_installed_rpms().
+//
 
 void
 gui_get_installed(void)
 {
-  int		i;			// Looping var
+  int		i, j;			// Looping vars
   int		num_files;		// Number of files
   dirent	**files;		// Files
   const char	*ext;			// Extension
   gui_dist_t	*temp;			// Pointer to current distribution
   FILE		*fp;			// File to read from
-  char		line[1024];		// Line from file...
+  char		line[1024],		// Line from file...
+		product[64],		// Product name
+		*ptr;			// Pointer into line
+  int		num_indexed;		// Number of products from inventory
+  char		*present,		// Inventory products still installed
+		*current;		// Removal scripts in inventory
+  struct stat	indexinfo,		// Inventory information
+		fileinfo;		// Removal script information
 
 
   // See if there are any installed files...
   NumInstalled = 0;
   Installed    = (gui_dist_t *)0;
 
+  indexinfo.st_mtime = 0;
+
+  // Load the software inventory...
+  if ((fp = fopen(EPM_SOFTWARE "/.index", "r")) != NULL)
+  {
+    if (fstat(fileno(fp), &indexinfo))
+      indexinfo.st_mtime = 0;
+
+    temp = NULL;
+
+    while (fgets(line, sizeof(line), fp))
+    {
+      // Lines are "product #%info"...
+      if ((ptr = strchr(line, ' ')) == NULL || strncmp(ptr + 1, "#%", 2))
+        continue;
+
+      *ptr++ = '\0';
+
+      if (!temp || strcmp(temp->product, line))
+      {
+	temp       = gui_add_dist(&NumInstalled, &Installed);
+	temp->type = PACKAGE_PORTABLE;
+
+	strncpy(temp->product, line, sizeof(temp->product) - 1);
+      }
+
+      // Drop the trailing newline...
+      ptr[strlen(ptr) - 1] = '\0';
+
+      gui_add_info(temp, ptr);
+    }
+
+    fclose(fp);
+  }
+
+  num_indexed = NumInstalled;
+
+  if ((present = (char *)calloc((size_t)num_indexed + 1, 1)) == NULL)
+  {
+    perror("setup: Unable to allocate memory");
+    exit(1);
+  }
+
   if ((num_files = fl_filename_list(EPM_SOFTWARE, &files)) > 0)
   {
-    // Build a distribution list...
+    if ((current = (char *)calloc((size_t)num_files, 1)) == NULL)
+    {
+      perror("setup: Unable to allocate memory");
+      exit(1);
+    }
+
+    // Find the .remove scripts that are in the inventory...
     for (i = 0; i < num_files; i ++)
     {
       ext = fl_filename_ext(files[i]->d_name);
 
       if (!strcmp(ext, ".remove"))
       {
-	// Found a .remove script...
+	strlcpy(product, files[i]->d_name, sizeof(product));
+	*strrchr(product, '.') = '\0';	// Drop .remove
+
 	snprintf(line, sizeof(line), EPM_SOFTWARE "/%s", files[i]->d_name);
-	if ((fp = fopen(line, "r")) == NULL)
+
+        if ((temp = gui_find_dist(product, num_indexed, Installed)) != NULL &&
+	    !stat(line, &fileinfo) && fileinfo.st_mtime <= indexinfo.st_mtime)
 	{
-          perror("setup: Unable to open removal script");
-	  exit(1);
+	  present[temp - Installed] = 1;
+	  current[i]                = 1;
 	}
+      }
+    }
+
+    // Then read any other .remove scripts...
+    for (i = 0; i < num_files; i ++)
+    {
+      ext = fl_filename_ext(files[i]->d_name);
 
+      if (!strcmp(ext, ".remove") && !current[i])
+      {
 	// Add a new distribution entry...
 	temp       = gui_add_dist(&NumInstalled, &Installed);
         temp->type = PACKAGE_PORTABLE;
@@ -164,51 +440,143 @@ gui_get_installed(void)
 	*strrchr(temp->product, '.') = '\0';	// Drop .remove
 
 	// Read info from the removal script...
-	while (fgets(line, sizeof(line), fp))
-	{
-          // Only read distribution info lines...
-          if (strncmp(line, "#%", 2))
-	    continue;
-
-          // Drop the trailing newline...
-          line[strlen(line) - 1] = '\0';
-
-          // Copy data as needed...
-	  if (!strncmp(line, "#%product ", 10))
-	    strncpy(temp->name, line + 10, sizeof(temp->name) - 1);
-	  else if (!strncmp(line, "#%version ", 10))
-	    sscanf(line + 10, "%31s%d", temp->version, &(temp->vernumber));
-	  else if (!strncmp(line, "#%rootsize ", 11))
-	    temp->rootsize = atoi(line + 11);
-	  else if (!strncmp(line, "#%usrsize ", 10))
-	    temp->usrsize = atoi(line + 10);
-	}
-
-	fclose(fp);
+	snprintf(line, sizeof(line), EPM_SOFTWARE "/%s", files[i]->d_name);
+	gui_read_header(temp, line);
       }
 
       free(files[i]);
     }
 
     free(files);
+    free(current);
   }
 
-  // Get a list of RPM packages that are installed...
-  if (!access("/bin/rpm", 0) &&
-      (fp = popen("/bin/rpm -qa --qf "
-                  "'%{NAME}|%{VERSION}|%{SIZE}|%{SUMMARY}\\n'", "r")) != NULL)
+  // Remove inventory entries for software that is no longer installed...
+  for (i = 0, j = 0; i < NumInstalled; i ++)
   {
-    char	*version,		// Version number
+    if (i < num_indexed && !present[i])
+    {
+      free(Installed[i].depends);
+      free(Installed[i].spaces);
+      continue;
+    }
+
+    if (i != j)
+      Installed[j] = Installed[i];
+
+    j ++;
+  }
+
+  NumInstalled = j;
+
+  free(present);
+
+  if (NumInstalled > 1)
+    qsort(Installed, NumInstalled, sizeof(gui_dist_t),
+          (compare_func_t)gui_sort_dists);
+
+  gui_changed_dists();
+}
+
+
+//
+// 'gui_get_installed_rpms()' - Get a list of installed RPM packages.
+//
+// Only the named distributions and the products they depend on are looked
+// up, unless "d" is NULL in which case all installed RPM packages are loaded.
+//
+
+void
+gui_get_installed_rpms(int        num_d,	// I - Number of distributions
+                       gui_dist_t *d)		// I - Distributions or NULL
+{
+  int		i, j;			// Looping vars
+  gui_depend_t	*depend;		// Current dependency
+  const char	*product;		// Product name
+  int		num_names;		// Number of names to look up
+  char		*command,		// rpm command
+		*cmdptr;		// Pointer into command
+  size_t	cmdsize;		// Size of command
+  gui_dist_t	*temp;			// Pointer to current distribution
+  FILE		*fp;			// File to read from
+  char		line[1024],		// Line from file...
+		*version,		// Version number
 		*size,			// Size of package
 		*description;		// Summary string
 
 
+  if (access("/bin/rpm", 0))
+    return;
+
+  // Build the rpm command...
+  cmdsize = 80;
+
+  if (d)
+  {
+    for (i = 0; i < num_d; i ++)
+    {
+      cmdsize += strlen(d[i].product) + 3;
+
+      for (j = 0; j < d[i].num_depends; j ++)
+        cmdsize += strlen(d[i].depends[j].product) + 3;
+    }
+  }
+
+  if ((command = (char *)malloc(cmdsize)) == NULL)
+  {
+    perror("setup: Unable to allocate memory");
+    exit(1);
+  }
+
+  strcpy(command, d ? "/bin/rpm -q" : "/bin/rpm -qa");
+  strcat(command, " --qf '%{NAME}|%{VERSION}|%{SIZE}|%{SUMMARY}\\n'");
+  cmdptr    = command + strlen(command);
+  num_names = 0;
+
+  for (i = 0; d && i < num_d; i ++)
+  {
+    for (j = -1, depend = d[i].depends; j < d[i].num_depends; j ++)
+    {
+      if (j < 0)
+        product = d[i].product;
+      else
+        product = (depend ++)->product;
+
+      // Skip files, names rpm can't have, installed portable products, and
+      // duplicates...
+      if (product[0] == '/' || !product[0] || strchr(product, '\'') ||
+          gui_find_dist(product, NumInstalled, Installed))
+        continue;
+
+      snprintf(cmdptr, cmdsize - (size_t)(cmdptr - command), " '%s'", product);
+
+      if (strstr(command, cmdptr) != cmdptr)
+      {
+        *cmdptr = '\0';
+        continue;
+      }
+
+      cmdptr += strlen(cmdptr);
+      num_names ++;
+    }
+  }
+
+  if (d && num_names == 0)
+  {
+    free(command);
+    return;
+  }
+
+  // Get the RPM packages that are installed...
+  if ((fp = popen(command, "r")) != NULL)
+  {
     while (fgets(line, sizeof(line), fp))
     {
       // Drop the trailing newline...
       line[strlen(line) - 1] = '\0';
 
-      // Grab the different fields...
+      // Grab the different fields; "package foo is not installed" lines are
+      // skipped...
       if ((version = strchr(line, '|')) == NULL)
         continue;
       *version++ = '\0';
@@ -235,9 +603,13 @@ gui_get_installed(void)
     pclose(fp);
   }
 
+  free(command);
+
   if (NumInstalled > 1)
     qsort(Installed, NumInstalled, sizeof(gui_dist_t),
           (compare_func_t)gui_sort_dists);
+
+  gui_changed_dists();
 }
 
 
@@ -331,3 +703,173 @@ gui_sort_dists(const gui_dist_t *d0,	// I - First distribution
 {
   return (strcmp(d0->name, d1->name));
 }
+
+
+//
+// 'gui_start_progress()' - Start tracking install or removal progress.
+//
+
+void
+gui_start_progress(gui_progress_t *p,	// I - Progress
+                   long long      total,	// I - Total bytes or files
+		   int            use_files)	// I - Count files instead of bytes?
+{
+  memset(p, 0, sizeof(gui_progress_t));
+
+  p->use_files = use_files;
+  p->total     = total;
+  p->start     = gui_time();
+}
+
+
+//
+// 'gui_update_progress()' - Update progress from a line of script output.
+//
+// The install and removal scripts write "#%progress phase bytes files"
+// records when the EPM_PROGRESS environment variable is set.  Other lines
+// are left alone so they can be added to the log.
+//
+
+int					// O - 1 if the line was a progress record
+gui_update_progress(gui_progress_t *p,	// I - Progress
+                    const char     *line)	// I - Line from script
+{
+  char		phase[32];		// Phase
+  long long	bytes;			// Bytes done
+  int		files;			// Files done
+
+
+  if (strncmp(line, "#%progress ", 11))
+    return (0);
+
+  if (sscanf(line + 11, "%31s%lld%d", phase, &bytes, &files) == 3)
+  {
+    strlcpy(p->phase, phase, sizeof(p->phase));
+
+    p->done += p->use_files ? files : bytes;
+  }
+
+  return (1);
+}
+
+
+//
+// 'gui_hash_name()' - Compute the hash for a product name.
+//
+
+static unsigned				// O - Hash value
+gui_hash_name(const char *name)		// I - Product name
+{
+  unsigned	hash;			// Hash value
+
+
+  for (hash = 5381; *name; name ++)
+    hash = hash * 33 + (unsigned char)*name;
+
+  return (hash);
+}
+
+
+//
+// 'gui_index_dists()' - Build a hash index for distributions.
+//
+
+static void
+gui_index_dists(gui_index_t      *index,	// I - Hash index
+                int              num_d,		// I - Number of distributions
+		const gui_dist_t *d)		// I - Distributions
+{
+  int		i;			// Looping var
+  int		slot;			// Current slot
+  int		num_slots;		// Number of slots
+  unsigned	hash;			// Hash of product name
+
+
+  for (num_slots = 64; num_slots < 2 * num_d; num_slots *= 2);
+
+  if (num_slots != index->num_slots)
+  {
+    free(index->slots);
+    free(index->hashes);
+
+    index->num_slots = num_slots;
+    index->slots     = (int *)malloc((size_t)num_slots * sizeof(int));
+    index->hashes    = (unsigned *)malloc((size_t)num_slots * sizeof(unsigned));
+
+    if (!index->slots || !index->hashes)
+    {
+      perror("setup: Unable to allocate memory");
+      exit(1);
+    }
+  }
+
+  index->d          = d;
+  index->num_d      = num_d;
+  index->generation = Generation;
+
+  for (slot = 0; slot < num_slots; slot ++)
+    index->slots[slot] = -1;
+
+  for (i = 0; i < num_d; i ++)
+  {
+    hash = gui_hash_name(d[i].product);
+
+    for (slot = (int)(hash & (unsigned)(num_slots - 1));
+         index->slots[slot] >= 0;
+	 slot = (slot + 1) & (num_slots - 1));
+
+    index->slots[slot]  = i;
+    index->hashes[slot] = hash;
+  }
+}
+
+
+//
+// 'gui_read_header()' - Read the "#%" header lines of a script.
+//
+
+static void
+gui_read_header(gui_dist_t *d,		// I - Distribution
+                const char *filename)	// I - Script filename
+{
+  FILE	*fp;				// Script file
+  char	line[1024];			// Line from file
+
+
+  if ((fp = fopen(filename, "r")) == NULL)
+  {
+    perror("setup: Unable to open removal script");
+    exit(1);
+  }
+
+  // The header ends with the first line that isn't a comment...
+  while (fgets(line, sizeof(line), fp) && line[0] == '#')
+  {
+    // Only read distribution info lines...
+    if (strncmp(line, "#%", 2))
+      continue;
+
+    // Drop the trailing newline...
+    line[strlen(line) - 1] = '\0';
+
+    gui_add_info(d, line);
+  }
+
+  fclose(fp);
+}
+
+
+//
+// 'gui_time()' - Get the current time in seconds.
+//
+
+static double				// O - Time in seconds
+gui_time(void)
+{
+  struct timeval	curtime;	// Current time
+
+
+  gettimeofday(&curtime, NULL);
+
+  return (curtime.tv_sec + 0.000001 * curtime.tv_usec);
+}
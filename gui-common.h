@@ -51,9 +51,20 @@ struct gui_dist_t			//// Distributions
   gui_depend_t	*depends;		// Dependencies
   int		rootsize,		// Size of root partition files in kbytes
 		usrsize;		// Size of /usr partition files in kbytes
+  int		num_spaces;		// Number of destination directories
+  space_t	*spaces;		// Space needed in destination directories
   char		*filename;		// Name of package file
 };
 
+struct gui_progress_t			//// Install or removal progress
+{
+  int		use_files;		// Count files instead of bytes?
+  double	start;			// Start time in seconds
+  long long	total,			// Total bytes or files
+		done;			// Bytes or files done
+  char		phase[32];		// Current phase
+};
+
 struct gui_intype_t			//// Installation types
 {
   char		name[80];		// Type name
@@ -98,9 +109,18 @@ VAR gui_intype_t	InstTypes[8];	// Installation types
 void		gui_add_depend(gui_dist_t *d, int type, const char *name,
 		               int lowver, int hiver);
 gui_dist_t	*gui_add_dist(int *num_d, gui_dist_t **d);
+void		gui_add_info(gui_dist_t *d, const char *line);
+void		gui_add_space(gui_dist_t *d, const char *line);
+void		gui_changed_dists(void);
 gui_dist_t	*gui_find_dist(const char *name, int num_d, gui_dist_t *d);
+double		gui_format_progress(const gui_progress_t *p, const char *title,
+		                    char *buffer, size_t bufsize);
 void		gui_get_installed(void);
+void		gui_get_installed_rpms(int num_d, gui_dist_t *d);
 void		gui_load_file(Fl_Help_View *hv, const char *filename);
 int		gui_sort_dists(const gui_dist_t *d0, const gui_dist_t *d1);
+void		gui_start_progress(gui_progress_t *p, long long total,
+		                   int use_files);
+int		gui_update_progress(gui_progress_t *p, const char *line);
 
 #endif // !_GUI_COMMON_H_
@@ -0,0 +1,454 @@
+/*
+ * User and group ID functions for the ESP Package Manager (EPM).
+ *
+ * Copyright 2020 by Michael R Sweet
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "epm.h"
+
+
+/*
+ * Local types...
+ */
+
+typedef struct				/**** Name/ID pair ****/
+{
+  char		*name;			/* User or group name */
+  unsigned	id;			/* User or group ID */
+  int		known;			/* 1 if the name has an ID */
+} ident_t;
+
+typedef struct				/**** Name/ID table ****/
+{
+  int		num_idents,		/* Number of pairs */
+		num_slots;		/* Number of hash slots */
+  ident_t	*idents,		/* Pairs */
+		**byname,		/* Pairs hashed by name */
+		**byid;			/* Pairs hashed by ID */
+} idtable_t;
+
+
+/*
+ * Local globals...
+ */
+
+static idtable_t	Users,		/* User names and IDs */
+			Groups;		/* Group names and IDs */
+
+
+/*
+ * Local functions...
+ */
+
+static ident_t	*add_ident(idtable_t *table, const char *name, unsigned id,
+		           int known);
+static ident_t	*find_id(idtable_t *table, unsigned id);
+static ident_t	*find_name(idtable_t *table, const char *name);
+static unsigned	hash_name(const char *name);
+static void	insert_ident(idtable_t *table, ident_t *ident);
+static int	load_table(idtable_t *table, const char *filename);
+static void	rehash_table(idtable_t *table);
+
+
+/*
+ * 'get_group_id()' - Get the ID for a group name.
+ *
+ * Names that are not in the snapshot or group database use the default ID.
+ */
+
+gid_t					/* O - Group ID */
+get_group_id(const char *name,		/* I - Group name */
+             gid_t      defid)		/* I - Default group ID */
+{
+  ident_t	*ident;			/* Name/ID pair */
+  struct group	*grp;			/* Group record */
+
+
+  if ((ident = find_name(&Groups, name)) == NULL)
+  {
+    grp = getgrnam(name);
+    endgrent();
+
+    ident = add_ident(&Groups, name, grp ? (unsigned)grp->gr_gid : 0, grp != NULL);
+  }
+
+  return (ident->known ? (gid_t)ident->id : defid);
+}
+
+
+/*
+ * 'get_group_name()' - Get the name for a group ID.
+ *
+ * IDs without a name are returned as a decimal string.
+ */
+
+const char *				/* O - Group name */
+get_group_name(gid_t gid)		/* I - Group ID */
+{
+  ident_t	*ident;			/* Name/ID pair */
+  struct group	*grp;			/* Group record */
+  char		name[16];		/* Numeric group name */
+
+
+  if ((ident = find_id(&Groups, (unsigned)gid)) == NULL)
+  {
+    if ((grp = getgrgid(gid)) != NULL)
+      ident = add_ident(&Groups, grp->gr_name, (unsigned)gid, 1);
+    else
+    {
+      snprintf(name, sizeof(name), "%u", (unsigned)gid);
+      ident = add_ident(&Groups, name, (unsigned)gid, 1);
+    }
+
+    endgrent();
+  }
+
+  return (ident->name);
+}
+
+
+/*
+ * 'get_user_id()' - Get the ID for a user name.
+ *
+ * Names that are not in the snapshot or password database use the default ID.
+ */
+
+uid_t					/* O - User ID */
+get_user_id(const char *name,		/* I - User name */
+            uid_t      defid)		/* I - Default user ID */
+{
+  ident_t	*ident;			/* Name/ID pair */
+  struct passwd	*pwd;			/* User record */
+
+
+  if ((ident = find_name(&Users, name)) == NULL)
+  {
+    pwd = getpwnam(name);
+    endpwent();
+
+    ident = add_ident(&Users, name, pwd ? (unsigned)pwd->pw_uid : 0, pwd != NULL);
+  }
+
+  return (ident->known ? (uid_t)ident->id : defid);
+}
+
+
+/*
+ * 'get_user_name()' - Get the name for a user ID.
+ *
+ * IDs without a name are returned as a decimal string.
+ */
+
+const char *				/* O - User name */
+get_user_name(uid_t uid)		/* I - User ID */
+{
+  ident_t	*ident;			/* Name/ID pair */
+  struct passwd	*pwd;			/* User record */
+  char		name[16];		/* Numeric user name */
+
+
+  if ((ident = find_id(&Users, (unsigned)uid)) == NULL)
+  {
+    if ((pwd = getpwuid(uid)) != NULL)
+      ident = add_ident(&Users, pwd->pw_name, (unsigned)uid, 1);
+    else
+    {
+      snprintf(name, sizeof(name), "%u", (unsigned)uid);
+      ident = add_ident(&Users, name, (unsigned)uid, 1);
+    }
+
+    endpwent();
+  }
+
+  return (ident->name);
+}
+
+
+/*
+ * 'load_ids()' - Load user and group names from snapshot files.
+ *
+ * The files use the /etc/passwd and /etc/group formats.  Names loaded
+ * from a snapshot take precedence over the local databases so that
+ * packages can be built for users and groups that only exist on the
+ * target system.  Either filename may be NULL.
+ */
+
+int					/* O - 0 on success, -1 on error */
+load_ids(const char *passwd,		/* I - Password file or NULL */
+         const char *group)		/* I - Group file or NULL */
+{
+  if (passwd && load_table(&Users, passwd))
+    return (-1);
+
+  if (group && load_table(&Groups, group))
+    return (-1);
+
+  return (0);
+}
+
+
+/*
+ * 'add_ident()' - Add a name/ID pair to a table.
+ */
+
+static ident_t *			/* O - New pair */
+add_ident(idtable_t  *table,		/* I - Table */
+          const char *name,		/* I - Name */
+          unsigned   id,		/* I - ID */
+	  int        known)		/* I - 1 if the ID is known */
+{
+  ident_t	*ident;			/* New pair */
+
+
+  if ((table->num_idents + 1) * 2 > table->num_slots)
+    rehash_table(table);
+
+  ident        = table->idents + table->num_idents;
+  ident->name  = strdup(name);
+  ident->id    = id;
+  ident->known = known;
+
+  if (!ident->name)
+  {
+    perror("epm: Out of memory allocating user and group names");
+    exit(1);
+  }
+
+  table->num_idents ++;
+
+  insert_ident(table, ident);
+
+  return (ident);
+}
+
+
+/*
+ * 'find_id()' - Find a pair by ID.
+ */
+
+static ident_t *			/* O - Pair or NULL */
+find_id(idtable_t *table,		/* I - Table */
+        unsigned  id)			/* I - ID */
+{
+  int		slot;			/* Current slot */
+  ident_t	*ident;			/* Current pair */
+
+
+  if (!table->num_slots)
+    return (NULL);
+
+  for (slot = (int)((id * 2654435761U) & (unsigned)(table->num_slots - 1));
+       (ident = table->byid[slot]) != NULL;
+       slot = (slot + 1) & (table->num_slots - 1))
+    if (ident->id == id)
+      return (ident);
+
+  return (NULL);
+}
+
+
+/*
+ * 'find_name()' - Find a pair by name.
+ */
+
+static ident_t *			/* O - Pair or NULL */
+find_name(idtable_t  *table,		/* I - Table */
+          const char *name)		/* I - Name */
+{
+  int		slot;			/* Current slot */
+  ident_t	*ident;			/* Current pair */
+
+
+  if (!table->num_slots)
+    return (NULL);
+
+  for (slot = (int)(hash_name(name) & (unsigned)(table->num_slots - 1));
+       (ident = table->byname[slot]) != NULL;
+       slot = (slot + 1) & (table->num_slots - 1))
+    if (!strcmp(ident->name, name))
+      return (ident);
+
+  return (NULL);
+}
+
+
+/*
+ * 'hash_name()' - Compute the hash for a name.
+ */
+
+static unsigned				/* O - Hash value */
+hash_name(const char *name)		/* I - Name */
+{
+  unsigned	hash;			/* Hash value */
+
+
+  for (hash = 5381; *name; name ++)
+    hash = hash * 33 + (unsigned char)*name;
+
+  return (hash);
+}
+
+
+/*
+ * 'insert_ident()' - Insert a pair into the hash slots.
+ *
+ * Only the first pair for an ID is used for ID lookups.
+ */
+
+static void
+insert_ident(idtable_t *table,		/* I - Table */
+             ident_t   *ident)		/* I - Pair */
+{
+  int		slot;			/* Current slot */
+
+
+  for (slot = (int)(hash_name(ident->name) & (unsigned)(table->num_slots - 1));
+       table->byname[slot];
+       slot = (slot + 1) & (table->num_slots - 1));
+
+  table->byname[slot] = ident;
+
+  if (!ident->known || find_id(table, ident->id))
+    return;
+
+  for (slot = (int)((ident->id * 2654435761U) & (unsigned)(table->num_slots - 1));
+       table->byid[slot];
+       slot = (slot + 1) & (table->num_slots - 1));
+
+  table->byid[slot] = ident;
+}
+
+
+/*
+ * 'load_table()' - Load names and IDs from a password or group file.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+load_table(idtable_t  *table,		/* I - Table */
+           const char *filename)	/* I - Password or group file */
+{
+  FILE		*fp;			/* File */
+  char		line[1024],		/* Line from file */
+		*name,			/* Name */
+		*idptr,			/* ID */
+		*ptr;			/* Pointer into line */
+  ident_t	*ident;			/* Existing pair */
+
+
+  if ((fp = fopen(filename, "r")) == NULL)
+  {
+    fprintf(stderr, "epm: Unable to open \"%s\": %s\n", filename,
+            strerror(errno));
+    return (-1);
+  }
+
+  while (fgets(line, sizeof(line), fp))
+  {
+   /*
+    * Lines look like "name:password:id:...", skip anything else...
+    */
+
+    if (line[0] == '#' || line[0] == '+' || line[0] == '-')
+      continue;
+
+    name = line;
+
+    if ((ptr = strchr(name, ':')) == NULL)
+      continue;
+
+    *ptr++ = '\0';
+
+    if ((ptr = strchr(ptr, ':')) == NULL)
+      continue;
+
+    idptr = ptr + 1;
+
+    if (!isdigit(*idptr & 255))
+      continue;
+
+    if ((ident = find_name(table, name)) != NULL)
+    {
+     /*
+      * Replace an earlier lookup; ID lookups use the first name...
+      */
+
+      ident->id    = (unsigned)strtoul(idptr, NULL, 10);
+      ident->known = 1;
+      rehash_table(table);
+    }
+    else
+      add_ident(table, name, (unsigned)strtoul(idptr, NULL, 10), 1);
+  }
+
+  fclose(fp);
+
+  return (0);
+}
+
+
+/*
+ * 'rehash_table()' - Grow the table as needed and rebuild the hash slots.
+ *
+ * The slot count is a power of 2 that is at least twice the number of
+ * pairs so that probe sequences stay short.
+ */
+
+static void
+rehash_table(idtable_t *table)		/* I - Table */
+{
+  int		i,			/* Looping var */
+		num_slots;		/* New number of slots */
+  ident_t	*ident,			/* Current pair */
+		*idents;		/* New pairs */
+
+
+  for (num_slots = table->num_slots ? table->num_slots : 64;
+       num_slots < (table->num_idents + 1) * 2;
+       num_slots *= 2);
+
+  if (num_slots != table->num_slots)
+  {
+    if ((idents = realloc(table->idents, (size_t)num_slots / 2 * sizeof(ident_t))) == NULL)
+    {
+      perror("epm: Out of memory allocating user and group names");
+      exit(1);
+    }
+
+    table->idents = idents;
+
+    free(table->byname);
+    free(table->byid);
+
+    table->num_slots = num_slots;
+    table->byname    = calloc((size_t)num_slots, sizeof(ident_t *));
+    table->byid      = calloc((size_t)num_slots, sizeof(ident_t *));
+
+    if (!table->byname || !table->byid)
+    {
+      perror("epm: Out of memory allocating user and group names");
+      exit(1);
+    }
+  }
+  else
+  {
+    memset(table->byname, 0, (size_t)num_slots * sizeof(ident_t *));
+    memset(table->byid, 0, (size_t)num_slots * sizeof(ident_t *));
+  }
+
+  for (i = 0, ident = table->idents; i < table->num_idents; i ++, ident ++)
+    insert_ident(table, ident);
+}
@@ -42,7 +42,10 @@ make_osx(int            format,		/* I - Format */
 	 struct utsname *platform,	/* I - Platform information */
 	 const char	*setup)		/* I - Setup GUI image */
 {
-  char		filename[1024];		/* Destination filename */
+  char		filename[1024],		/* Destination filename */
+		srcname[1024],		/* Package to put in the image */
+		dmgname[1024],		/* Disk image filename */
+		*argv[7];		/* hdiutil command */
 
 
   REF(platname);
@@ -63,6 +66,8 @@ make_osx(int            format,		/* I - Format */
   * Create a disk image of the package...
   */
 
+  stats_phase("archive");
+
   if (Verbosity)
     puts("Creating disk image...");
 
@@ -78,7 +83,18 @@ make_osx(int            format,		/* I - Format */
     strlcat(filename, platname, sizeof(filename));
   }
 
-  if (run_command(NULL, "hdiutil create -ov -srcfolder %s/%s.pkg %s/%s.dmg", directory, prodname, directory, filename))
+  snprintf(srcname, sizeof(srcname), "%s/%s.pkg", directory, prodname);
+  snprintf(dmgname, sizeof(dmgname), "%s/%s.dmg", directory, filename);
+
+  argv[0] = "hdiutil";
+  argv[1] = "create";
+  argv[2] = "-ov";
+  argv[3] = "-srcfolder";
+  argv[4] = srcname;
+  argv[5] = dmgname;
+  argv[6] = NULL;
+
+  if (run_argv(NULL, argv))
   {
     fputs("epm: Unable to create disk image.\n", stderr);
     return (1);
@@ -104,11 +120,15 @@ make_package(int        format,		/* I - Format */
   char		prodfull[1024],		/* Full product name */
 		title[1024],		/* Software title */
 		filename[1024],		/* Destination filename */
-		pkgname[1024];		/* Package name */
+		pkgname[1024],		/* Package name */
+		scripts[1024],		/* Scripts directory */
+		root[1024],		/* Package root directory */
+		*argv[16];		/* pkgbuild command */
+  int		argc;			/* Number of arguments */
   file_t	*file;			/* Current distribution file */
   command_t	*c;			/* Current command */
-  struct passwd	*pwd;			/* Pointer to user record */
-  struct group	*grp;			/* Pointer to group record */
+  uid_t		uid;			/* User ID */
+  gid_t		gid;			/* Group ID */
   char		current[1024];		/* Current directory */
   const char	*option;		/* Init script option */
 
@@ -126,6 +146,8 @@ make_package(int        format,		/* I - Format */
   * stuff...
   */
 
+  stats_phase("scripts");
+
   if (Verbosity)
     puts("Copying temporary resource files...");
 
@@ -199,6 +221,8 @@ make_package(int        format,		/* I - Format */
   * Copy the files over...
   */
 
+  stats_phase("stage");
+
   if (Verbosity)
     puts("Copying temporary distribution files...");
 
@@ -208,11 +232,8 @@ make_package(int        format,		/* I - Format */
     * Find the username and groupname IDs...
     */
 
-    pwd = getpwnam(file->user);
-    grp = getgrnam(file->group);
-
-    endpwent();
-    endgrent();
+    uid = get_user_id(file->user, 0);
+    gid = get_group_id(file->group, 0);
 
    /*
     * Copy the file or make the directory or make the symlink as needed...
@@ -232,8 +253,8 @@ make_package(int        format,		/* I - Format */
 	  if (Verbosity > 1)
 	    printf("%s -> %s...\n", file->src, filename);
 
-	  if (copy_file(filename, file->src, file->mode, pwd ? pwd->pw_uid : 0,
-			grp ? grp->gr_gid : 0))
+	  if (copy_file(filename, file->src, file->mode, uid, gid,
+			file))
 	    return (1);
           break;
       case 'i' :
@@ -244,8 +265,8 @@ make_package(int        format,		/* I - Format */
 	  if (Verbosity > 1)
 	    printf("%s -> %s...\n", file->src, filename);
 
-	  if (copy_file(filename, file->src, file->mode, pwd ? pwd->pw_uid : 0,
-			grp ? grp->gr_gid : 0))
+	  if (copy_file(filename, file->src, file->mode, uid, gid,
+			file))
 	    return (1);
 
           snprintf(filename, sizeof(filename),
@@ -308,7 +329,7 @@ make_package(int        format,		/* I - Format */
 	  if (Verbosity > 1)
 	    printf("Directory %s...\n", filename);
 
-          make_directory(filename, file->mode, pwd ? pwd->pw_uid : 0, grp ? grp->gr_gid : 0);
+          make_directory(filename, file->mode, uid, gid);
           break;
       case 'l' :
           if (!strncmp(file->dst, "/etc/", 5) || !strncmp(file->dst, "/var/", 5))
@@ -330,6 +351,8 @@ make_package(int        format,		/* I - Format */
   * Build the distribution...
   */
 
+  stats_phase("build");
+
   if (Verbosity)
     puts("Building macOS package...");
 
@@ -344,6 +367,22 @@ make_package(int        format,		/* I - Format */
 
   snprintf(pkgname, sizeof(pkgname), "%s/%s.pkg", filename, prodfull);
 
+  snprintf(scripts, sizeof(scripts), "%s/%s/Resources", directory, prodfull);
+  snprintf(root, sizeof(root), "%s/%s/Package", directory, prodfull);
+
+  argc          = 0;
+  argv[argc ++] = "/usr/bin/pkgbuild";
+  argv[argc ++] = "--identifier";
+  argv[argc ++] = prodfull;
+  argv[argc ++] = "--version";
+  argv[argc ++] = dist->version;
+  argv[argc ++] = "--ownership";
+  argv[argc ++] = "preserve";
+  argv[argc ++] = "--scripts";
+  argv[argc ++] = scripts;
+  argv[argc ++] = "--root";
+  argv[argc ++] = root;
+
   if (format == PACKAGE_MACOS_SIGNED)
   {
     const char *identity = getenv("EPM_SIGNING_IDENTITY");
@@ -354,13 +393,15 @@ make_package(int        format,		/* I - Format */
       identity = "Developer ID Installer";
     }
 
-    run_command(NULL, "/usr/bin/pkgbuild --identifier %s --version %s --ownership preserve --scripts %s/%s/Resources --root %s/%s/Package --sign '%s' %s", prodfull, dist->version, directory, prodfull, directory, prodfull, identity, pkgname);
-  }
-  else
-  {
-    run_command(NULL, "/usr/bin/pkgbuild --identifier %s --version %s --ownership preserve --scripts %s/%s/Resources --root %s/%s/Package %s", prodfull, dist->version, directory, prodfull, directory, prodfull, pkgname);
+    argv[argc ++] = "--sign";
+    argv[argc ++] = (char *)identity;
   }
 
+  argv[argc ++] = pkgname;
+  argv[argc]    = NULL;
+
+  run_argv(NULL, argv);
+
  /*
   * Verify that the package was created...
   */
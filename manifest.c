@@ -0,0 +1,420 @@
+/*
+ * Manifest functions for the ESP Package Manager (EPM).
+ *
+ * Copyright 2020 by Michael R Sweet
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "epm.h"
+
+
+/*
+ * Local types...
+ */
+
+typedef struct				/**** Previous manifest entry ****/
+{
+  int		type;			/* Type of file */
+  mode_t	mode;			/* Permissions of file */
+  long long	size;			/* Size of file */
+  int		used;			/* Still in the distribution? */
+  char		*user,			/* Owner of file */
+		*group,			/* Group of file */
+		*sha256,		/* SHA-256 digest of contents */
+		*subpackage,		/* Sub-package name */
+		*dst,			/* Destination path */
+		*link;			/* Link destination or "" */
+} entry_t;
+
+
+/*
+ * Local functions...
+ */
+
+static int	compare_entries(const void *a, const void *b);
+
+
+/*
+ * 'patch_dist()' - Mark the files that changed since a previous release.
+ *
+ * The files in the distribution are compared against the manifest from
+ * the previous release.  New and changed files, directories, and links
+ * are marked for the patch distribution, and files, links, config files,
+ * and init scripts that are no longer in the distribution are added with
+ * the "R" type so the patch script removes them.  The previous type of
+ * each removed file is kept in the source path and the digest of removed
+ * config files is kept so the patch script can leave changed config files
+ * alone.  Any patch types from the list file are ignored.
+ */
+
+int					/* O - 0 on success, -1 on failure */
+patch_dist(dist_t     *dist,		/* I - Distribution information */
+           const char *filename)	/* I - Previous manifest */
+{
+  int		i, j,			/* Looping vars */
+		num_entries,		/* Number of entries */
+		alloc_entries,		/* Allocated entries */
+		changed,		/* Number of changed files */
+		removed;		/* Number of removed files */
+  entry_t	*entries,		/* Previous manifest entries */
+		*entry,			/* Current entry */
+		key;			/* Search key */
+  file_t	*file;			/* Current file */
+  FILE		*fp;			/* Manifest file */
+  char		line[4096],		/* Line from manifest */
+		*fields[9],		/* Fields in line */
+		*ptr;			/* Pointer into line */
+  int		num_fields;		/* Number of fields */
+  struct stat	fileinfo;		/* File information */
+  int		same;			/* Is the file unchanged? */
+  const char	*subpackage;		/* Subpackage for removed file */
+
+
+ /*
+  * Read the previous manifest...
+  */
+
+  if ((fp = fopen(filename, "r")) == NULL)
+  {
+    fprintf(stderr, "epm: Unable to open manifest file \"%s\": %s\n",
+            filename, strerror(errno));
+    return (-1);
+  }
+
+  IOStats.files_read ++;
+
+  num_entries   = 0;
+  alloc_entries = 0;
+  entries       = NULL;
+
+  while (fgets(line, sizeof(line), fp))
+  {
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+
+    if ((ptr = strchr(line, '\n')) != NULL)
+      *ptr = '\0';
+
+    for (num_fields = 0, ptr = line; num_fields < 9 && ptr; num_fields ++)
+    {
+      fields[num_fields] = ptr;
+
+      if ((ptr = strchr(ptr, '\t')) != NULL)
+        *ptr++ = '\0';
+    }
+
+    if (num_fields < 8)
+    {
+      fprintf(stderr, "epm: Bad line in manifest file \"%s\": %s\n",
+              filename, line);
+      continue;
+    }
+
+    if (num_entries >= alloc_entries)
+    {
+      alloc_entries += 1024;
+
+      if ((entry = realloc(entries, (size_t)alloc_entries *
+                                    sizeof(entry_t))) == NULL)
+      {
+        perror("epm: Out of memory reading manifest");
+	exit(1);
+      }
+
+      entries = entry;
+    }
+
+    entry = entries + num_entries;
+    num_entries ++;
+
+    entry->type       = tolower(fields[0][0] & 255);
+    entry->mode       = (mode_t)strtol(fields[1], NULL, 8);
+    entry->size       = strtoll(fields[4], NULL, 10);
+    entry->used       = 0;
+    entry->user       = strdup(fields[2]);
+    entry->group      = strdup(fields[3]);
+    entry->sha256     = strdup(fields[5]);
+    entry->subpackage = strdup(fields[6]);
+    entry->dst        = strdup(fields[7]);
+    entry->link       = strdup(num_fields > 8 ? fields[8] : "");
+  }
+
+  fclose(fp);
+
+  if (num_entries > 1)
+    qsort(entries, (size_t)num_entries, sizeof(entry_t), compare_entries);
+
+ /*
+  * Compare the files in the distribution...
+  */
+
+  changed = 0;
+
+  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
+  {
+    if (file->type == 'R')
+      continue;
+
+    key.dst = file->dst;
+
+    if (num_entries > 0 &&
+        (entry = bsearch(&key, entries, (size_t)num_entries, sizeof(entry_t),
+	                 compare_entries)) != NULL)
+    {
+      entry->used = 1;
+
+      same = entry->type == tolower(file->type) && entry->mode == file->mode &&
+             !strcmp(entry->user, file->user) &&
+	     !strcmp(entry->group, file->group);
+    }
+    else
+      same = 0;
+
+    switch (tolower(file->type))
+    {
+      case 'c' :
+      case 'f' :
+      case 'i' :
+          if (!same)
+	    break;
+
+          IOStats.stat_calls ++;
+
+          if (stat(file->src, &fileinfo))
+	  {
+	    fprintf(stderr, "epm: Unable to stat \"%s\": %s\n", file->src,
+	            strerror(errno));
+	    same = 0;
+	  }
+	  else if (entry->size != (long long)fileinfo.st_size)
+	    same = 0;
+	  else if (!file->sha256[0] && digest_file(file))
+	    same = 0;
+	  else
+	    same = !strcmp(entry->sha256, file->sha256);
+	  break;
+
+      case 'l' :
+          if (same)
+	    same = !strcmp(entry->link, file->src);
+	  break;
+    }
+
+    if (same)
+      file->type = tolower(file->type);
+    else
+    {
+      file->type = toupper(file->type);
+      changed ++;
+
+      if (Verbosity > 1)
+        printf("Changed: %s\n", file->dst);
+    }
+  }
+
+ /*
+  * Remove files that are no longer in the distribution...
+  */
+
+  removed = 0;
+
+  for (i = num_entries, entry = entries; i > 0; i --, entry ++)
+  {
+    if (!entry->used && entry->type != 'd')
+    {
+      for (j = 0, subpackage = NULL; j < dist->num_subpackages; j ++)
+        if (!strcmp(dist->subpackages[j], entry->subpackage))
+	{
+	  subpackage = dist->subpackages[j];
+	  break;
+	}
+
+      file = add_file(dist, subpackage);
+
+      file->type = 'R';
+      file->mode = entry->mode;
+      strlcpy(file->user, entry->user, sizeof(file->user));
+      strlcpy(file->group, entry->group, sizeof(file->group));
+      strlcpy(file->dst, entry->dst, sizeof(file->dst));
+      file->src[0]     = (char)entry->type;
+      file->src[1]     = '\0';
+      file->options[0] = '\0';
+      file->md5[0]     = '\0';
+
+      if (entry->type == 'c' && strlen(entry->sha256) == 64)
+        strlcpy(file->sha256, entry->sha256, sizeof(file->sha256));
+      else
+        file->sha256[0] = '\0';
+
+      removed ++;
+
+      if (Verbosity > 1)
+        printf("Removed: %s\n", entry->dst);
+    }
+
+    free(entry->user);
+    free(entry->group);
+    free(entry->sha256);
+    free(entry->subpackage);
+    free(entry->dst);
+    free(entry->link);
+  }
+
+  free(entries);
+
+  if (Verbosity)
+    printf("Patch contains %d changed and %d removed files.\n", changed,
+           removed);
+
+ /*
+  * Re-sort and index the files...
+  */
+
+  sort_dist_files(dist);
+
+  return (0);
+}
+
+
+/*
+ * 'write_manifest()' - Write a manifest of the files in a distribution.
+ *
+ * The manifest contains one tab-delimited line per file:
+ *
+ *     type mode user group size sha256 subpackage dst [link]
+ *
+ * Digests computed while the files were staged or archived are reused;
+ * any remaining files are read once to compute them.
+ */
+
+int					/* O - 0 on success, -1 on failure */
+write_manifest(const char *prodname,	/* I - Product short name */
+               const char *directory,	/* I - Directory for distribution files */
+               const char *platname,	/* I - Platform name */
+               dist_t     *dist)	/* I - Distribution information */
+{
+  int		i;			/* Looping var */
+  file_t	*file;			/* Current file */
+  FILE		*fp;			/* Manifest file */
+  char		filename[1024];		/* Manifest filename */
+  struct stat	fileinfo;		/* File information */
+
+
+ /*
+  * Create the manifest file...
+  */
+
+  if (dist->release[0])
+    snprintf(filename, sizeof(filename), "%s/%s-%s-%s", directory, prodname,
+             dist->version, dist->release);
+  else
+    snprintf(filename, sizeof(filename), "%s/%s-%s", directory, prodname,
+             dist->version);
+
+  if (platname[0])
+  {
+    strlcat(filename, "-", sizeof(filename));
+    strlcat(filename, platname, sizeof(filename));
+  }
+
+  strlcat(filename, ".manifest", sizeof(filename));
+
+  if (Verbosity)
+    printf("Writing manifest %s...\n", filename);
+
+  if ((fp = fopen(filename, "w")) == NULL)
+  {
+    fprintf(stderr, "epm: Unable to create manifest file \"%s\": %s\n",
+            filename, strerror(errno));
+    return (-1);
+  }
+
+  fprintf(fp, "# %s %s", dist->product, dist->version);
+  if (dist->release[0])
+    fprintf(fp, "-%s", dist->release);
+  fputs("\n", fp);
+
+ /*
+  * Write the files...
+  */
+
+  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
+  {
+    switch (tolower(file->type))
+    {
+      case 'c' :
+      case 'f' :
+      case 'i' :
+          IOStats.stat_calls ++;
+
+          if (stat(file->src, &fileinfo))
+	  {
+	    fprintf(stderr, "epm: Unable to stat \"%s\": %s\n", file->src,
+	            strerror(errno));
+	    fclose(fp);
+	    unlink(filename);
+	    return (-1);
+	  }
+
+          if (digest_file(file))
+	  {
+	    fclose(fp);
+	    unlink(filename);
+	    return (-1);
+	  }
+
+          fprintf(fp, "%c\t%04o\t%s\t%s\t%lld\t%s\t%s\t%s\n", file->type,
+	          (unsigned)file->mode, file->user, file->group,
+		  (long long)fileinfo.st_size, file->sha256,
+		  file->subpackage ? file->subpackage : "-", file->dst);
+	  break;
+
+      case 'd' :
+          fprintf(fp, "%c\t%04o\t%s\t%s\t0\t-\t%s\t%s\n", file->type,
+	          (unsigned)file->mode, file->user, file->group,
+		  file->subpackage ? file->subpackage : "-", file->dst);
+	  break;
+
+      case 'l' :
+          fprintf(fp, "%c\t%04o\t%s\t%s\t0\t-\t%s\t%s\t%s\n", file->type,
+	          (unsigned)file->mode, file->user, file->group,
+		  file->subpackage ? file->subpackage : "-", file->dst,
+		  file->src);
+	  break;
+    }
+  }
+
+  if (fclose(fp))
+  {
+    fprintf(stderr, "epm: Unable to write manifest file \"%s\": %s\n",
+            filename, strerror(errno));
+    return (-1);
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'compare_entries()' - Compare the destinations of two manifest entries.
+ */
+
+static int				/* O - Result of comparison */
+compare_entries(const void *a,		/* I - First entry */
+                const void *b)		/* I - Second entry */
+{
+  return (strcmp(((const entry_t *)a)->dst, ((const entry_t *)b)->dst));
+}
@@ -17,48 +17,157 @@
  */
 
 #include "epm.h"
+#include <fcntl.h>
+#include <fnmatch.h>
+#ifdef HAVE_PTHREAD_H
+#  include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
 
 
 /*
- * Lookup hash table structure...
+ * File list structures...
  */
 
-#define HASH_M 101
+typedef struct				/**** File list entry ****/
+{
+  char		type;			/* Type of file ('d', 'f', or 'l') */
+  mode_t	mode;			/* Permissions */
+  uid_t		uid;			/* Owner */
+  gid_t		gid;			/* Group */
+  char		*dst,			/* Destination path */
+		*src,			/* Source path */
+		*link,			/* Link destination */
+		*options;		/* File options */
+  int		keep;			/* Keep existing list entry? */
+  dev_t		dev;			/* Device number */
+  ino_t		ino;			/* Inode number */
+  time_t	mtime;			/* Modification time */
+  off_t		size;			/* Size */
+} entry_t;
+
+typedef struct				/**** Array of entries ****/
+{
+  size_t	num_entries,		/* Number of entries */
+		alloc_entries;		/* Allocated entries */
+  entry_t	*entries;		/* Entries */
+} list_t;
+
+typedef struct				/**** Path pattern ****/
+{
+  int		type;			/* File type for rules */
+  int		dirs;			/* Only match directories? */
+  char		*pattern,		/* Pattern */
+		*options;		/* File options for rules */
+} pattern_t;
+
+typedef struct				/**** Array of patterns ****/
+{
+  int		num_patterns;		/* Number of patterns */
+  pattern_t	*patterns;		/* Patterns */
+} patterns_t;
+
+typedef struct dir_s			/**** Directory to scan ****/
+{
+  struct dir_s	*next;			/* Next directory */
+  char		*src,			/* Source path */
+		*dst;			/* Destination path */
+  int		changed;		/* Has the directory changed? */
+} dir_t;
 
-struct node
+typedef struct				/**** Cached file information ****/
 {
-  unsigned	id;			/* User or group ID */
-  char		*name;			/* User or group name */
-};
+  int		type,			/* Type of entry ('r' for scanned directories) */
+		hashed;			/* Does the list entry have a digest? */
+  unsigned long long dev,		/* Device number */
+		ino;			/* Inode number */
+  long long	mtime,			/* Modification time */
+		size;			/* Size */
+  unsigned	mode,			/* Permissions */
+		uid,			/* Owner */
+		gid;			/* Group */
+  char		*src,			/* Source path */
+		*dst;			/* Destination path in list */
+} snap_t;
+
+typedef struct				/**** Lines of a list file ****/
+{
+  size_t	num_lines,		/* Number of lines */
+		alloc_lines;		/* Allocated lines */
+  char		**text,			/* Text of lines */
+		**dsts;			/* Destination paths of file lines */
+  int		reset[4];		/* Reset %system, etc. for new files? */
+} lines_t;
 
 
 /*
  * Globals...
  */
 
+int		Verbosity = 0;		/* Be verbose? */
 char		*DefaultUser = NULL,	/* Default user for entries */
 		*DefaultGroup = NULL;	/* Default group for entries */
-struct node	Users[HASH_M];		/* Hash table for users */
-struct node	Groups[HASH_M];		/* Hash table for groups */
+list_t		Files;			/* Files found so far */
+dir_t		*Dirs = NULL;		/* Directories to scan */
+patterns_t	Excludes,		/* Paths to exclude */
+		Includes,		/* Files to include */
+		Rules;			/* Type and option rules */
+snap_t		*Snaps = NULL;		/* Cached file information */
+size_t		NumSnaps = 0;		/* Number of cached files */
+time_t		SnapTime = 0;		/* Time of cached information */
+int		Hash = 0,		/* Add SHA-256 digests of files? */
+		Walkers = 0,		/* Number of busy directory walkers */
+		WalkError = 0;		/* Did a walker fail? */
+#ifdef HAVE_PTHREAD_H
+pthread_mutex_t	WalkMutex = PTHREAD_MUTEX_INITIALIZER;
+					/* Mutex for walker state */
+pthread_cond_t	WalkCond = PTHREAD_COND_INITIALIZER;
+					/* Condition for walker state */
+#endif /* HAVE_PTHREAD_H */
 
 
 /*
  * Functions...
  */
 
-char		*get_group(gid_t gid);
-char		*get_user(uid_t uid);
-void		hash_deinit(struct node *a);
-unsigned	hash_id(unsigned id);
-void		hash_init(struct node *a);
-char		*hash_insert(struct node *a, unsigned id,
-		             const char *name);
-char		*hash_search(struct node *a, unsigned id);
+int		add_dir(dir_t **dirs, const char *src, const char *dst,
+		        int changed);
+entry_t		*add_entry(list_t *list, int type, struct stat *info,
+		          const char *dst, const char *src,
+			  const char *options);
+int		add_pattern(patterns_t *patterns, int type,
+		            const char *pattern, const char *options);
+int		add_rule(const char *rule);
+int		compare_entries(const entry_t *a, const entry_t *b);
+int		compare_files(const file_t *a, const file_t *b);
+int		compare_snaps(const snap_t *a, const snap_t *b);
+file_t		*find_file(dist_t *dist, const char *dst);
+snap_t		*find_snap(const char *src, int first);
+void		free_lines(lines_t *lines);
+char		*get_field(char **src, char *dst, size_t dstsize);
+const char	*get_group(gid_t gid);
+const char	*get_user(uid_t uid);
+int		hash_file(int dirfd, const char *src, char *sha256);
 void		info(void);
-int		process_dir(const char *srcpath, const char *dstpath);
-int		process_file(const char *src, const char *dstpath);
+int		in_scan(file_t *file, entry_t *root);
+pattern_t	*match_pattern(patterns_t *patterns, const char *dst,
+		               int isdir);
+int		process_dir(const char *srcpath, const char *dstpath,
+		            int changed, list_t *list, dir_t **dirs);
+int		process_file(int dirfd, const char *src, const char *dstpath,
+		             list_t *list, dir_t **dirs);
 char		*quote_string(char *q, const char *s, size_t qsize);
+int		read_list(const char *listname, lines_t *lines,
+		          dist_t *dist);
+int		read_rules(const char *filename);
+int		read_snaps(const char *listname);
+int		same_snap(snap_t *snap, struct stat *info);
+void		update_file(file_t *file, entry_t *entry);
+int		update_list(const char *listname, time_t snaptime);
 void		usage(void);
+void		*walk_dirs(void *data);
+void		write_file(FILE *fp, file_t *file);
+int		write_snaps(const char *listname, dist_t *dist,
+		            time_t snaptime);
 
 
 /*
@@ -70,29 +179,58 @@ main(int  argc,			/* I - Number of command-line arguments */
      char *argv[])		/* I - Command-line arguments */
 {
   int		i;		/* Looping var */
+  size_t	j;		/* Looping var */
+  entry_t	*entry;		/* Current entry */
+  int		num_walkers;	/* Number of directory walkers */
+#ifdef HAVE_PTHREAD_H
+  pthread_t	walkers[64];	/* Directory walker threads */
+#endif /* HAVE_PTHREAD_H */
   const char	*prefix,	/* Installation prefix */
-		*dstpath;	/* Destination path  */
+		*dstpath,	/* Destination path  */
+		*listname;	/* List file to update */
+  time_t	snaptime;	/* Time of scan */
+  snap_t	*snap;		/* Cached file information */
   char		dst[1024],	/* Destination */
+		qdst[1024],	/* Quoted destination */
+		qsrc[1024],	/* Quoted source/link */
+		qoptions[1024],	/* Quoted options */
 		*ptr;		/* Pointer into filename */
   struct stat	info;		/* File information */
 
 
- /*
-  * Initialize the hash tables...
-  */
-
-  hash_init(Users);
-  hash_init(Groups);
-
  /*
   * Loop through the command-line arguments, processing directories as
   * needed...
   */
 
-  prefix = NULL;
+  prefix      = NULL;
+  listname    = NULL;
+  num_walkers = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+  if ((num_walkers = (int)sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+    num_walkers = 1;
+#endif /* _SC_NPROCESSORS_ONLN */
 
   for (i = 1; i < argc; i ++)
-    if (strcmp(argv[i], "-u") == 0)
+    if (strcmp(argv[i], "-j") == 0)
+    {
+     /*
+      * -j jobs
+      */
+
+      i ++;
+
+      if (i >= argc)
+	usage();
+
+      if ((num_walkers = atoi(argv[i])) < 1)
+      {
+        fprintf(stderr, "Bad number of jobs \"%s\"!\n", argv[i]);
+	usage();
+      }
+    }
+    else if (strcmp(argv[i], "-u") == 0)
     {
      /*
       * -u username
@@ -118,6 +256,34 @@ main(int  argc,			/* I - Number of command-line arguments */
 
       DefaultGroup = argv[i];
     }
+    else if (strcmp(argv[i], "--group-file") == 0)
+    {
+     /*
+      * --group-file filename
+      */
+
+      i ++;
+
+      if (i >= argc)
+	usage();
+
+      if (load_ids(NULL, argv[i]))
+        return (1);
+    }
+    else if (strcmp(argv[i], "--passwd-file") == 0)
+    {
+     /*
+      * --passwd-file filename
+      */
+
+      i ++;
+
+      if (i >= argc)
+	usage();
+
+      if (load_ids(argv[i], NULL))
+        return (1);
+    }
     else if (strcmp(argv[i], "--prefix") == 0)
     {
       i ++;
@@ -127,6 +293,86 @@ main(int  argc,			/* I - Number of command-line arguments */
 
       prefix = argv[i];
     }
+    else if (strcmp(argv[i], "--exclude") == 0)
+    {
+     /*
+      * --exclude pattern
+      */
+
+      i ++;
+
+      if (i >= argc)
+	usage();
+
+      if (add_pattern(&Excludes, 0, argv[i], NULL))
+        return (1);
+    }
+    else if (strcmp(argv[i], "--hash") == 0)
+    {
+     /*
+      * --hash
+      */
+
+      Hash = 1;
+    }
+    else if (strcmp(argv[i], "--include") == 0)
+    {
+     /*
+      * --include pattern
+      */
+
+      i ++;
+
+      if (i >= argc)
+	usage();
+
+      if (add_pattern(&Includes, 0, argv[i], NULL))
+        return (1);
+    }
+    else if (strcmp(argv[i], "--rule") == 0)
+    {
+     /*
+      * --rule "type pattern [options]"
+      */
+
+      i ++;
+
+      if (i >= argc)
+	usage();
+
+      if (add_rule(argv[i]))
+        return (1);
+    }
+    else if (strcmp(argv[i], "--update") == 0)
+    {
+     /*
+      * --update filename.list
+      */
+
+      i ++;
+
+      if (i >= argc)
+	usage();
+
+      listname = argv[i];
+
+      if (read_snaps(listname))
+        return (1);
+    }
+    else if (strcmp(argv[i], "--rules") == 0)
+    {
+     /*
+      * --rules filename
+      */
+
+      i ++;
+
+      if (i >= argc)
+	usage();
+
+      if (read_rules(argv[i]))
+        return (1);
+    }
     else if (argv[i][0] == '-')
     {
      /*
@@ -196,276 +442,764 @@ main(int  argc,			/* I - Number of command-line arguments */
 	      *ptr = '\0';
           }
 
-          process_file(argv[i], dstpath);
+          process_file(-1, argv[i], dstpath, &Files, &Dirs);
 	}
 	else
-	  process_dir(argv[i], dstpath);
+	{
+	  snap = listname ? find_snap(argv[i], 0) : NULL;
+
+	  if (listname && !add_entry(&Files, 'r', &info, dstpath, argv[i], NULL))
+	    return (1);
+
+	  add_dir(&Dirs, argv[i], dstpath, !snap || !same_snap(snap, &info));
+	}
       }
     }
 
  /*
-  * Free any memory we have left allocated...
+  * Scan the directories, in parallel when we can...
   */
 
-  hash_deinit(Users);
-  hash_deinit(Groups);
+  time(&snaptime);
 
-  return (0);
-}
+#ifdef HAVE_PTHREAD_H
+  if (num_walkers > (int)(sizeof(walkers) / sizeof(walkers[0])))
+    num_walkers = (int)(sizeof(walkers) / sizeof(walkers[0]));
 
+  for (i = 0; i < num_walkers; i ++)
+    if (pthread_create(walkers + i, NULL, walk_dirs, NULL))
+      break;
 
-/*
- * 'get_group()' - Get a group name for the given group ID.
- */
+  if (i == 0)
+    walk_dirs(NULL);
 
-char *				/* O - Name of group or NULL */
-get_group(gid_t gid)		/* I - Group ID */
-{
-  char		*name;		/* Name of group */
-  struct group	*gr;		/* Group entry for group */
-  char		buf[16];	/* Temporary string buffer for group numbers */
+  while (i > 0)
+    pthread_join(walkers[-- i], NULL);
 
+#else
+  walk_dirs(NULL);
+#endif /* HAVE_PTHREAD_H */
 
  /*
-  * Always return the default group if set...
+  * Then write the sorted list or update the list file...
   */
 
-  if (DefaultGroup)
-    return (DefaultGroup);
+  if (Files.num_entries > 1)
+    qsort(Files.entries, Files.num_entries, sizeof(entry_t),
+          (int (*)(const void *, const void *))compare_entries);
 
- /*
-  * See if the group ID is already in the hash table...
-  */
+  if (listname && !WalkError && update_list(listname, snaptime))
+    WalkError = 1;
 
-  if ((name = hash_search(Groups, gid)) != NULL)
-    return (name);
+  for (j = Files.num_entries, entry = Files.entries; j > 0; j --, entry ++)
+  {
+    if (!listname)
+    {
+      switch (entry->type)
+      {
+	case 'd' :
+	    printf("d %o %s %s %s -\n", (unsigned)(entry->mode & 07777), get_user(entry->uid), get_group(entry->gid), quote_string(qdst, entry->dst, sizeof(qdst)));
+	    break;
+
+	default :
+	    printf("%c %o %s %s %s %s", entry->type, (unsigned)(entry->mode & 07777), get_user(entry->uid), get_group(entry->gid), quote_string(qdst, entry->dst, sizeof(qdst)), quote_string(qsrc, entry->type == 'l' ? entry->link : entry->src, sizeof(qsrc)));
+
+	    if (entry->options)
+	      printf(" %s\n", quote_string(qoptions, entry->options, sizeof(qoptions)));
+	    else
+	      putchar('\n');
+	    break;
+      }
+    }
 
- /*
-  * Lookup the group ID in the password file...
-  */
+    free(entry->dst);
+    free(entry->src);
+    free(entry->link);
+    free(entry->options);
+  }
 
-  setgrent();
+  free(Files.entries);
 
-  if ((gr = getgrgid(gid)) != NULL)
-    name = gr->gr_name;
-  else
+  return (WalkError ? 1 : 0);
+}
+
+
+/*
+ * 'add_dir()' - Add a directory to scan.
+ */
+
+int				/* O - 0 on success, -1 on error */
+add_dir(dir_t      **dirs,	/* IO - Directories to scan */
+        const char *src,	/* I - Source path */
+	const char *dst,	/* I - Destination path */
+	int        changed)	/* I - Has the directory changed? */
+{
+  dir_t	*dir;			/* New directory */
+
+
+  if ((dir = calloc(1, sizeof(dir_t))) == NULL ||
+      (dir->src = strdup(src)) == NULL || (dir->dst = strdup(dst)) == NULL)
   {
-   /*
-    * Unable to find group ID; just return the number...
-    */
+    fputs("mkepmlist: Out of memory.\n", stderr);
+
+    if (dir)
+    {
+      free(dir->src);
+      free(dir);
+    }
 
-    snprintf(buf, sizeof(buf), "%u", (unsigned)gid);
-    name = buf;
+    return (-1);
   }
 
- /*
-  * Add the name to the hash table and return it...
-  */
+  dir->changed = changed;
+  dir->next    = *dirs;
+  *dirs        = dir;
 
-  return (hash_insert(Groups, gid, name));
+  return (0);
 }
 
 
 /*
- * 'get_user()' - Get a user name for the given user ID.
+ * 'add_entry()' - Add a file list entry.
  */
 
-char *				/* O - Name of user or NULL */
-get_user(uid_t uid)		/* I - User ID */
+entry_t *			/* O - New entry or NULL on error */
+add_entry(list_t      *list,	/* I - File list */
+          int         type,	/* I - Type of file */
+	  struct stat *info,	/* I - File information */
+	  const char  *dst,	/* I - Destination path */
+	  const char  *src,	/* I - Source path */
+	  const char  *options)	/* I - File options or NULL */
 {
-  char		*name;		/* Name of user */
-  struct passwd	*pw;		/* Password entry for user */
-  char		buf[16];	/* Temporary string buffer for user numbers */
+  entry_t	*entry;		/* New entry */
 
 
- /*
-  * Always return the default user if set...
-  */
+  if (list->num_entries >= list->alloc_entries)
+  {
+    if ((entry = realloc(list->entries, (list->alloc_entries + 1024) *
+                                        sizeof(entry_t))) == NULL)
+    {
+      fputs("mkepmlist: Out of memory.\n", stderr);
+      return (NULL);
+    }
 
-  if (DefaultUser)
-    return (DefaultUser);
+    list->entries       = entry;
+    list->alloc_entries += 1024;
+  }
 
- /*
-  * See if the user ID is already in the hash table...
-  */
+  entry = list->entries + list->num_entries;
+
+  entry->type = (char)type;
+  entry->mode = info->st_mode;
+  entry->uid  = info->st_uid;
+  entry->gid  = info->st_gid;
+  entry->dst  = strdup(dst);
+  entry->src  = src ? strdup(src) : NULL;
+  entry->link    = NULL;
+  entry->options = options && *options ? strdup(options) : NULL;
+  entry->keep    = 0;
+  entry->dev     = info->st_dev;
+  entry->ino     = info->st_ino;
+  entry->mtime   = info->st_mtime;
+  entry->size    = info->st_size;
+
+  if (!entry->dst || (src && !entry->src) ||
+      (options && *options && !entry->options))
+  {
+    fputs("mkepmlist: Out of memory.\n", stderr);
+    free(entry->dst);
+    free(entry->src);
+    free(entry->options);
+    return (NULL);
+  }
 
-  if ((name = hash_search(Users, uid)) != NULL)
-    return (name);
+  list->num_entries ++;
 
- /*
-  * Lookup the user ID in the password file...
-  */
+  return (entry);
+}
 
-  setpwent();
 
-  if ((pw = getpwuid(uid)) != NULL)
-    name = pw->pw_name;
-  else
+/*
+ * 'add_pattern()' - Add a path pattern.
+ *
+ * Patterns ending with "/" only match directories.
+ */
+
+int				/* O - 0 on success, -1 on error */
+add_pattern(patterns_t *patterns,/* I - Patterns */
+            int        type,	/* I - File type or 0 */
+	    const char *pattern,/* I - Pattern */
+	    const char *options)/* I - File options or NULL */
+{
+  pattern_t	*temp;		/* New pattern */
+  size_t	len;		/* Length of pattern */
+
+
+  if ((temp = realloc(patterns->patterns, (size_t)(patterns->num_patterns + 1) * sizeof(pattern_t))) == NULL)
   {
-   /*
-    * Unable to find user ID; just return the number...
-    */
+    fputs("mkepmlist: Out of memory.\n", stderr);
+    return (-1);
+  }
+
+  patterns->patterns = temp;
+  temp += patterns->num_patterns;
+
+  if ((temp->pattern = strdup(pattern)) == NULL ||
+      (options && (temp->options = strdup(options)) == NULL))
+  {
+    fputs("mkepmlist: Out of memory.\n", stderr);
+    free(temp->pattern);
+    return (-1);
+  }
+
+  if (!options)
+    temp->options = NULL;
+
+  temp->type = type;
+  temp->dirs = 0;
 
-    snprintf(buf, sizeof(buf), "%u", (unsigned)uid);
-    name = buf;
+  if ((len = strlen(temp->pattern)) > 1 && temp->pattern[len - 1] == '/')
+  {
+    temp->pattern[len - 1] = '\0';
+    temp->dirs             = 1;
   }
 
- /*
-  * Add the name to the hash table and return it...
-  */
+  patterns->num_patterns ++;
 
-  return (hash_insert(Users, uid, name));
+  return (0);
 }
 
 
 /*
- * 'hash_deinit()' - Deinitialize a hash table.
+ * 'add_rule()' - Add a type and options rule.
+ *
+ * Rules use the form "type pattern [options]", where type is "c", "f", or
+ * "i".
  */
 
-void
-hash_deinit(struct node *a)	/* I - Hash table */
+int				/* O - 0 on success, -1 on error */
+add_rule(const char *rule)	/* I - Rule string */
 {
-  unsigned	h;		/* Looping var */
+  int	type;			/* File type */
+  char	pattern[1024],		/* Pattern */
+	options[256];		/* File options */
 
 
-  for (h = 0; h < HASH_M; h ++)
-    if (a[h].name)
-    {
-      free(a[h].name);
-      memset(a, 0, sizeof(struct node));
-    }
+  while (isspace(*rule & 255))
+    rule ++;
+
+  type       = *rule;
+  options[0] = '\0';
+
+  if (!type || !strchr("cfi", type) || !isspace(rule[1] & 255) ||
+      sscanf(rule + 1, "%1023s %255[^\n]", pattern, options) < 1)
+  {
+    fprintf(stderr, "mkepmlist: Bad rule \"%s\".\n", rule);
+    return (-1);
+  }
+
+  return (add_pattern(&Rules, type, pattern, options[0] ? options : NULL));
 }
 
 
 /*
- * 'hash_id()' - Generate a hash for a user or group ID.
+ * 'compare_entries()' - Compare two file list entries.
  */
 
-unsigned			/* O - Hash number */
-hash_id(unsigned id)		/* I - User or group ID */
+int				/* O - Result of comparison */
+compare_entries(const entry_t *a,/* I - First entry */
+                const entry_t *b)/* I - Second entry */
 {
-  return (id % HASH_M);
+  int	ret;			/* Result of comparison */
+
+
+  if ((ret = strcmp(a->dst, b->dst)) != 0)
+    return (ret);
+  else if (a->src && b->src)
+    return (strcmp(a->src, b->src));
+  else
+    return (a->type - b->type);
 }
 
 
 /*
- * 'hash_init()' - Initialize a hash table.
+ * 'compare_files()' - Compare the destination paths of list file entries.
  */
 
-void
-hash_init(struct node *a)	/* I - Hash table to initialize */
+int				/* O - Result of comparison */
+compare_files(const file_t *a,	/* I - First file */
+              const file_t *b)	/* I - Second file */
 {
- /*
-  * Zero out the hash table...
-  */
+  return (strcmp(a->dst, b->dst));
+}
+
+
+/*
+ * 'compare_snaps()' - Compare the source paths of cached files.
+ */
 
-  memset(a, 0, HASH_M * sizeof(struct node));
+int				/* O - Result of comparison */
+compare_snaps(const snap_t *a,	/* I - First file */
+              const snap_t *b)	/* I - Second file */
+{
+  return (strcmp(a->src, b->src));
 }
 
 
 /*
- * 'hash_insert()' - Insert a new entry in a hash table.
+ * 'find_file()' - Find a file in a distribution sorted by destination path.
  */
 
-char *				/* O - New user or group name or NULL */
-hash_insert(struct node *a,	/* I - Hash table */
-            unsigned    id,	/* I - User or group ID */
-            const char  *name)	/* I - User or group name */
+file_t *			/* O - Matching file or NULL */
+find_file(dist_t     *dist,	/* I - Distribution */
+          const char *dst)	/* I - Destination path */
 {
-  unsigned	h,		/* Current hash value */
-		start;		/* Starting hash value */
+  int	left,			/* Left side of search */
+	right,			/* Right side of search */
+	current,		/* Current file */
+	diff;			/* Result of comparison */
 
 
-  for (h = start = hash_id(id); a[h].name;)
+  for (left = 0, right = dist->num_files - 1; left <= right;)
   {
-    h = (h + 1) % HASH_M;
-    if (h == start)
-      return (NULL);
-  }
+    current = (left + right) / 2;
 
-  a[h].id   = id;
-  a[h].name = strdup(name);
+    if ((diff = strcmp(dst, dist->files[current].dst)) == 0)
+      return (dist->files + current);
+    else if (diff < 0)
+      right = current - 1;
+    else
+      left = current + 1;
+  }
 
-  return (a[h].name);
+  return (NULL);
 }
 
 
 /*
- * 'hash_search()' - Find a user or group ID in the hash table...
+ * 'find_snap()' - Find cached file information by source path.
+ *
+ * When "first" is non-zero, the first file whose source path is greater
+ * than or equal to "src" is returned instead.
  */
 
-char *				/* O - User or group name, or NULL */
-hash_search(struct node *a,	/* I - Hash table */
-            unsigned    id)	/* I - User or group ID */
+snap_t *			/* O - Cached file information or NULL */
+find_snap(const char *src,	/* I - Source path */
+          int        first)	/* I - Find the first greater or equal path? */
 {
-  unsigned	h,		/* Current hash value */
-		start;		/* Starting hash value */
+  size_t	left,		/* Left side of search */
+		right,		/* Right side of search */
+		current;	/* Current file */
+  int		diff;		/* Result of comparison */
 
 
-  for (h = start = hash_id(id); a[h].name;)
+  for (left = 0, right = NumSnaps; left < right;)
   {
-    h = (h + 1) % HASH_M;
-
-    if (a[h].id == id)
-      return (a[h].name);
+    current = (left + right) / 2;
 
-    if (h == start)
-      break;
+    if ((diff = strcmp(src, Snaps[current].src)) == 0)
+      return (Snaps + current);
+    else if (diff < 0)
+      right = current;
+    else
+      left = current + 1;
   }
 
-  return (NULL);
+  if (first && left < NumSnaps)
+    return (Snaps + left);
+  else
+    return (NULL);
 }
 
 
 /*
- * 'info()' - Show the EPM copyright and license.
+ * 'free_lines()' - Free the lines of a list file.
  */
 
 void
-info(void)
+free_lines(lines_t *lines)	/* I - Lines */
 {
-  puts(EPM_VERSION);
-  puts("Copyright 1999-2019 by Michael R Sweet.");
-  puts("");
-  puts("EPM is free software and comes with ABSOLUTELY NO WARRANTY; for details");
-  puts("see the GNU General Public License in the file COPYING or at");
-  puts("\"http://www.fsf.org/gpl.html\".  Report all problems to");
-  puts("\"https://github.com/michaelrsweet/epm/issues\".");
-  puts("");
+  size_t	i;		/* Looping var */
+
+
+  for (i = 0; i < lines->num_lines; i ++)
+  {
+    free(lines->text[i]);
+    free(lines->dsts[i]);
+  }
+
+  free(lines->text);
+  free(lines->dsts);
+
+  memset(lines, 0, sizeof(lines_t));
 }
 
 
 /*
- * 'process_dir()' - Process a directory...
+ * 'get_field()' - Get a field from a file line in a list file.
+ *
+ * Fields are separated by whitespace and unquoted the same way as
+ * read_dist() does, with "$$" for a literal "$".
  */
 
-int				/* O - 0 on success, -1 on error */
-process_dir(const char *srcpath,/* I - Source path */
-            const char *dstpath)/* I - Destination path */
+char *				/* O  - Field or NULL */
+get_field(char   **src,		/* IO - Pointer into line */
+          char   *dst,		/* O  - Field buffer */
+	  size_t dstsize)	/* I  - Size of field buffer */
 {
-  DIR		*dir;		/* Directory to read from */
-  struct dirent *dent;		/* Current directory entry */
-  size_t	srclen;		/* Length of source path */
-  char		src[1024];	/* Temporary source path */
+  char	*srcptr,		/* Pointer into line */
+	*dstptr,		/* Pointer into field */
+	*dstend,		/* End of field buffer */
+	quote;			/* Quote character */
 
 
- /*
-  * Try opening the source directory...
-  */
+  srcptr = *src;
+  dstptr = dst;
+  dstend = dst + dstsize - 1;
 
-  if ((dir = opendir(srcpath)) == NULL)
+  while (isspace(*srcptr & 255))
+    srcptr ++;
+
+  if (!*srcptr)
+  {
+    *src = srcptr;
+    *dst = '\0';
+    return (NULL);
+  }
+
+  while (*srcptr && !isspace(*srcptr & 255))
+  {
+    if (*srcptr == '\'' || *srcptr == '\"')
+    {
+      for (quote = *srcptr++; *srcptr && *srcptr != quote; srcptr ++)
+      {
+        if (*srcptr == '\\' && srcptr[1])
+	  srcptr ++;
+
+        if (dstptr < dstend)
+	  *dstptr++ = *srcptr;
+      }
+
+      if (*srcptr)
+        srcptr ++;
+      continue;
+    }
+
+    if ((*srcptr == '\\' || (*srcptr == '$' && srcptr[1] == '$')) && srcptr[1])
+      srcptr ++;
+
+    if (dstptr < dstend)
+      *dstptr++ = *srcptr;
+
+    srcptr ++;
+  }
+
+  *dstptr = '\0';
+  *src    = srcptr;
+
+  return (dst);
+}
+
+
+/*
+ * 'get_group()' - Get a group name for the given group ID.
+ */
+
+const char *			/* O - Name of group */
+get_group(gid_t gid)		/* I - Group ID */
+{
+ /*
+  * Always return the default group if set...
+  */
+
+  if (DefaultGroup)
+    return (DefaultGroup);
+
+ /*
+  * Lookup the group ID, using the number if it has no name...
+  */
+
+  return (get_group_name(gid));
+}
+
+
+/*
+ * 'get_user()' - Get a user name for the given user ID.
+ */
+
+const char *			/* O - Name of user */
+get_user(uid_t uid)		/* I - User ID */
+{
+ /*
+  * Always return the default user if set...
+  */
+
+  if (DefaultUser)
+    return (DefaultUser);
+
+ /*
+  * Lookup the user ID, using the number if it has no name...
+  */
+
+  return (get_user_name(uid));
+}
+
+
+/*
+ * 'hash_file()' - Compute the SHA-256 digest of a file.
+ */
+
+int				/* O - 0 on success, -1 on error */
+hash_file(int        dirfd,	/* I - Directory file descriptor or -1 */
+          const char *src,	/* I - Source path */
+	  char       *sha256)	/* O - SHA-256 digest (65 bytes) */
+{
+  int		fd;		/* File descriptor */
+  ssize_t	bytes;		/* Bytes read */
+  char		buffer[65536];	/* Read buffer */
+  digest_t	digest;		/* Digest state */
+  file_t	digests;	/* Digest strings */
+  const char	*srcptr;	/* Filename in directory */
+
+
+  if ((srcptr = strrchr(src, '/')) != NULL)
+    srcptr ++;
+  else
+    srcptr = src;
+
+#ifdef AT_SYMLINK_NOFOLLOW
+  if (dirfd >= 0)
+    fd = openat(dirfd, srcptr, O_RDONLY);
+  else
+#else
+  REF(dirfd);
+#endif /* AT_SYMLINK_NOFOLLOW */
+  fd = open(src, O_RDONLY);
+
+  if (fd < 0)
+  {
+    fprintf(stderr, "mkepmlist: Unable to open \"%s\": %s.\n", src, strerror(errno));
+    return (-1);
+  }
+
+  digest_init(&digest);
+
+  while ((bytes = read(fd, buffer, sizeof(buffer))) > 0)
+    digest_update(&digest, buffer, (size_t)bytes);
+
+  close(fd);
+
+  if (bytes < 0)
+  {
+    fprintf(stderr, "mkepmlist: Unable to read \"%s\": %s.\n", src, strerror(errno));
+    return (-1);
+  }
+
+  digest_finish(&digest, &digests);
+  strlcpy(sha256, digests.sha256, 65);
+
+  return (0);
+}
+
+
+/*
+ * 'info()' - Show the EPM copyright and license.
+ */
+
+void
+info(void)
+{
+  puts(EPM_VERSION);
+  puts("Copyright 1999-2019 by Michael R Sweet.");
+  puts("");
+  puts("EPM is free software and comes with ABSOLUTELY NO WARRANTY; for details");
+  puts("see the GNU General Public License in the file COPYING or at");
+  puts("\"http://www.fsf.org/gpl.html\".  Report all problems to");
+  puts("\"https://github.com/michaelrsweet/epm/issues\".");
+  puts("");
+}
+
+
+/*
+ * 'in_scan()' - Determine whether a list file would be found by a scan.
+ *
+ * The file's source path must be under the scanned directory and the file
+ * must not be excluded, either by itself or by one of its directories.
+ * Directories and links have no source path and are never matched.
+ */
+
+int				/* O - 1 if scanned, 0 otherwise */
+in_scan(file_t  *file,		/* I - List file entry */
+        entry_t *root)		/* I - Scanned directory */
+{
+  size_t	srclen,		/* Length of source directory */
+		dstlen;		/* Length of destination directory */
+  char		dst[1024],	/* Parent directory */
+		*ptr;		/* Pointer into parent directory */
+
+
+  if (file->type == 'd' || file->type == 'l')
+    return (0);
+
+  for (srclen = strlen(root->src); srclen > 0 && root->src[srclen - 1] == '/'; srclen --);
+
+  if (strncmp(file->src, root->src, srclen) || file->src[srclen] != '/')
+    return (0);
+
+  if (match_pattern(&Excludes, file->dst, 0) ||
+      (Includes.num_patterns && !match_pattern(&Includes, file->dst, 0)))
+    return (0);
+
+  dstlen = strlen(root->dst);
+
+  strlcpy(dst, file->dst, sizeof(dst));
+
+  while ((ptr = strrchr(dst, '/')) != NULL && (size_t)(ptr - dst) > dstlen)
+  {
+    *ptr = '\0';
+
+    if (match_pattern(&Excludes, dst, 1))
+      return (0);
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'match_pattern()' - Find the first pattern matching a destination path.
+ *
+ * Patterns containing a "/" are matched against the whole path, while
+ * other patterns are matched against the filename.
+ */
+
+pattern_t *			/* O - Matching pattern or NULL */
+match_pattern(patterns_t *patterns,/* I - Patterns */
+              const char *dst,	/* I - Destination path */
+	      int        isdir)	/* I - Is the path a directory? */
+{
+  int		i;		/* Looping var */
+  pattern_t	*pattern;	/* Current pattern */
+  const char	*name;		/* Filename */
+
+
+  if ((name = strrchr(dst, '/')) != NULL)
+    name ++;
+  else
+    name = dst;
+
+  for (i = patterns->num_patterns, pattern = patterns->patterns; i > 0; i --, pattern ++)
+  {
+    if (pattern->dirs && !isdir)
+      continue;
+
+    if (strchr(pattern->pattern, '/'))
+    {
+      if (!fnmatch(pattern->pattern, dst, FNM_PATHNAME))
+        return (pattern);
+    }
+    else if (!fnmatch(pattern->pattern, name, 0))
+      return (pattern);
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * 'process_dir()' - Process a directory...
+ */
+
+int				/* O - 0 on success, -1 on error */
+process_dir(const char *srcpath,/* I - Source path */
+            const char *dstpath,/* I - Destination path */
+	    int        changed,	/* I - Has the directory changed? */
+	    list_t     *list,	/* I - File list */
+	    dir_t      **dirs)	/* IO - Subdirectories to scan */
+{
+  DIR		*dir;		/* Directory to read from */
+  struct dirent *dent;		/* Current directory entry */
+  size_t	srclen;		/* Length of source path */
+  char		src[1024];	/* Temporary source path */
+  int		fd;		/* Directory file descriptor */
+  snap_t	*snap,		/* Cached file information */
+		*end;		/* End of cached information */
+  entry_t	*entry;		/* Unchanged entry */
+  struct stat	info;		/* Cached file information */
+
+
+  srclen = strlen(srcpath);
+
+  if (!changed)
+  {
+   /*
+    * The directory has not changed so use the cached list of files, only
+    * checking subdirectories and files with digests...
+    */
+
+    if (srclen > 0 && srcpath[srclen - 1] == '/')
+      strlcpy(src, srcpath, sizeof(src));
+    else
+      snprintf(src, sizeof(src), "%s/", srcpath);
+
+    srclen = strlen(src);
+
+    for (snap = find_snap(src, 1), end = Snaps + NumSnaps;
+         snap && snap < end && !strncmp(snap->src, src, srclen);
+	 snap ++)
+    {
+      if (!snap->src[srclen] || strchr(snap->src + srclen, '/') ||
+          snap->type == 'r')
+        continue;
+
+      if (snap->type == 'd' || snap->hashed)
+      {
+        if (process_file(-1, snap->src, dstpath, list, dirs))
+	  return (-1);
+      }
+      else
+      {
+        memset(&info, 0, sizeof(info));
+
+	info.st_dev   = (dev_t)snap->dev;
+	info.st_ino   = (ino_t)snap->ino;
+	info.st_mtime = (time_t)snap->mtime;
+	info.st_size  = (off_t)snap->size;
+	info.st_mode  = (mode_t)snap->mode;
+	info.st_uid   = (uid_t)snap->uid;
+	info.st_gid   = (gid_t)snap->gid;
+
+        if ((entry = add_entry(list, snap->type, &info, snap->dst, snap->src, NULL)) == NULL)
+	  return (-1);
+
+        entry->keep = 1;
+      }
+    }
+
+    return (0);
+  }
+
+ /*
+  * Try opening the source directory...
+  */
+
+  if ((dir = opendir(srcpath)) == NULL)
   {
     fprintf(stderr, "mkepmlist: Unable to open directory \"%s\": %s.\n", srcpath, strerror(errno));
 
     return (-1);
   }
 
+#ifdef AT_SYMLINK_NOFOLLOW
+  fd = dirfd(dir);
+#else
+  fd = -1;
+#endif /* AT_SYMLINK_NOFOLLOW */
+
  /*
   * Read from the directory...
   */
 
-  srclen = strlen(srcpath);
-
   while ((dent = readdir(dir)) != NULL)
   {
    /*
@@ -485,7 +1219,7 @@ process_dir(const char *srcpath,/* I - Source path */
     else
       snprintf(src, sizeof(src), "%s/%s", srcpath, dent->d_name);
 
-    if (process_file(src, dstpath))
+    if (process_file(fd, src, dstpath, list, dirs))
     {
       closedir(dir);
       return (-1);
@@ -499,20 +1233,33 @@ process_dir(const char *srcpath,/* I - Source path */
 
 /*
  * 'process_file()' - Process a file...
+ *
+ * When "dirfd" is not -1 the file is looked up relative to the directory
+ * being read, which saves resolving the full path again.  Subdirectories
+ * are added to the list of directories to scan.
  */
 
 int				/* O - 0 on success, -1 on error */
-process_file(const char *src,	/* I - Source path */
-             const char *dstpath)/* I - Destination path */
+process_file(int        dirfd,	/* I - Directory file descriptor or -1 */
+             const char *src,	/* I - Source path */
+             const char *dstpath,/* I - Destination path */
+	     list_t     *list,	/* I - File list */
+	     dir_t      **dirs)	/* IO - Subdirectories to scan */
 {
   const char	*srcptr;	/* Pointer into source path */
   struct stat	srcinfo;	/* Information on the source file */
   ssize_t	linklen;	/* Length of link path */
   size_t	dstlen;		/* Length of destination path */
+  int		status;		/* Status of lstat() */
+  pattern_t	*rule;		/* Matching type rule */
+  snap_t	*snap;		/* Cached file information */
+  entry_t	*entry;		/* Unchanged entry */
   char		link[1024],	/* Link for source */
 		dst[1024],	/* Temporary destination path */
-		qdst[1024],	/* Quoted destination */
-		qsrc[1024];	/* Quoted source/link */
+		*dstptr,	/* Destination path for entry */
+		sha256[65],	/* SHA-256 digest */
+		size[32],	/* Size option */
+		options[1024];	/* File options */
 
 
  /*
@@ -531,12 +1278,52 @@ process_file(const char *src,	/* I - Source path */
   else
     snprintf(dst, sizeof(dst), "%s/%s", dstpath, srcptr);
 
-  if (lstat(src, &srcinfo))
+#ifdef AT_SYMLINK_NOFOLLOW
+  if (dirfd >= 0)
+    status = fstatat(dirfd, srcptr, &srcinfo, AT_SYMLINK_NOFOLLOW);
+  else
+#endif /* AT_SYMLINK_NOFOLLOW */
+  status = lstat(src, &srcinfo);
+
+  if (status)
   {
     fprintf(stderr, "mkepmlist: Unable to stat \"%s\": %s.\n", src, strerror(errno));
     return (-1);
   }
 
+ /*
+  * Skip excluded files and directories, and files that are not included...
+  */
+
+  if (match_pattern(&Excludes, dst, S_ISDIR(srcinfo.st_mode)))
+    return (0);
+
+  if (Includes.num_patterns && !S_ISDIR(srcinfo.st_mode) &&
+      !match_pattern(&Includes, dst, 0))
+    return (0);
+
+ /*
+  * Keep unchanged files from the list file being updated...
+  */
+
+  if ((snap = find_snap(src, 0)) != NULL && same_snap(snap, &srcinfo) &&
+      (snap->type == 'd') == (S_ISDIR(srcinfo.st_mode) != 0) &&
+      (snap->type == 'l') == (S_ISLNK(srcinfo.st_mode) != 0))
+  {
+    if ((entry = add_entry(list, snap->type, &srcinfo, snap->dst, snap->src, NULL)) == NULL)
+      return (-1);
+
+    entry->keep = 1;
+    entry->mode = (mode_t)snap->mode;	/* Keep the cached attributes */
+    entry->uid  = (uid_t)snap->uid;
+    entry->gid  = (gid_t)snap->gid;
+
+    if (snap->type == 'd')
+      return (add_dir(dirs, src, dst, 0));
+    else
+      return (0);
+  }
+
  /*
   * Process accordingly...
   */
@@ -547,9 +1334,8 @@ process_file(const char *src,	/* I - Source path */
     * Directory...
     */
 
-    printf("d %o %s %s %s -\n", (unsigned)(srcinfo.st_mode & 07777), get_user(srcinfo.st_uid), get_group(srcinfo.st_gid), quote_string(qdst, dst, sizeof(qdst)));
-
-    if (process_dir(src, dst))
+    if (!add_entry(list, 'd', &srcinfo, dst, src, NULL) ||
+        add_dir(dirs, src, dst, 1))
       return (-1);
   }
   else if (S_ISLNK(srcinfo.st_mode))
@@ -558,7 +1344,14 @@ process_file(const char *src,	/* I - Source path */
     * Symlink...
     */
 
-    if ((linklen = readlink(src, link, sizeof(link) - 1)) < 0)
+#ifdef AT_SYMLINK_NOFOLLOW
+    if (dirfd >= 0)
+      linklen = readlinkat(dirfd, srcptr, link, sizeof(link) - 1);
+    else
+#endif /* AT_SYMLINK_NOFOLLOW */
+    linklen = readlink(src, link, sizeof(link) - 1);
+
+    if (linklen < 0)
     {
       fprintf(stderr, "mkepmlist: Unable to read symlink \"%s\": %s.\n", src, strerror(errno));
       return (-1);
@@ -566,7 +1359,14 @@ process_file(const char *src,	/* I - Source path */
 
     link[linklen] = '\0';
 
-    printf("l %o %s %s %s %s\n", (unsigned)(srcinfo.st_mode & 07777), get_user(srcinfo.st_uid), get_group(srcinfo.st_gid), quote_string(qdst, dst, sizeof(qdst)), quote_string(qsrc, link, sizeof(qsrc)));
+    if ((entry = add_entry(list, 'l', &srcinfo, dst, src, NULL)) == NULL)
+      return (-1);
+
+    if ((entry->link = strdup(link)) == NULL)
+    {
+      fputs("mkepmlist: Out of memory.\n", stderr);
+      return (-1);
+    }
   }
   else if (S_ISREG(srcinfo.st_mode))
   {
@@ -574,7 +1374,39 @@ process_file(const char *src,	/* I - Source path */
     * Regular file...
     */
 
-    printf("f %o %s %s %s %s\n", (unsigned)(srcinfo.st_mode & 07777), get_user(srcinfo.st_uid), get_group(srcinfo.st_gid), quote_string(qdst, dst, sizeof(qdst)), quote_string(qsrc, src, sizeof(qsrc)));
+    options[0] = '\0';
+    dstptr     = dst;
+
+    if ((rule = match_pattern(&Rules, dst, 0)) != NULL)
+    {
+      if (rule->options)
+        strlcpy(options, rule->options, sizeof(options));
+
+      if (rule->type == 'i' && (dstptr = strrchr(dst, '/')) != NULL)
+        dstptr ++;			/* Init scripts just use the name */
+      else
+        dstptr = dst;
+    }
+
+    if (Hash)
+    {
+      if (hash_file(dirfd, src, sha256))
+        return (-1);
+
+      if (options[0])
+        strlcat(options, " ", sizeof(options));
+
+      strlcat(options, "sha256(", sizeof(options));
+      strlcat(options, sha256, sizeof(options));
+      strlcat(options, ")", sizeof(options));
+
+      snprintf(size, sizeof(size), " size(%lld)", (long long)srcinfo.st_size);
+      strlcat(options, size, sizeof(options));
+    }
+
+    if (!add_entry(list, rule ? rule->type : 'f', &srcinfo, dstptr, src,
+                   options))
+      return (-1);
   }
 
   return (0);
@@ -610,19 +1442,902 @@ quote_string(char       *q,		/* I - Quoted string buffer */
 
 
 /*
- * 'usage()' - Show command-line usage instructions.
+ * 'read_list()' - Read the lines and file entries of a list file.
+ *
+ * Each line is kept as is so that only changed file lines are rewritten.
+ * File lines add an entry to "dist".  List files that include other files
+ * or use variables or wildcards in file lines cannot be updated.
  */
 
-void
-usage(void)
+int				/* O - 0 on success, -1 on error */
+read_list(const char *listname,	/* I - List file */
+          lines_t    *lines,	/* O - Lines of list file */
+	  dist_t     *dist)	/* I - Distribution for file lines */
 {
-  info();
+  FILE		*fp;		/* List file */
+  char		line[16384],	/* Line from file */
+		term[256],	/* Terminator of inline text */
+		user[256],	/* User field */
+		group[256],	/* Group field */
+		dst[1024],	/* Destination field */
+		src[1024],	/* Source field */
+		options[1024],	/* Options field */
+		*ptr,		/* Pointer into line */
+		**temp;		/* New lines array */
+  const char	*error;		/* Why the list file cannot be updated */
+  int		linenum,	/* Current line number */
+		newline,	/* Does the next chunk start a line? */
+		startline;	/* Does this chunk start a line? */
+  mode_t	mode;		/* Permissions */
+  file_t	*file;		/* New file entry */
+  static const char * const directives[4] =
+		{		/* Directives that apply to later files */
+		  "%system ",
+		  "%arch ",
+		  "%format ",
+		  "%subpackage"
+		};
+  int		i;		/* Looping var */
 
-  puts("Usage: mkepmlist [options] directory [... directory] >filename.list");
-  puts("Options:");
-  puts("-g group              Set group name for files.");
-  puts("-u user               Set user name for files.");
-  puts("--prefix directory    Set directory prefix for files.");
 
-  exit(1);
+  memset(lines, 0, sizeof(lines_t));
+
+  if ((fp = fopen(listname, "r")) == NULL)
+  {
+    if (errno == ENOENT)
+      return (0);
+
+    fprintf(stderr, "mkepmlist: Unable to read list file \"%s\": %s.\n", listname, strerror(errno));
+    return (-1);
+  }
+
+  term[0] = '\0';
+  error   = NULL;
+  linenum = 0;
+  newline = 1;
+
+  while (fgets(line, sizeof(line), fp))
+  {
+    startline = newline;
+    newline   = strchr(line, '\n') != NULL;
+
+    if (lines->num_lines >= lines->alloc_lines)
+    {
+      if ((temp = realloc(lines->text, (lines->alloc_lines + 1024) * sizeof(char *))) == NULL)
+        goto out_of_memory;
+
+      lines->text = temp;
+
+      if ((temp = realloc(lines->dsts, (lines->alloc_lines + 1024) * sizeof(char *))) == NULL)
+        goto out_of_memory;
+
+      lines->dsts        = temp;
+      lines->alloc_lines += 1024;
+    }
+
+    if ((lines->text[lines->num_lines] = strdup(line)) == NULL)
+      goto out_of_memory;
+
+    lines->dsts[lines->num_lines ++] = NULL;
+
+    if (!startline)
+      continue;				/* Rest of a long line */
+
+    linenum ++;
+
+    if (term[0])
+    {
+     /*
+      * Inline text...
+      */
+
+      if (!strncmp(line, term, strlen(term)) && line[strlen(term)] == '\n')
+        term[0] = '\0';
+      continue;
+    }
+
+    if (line[0] == '#' || line[0] == '$' || isspace(line[0] & 255))
+      continue;
+
+    if (line[0] == '%')
+    {
+     /*
+      * Directive lines are copied as is...
+      */
+
+      if (!strncmp(line, "%include", 8) && isspace(line[8] & 255))
+      {
+        error = "%include is not supported";
+	break;
+      }
+
+      for (i = 0; i < 4; i ++)
+        if (!strncmp(line, directives[i], strlen(directives[i])))
+	{
+	  for (ptr = line + strlen(directives[i]); isspace(*ptr & 255); ptr ++);
+
+	  lines->reset[i] = i == 3 ? *ptr != '\0' : strncmp(ptr, "all", 3) != 0;
+	}
+
+      for (ptr = line; *ptr && !isspace(*ptr & 255); ptr ++);
+      while (isspace(*ptr & 255))
+        ptr ++;
+
+      if (!strncmp(ptr, "<<", 2))
+      {
+        for (ptr += 2; isspace(*ptr & 255); ptr ++);
+
+        strlcpy(term, ptr, sizeof(term));
+	for (ptr = term + strlen(term); ptr > term && isspace(ptr[-1] & 255); *--ptr = '\0');
+      }
+      continue;
+    }
+
+   /*
+    * File line...
+    */
+
+    if (!newline)
+    {
+      error = "line too long";
+      break;
+    }
+
+    for (ptr = line; (ptr = strchr(ptr, '$')) != NULL; ptr += 2)
+      if (ptr[1] != '$')
+        break;
+
+    if (ptr)
+    {
+      error = "variables in file lines are not supported";
+      break;
+    }
+
+    ptr  = line + 1;
+    mode = (mode_t)strtol(ptr, &ptr, 8);
+
+    if (!isspace(line[1] & 255) || ptr == line + 1 ||
+        !get_field(&ptr, user, sizeof(user)) ||
+        !get_field(&ptr, group, sizeof(group)) ||
+	!get_field(&ptr, dst, sizeof(dst)))
+      continue;				/* Bad lines are kept as is */
+
+    get_field(&ptr, src, sizeof(src));
+    get_field(&ptr, options, sizeof(options));
+
+    if (tolower(line[0]) == 'd' || line[0] == 'R')
+    {
+      strlcpy(options, src, sizeof(options));
+      src[0] = '\0';
+    }
+    else if (strpbrk((ptr = strrchr(src, '/')) != NULL ? ptr : src, "*?["))
+    {
+      error = "wildcards in file lines are not supported";
+      break;
+    }
+
+    if ((file = add_file(dist, NULL)) == NULL ||
+        (lines->dsts[lines->num_lines - 1] = strdup(dst)) == NULL)
+      goto out_of_memory;
+
+    file->type = line[0];
+    file->mode = mode;
+    strlcpy(file->user, user, sizeof(file->user));
+    strlcpy(file->group, group, sizeof(file->group));
+    strlcpy(file->dst, dst, sizeof(file->dst));
+    strlcpy(file->src, src, sizeof(file->src));
+    strlcpy(file->options, options, sizeof(file->options));
+  }
+
+  fclose(fp);
+
+  if (error)
+  {
+    fprintf(stderr, "mkepmlist: Unable to update list file \"%s\" on line %d: %s.\n", listname, linenum, error);
+    free_lines(lines);
+    return (-1);
+  }
+
+  if (dist->num_files > 1)
+    qsort(dist->files, (size_t)dist->num_files, sizeof(file_t),
+          (int (*)(const void *, const void *))compare_files);
+
+  return (0);
+
+ /*
+  * If we get here we ran out of memory...
+  */
+
+  out_of_memory:
+
+  fputs("mkepmlist: Out of memory.\n", stderr);
+  fclose(fp);
+  free_lines(lines);
+
+  return (-1);
+}
+
+
+/*
+ * 'read_rules()' - Read type and option rules from a file.
+ *
+ * Blank lines and lines starting with "#" are ignored.
+ */
+
+int				/* O - 0 on success, -1 on error */
+read_rules(const char *filename)/* I - Rules file */
+{
+  FILE	*fp;			/* Rules file */
+  char	line[2048],		/* Line from file */
+	*ptr;			/* Pointer into line */
+  int	status;			/* Return status */
+
+
+  if ((fp = fopen(filename, "r")) == NULL)
+  {
+    fprintf(stderr, "mkepmlist: Unable to open rules file \"%s\": %s.\n", filename, strerror(errno));
+    return (-1);
+  }
+
+  status = 0;
+
+  while (!status && fgets(line, sizeof(line), fp))
+  {
+    for (ptr = line; isspace(*ptr & 255); ptr ++);
+
+    if (!*ptr || *ptr == '#')
+      continue;
+
+    status = add_rule(ptr);
+  }
+
+  fclose(fp);
+
+  return (status);
+}
+
+
+/*
+ * 'read_snaps()' - Read the cached file information for a list file.
+ *
+ * The cache is stored in "filename.list.cache" with a line for each file:
+ *
+ *     type hashed dev ino mtime size<TAB>src<TAB>dst
+ */
+
+int				/* O - 0 on success, -1 on error */
+read_snaps(const char *listname)/* I - List file */
+{
+  FILE		*fp;		/* Cache file */
+  char		filename[1024],	/* Cache filename */
+		line[4096],	/* Line from file */
+		*src,		/* Source path */
+		*dst,		/* Destination path */
+		*ptr;		/* Pointer into line */
+  long long	snaptime;	/* Time of cache */
+  size_t	alloc_snaps;	/* Allocated cache entries */
+  snap_t	*snap;		/* Current cache entry */
+  char		type;		/* Type of entry */
+
+
+  snprintf(filename, sizeof(filename), "%s.cache", listname);
+
+  if ((fp = fopen(filename, "r")) == NULL)
+  {
+    if (errno == ENOENT)
+      return (0);
+
+    fprintf(stderr, "mkepmlist: Unable to open cache file \"%s\": %s.\n", filename, strerror(errno));
+    return (-1);
+  }
+
+  if (!fgets(line, sizeof(line), fp) ||
+      sscanf(line, "# mkepmlist cache %lld", &snaptime) != 1)
+  {
+    fprintf(stderr, "mkepmlist: Ignoring bad cache file \"%s\".\n", filename);
+    fclose(fp);
+    return (0);
+  }
+
+  SnapTime    = (time_t)snaptime;
+  alloc_snaps = 0;
+
+  while (fgets(line, sizeof(line), fp))
+  {
+    if ((ptr = strchr(line, '\n')) == NULL)
+      continue;				/* Line too long */
+
+    *ptr = '\0';
+
+    if ((src = strchr(line, '\t')) == NULL ||
+        (dst = strchr(src + 1, '\t')) == NULL)
+      continue;
+
+    *src++ = '\0';
+    *dst++ = '\0';
+
+    if (NumSnaps >= alloc_snaps)
+    {
+      if ((snap = realloc(Snaps, (alloc_snaps + 1024) * sizeof(snap_t))) == NULL)
+      {
+        fputs("mkepmlist: Out of memory.\n", stderr);
+	fclose(fp);
+	return (-1);
+      }
+
+      Snaps       = snap;
+      alloc_snaps += 1024;
+    }
+
+    snap = Snaps + NumSnaps;
+
+    if (sscanf(line, "%c%d%llu%llu%lld%lld%o%u%u", &type, &snap->hashed,
+               &snap->dev, &snap->ino, &snap->mtime, &snap->size, &snap->mode,
+	       &snap->uid, &snap->gid) != 9)
+      continue;
+
+    snap->type = type;
+
+    if ((snap->src = strdup(src)) == NULL || (snap->dst = strdup(dst)) == NULL)
+    {
+      fputs("mkepmlist: Out of memory.\n", stderr);
+      fclose(fp);
+      return (-1);
+    }
+
+    NumSnaps ++;
+  }
+
+  fclose(fp);
+
+  if (NumSnaps > 1)
+    qsort(Snaps, NumSnaps, sizeof(snap_t),
+          (int (*)(const void *, const void *))compare_snaps);
+
+  return (0);
+}
+
+
+/*
+ * 'same_snap()' - Determine whether a file is unchanged since it was cached.
+ *
+ * Files changed in the same second the cache was written are always treated
+ * as changed.
+ */
+
+int				/* O - 1 if unchanged, 0 otherwise */
+same_snap(snap_t      *snap,	/* I - Cached file information */
+          struct stat *info)	/* I - Current file information */
+{
+  return (snap->dev == (unsigned long long)info->st_dev &&
+          snap->ino == (unsigned long long)info->st_ino &&
+	  snap->mtime == (long long)info->st_mtime &&
+	  snap->size == (long long)info->st_size &&
+	  info->st_mtime < SnapTime);
+}
+
+
+/*
+ * 'update_file()' - Update a list file entry from a changed or new file.
+ *
+ * The type and options of existing entries are kept unless the file changed
+ * between a directory, link, and file, except for the "sha256()" and
+ * "size()" options which are replaced.  The permissions, owner, and group
+ * of existing entries are only replaced when the file's type changed or
+ * they changed since the cached scan.
+ */
+
+void
+update_file(file_t  *file,	/* I - List file entry */
+            entry_t *entry)	/* I - Scanned file */
+{
+  int		i,		/* Looping var */
+		attrs;		/* Update permissions, owner, and group? */
+  snap_t	*snap;		/* Cached file information */
+  char		*ptr,		/* Pointer into options */
+		*end;		/* End of option */
+  size_t	len;		/* Length of option */
+  static const char * const hashopts[] =
+  {				/* Options written by --hash */
+    "sha256(",
+    "size("
+  };
+
+
+  if (!file->dst[0])
+  {
+   /*
+    * New file...
+    */
+
+    file->type = entry->type;
+    strlcpy(file->dst, entry->dst, sizeof(file->dst));
+
+    if (entry->options)
+      strlcpy(file->options, entry->options, sizeof(file->options));
+
+    attrs = 1;
+  }
+  else
+  {
+   /*
+    * Existing file...
+    */
+
+    if ((file->type == 'd') != (entry->type == 'd') ||
+        (file->type == 'l') != (entry->type == 'l'))
+    {
+      file->type       = entry->type;
+      file->src[0]     = '\0';
+      file->options[0] = '\0';
+      attrs            = 1;
+    }
+    else
+      attrs = (snap = find_snap(entry->src, 0)) != NULL &&
+              (snap->mode != (unsigned)(entry->mode & 07777) ||
+	       snap->uid != (unsigned)entry->uid ||
+	       snap->gid != (unsigned)entry->gid);
+
+    for (i = 0; i < (int)(sizeof(hashopts) / sizeof(hashopts[0])); i ++)
+    {
+      if ((ptr = strstr(file->options, hashopts[i])) != NULL)
+      {
+	if ((end = strchr(ptr, ')')) != NULL)
+	  end ++;
+	else
+	  end = ptr + strlen(ptr);
+
+	while (isspace(*end & 255))
+	  end ++;
+
+	while (ptr > file->options && isspace(ptr[-1] & 255))
+	  ptr --;
+
+	if (ptr > file->options && *end)
+	  *ptr++ = ' ';
+
+	memmove(ptr, end, strlen(end) + 1);
+      }
+
+      if (entry->options && (ptr = strstr(entry->options, hashopts[i])) != NULL)
+      {
+	if ((end = strchr(ptr, ')')) != NULL)
+	  len = (size_t)(end - ptr + 1);
+	else
+	  len = strlen(ptr);
+
+	if (file->options[0])
+	  strlcat(file->options, " ", sizeof(file->options));
+
+	if (strlen(file->options) + len < sizeof(file->options))
+	  strncat(file->options, ptr, len);
+      }
+    }
+  }
+
+  if (attrs)
+  {
+    file->mode = entry->mode & 07777;
+    strlcpy(file->user, get_user(entry->uid), sizeof(file->user));
+    strlcpy(file->group, get_group(entry->gid), sizeof(file->group));
+  }
+
+  if (entry->type == 'd')
+  {
+    if (!file->src[0] && !file->options[0])
+      strlcpy(file->src, "-", sizeof(file->src));
+  }
+  else
+    strlcpy(file->src, entry->type == 'l' ? entry->link : entry->src, sizeof(file->src));
+}
+
+
+/*
+ * 'update_list()' - Update a list file from the scanned files.
+ *
+ * Files that were listed by a previous update or whose source is in one of
+ * the scanned directories and are no longer present are removed, changed
+ * files are updated, and new files are added at the end.
+ * All other lines in the list file are kept as is, as are file lines whose
+ * destination is listed more than once, e.g. for different systems.
+ */
+
+int				/* O - 0 on success, -1 on error */
+update_list(const char *listname,/* I - List file */
+            time_t     snaptime)/* I - Time of scan */
+{
+  dist_t	*dist;		/* Distribution */
+  lines_t	lines;		/* Lines of list file */
+  file_t	*file;		/* Current file */
+  char		*remove,	/* Files to remove */
+		*changed;	/* Files to rewrite */
+  entry_t	**added,	/* New files */
+		*entry;		/* Current entry */
+  size_t	i,		/* Looping var */
+		num_added;	/* Number of new files */
+  int		j,		/* Looping var */
+		status;		/* Return status */
+  snap_t	*snap;		/* Cached file information */
+  FILE		*fp;		/* New list file */
+  char		listbck[1024],	/* Backup filename */
+		listtmp[1024];	/* Temporary filename */
+  static const char * const resets[4] =
+		{		/* Lines that reset directives for new files */
+		  "%system all\n",
+		  "%arch all\n",
+		  "%format all\n",
+		  "%subpackage\n"
+		};
+
+
+ /*
+  * Load the existing list file...
+  */
+
+  if ((dist = new_dist()) == NULL)
+  {
+    fputs("mkepmlist: Out of memory.\n", stderr);
+    return (-1);
+  }
+
+  if (read_list(listname, &lines, dist))
+  {
+    free_dist(dist);
+    return (-1);
+  }
+
+  remove  = calloc((size_t)dist->num_files + 1, 1);
+  changed = calloc((size_t)dist->num_files + 1, 1);
+  added   = calloc(Files.num_entries + 1, sizeof(entry_t *));
+
+  if (!remove || !changed || !added)
+  {
+    fputs("mkepmlist: Out of memory.\n", stderr);
+    free(remove);
+    free(changed);
+    free(added);
+    free_lines(&lines);
+    free_dist(dist);
+    return (-1);
+  }
+
+ /*
+  * Files from the last update are removed unless they are still there...
+  */
+
+  for (i = NumSnaps, snap = Snaps; i > 0; i --, snap ++)
+    if (snap->type != 'r' && (file = find_file(dist, snap->dst)) != NULL)
+      remove[file - dist->files] = 1;
+
+  for (i = Files.num_entries, entry = Files.entries; i > 0; i --, entry ++)
+    if (entry->type == 'r')
+      for (j = 0, file = dist->files; j < dist->num_files; j ++, file ++)
+        if (in_scan(file, entry))
+	  remove[j] = 1;
+
+  for (i = Files.num_entries, entry = Files.entries, num_added = 0; i > 0; i --, entry ++)
+  {
+    if (entry->type == 'r')
+      continue;
+
+    if ((file = find_file(dist, entry->dst)) != NULL)
+    {
+      remove[file - dist->files] = 0;
+
+      if (!entry->keep)
+      {
+        update_file(file, entry);
+	changed[file - dist->files] = 1;
+      }
+    }
+    else if (!entry->keep)
+      added[num_added ++] = entry;	/* Unchanged files removed from the list stay removed */
+  }
+
+ /*
+  * Destinations that are listed more than once are left alone...
+  */
+
+  for (j = 1, file = dist->files + 1; j < dist->num_files; j ++, file ++)
+    if (!strcmp(file[-1].dst, file[0].dst))
+      remove[j - 1] = remove[j] = changed[j - 1] = changed[j] = 0;
+
+ /*
+  * Write the new list file...
+  */
+
+  snprintf(listbck, sizeof(listbck), "%s.O", listname);
+  snprintf(listtmp, sizeof(listtmp), "%s.N%d", listname, (int)getpid());
+
+  if ((fp = fopen(listtmp, "w")) != NULL)
+  {
+    for (i = 0; i < lines.num_lines; i ++)
+    {
+      if (!lines.dsts[i] || (file = find_file(dist, lines.dsts[i])) == NULL)
+        fputs(lines.text[i], fp);
+      else if (changed[file - dist->files])
+        write_file(fp, file);
+      else if (!remove[file - dist->files])
+        fputs(lines.text[i], fp);
+    }
+
+    for (j = 0; num_added > 0 && j < 4; j ++)
+      if (lines.reset[j])
+        fputs(resets[j], fp);
+
+    for (i = 0; i < num_added; i ++)
+    {
+      file = add_file(dist, NULL);
+
+      memset(file, 0, sizeof(file_t));
+      update_file(file, added[i]);
+      write_file(fp, file);
+    }
+
+    if (fclose(fp))
+      status = -1;
+    else
+    {
+     /*
+      * Make a backup of the list file and replace it...
+      */
+
+      unlink(listbck);
+
+      if (link(listname, listbck) && errno != ENOENT)
+        rename(listname, listbck);
+
+      status = rename(listtmp, listname);
+    }
+
+    if (status)
+      unlink(listtmp);
+  }
+  else
+    status = -1;
+
+  free(remove);
+  free(changed);
+  free(added);
+  free_lines(&lines);
+
+ /*
+  * Then write the cache...
+  */
+
+  if (status)
+    fprintf(stderr, "mkepmlist: Unable to write list file \"%s\": %s.\n", listname, strerror(errno));
+  else
+  {
+    if (dist->num_files > 1)
+      qsort(dist->files, (size_t)dist->num_files, sizeof(file_t),
+            (int (*)(const void *, const void *))compare_files);
+
+    status = write_snaps(listname, dist, snaptime);
+  }
+
+  free_dist(dist);
+
+  return (status);
+}
+
+
+/*
+ * 'usage()' - Show command-line usage instructions.
+ */
+
+void
+usage(void)
+{
+  info();
+
+  puts("Usage: mkepmlist [options] directory [... directory] >filename.list");
+  puts("Options:");
+  puts("-g group              Set group name for files.");
+  puts("-j jobs               Set number of directories to scan at once.");
+  puts("-u user               Set user name for files.");
+  puts("--exclude pattern     Exclude matching files and directories.");
+  puts("--group-file filename Read group names from a group file.");
+  puts("--hash                Add SHA-256 digests of files.");
+  puts("--include pattern     Only include matching files.");
+  puts("--passwd-file filename\n                      Read user names from a password file.");
+  puts("--prefix directory    Set directory prefix for files.");
+  puts("--rule \"type pattern [options]\"");
+  puts("                      Set type and options of matching files.");
+  puts("--rules filename      Read type and option rules from a file.");
+  puts("--update filename     Update list file with changed files.");
+
+  exit(1);
+}
+
+
+/*
+ * 'walk_dirs()' - Scan directories until there are none left.
+ *
+ * Each walker takes the next directory to scan, collects its files and
+ * subdirectories without holding the lock, and then adds them to the
+ * global lists.  The walkers are done when there are no directories left
+ * and no walker is busy, since only busy walkers can add new directories.
+ */
+
+void *				/* O - Thread exit status (unused) */
+walk_dirs(void *data)		/* I - Thread data (unused) */
+{
+  dir_t		*dir,		/* Current directory */
+		*subdirs,	/* Subdirectories found */
+		*next;		/* Next subdirectory */
+  list_t	list;		/* Files found */
+  int		status;		/* Status of process_dir() */
+
+
+  REF(data);
+
+  memset(&list, 0, sizeof(list));
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&WalkMutex);
+#endif /* HAVE_PTHREAD_H */
+
+  for (;;)
+  {
+#ifdef HAVE_PTHREAD_H
+    while (!Dirs && Walkers > 0 && !WalkError)
+      pthread_cond_wait(&WalkCond, &WalkMutex);
+#endif /* HAVE_PTHREAD_H */
+
+    if (!Dirs || WalkError)
+      break;
+
+    dir  = Dirs;
+    Dirs = dir->next;
+    Walkers ++;
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&WalkMutex);
+#endif /* HAVE_PTHREAD_H */
+
+    subdirs          = NULL;
+    list.num_entries = 0;
+    status           = process_dir(dir->src, dir->dst, dir->changed, &list,
+                                   &subdirs);
+
+    free(dir->src);
+    free(dir->dst);
+    free(dir);
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&WalkMutex);
+#endif /* HAVE_PTHREAD_H */
+
+    if (status)
+      WalkError = 1;
+
+    if (Files.num_entries + list.num_entries > Files.alloc_entries)
+    {
+      entry_t	*temp;		/* New entries */
+      size_t	alloc;		/* New allocation */
+
+      alloc = 2 * Files.alloc_entries + list.num_entries;
+
+      if ((temp = realloc(Files.entries, alloc * sizeof(entry_t))) == NULL)
+      {
+        fputs("mkepmlist: Out of memory.\n", stderr);
+	WalkError = 1;
+      }
+      else
+      {
+	Files.entries       = temp;
+	Files.alloc_entries = alloc;
+      }
+    }
+
+    if (!WalkError)
+    {
+      memcpy(Files.entries + Files.num_entries, list.entries,
+             list.num_entries * sizeof(entry_t));
+      Files.num_entries += list.num_entries;
+    }
+
+    for (; subdirs; subdirs = next)
+    {
+      next          = subdirs->next;
+      subdirs->next = Dirs;
+      Dirs          = subdirs;
+    }
+
+    Walkers --;
+
+#ifdef HAVE_PTHREAD_H
+    pthread_cond_broadcast(&WalkCond);
+#endif /* HAVE_PTHREAD_H */
+  }
+
+#ifdef HAVE_PTHREAD_H
+  pthread_cond_broadcast(&WalkCond);
+  pthread_mutex_unlock(&WalkMutex);
+#endif /* HAVE_PTHREAD_H */
+
+  free(list.entries);
+
+  return (NULL);
+}
+
+
+/*
+ * 'write_file()' - Write a file line to a list file.
+ */
+
+void
+write_file(FILE   *fp,		/* I - List file */
+           file_t *file)	/* I - List file entry */
+{
+  char	qdst[1024],		/* Quoted destination */
+	qsrc[1024],		/* Quoted source/link */
+	qoptions[1024];		/* Quoted options */
+
+
+  fprintf(fp, "%c %o %s %s %s", file->type, (unsigned)file->mode, file->user,
+          file->group, quote_string(qdst, file->dst, sizeof(qdst)));
+
+  if (file->src[0])
+    fprintf(fp, " %s", quote_string(qsrc, file->src, sizeof(qsrc)));
+
+  if (file->options[0])
+    fprintf(fp, " %s", quote_string(qoptions, file->options, sizeof(qoptions)));
+
+  putc('\n', fp);
+}
+
+
+/*
+ * 'write_snaps()' - Write the cached file information for a list file.
+ */
+
+int				/* O - 0 on success, -1 on error */
+write_snaps(const char *listname,/* I - List file */
+            dist_t     *dist,	/* I - Updated distribution */
+	    time_t     snaptime)/* I - Time of scan */
+{
+  FILE		*fp;		/* Cache file */
+  char		filename[1024],	/* Cache filename */
+		tempname[1024];	/* Temporary filename */
+  size_t	i;		/* Looping var */
+  entry_t	*entry;		/* Current entry */
+  file_t	*file;		/* List file entry */
+
+
+  snprintf(filename, sizeof(filename), "%s.cache", listname);
+  snprintf(tempname, sizeof(tempname), "%s.cache.N", listname);
+
+  if ((fp = fopen(tempname, "w")) == NULL)
+  {
+    fprintf(stderr, "mkepmlist: Unable to create cache file \"%s\": %s.\n", tempname, strerror(errno));
+    return (-1);
+  }
+
+  fprintf(fp, "# mkepmlist cache %lld\n", (long long)snaptime);
+
+  for (i = Files.num_entries, entry = Files.entries; i > 0; i --, entry ++)
+  {
+    if (strpbrk(entry->src, "\t\n") || strpbrk(entry->dst, "\t\n"))
+      continue;				/* Always rescan these files */
+
+    file = entry->type == 'r' ? NULL : find_file(dist, entry->dst);
+
+    fprintf(fp, "%c %d %llu %llu %lld %lld %o %u %u\t%s\t%s\n", entry->type,
+            file && strstr(file->options, "sha256(") != NULL,
+	    (unsigned long long)entry->dev, (unsigned long long)entry->ino,
+	    (long long)entry->mtime, (long long)entry->size,
+	    (unsigned)(entry->mode & 07777), (unsigned)entry->uid,
+	    (unsigned)entry->gid, entry->src, entry->dst);
+  }
+
+  if (fclose(fp) || rename(tempname, filename))
+  {
+    fprintf(stderr, "mkepmlist: Unable to write cache file \"%s\": %s.\n", filename, strerror(errno));
+    unlink(tempname);
+    return (-1);
+  }
+
+  return (0);
 }
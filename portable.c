@@ -22,6 +22,14 @@
 #include "epm.h"
 
 
+/*
+ * Local constants...
+ */
+
+#define PERMS_MODE	1		/* Set the mode of all files */
+#define PERMS_NEW	2		/* Also set config file .N copies */
+
+
 /*
  * Local functions...
  */
@@ -29,6 +37,13 @@
 static void	clean_distfiles(const char *directory, const char *prodname,
 		                const char *platname, dist_t *dist,
 				const char *subpackage);
+static void	close_delta(tarf_t *deltafile, const char *directory,
+		            const char *prodfull);
+static int	compare_group(const void *a, const void *b);
+static int	compare_mode(const void *a, const void *b);
+static int	compare_user(const void *a, const void *b);
+static int	get_spaces(fileindex_t *fileindex, int patch,
+		           space_t **spaces);
 static int	write_combined(const char *title, const char *directory,
 		               const char *prodname, const char *platname,
 			       dist_t *dist, const char **files,
@@ -36,15 +51,23 @@ static int	write_combined(const char *title, const char *directory,
 			       const char *types);
 static int	write_commands(dist_t *dist, FILE *fp, int type,
 		               const char *subpackage);
-static FILE	*write_common(dist_t *dist, const char *title,
-			      int rootsize, int usrsize,
-		              const char *filename, const char *subpackage);
+static FILE	*write_common(dist_t *dist, const char *prodname,
+			      const char *title, int rootsize, int usrsize, int num_spaces,
+			      space_t *spaces, const char *filename,
+			      const char *subpackage);
 static int	write_confcheck(FILE *fp);
+static int	write_delta(tarf_t **deltafile, const char *directory,
+		            const char *prodfull, file_t *file,
+			    struct stat *srcstat);
 static int	write_depends(const char *prodname, dist_t *dist, FILE *fp,
 		              const char *subpackage);
 static int	write_distfiles(const char *directory, const char *prodname,
 		                const char *platname, dist_t *dist,
 				time_t deftime, const char *subpackage);
+static int	write_filelist(dist_t *dist, const char *prodname,
+		               const char *directory,
+			       const char *subpackage);
+static void	write_filesfunc(FILE *fp);
 static int	write_install(dist_t *dist, const char *prodname,
 			      int rootsize, int usrsize,
 		              const char *directory,
@@ -53,17 +76,21 @@ static int	write_instfiles(tarf_t *tarfile, const char *directory,
 		                const char *prodname, const char *platname,
 			        const char **files, const char *destdir,
 				const char *subpackage);
+static void	write_inventory(FILE *fp, const char *prodfull, int add);
 static int	write_patch(dist_t *dist, const char *prodname,
-			    int rootsize, int usrsize,
+			    int rootsize, int usrsize, int deltas,
 		            const char *directory,
 		            const char *subpackage);
+static int	write_permissions(FILE *fp, int num_files, file_t **files,
+			          const char *types, int flags);
 static int	write_remove(dist_t *dist, const char *prodname,
 			     int rootsize, int usrsize,
 		             const char *directory,
 		             const char *subpackage);
-static int	write_space_checks(const char *prodname, FILE *fp,
-		                   const char *sw, const char *ss,
-				   int rootsize, int usrsize);
+static int	write_space_checks(FILE *fp, const char *script,
+		                   int num_spaces, space_t *spaces);
+static int	write_suite(dist_t *dist, const char *prodname,
+		            const char *directory);
 
 
 /*
@@ -82,21 +109,25 @@ make_portable(const char     *prodname,	/* I - Product short name */
   int		i;			/* Looping var */
   int		havepatchfiles;		/* 1 if we have patch files, 0 otherwise */
   time_t	deftime;		/* File creation time */
-  file_t	*file;			/* Software file */
+  fileindex_t	*fileindex;		/* File index */
   static const char	*distfiles[] =	/* Distribution files */
 		{
 		  "install",
+		  "files",
 		  "license",
 		  "readme",
 		  "remove",
 		  "ss",
+		  "suite",
 		  "sw",
 		  NULL
 		};
   static const char	*patchfiles[] =	/* Patch files */
 		{
 		  "patch",
+		  "files",
 		  "license",
+		  "psd",
 		  "pss",
 		  "psw",
 		  "readme",
@@ -114,11 +145,12 @@ make_portable(const char     *prodname,	/* I - Product short name */
   * See if we need to make a patch distribution...
   */
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (isupper((int)file->type))
-      break;
-
-  havepatchfiles = i > 0;
+  for (i = dist->num_subpackages, fileindex = get_index(dist, NULL),
+           havepatchfiles = 0;
+       i >= 0;
+       i --, fileindex ++)
+    if (fileindex->num_patches)
+      havepatchfiles = 1;
 
   deftime = time(NULL);
 
@@ -134,10 +166,15 @@ make_portable(const char     *prodname,	/* I - Product short name */
                         dist->subpackages[i]))
       return (1);
 
+  if (dist->num_subpackages > 0 && write_suite(dist, prodname, directory))
+    return (1);
+
  /*
   * Create the distribution archives...
   */
 
+  stats_phase("archive");
+
   if (write_combined("distribution", directory, prodname, platname, dist,
                      distfiles, deftime, setup, types))
     return (1);
@@ -199,6 +236,9 @@ clean_distfiles(const char *directory,	/* I - Directory */
   if (Verbosity)
     printf("Removing %s temporary files...\n", prodfull);
 
+  snprintf(filename, sizeof(filename), "%s/%s.files", directory, prodfull);
+  unlink(filename);
+
   snprintf(filename, sizeof(filename), "%s/%s.install", directory, prodfull);
   unlink(filename);
 
@@ -208,7 +248,10 @@ clean_distfiles(const char *directory,	/* I - Directory */
   snprintf(filename, sizeof(filename), "%s/%s.patch", directory, prodfull);
   unlink(filename);
 
-  snprintf(filename, sizeof(filename), "%s/%s.psw", directory, prodfull);
+  snprintf(filename, sizeof(filename), "%s/%s.psd", directory, prodfull);
+  unlink(filename);
+
+  snprintf(filename, sizeof(filename), "%s/%s.pss", directory, prodfull);
   unlink(filename);
 
   snprintf(filename, sizeof(filename), "%s/%s.psw", directory, prodfull);
@@ -223,11 +266,183 @@ clean_distfiles(const char *directory,	/* I - Directory */
   snprintf(filename, sizeof(filename), "%s/%s.ss", directory, prodfull);
   unlink(filename);
 
+  snprintf(filename, sizeof(filename), "%s/%s.suite", directory, prodfull);
+  unlink(filename);
+
   snprintf(filename, sizeof(filename), "%s/%s.sw", directory, prodfull);
   unlink(filename);
 }
 
 
+/*
+ * 'close_delta()' - Close and remove a partial binary patch file.
+ */
+
+static void
+close_delta(tarf_t     *deltafile,	/* I - Binary patch tar file or NULL */
+            const char *directory,	/* I - Directory */
+	    const char *prodfull)	/* I - Full product name */
+{
+  char	filename[1024];			/* Binary patch file */
+
+
+  if (!deltafile)
+    return;
+
+  tar_close(deltafile);
+
+  snprintf(filename, sizeof(filename), "%s/%s.psd", directory, prodfull);
+  unlink(filename);
+}
+
+
+/*
+ * 'compare_group()' - Compare the groups of two files.
+ */
+
+static int				/* O - Result of comparison */
+compare_group(const void *a,		/* I - First file */
+              const void *b)		/* I - Second file */
+{
+  const file_t	*fa = *((file_t * const *)a),
+		*fb = *((file_t * const *)b);
+  int		result;			/* Result of comparison */
+
+
+  if ((result = strcmp(fa->group, fb->group)) != 0)
+    return (result);
+  else
+    return (fa < fb ? -1 : fa > fb);
+}
+
+
+/*
+ * 'compare_mode()' - Compare the permissions of two files.
+ */
+
+static int				/* O - Result of comparison */
+compare_mode(const void *a,		/* I - First file */
+             const void *b)		/* I - Second file */
+{
+  const file_t	*fa = *((file_t * const *)a),
+		*fb = *((file_t * const *)b);
+
+
+  if (fa->mode != fb->mode)
+    return (fa->mode - fb->mode);
+  else
+    return (fa < fb ? -1 : fa > fb);
+}
+
+
+/*
+ * 'compare_user()' - Compare the owners of two files.
+ */
+
+static int				/* O - Result of comparison */
+compare_user(const void *a,		/* I - First file */
+             const void *b)		/* I - Second file */
+{
+  const file_t	*fa = *((file_t * const *)a),
+		*fb = *((file_t * const *)b);
+  int		result;			/* Result of comparison */
+
+
+  if ((result = strcmp(fa->user, fb->user)) != 0)
+    return (result);
+  else
+    return (fa < fb ? -1 : fa > fb);
+}
+
+
+/*
+ * 'get_spaces()' - Get the disk space needed in each destination directory.
+ *
+ * The full destination directory is used so that the installer finds the
+ * right filesystem even when it is mounted deep in the tree.  Config files
+ * are counted twice for the new (.N) and installed copies.
+ */
+
+static int				/* O - Number of directories */
+get_spaces(fileindex_t *fileindex,	/* I - File index */
+           int         patch,		/* I - Only count patch files? */
+	   space_t     **spaces)	/* O - Directories */
+{
+  int		i,			/* Looping var */
+		count,			/* Number of copies */
+		num_spaces;		/* Number of directories */
+  file_t	*file,			/* Current file */
+		**fileptr;		/* Pointer into file index */
+  char		dir[1024],		/* Destination directory */
+		*ptr;			/* Pointer into directory */
+  struct stat	srcstat;		/* Source file information */
+  long long	size;			/* Size of file */
+
+
+  *spaces    = NULL;
+  num_spaces = 0;
+
+  for (i = fileindex->num_files, fileptr = fileindex->files;
+       i > 0;
+       i --, fileptr ++)
+  {
+    file = *fileptr;
+
+    if (patch && !isupper(file->type & 255))
+      continue;
+
+    count = 1;
+    size  = 0;
+
+    switch (tolower(file->type))
+    {
+      case 'c' :
+          count = 2;
+
+      case 'f' :
+      case 'i' :
+          IOStats.stat_calls ++;
+
+          if (!stat(file->src, &srcstat))
+	    size = srcstat.st_size;
+
+          if (tolower(file->type) == 'i')
+	    snprintf(dir, sizeof(dir), "%s/init.d/%s", SoftwareDir, file->dst);
+	  else
+	    strlcpy(dir, file->dst, sizeof(dir));
+
+          if ((ptr = strrchr(dir, '/')) != NULL && ptr > dir)
+	    *ptr = '\0';
+	  break;
+
+      case 'd' :
+          size = 1;
+          strlcpy(dir, file->dst, sizeof(dir));
+	  break;
+
+      case 'l' :
+          strlcpy(dir, file->dst, sizeof(dir));
+
+          if ((ptr = strrchr(dir, '/')) != NULL && ptr > dir)
+	    *ptr = '\0';
+	  break;
+
+      default :
+          continue;
+    }
+
+    while (strlen(dir) >= sizeof((*spaces)->dst) &&
+           (ptr = strrchr(dir, '/')) != NULL && ptr > dir)
+      *ptr = '\0';			/* Use the parent of very long paths */
+
+    add_space(&num_spaces, spaces, dir, count, count * ((size + 1023) / 1024),
+              count * ((size + 4095) / 4096 * 4));
+  }
+
+  return (num_spaces);
+}
+
+
 /*
  * 'write_combined()' - Write all of the distribution files in tar files.
  */
@@ -341,7 +556,7 @@ write_combined(const char *title,	/* I - Title */
       return (-1);
     }
 
-    if (tar_file(tarfile, filename) < 0)
+    if (tar_file(tarfile, filename, NULL) < 0)
     {
       tar_close(tarfile);
       return (-1);
@@ -408,7 +623,7 @@ write_combined(const char *title,	/* I - Title */
       return (-1);
     }
 
-    if (tar_file(tarfile, filename) < 0)
+    if (tar_file(tarfile, filename, NULL) < 0)
     {
       tar_close(tarfile);
       return (-1);
@@ -446,6 +661,38 @@ write_combined(const char *title,	/* I - Title */
       return (-1);
     }
 
+ /*
+  * Include the installer runtime...
+  */
+
+  if (UnpackProgram)
+  {
+    if (stat(UnpackProgram, &srcstat))
+    {
+      fprintf(stderr, "epm: Unable to stat unpack program %s: %s\n", UnpackProgram, strerror(errno));
+      tar_close(tarfile);
+      return (-1);
+    }
+
+    snprintf(filename, sizeof(filename), "%sepmunpack", destdir);
+
+    if (tar_header(tarfile, TAR_NORMAL, 0555, srcstat.st_size,
+	           srcstat.st_mtime, "root", "root", filename, NULL) < 0)
+    {
+      tar_close(tarfile);
+      return (-1);
+    }
+
+    if (tar_file(tarfile, UnpackProgram, NULL) < 0)
+    {
+      tar_close(tarfile);
+      return (-1);
+    }
+
+    if (Verbosity)
+      printf("    %7.0fk epmunpack\n", (srcstat.st_size + 1023) / 1024.0);
+  }
+
  /*
   * Now the setup files...
   */
@@ -476,7 +723,7 @@ write_combined(const char *title,	/* I - Title */
       return (-1);
     }
 
-    if (tar_file(tarfile, SetupProgram) < 0)
+    if (tar_file(tarfile, SetupProgram, NULL) < 0)
     {
       tar_close(tarfile);
       return (-1);
@@ -509,7 +756,7 @@ write_combined(const char *title,	/* I - Title */
       return (-1);
     }
 
-    if (tar_file(tarfile, setup) < 0)
+    if (tar_file(tarfile, setup, NULL) < 0)
     {
       tar_close(tarfile);
       return (-1);
@@ -534,7 +781,7 @@ write_combined(const char *title,	/* I - Title */
 	return (-1);
       }
 
-      if (tar_file(tarfile, types) < 0)
+      if (tar_file(tarfile, types, NULL) < 0)
       {
         tar_close(tarfile);
 	return (-1);
@@ -592,7 +839,7 @@ write_combined(const char *title,	/* I - Title */
       return (-1);
     }
 
-    if (tar_file(tarfile, filename) < 0)
+    if (tar_file(tarfile, filename, NULL) < 0)
     {
       tar_close(tarfile);
       return (-1);
@@ -659,7 +906,7 @@ write_combined(const char *title,	/* I - Title */
       return (-1);
     }
 
-    if (tar_file(tarfile, filename) < 0)
+    if (tar_file(tarfile, filename, NULL) < 0)
     {
       tar_close(tarfile);
       return (-1);
@@ -696,7 +943,7 @@ write_combined(const char *title,	/* I - Title */
       return (-1);
     }
 
-    if (tar_file(tarfile, UninstProgram) < 0)
+    if (tar_file(tarfile, UninstProgram, NULL) < 0)
     {
       tar_close(tarfile);
       return (-1);
@@ -722,7 +969,7 @@ write_combined(const char *title,	/* I - Title */
       return (-1);
     }
 
-    if (tar_file(tarfile, setup) < 0)
+    if (tar_file(tarfile, setup, NULL) < 0)
     {
       tar_close(tarfile);
       return (-1);
@@ -759,7 +1006,9 @@ write_combined(const char *title,	/* I - Title */
 
 #ifdef __APPLE__
   {
-    char	dmgfilename[1024];	/* Disk image filename */
+    char	dmgfilename[1024],	/* Disk image filename */
+		tararg[1024],		/* Tar file relative to the folder */
+		*argv[7];		/* Command */
 
 
    /*
@@ -786,14 +1035,28 @@ write_combined(const char *title,	/* I - Title */
 
     mkdir(filename, 0777);
 
-    if (run_command(filename, "tar xvzf ../%s", strrchr(tarfilename, '/') + 1))
+    snprintf(tararg, sizeof(tararg), "../%s", strrchr(tarfilename, '/') + 1);
+
+    argv[0] = "tar";
+    argv[1] = "xvzf";
+    argv[2] = tararg;
+    argv[3] = NULL;
+
+    if (run_argv(filename, argv))
     {
       fputs("epm: Unable to create disk image template folder!\n", stderr);
       return (1);
     }
 
-    if (run_command(NULL, "hdiutil create -ov -srcfolder %s %s",
-		    filename, dmgfilename))
+    argv[0] = "hdiutil";
+    argv[1] = "create";
+    argv[2] = "-ov";
+    argv[3] = "-srcfolder";
+    argv[4] = filename;
+    argv[5] = dmgfilename;
+    argv[6] = NULL;
+
+    if (run_argv(NULL, argv))
     {
       fputs("epm: Unable to create disk image!\n", stderr);
       return (1);
@@ -866,17 +1129,28 @@ write_commands(dist_t     *dist,	/* I - Distribution */
 
 static FILE *				/* O - File pointer */
 write_common(dist_t     *dist,		/* I - Distribution */
+             const char *prodname,	/* I - Product name or NULL */
              const char *title,		/* I - "Installation", etc... */
              int        rootsize,	/* I - Size of root files in kbytes */
 	     int        usrsize,	/* I - Size of /usr files in kbytes */
+	     int        num_spaces,	/* I - Number of directories */
+	     space_t    *spaces,	/* I - Space needed in directories */
              const char *filename,	/* I - Script to create */
 	     const char *subpackage)	/* I - Subpackage name */
 {
-  int	i;				/* Looping var */
-  FILE	*fp;				/* File pointer */
-  char	line[1024],			/* Line buffer */
-	*start,				/* Start of line */
-	*ptr;				/* Pointer into line */
+  int		i;			/* Looping var */
+  FILE		*fp;			/* File pointer */
+  char		line[1024],		/* Line buffer */
+		*start,			/* Start of line */
+		*ptr;			/* Pointer into line */
+  depend_t	*d;			/* Current dependency */
+  static const char *depends[] =	/* Dependency strings */
+		{
+		  "requires",
+		  "incompat",
+		  "replaces",
+		  "provides"
+		};
 
 
  /*
@@ -974,6 +1248,25 @@ write_common(dist_t     *dist,		/* I - Distribution */
 
   fprintf(fp, "#%%rootsize %d\n", rootsize);
   fprintf(fp, "#%%usrsize %d\n", usrsize);
+
+  for (i = 0; i < num_spaces; i ++)
+    fprintf(fp, "#%%space %s %ld %lld %lld\n", spaces[i].dst, spaces[i].inodes,
+            spaces[i].kbytes[0], spaces[i].kbytes[1]);
+
+ /*
+  * Dependencies are listed in the header as well so that the setup program
+  * only needs to read the header...
+  */
+
+  if (prodname)
+  {
+    for (i = 0, d = dist->depends; i < dist->num_depends; i ++, d ++)
+      if (d->subpackage == subpackage)
+	fprintf(fp, "#%%%s %s %d %d\n", depends[(int)d->type],
+		strcmp(d->product, "_self") ? d->product : prodname,
+		d->vernumber[0], d->vernumber[1]);
+  }
+
   fputs("#\n", fp);
 
   fputs("PATH=/usr/gnu/bin:/usr/xpg4/bin:/bin:/usr/bin:/usr/ucb:${PATH}\n", fp);
@@ -1059,6 +1352,79 @@ write_confcheck(FILE *fp)		/* I - Script file */
 }
 
 
+/*
+ * 'write_delta()' - Write a binary patch for a file.
+ *
+ * The delta is made against the same file in the previous release
+ * directory and is only used when it is smaller than 3/4 of the new file.
+ */
+
+static int				/* O - 1 if written, 0 if not, -1 on error */
+write_delta(tarf_t      **deltafile,	/* IO - Binary patch tar file */
+            const char  *directory,	/* I - Directory */
+	    const char  *prodfull,	/* I - Full product name */
+	    file_t      *file,		/* I - File */
+	    struct stat *srcstat)	/* I - File information */
+{
+  char		oldname[1024],		/* File in previous release */
+		deltaname[1024];	/* Delta file */
+  struct stat	oldstat;		/* Previous file information */
+  off_t		size;			/* Size of delta */
+
+
+  snprintf(oldname, sizeof(oldname), "%s%s", PatchFrom, file->dst);
+
+  IOStats.stat_calls ++;
+
+  if (lstat(oldname, &oldstat) || !S_ISREG(oldstat.st_mode))
+    return (0);
+
+  snprintf(deltaname, sizeof(deltaname), "%s/%s.delta", directory, prodfull);
+
+  if ((size = delta_create(oldname, file->src, deltaname)) < 0)
+    return (-1);
+
+  if (size >= srcstat->st_size / 4 * 3)
+  {
+    unlink(deltaname);
+    return (0);
+  }
+
+  if (!*deltafile)
+  {
+    if (Verbosity)
+      puts("Creating software binary patch file...");
+
+    snprintf(oldname, sizeof(oldname), "%s/%s.psd", directory, prodfull);
+
+    if ((*deltafile = tar_open(oldname, CompressFiles)) == NULL)
+    {
+      fprintf(stderr, "epm: Unable to create file \"%s\" -\n     %s\n",
+              oldname, strerror(errno));
+      unlink(deltaname);
+      return (-1);
+    }
+  }
+
+  if (Verbosity > 1)
+    printf("%s -> %s (%.0f%% delta)...\n", file->src, file->dst,
+           100.0 * size / (srcstat->st_size ? srcstat->st_size : 1));
+
+  if (tar_header(*deltafile, TAR_NORMAL, file->mode, size,
+                 srcstat->st_mtime, file->user, file->group, file->dst,
+		 NULL) < 0 ||
+      tar_file(*deltafile, deltaname, NULL) < 0)
+  {
+    unlink(deltaname);
+    return (-1);
+  }
+
+  unlink(deltaname);
+
+  return (1);
+}
+
+
 /*
  * 'write_depends()' - Write dependencies.
  */
@@ -1072,13 +1438,6 @@ write_depends(const char *prodname,	/* I - Product name */
   int			i;		/* Looping var */
   depend_t		*d;		/* Current dependency */
   const char		*product;	/* Product/file to depend on */
-  static const char	*depends[] =	/* Dependency strings */
-			{
-			  "requires",
-			  "incompat",
-			  "replaces",
-			  "provides"
-			};
 
 
   for (i = 0, d = dist->depends; i < dist->num_depends; i ++, d ++)
@@ -1089,9 +1448,6 @@ write_depends(const char *prodname,	/* I - Product name */
       else
         product = d->product;
 
-      fprintf(fp, "#%%%s %s %d %d\n", depends[(int)d->type], product,
-              d->vernumber[0], d->vernumber[1]);
-
       switch (d->type)
       {
 	case DEPEND_REQUIRES :
@@ -1282,11 +1638,16 @@ write_distfiles(const char *directory,	/* I - Directory */
 		pswname[255],		/* Name of patch tar file */
 		filename[1024];		/* Name of temporary file */
   struct stat	srcstat;		/* Source file information */
-  file_t	*file;			/* Software file */
+  file_t	*file,			/* Software file */
+		**fileptr;		/* Pointer into file index */
+  fileindex_t	*fileindex;		/* File index for subpackage */
   int		rootsize,		/* Size of files in root partition */
 		usrsize;		/* Size of files in /usr partition */
   int		prootsize,		/* Size of patch files in root partition */
 		pusrsize;		/* Size of patch files in /usr partition */
+  tarf_t	*deltafile;		/* Binary patch tar file */
+  int		status,			/* Status of write_delta() */
+		empty;			/* Is the patch archive empty? */
 
 
  /*
@@ -1302,30 +1663,29 @@ write_distfiles(const char *directory,	/* I - Directory */
   * See if we need to make a patch distribution...
   */
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (isupper((int)file->type) && file->subpackage == subpackage)
-      break;
-
-  havepatchfiles = i > 0;
+  fileindex      = get_index(dist, subpackage);
+  havepatchfiles = fileindex->num_patches > 0;
 
  /*
   * Copy the license and readme files...
   */
 
+  stats_phase("archive");
+
   if (Verbosity)
     printf("Copying %s license and readme files...\n", prodfull);
 
   if (dist->license[0])
   {
     snprintf(filename, sizeof(filename), "%s/%s.license", directory, prodfull);
-    if (copy_file(filename, dist->license, 0444, getuid(), getgid()))
+    if (copy_file(filename, dist->license, 0444, getuid(), getgid(), NULL))
       return (1);
   }
 
   if (dist->readme[0])
   {
     snprintf(filename, sizeof(filename), "%s/%s.readme", directory, prodfull);
-    if (copy_file(filename, dist->readme, 0444, getuid(), getgid()))
+    if (copy_file(filename, dist->readme, 0444, getuid(), getgid(), NULL))
       return (1);
   }
 
@@ -1347,87 +1707,86 @@ write_distfiles(const char *directory,	/* I - Directory */
     return (1);
   }
 
-  for (i = dist->num_files, file = dist->files, rootsize = 0, prootsize = 0;
+  for (i = fileindex->num_parts[INDEX_ROOT],
+           fileptr = fileindex->parts[INDEX_ROOT], rootsize = 0, prootsize = 0;
        i > 0;
-       i --, file ++)
-    if (strncmp(file->dst, "/usr", 4) != 0 && file->subpackage == subpackage)
-      switch (tolower(file->type))
-      {
-	case 'f' : /* Regular file */
-	case 'c' : /* Config file */
-	case 'i' : /* Init script */
-            if (stat(file->src, &srcstat))
-	    {
-	      fprintf(stderr, "epm: Cannot stat \"%s\": %s\n", file->src, strerror(errno));
-	      tar_close(tarfile);
-	      return (1);
-	    }
-
-            rootsize += (srcstat.st_size + 1023) / 1024;
-
-            if (isupper(file->type & 255))
-              prootsize += (srcstat.st_size + 1023) / 1024;
-
-           /*
-	    * Configuration files are extracted to the config file name with
-	    * .N appended; add a bit of script magic to check if the config
-	    * file already exists, and if not we copy the .N to the config
-	    * file location...
-	    */
-
-	    if (tolower(file->type) == 'c')
-	      snprintf(filename, sizeof(filename), "%s.N", file->dst);
-	    else if (tolower(file->type) == 'i')
-	      snprintf(filename, sizeof(filename), "%s/init.d/%s", SoftwareDir,
-	               file->dst);
-	    else
-              strlcpy(filename, file->dst, sizeof(filename));
+       i --, fileptr ++)
+  {
+    file = *fileptr;
 
-            if (Verbosity > 1)
-	      printf("%s -> %s...\n", file->src, filename);
+    switch (tolower(file->type))
+    {
+      case 'f' : /* Regular file */
+      case 'c' : /* Config file */
+      case 'i' : /* Init script */
+	  IOStats.stat_calls ++;
+
+	  if (stat(file->src, &srcstat))
+	  {
+	    fprintf(stderr, "epm: Cannot stat \"%s\": %s\n", file->src, strerror(errno));
+	    tar_close(tarfile);
+	    return (1);
+	  }
+
+	  rootsize += (srcstat.st_size + 1023) / 1024;
+
+	  if (isupper(file->type & 255))
+	    prootsize += (srcstat.st_size + 1023) / 1024;
+
+	 /*
+	  * Configuration files are extracted to the config file name with
+	  * .N appended; add a bit of script magic to check if the config
+	  * file already exists, and if not we copy the .N to the config
+	  * file location...
+	  */
+
+	  if (tolower(file->type) == 'c')
+	    snprintf(filename, sizeof(filename), "%s.N", file->dst);
+	  else if (tolower(file->type) == 'i')
+	    snprintf(filename, sizeof(filename), "%s/init.d/%s", SoftwareDir,
+		     file->dst);
+	  else
+	    strlcpy(filename, file->dst, sizeof(filename));
 
-	    if (tar_header(tarfile, TAR_NORMAL, file->mode, srcstat.st_size,
-	                   srcstat.st_mtime, file->user, file->group,
-			   filename, NULL) < 0)
-	    {
-	      tar_close(tarfile);
-	      return (1);
-	    }
+	  if (Verbosity > 1)
+	    printf("%s -> %s...\n", file->src, filename);
 
-	    if (tar_file(tarfile, file->src) < 0)
-	    {
-	      tar_close(tarfile);
-	      return (1);
-	    }
-	    break;
+	  if (tar_dist_file(tarfile, file, srcstat.st_size, srcstat.st_mtime,
+			    filename) < 0)
+	  {
+	    tar_close(tarfile);
+	    return (1);
+	  }
+	  break;
 
-	case 'd' : /* Create directory */
-            if (Verbosity > 1)
-	      printf("Directory %s...\n", file->dst);
+      case 'd' : /* Create directory */
+	  if (Verbosity > 1)
+	    printf("Directory %s...\n", file->dst);
 
-            rootsize ++;
+	  rootsize ++;
 
-            if (isupper(file->type & 255))
-              prootsize ++;
-	    break;
+	  if (isupper(file->type & 255))
+	    prootsize ++;
+	  break;
 
-	case 'l' : /* Link file */
-            if (Verbosity > 1)
-	      printf("%s -> %s...\n", file->src, file->dst);
+      case 'l' : /* Link file */
+	  if (Verbosity > 1)
+	    printf("%s -> %s...\n", file->src, file->dst);
 
-	    if (tar_header(tarfile, TAR_SYMLINK, file->mode, 0, deftime,
-	                   file->user, file->group, file->dst, file->src) < 0)
-	    {
-	      tar_close(tarfile);
-	      return (1);
-	    }
+	  if (tar_header(tarfile, TAR_SYMLINK, file->mode, 0, deftime,
+			 file->user, file->group, file->dst, file->src) < 0)
+	  {
+	    tar_close(tarfile);
+	    return (1);
+	  }
 
-            rootsize ++;
+	  rootsize ++;
 
-            if (isupper(file->type & 255))
-              prootsize ++;
-	    break;
-      }
+	  if (isupper(file->type & 255))
+	    prootsize ++;
+	  break;
+    }
+  }
 
   tar_close(tarfile);
 
@@ -1449,89 +1808,88 @@ write_distfiles(const char *directory,	/* I - Directory */
     return (1);
   }
 
-  for (i = dist->num_files, file = dist->files, usrsize = 0, pusrsize = 0;
+  for (i = fileindex->num_parts[INDEX_USR],
+           fileptr = fileindex->parts[INDEX_USR], usrsize = 0, pusrsize = 0;
        i > 0;
-       i --, file ++)
-    if (strncmp(file->dst, "/usr", 4) == 0 && file->subpackage == subpackage)
-      switch (tolower(file->type))
-      {
-	case 'f' : /* Regular file */
-	case 'c' : /* Config file */
-	case 'i' : /* Init script */
-            if (stat(file->src, &srcstat))
-	    {
-	      fprintf(stderr, "epm: Cannot stat \"%s\": %s\n", file->src, strerror(errno));
-	      tar_close(tarfile);
-	      return (1);
-	    }
+       i --, fileptr ++)
+  {
+    file = *fileptr;
 
-            usrsize += (srcstat.st_size + 1023) / 1024;
+    switch (tolower(file->type))
+    {
+      case 'f' : /* Regular file */
+      case 'c' : /* Config file */
+      case 'i' : /* Init script */
+	  IOStats.stat_calls ++;
+
+	  if (stat(file->src, &srcstat))
+	  {
+	    fprintf(stderr, "epm: Cannot stat \"%s\": %s\n", file->src, strerror(errno));
+	    tar_close(tarfile);
+	    return (1);
+	  }
+
+	  usrsize += (srcstat.st_size + 1023) / 1024;
+
+	  if (isupper(file->type & 255))
+	    pusrsize += (srcstat.st_size + 1023) / 1024;
+
+	 /*
+	  * Configuration files are extracted to the config file name with
+	  * .N appended; add a bit of script magic to check if the config
+	  * file already exists, and if not we copy the .N to the config
+	  * file location...
+	  */
+
+	  if (tolower(file->type) == 'c')
+	    snprintf(filename, sizeof(filename), "%s.N", file->dst);
+	  else if (tolower(file->type) == 'i')
+	    snprintf(filename, sizeof(filename), "%s/init.d/%s", SoftwareDir,
+		     file->dst);
+	  else
+	    strlcpy(filename, file->dst, sizeof(filename));
 
-            if (isupper(file->type & 255))
-              pusrsize += (srcstat.st_size + 1023) / 1024;
+	  if (Verbosity > 1)
+	    printf("%s -> %s...\n", file->src, filename);
 
-           /*
-	    * Configuration files are extracted to the config file name with
-	    * .N appended; add a bit of script magic to check if the config
-	    * file already exists, and if not we copy the .N to the config
-	    * file location...
-	    */
+	  if (tar_dist_file(tarfile, file, srcstat.st_size, srcstat.st_mtime,
+			    filename) < 0)
+	  {
+	    tar_close(tarfile);
+	    return (1);
+	  }
+	  break;
 
-	    if (tolower(file->type) == 'c')
-	      snprintf(filename, sizeof(filename), "%s.N", file->dst);
-	    else if (tolower(file->type) == 'i')
-	      snprintf(filename, sizeof(filename), "%s/init.d/%s", SoftwareDir,
-	               file->dst);
-	    else
-              strlcpy(filename, file->dst, sizeof(filename));
+      case 'd' : /* Create directory */
+	  if (Verbosity > 1)
+	    printf("%s...\n", file->dst);
 
-            if (Verbosity > 1)
-	      printf("%s -> %s...\n", file->src, filename);
+	  usrsize ++;
 
-	    if (tar_header(tarfile, TAR_NORMAL, file->mode, srcstat.st_size,
-	                   srcstat.st_mtime, file->user, file->group,
-			   filename, NULL) < 0)
-	    {
-	      tar_close(tarfile);
-	      return (1);
-	    }
+	  if (isupper(file->type & 255))
+	    pusrsize ++;
+	  break;
 
-	    if (tar_file(tarfile, file->src) < 0)
-	    {
-	      tar_close(tarfile);
-	      return (1);
-	    }
-	    break;
+      case 'l' : /* Link file */
+	  if (Verbosity > 1)
+	    printf("%s -> %s...\n", file->src, file->dst);
 
-	case 'd' : /* Create directory */
-            if (Verbosity > 1)
-	      printf("%s...\n", file->dst);
+	  if (tar_header(tarfile, TAR_SYMLINK, file->mode, 0, deftime,
+			 file->user, file->group, file->dst, file->src) < 0)
+	  {
+	    tar_close(tarfile);
+	    return (1);
+	  }
 
-	    usrsize ++;
+	  usrsize ++;
 
-            if (isupper(file->type & 255))
-              pusrsize ++;
-	    break;
+	  if (isupper(file->type & 255))
+	    pusrsize ++;
+	  break;
+    }
+  }
 
-	case 'l' : /* Link file */
-            if (Verbosity > 1)
-	      printf("%s -> %s...\n", file->src, file->dst);
-
-	    if (tar_header(tarfile, TAR_SYMLINK, file->mode, 0, deftime,
-	                   file->user, file->group, file->dst, file->src) < 0)
-	    {
-	      tar_close(tarfile);
-	      return (1);
-	    }
-
-	    usrsize ++;
-
-            if (isupper(file->type & 255))
-              pusrsize ++;
-	    break;
-      }
-
-  tar_close(tarfile);
+  tar_close(tarfile);
 
  /*
   * Create the patch distribution files...
@@ -1539,6 +1897,11 @@ write_distfiles(const char *directory,	/* I - Directory */
 
   if (havepatchfiles)
   {
+    deltafile = NULL;
+
+    snprintf(filename, sizeof(filename), "%s/%s.psd", directory, prodfull);
+    unlink(filename);
+
     if (Verbosity)
       puts("Creating non-shared software patch file...");
 
@@ -1550,76 +1913,106 @@ write_distfiles(const char *directory,	/* I - Directory */
     {
       fprintf(stderr, "epm: Unable to create file \"%s\" -\n     %s\n",
               filename, strerror(errno));
+      close_delta(deltafile, directory, prodfull);
       return (1);
     }
 
-    for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-      if (strncmp(file->dst, "/usr", 4) != 0 && file->subpackage == subpackage)
-	switch (file->type)
-	{
-	  case 'C' : /* Config file */
-	  case 'F' : /* Regular file */
-          case 'I' : /* Init script */
-              if (stat(file->src, &srcstat))
-	      {
-		fprintf(stderr, "epm: Cannot stat \"%s\": %s\n", file->src, strerror(errno));
-		tar_close(tarfile);
-		return (1);
-	      }
+    for (i = fileindex->num_parts[INDEX_ROOT],
+             fileptr = fileindex->parts[INDEX_ROOT];
+	 i > 0;
+	 i --, fileptr ++)
+    {
+      file = *fileptr;
 
-             /*
-	      * Configuration files are extracted to the config file name with
-	      * .N appended; add a bit of script magic to check if the config
-	      * file already exists, and if not we copy the .N to the config
-	      * file location...
-	      */
+      switch (file->type)
+      {
+	case 'C' : /* Config file */
+	case 'F' : /* Regular file */
+	case 'I' : /* Init script */
+	    IOStats.stat_calls ++;
 
-	      if (file->type == 'C')
-		snprintf(filename, sizeof(filename), "%s.N", file->dst);
-	      else if (file->type == 'I')
-		snprintf(filename, sizeof(filename), "%s/init.d/%s", SoftwareDir,
-		         file->dst);
-	      else
-        	strlcpy(filename, file->dst, sizeof(filename));
+	    if (stat(file->src, &srcstat))
+	    {
+	      fprintf(stderr, "epm: Cannot stat \"%s\": %s\n", file->src, strerror(errno));
+	      tar_close(tarfile);
+	      close_delta(deltafile, directory, prodfull);
+	      return (1);
+	    }
 
-              if (Verbosity > 1)
-		printf("%s -> %s...\n", file->src, filename);
+	   /*
+	    * Configuration files are extracted to the config file name with
+	    * .N appended; add a bit of script magic to check if the config
+	    * file already exists, and if not we copy the .N to the config
+	    * file location...
+	    */
 
-	      if (tar_header(tarfile, TAR_NORMAL, file->mode, srcstat.st_size,
-	                     srcstat.st_mtime, file->user, file->group,
-			     filename, NULL) < 0)
-	      {
-		tar_close(tarfile);
-		return (1);
-	      }
+	    if (file->type == 'C')
+	      snprintf(filename, sizeof(filename), "%s.N", file->dst);
+	    else if (file->type == 'I')
+	      snprintf(filename, sizeof(filename), "%s/init.d/%s", SoftwareDir,
+		       file->dst);
+	    else
+	      strlcpy(filename, file->dst, sizeof(filename));
 
-	      if (tar_file(tarfile, file->src) < 0)
+	    if (file->type == 'F' && PatchFrom)
+	    {
+	      if ((status = write_delta(&deltafile, directory, prodfull, file,
+	                                &srcstat)) < 0)
 	      {
-		tar_close(tarfile);
+	        tar_close(tarfile);
+		close_delta(deltafile, directory, prodfull);
 		return (1);
 	      }
-	      break;
+	      else if (status > 0)
+	        break;
+	    }
 
-	  case 'd' : /* Create directory */
-              if (Verbosity > 1)
-		printf("%s...\n", file->dst);
-	      break;
+	    if (Verbosity > 1)
+	      printf("%s -> %s...\n", file->src, filename);
 
-	  case 'L' : /* Link file */
-              if (Verbosity > 1)
-		printf("%s -> %s...\n", file->src, file->dst);
+	    if (tar_dist_file(tarfile, file, srcstat.st_size, srcstat.st_mtime,
+			      filename) < 0)
+	    {
+	      tar_close(tarfile);
+	      close_delta(deltafile, directory, prodfull);
+	      return (1);
+	    }
+	    break;
 
-	      if (tar_header(tarfile, TAR_SYMLINK, file->mode, 0, deftime,
-	                     file->user, file->group, file->dst, file->src) < 0)
-	      {
-		tar_close(tarfile);
-		return (1);
-	      }
-	      break;
-	}
+	case 'd' : /* Create directory */
+	    if (Verbosity > 1)
+	      printf("%s...\n", file->dst);
+	    break;
+
+	case 'L' : /* Link file */
+	    if (Verbosity > 1)
+	      printf("%s -> %s...\n", file->src, file->dst);
+
+	    if (tar_header(tarfile, TAR_SYMLINK, file->mode, 0, deftime,
+			   file->user, file->group, file->dst, file->src) < 0)
+	    {
+	      tar_close(tarfile);
+	      close_delta(deltafile, directory, prodfull);
+	      return (1);
+	    }
+	    break;
+      }
+    }
+
+   /*
+    * Remove the archive if all of the files are binary patches...
+    */
+
+    empty = tarfile->blocks == 0;
 
     tar_close(tarfile);
 
+    if (empty)
+    {
+      snprintf(filename, sizeof(filename), "%s/%s", directory, pswname);
+      unlink(filename);
+    }
+
     if (Verbosity)
       puts("Creating shared software patch file...");
 
@@ -1631,86 +2024,125 @@ write_distfiles(const char *directory,	/* I - Directory */
     {
       fprintf(stderr, "epm: Unable to create file \"%s\" -\n     %s\n",
               filename, strerror(errno));
+      close_delta(deltafile, directory, prodfull);
       return (1);
     }
 
-    for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-      if (strncmp(file->dst, "/usr", 4) == 0 && file->subpackage == subpackage)
-	switch (file->type)
-	{
-	  case 'C' : /* Config file */
-	  case 'F' : /* Regular file */
-          case 'I' : /* Init script */
-              if (stat(file->src, &srcstat))
-	      {
-		fprintf(stderr, "epm: Cannot stat \"%s\": %s\n", file->src, strerror(errno));
-		tar_close(tarfile);
-		return (1);
-	      }
+    for (i = fileindex->num_parts[INDEX_USR],
+             fileptr = fileindex->parts[INDEX_USR];
+	 i > 0;
+	 i --, fileptr ++)
+    {
+      file = *fileptr;
 
-             /*
-	      * Configuration files are extracted to the config file name with
-	      * .N appended; add a bit of script magic to check if the config
-	      * file already exists, and if not we copy the .N to the config
-	      * file location...
-	      */
+      switch (file->type)
+      {
+	case 'C' : /* Config file */
+	case 'F' : /* Regular file */
+	case 'I' : /* Init script */
+	    IOStats.stat_calls ++;
 
-	      if (file->type == 'C')
-		snprintf(filename, sizeof(filename), "%s.N", file->dst);
-	      else if (file->type == 'I')
-		snprintf(filename, sizeof(filename), "%s/init.d/%s",
-		         SoftwareDir, file->dst);
-	      else
-        	strlcpy(filename, file->dst, sizeof(filename));
+	    if (stat(file->src, &srcstat))
+	    {
+	      fprintf(stderr, "epm: Cannot stat \"%s\": %s\n", file->src, strerror(errno));
+	      tar_close(tarfile);
+	      close_delta(deltafile, directory, prodfull);
+	      return (1);
+	    }
 
-              if (Verbosity > 1)
-		printf("%s -> %s...\n", file->src, filename);
+	   /*
+	    * Configuration files are extracted to the config file name with
+	    * .N appended; add a bit of script magic to check if the config
+	    * file already exists, and if not we copy the .N to the config
+	    * file location...
+	    */
 
-	      if (tar_header(tarfile, TAR_NORMAL, file->mode, srcstat.st_size,
-	                     srcstat.st_mtime, file->user, file->group,
-			     filename, NULL) < 0)
-	      {
-		tar_close(tarfile);
-		return (1);
-	      }
+	    if (file->type == 'C')
+	      snprintf(filename, sizeof(filename), "%s.N", file->dst);
+	    else if (file->type == 'I')
+	      snprintf(filename, sizeof(filename), "%s/init.d/%s",
+		       SoftwareDir, file->dst);
+	    else
+	      strlcpy(filename, file->dst, sizeof(filename));
 
-	      if (tar_file(tarfile, file->src) < 0)
+	    if (file->type == 'F' && PatchFrom)
+	    {
+	      if ((status = write_delta(&deltafile, directory, prodfull, file,
+	                                &srcstat)) < 0)
 	      {
-		tar_close(tarfile);
+	        tar_close(tarfile);
+		close_delta(deltafile, directory, prodfull);
 		return (1);
 	      }
-	      break;
+	      else if (status > 0)
+	        break;
+	    }
+
+	    if (Verbosity > 1)
+	      printf("%s -> %s...\n", file->src, filename);
 
-	  case 'd' : /* Create directory */
-              if (Verbosity > 1)
-		printf("%s...\n", file->dst);
-	      break;
+	    if (tar_dist_file(tarfile, file, srcstat.st_size, srcstat.st_mtime,
+			      filename) < 0)
+	    {
+	      tar_close(tarfile);
+	      close_delta(deltafile, directory, prodfull);
+	      return (1);
+	    }
+	    break;
 
-	  case 'L' : /* Link file */
-              if (Verbosity > 1)
-		printf("%s -> %s...\n", file->src, file->dst);
+	case 'd' : /* Create directory */
+	    if (Verbosity > 1)
+	      printf("%s...\n", file->dst);
+	    break;
 
-	      if (tar_header(tarfile, TAR_SYMLINK, file->mode, 0, deftime,
-	                     file->user, file->group, file->dst, file->src) < 0)
-	      {
-		tar_close(tarfile);
-		return (1);
-	      }
-	      break;
-	}
+	case 'L' : /* Link file */
+	    if (Verbosity > 1)
+	      printf("%s -> %s...\n", file->src, file->dst);
+
+	    if (tar_header(tarfile, TAR_SYMLINK, file->mode, 0, deftime,
+			   file->user, file->group, file->dst, file->src) < 0)
+	    {
+	      tar_close(tarfile);
+	      close_delta(deltafile, directory, prodfull);
+	      return (1);
+	    }
+	    break;
+      }
+    }
+
+    empty = tarfile->blocks == 0;
 
     tar_close(tarfile);
+
+    if (empty)
+    {
+      snprintf(filename, sizeof(filename), "%s/%s", directory, pswname);
+      unlink(filename);
+    }
+
+    if (deltafile && tar_close(deltafile))
+    {
+      snprintf(filename, sizeof(filename), "%s/%s.psd", directory, prodfull);
+      unlink(filename);
+      return (1);
+    }
   }
 
  /*
   * Create the scripts...
   */
 
+  stats_phase("scripts");
+
+  if (write_filelist(dist, prodname, directory, subpackage))
+    return (1);
+
   if (write_install(dist, prodname, rootsize, usrsize, directory, subpackage))
     return (1);
 
   if (havepatchfiles)
-    if (write_patch(dist, prodname, prootsize, pusrsize, directory, subpackage))
+    if (write_patch(dist, prodname, prootsize, pusrsize, deltafile != NULL,
+                    directory, subpackage))
       return (1);
 
   if (write_remove(dist, prodname, rootsize, usrsize, directory, subpackage))
@@ -1724,6 +2156,122 @@ write_distfiles(const char *directory,	/* I - Directory */
 }
 
 
+/*
+ * 'write_filelist()' - Write the list of installed files.
+ *
+ * The list contains the type and destination of each config, regular,
+ * and link file separated by nul characters so the installation and
+ * removal scripts can process it in a single pass with xargs.
+ */
+
+static int				/* O - -1 on error, 0 on success */
+write_filelist(dist_t     *dist,	/* I - Software distribution */
+               const char *prodname,	/* I - Product name */
+	       const char *directory,	/* I - Directory */
+	       const char *subpackage)	/* I - Subpackage */
+{
+  int		i;			/* Looping var */
+  FILE		*fp;			/* File list */
+  char		filename[1024];		/* Name of file list */
+  char		prodfull[255];		/* Full product name */
+  file_t	*file,			/* Software file */
+		**fileptr;		/* Pointer into file index */
+  fileindex_t	*fileindex;		/* File index for subpackage */
+
+
+  if (Verbosity)
+    puts("Writing file list...");
+
+  fileindex = get_index(dist, subpackage);
+
+  if (subpackage)
+    snprintf(prodfull, sizeof(prodfull), "%s-%s", prodname, subpackage);
+  else
+    strlcpy(prodfull, prodname, sizeof(prodfull));
+
+  snprintf(filename, sizeof(filename), "%s/%s.files", directory, prodfull);
+
+  if ((fp = fopen(filename, "wb")) == NULL)
+  {
+    fprintf(stderr, "epm: Unable to create file list \"%s\" -\n"
+                    "     %s\n", filename, strerror(errno));
+    return (-1);
+  }
+
+  for (i = fileindex->num_files, fileptr = fileindex->files;
+       i > 0;
+       i --, fileptr ++)
+  {
+    file = *fileptr;
+
+    switch (tolower(file->type))
+    {
+      case 'c' :
+         /*
+	  * Config files include the SHA-256 digest of the shipped contents
+	  * so the scripts can tell whether they were changed locally...
+	  */
+
+          if (digest_file(file))
+	    fprintf(fp, "c%s", file->dst);
+	  else
+	    fprintf(fp, "c%s%s", file->sha256, file->dst);
+	  putc('\0', fp);
+          break;
+
+      case 'f' :
+      case 'l' :
+          fprintf(fp, "%c%s", tolower(file->type), file->dst);
+	  putc('\0', fp);
+          break;
+    }
+  }
+
+  if (fclose(fp))
+  {
+    fprintf(stderr, "epm: Unable to write file list \"%s\" -\n"
+                    "     %s\n", filename, strerror(errno));
+    return (-1);
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'write_filesfunc()' - Write the shell function that processes a file list.
+ *
+ * "epm_files list commands [phase]" runs the commands for each entry in the
+ * list with the type and destination in "$file".  The list is fed to
+ * xargs -0 when it is supported, otherwise it is converted to lines and
+ * read by the shell.  When a phase is given and the EPM_PROGRESS
+ * environment variable is set, a "#%progress phase 0 files" record is
+ * written after each group of entries for the installer GUI.
+ */
+
+static void
+write_filesfunc(FILE *fp)		/* I - Script file */
+{
+  fputs("epm_files()\n", fp);
+  fputs("{\n", fp);
+  fputs("	ac_progress=:\n", fp);
+  fputs("	if test \"x$3\" != x -a \"x$EPM_PROGRESS\" != x; then\n", fp);
+  fputs("		ac_progress=\"echo '#%progress $3 0'\"\n", fp);
+  fputs("	fi\n", fp);
+  fputs("	if (echo | xargs -0 echo) >/dev/null 2>&1; then\n", fp);
+  fputs("		xargs -0 sh -c \"for file do $2\n", fp);
+  fputs("done\n", fp);
+  fputs("$ac_progress \\$#\" sh <\"$1\"\n", fp);
+  fputs("	else\n", fp);
+  fputs("		tr '\\000' '\\n' <\"$1\" | while IFS= read -r file; do\n", fp);
+  fputs("			eval \"$ac_progress 1\"\n", fp);
+  fputs("			eval \"$2\"\n", fp);
+  fputs("		done\n", fp);
+  fputs("	fi\n", fp);
+  fputs("}\n", fp);
+}
+
+
 /*
  * 'write_install()' - Write the installation script.
  */
@@ -1737,11 +2285,14 @@ write_install(dist_t     *dist,		/* I - Software distribution */
 	      const char *subpackage)	/* I - Subpackage */
 {
   int		i;			/* Looping var */
-  int		col;			/* Column in the output */
   FILE		*scriptfile;		/* Install script */
   char		prodfull[255];		/* Full product name */
   char		filename[1024];		/* Name of temporary file */
-  file_t	*file;			/* Software file */
+  file_t	*file,			/* Software file */
+		**fileptr;		/* Pointer into file index */
+  fileindex_t	*fileindex;		/* File index for subpackage */
+  int		num_spaces;		/* Number of directories */
+  space_t	*spaces;		/* Space needed in directories */
   const char	*runlevels;		/* Run levels */
   int		number;			/* Start/stop number */
 
@@ -1749,6 +2300,8 @@ write_install(dist_t     *dist,		/* I - Software distribution */
   if (Verbosity)
     puts("Writing installation script...");
 
+  fileindex = get_index(dist, subpackage);
+
   if (subpackage)
     snprintf(prodfull, sizeof(prodfull), "%s-%s", prodname, subpackage);
   else
@@ -1756,14 +2309,20 @@ write_install(dist_t     *dist,		/* I - Software distribution */
 
   snprintf(filename, sizeof(filename), "%s/%s.install", directory, prodfull);
 
-  if ((scriptfile = write_common(dist, "Installation", rootsize, usrsize,
-                                 filename, subpackage)) == NULL)
+  num_spaces = get_spaces(fileindex, 0, &spaces);
+
+  if ((scriptfile = write_common(dist, prodname, "Installation", rootsize, usrsize,
+                                 num_spaces, spaces, filename,
+				 subpackage)) == NULL)
   {
     fprintf(stderr, "epm: Unable to create installation script \"%s\" -\n"
                     "     %s\n", filename, strerror(errno));
+    free(spaces);
     return (-1);
   }
 
+  write_filesfunc(scriptfile);
+
   fputs("if test \"$*\" = \"now\"; then\n", scriptfile);
   fputs("	echo Software license silently accepted via command-line option.\n", scriptfile);
   fputs("else\n", scriptfile);
@@ -1811,102 +2370,126 @@ write_install(dist_t     *dist,		/* I - Software distribution */
   }
 
   fputs("fi\n", scriptfile);
+
+  if (UnpackProgram)
+  {
+   /*
+    * Use the installer runtime when it runs on this system, otherwise
+    * fall back on the shell commands.  The runtime replaces the files of
+    * an old version in one step, so when the old removal script supports
+    * it only its commands are run first...
+    */
+
+    fputs("ac_unpack=\"\"\n", scriptfile);
+    fputs("ac_oldfiles=\"\"\n", scriptfile);
+    fputs("if test -x ./epmunpack; then\n", scriptfile);
+    fputs("	if ./epmunpack -t >/dev/null 2>&1; then\n", scriptfile);
+    fputs("		ac_unpack=./epmunpack\n", scriptfile);
+    fprintf(scriptfile, "		if test -x %s/%s.remove -a -f %s/%s.files && "
+                        "grep '\"$\\*\" = \"upgrade\"' %s/%s.remove >/dev/null 2>&1; then\n",
+            SoftwareDir, prodfull, SoftwareDir, prodfull, SoftwareDir, prodfull);
+    fprintf(scriptfile, "			ac_oldfiles=\"-o %s/%s.files\"\n",
+            SoftwareDir, prodfull);
+    fputs("		fi\n", scriptfile);
+    fputs("	fi\n", scriptfile);
+    fputs("fi\n", scriptfile);
+    fputs("if test \"x$ac_oldfiles\" = x; then\n", scriptfile);
+  }
+
   fprintf(scriptfile, "if test -x %s/%s.remove; then\n", SoftwareDir, prodfull);
   fprintf(scriptfile, "	echo Removing old versions of %s software...\n",
           prodfull);
   fprintf(scriptfile, "	%s/%s.remove now\n", SoftwareDir, prodfull);
   fputs("fi\n", scriptfile);
 
-  write_space_checks(prodfull, scriptfile, rootsize ? "sw" : NULL,
-                     usrsize ? "ss" : NULL, rootsize, usrsize);
+  if (UnpackProgram)
+  {
+    fputs("else\n", scriptfile);
+    fprintf(scriptfile, "	echo Stopping old versions of %s software...\n",
+            prodfull);
+    fprintf(scriptfile, "	%s/%s.remove upgrade\n", SoftwareDir, prodfull);
+    fputs("fi\n", scriptfile);
+  }
+
+  snprintf(filename, sizeof(filename), "%s.install", prodfull);
+  write_space_checks(scriptfile, filename, num_spaces, spaces);
   write_depends(prodname, dist, scriptfile, subpackage);
   write_commands(dist, scriptfile, COMMAND_PRE_INSTALL, subpackage);
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if ((tolower(file->type) == 'f' || tolower(file->type) == 'l') &&
-        strncmp(file->dst, "/usr", 4) != 0 && file->subpackage == subpackage)
-      break;
-
-  if (i)
+  if (fileindex->num_types[INDEX_FILE] || fileindex->num_types[INDEX_LINK])
   {
-    fputs("echo Backing up old versions of non-shared files to be installed...\n", scriptfile);
-
-    col = fputs("for file in", scriptfile);
-    for (; i > 0; i --, file ++)
-      if ((tolower(file->type) == 'f' || tolower(file->type) == 'l') &&
-          strncmp(file->dst, "/usr", 4) != 0 && file->subpackage == subpackage)
-      {
-        if (col > 80)
-	  col = qprintf(scriptfile, " \\\n%s", file->dst) - 2;
-	else
-          col += qprintf(scriptfile, " %s", file->dst);
-      }
-
-    fputs("; do\n", scriptfile);
-    fputs("	if test -d \"$file\" -o -f \"$file\" -o -h \"$file\"; then\n", scriptfile);
-    fputs("		mv -f \"$file\" \"$file.O\"\n", scriptfile);
-    fputs("	fi\n", scriptfile);
-    fputs("done\n", scriptfile);
+    if (UnpackProgram)
+      fputs("if test \"x$ac_unpack\" = x; then\n", scriptfile);
+
+    fputs("echo Backing up old versions of files to be installed...\n", scriptfile);
+    fprintf(scriptfile, "epm_files %s.files '\n", prodfull);
+    fputs("case \"$file\" in\n", scriptfile);
+    fputs("	[fl]/usr*) test -w /usr || continue ;;\n", scriptfile);
+    fputs("	[fl]*) ;;\n", scriptfile);
+    fputs("	*) continue ;;\n", scriptfile);
+    fputs("esac\n", scriptfile);
+    fputs("file=\"${file#?}\"\n", scriptfile);
+    fputs("if test -d \"$file\" -o -f \"$file\" -o -h \"$file\"; then\n", scriptfile);
+    fputs("	mv -f \"$file\" \"$file.O\"\n", scriptfile);
+    fputs("fi'\n", scriptfile);
+
+    if (UnpackProgram)
+      fputs("fi\n", scriptfile);
   }
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if ((tolower(file->type) == 'f' || tolower(file->type) == 'l') &&
-        strncmp(file->dst, "/usr", 4) == 0 && file->subpackage == subpackage)
-      break;
-
-  if (i)
+  if (fileindex->num_types[INDEX_DIR])
   {
-    fputs("if test -w /usr ; then\n", scriptfile);
-    fputs("	echo Backing up old versions of shared files to be installed...\n", scriptfile);
+    fputs("echo Creating installation directories...\n", scriptfile);
 
-    col = fputs("	for file in", scriptfile);
-    for (; i > 0; i --, file ++)
-      if ((tolower(file->type) == 'f' || tolower(file->type) == 'l') &&
-          strncmp(file->dst, "/usr", 4) == 0 && file->subpackage == subpackage)
-      {
-        if (col > 80)
-	  col = qprintf(scriptfile, " \\\n%s", file->dst) - 2;
-	else
-          col += qprintf(scriptfile, " %s", file->dst);
-      }
+    for (i = fileindex->num_types[INDEX_DIR],
+             fileptr = fileindex->types[INDEX_DIR];
+	 i > 0;
+	 i --, fileptr ++)
+    {
+      file = *fileptr;
+
+      qprintf(scriptfile, "if test ! -d %s -a ! -f %s -a ! -h %s; then\n",
+	      file->dst, file->dst, file->dst);
+      qprintf(scriptfile, "	mkdir -p %s\n", file->dst);
+      fputs("else\n", scriptfile);
+      qprintf(scriptfile, "	if test -f %s; then\n", file->dst);
+      qprintf(scriptfile, "		echo Error: %s already exists as a regular file!\n",
+	      file->dst);
+      fputs("		exit 1\n", scriptfile);
+      fputs("	fi\n", scriptfile);
+      fputs("fi\n", scriptfile);
+    }
 
-    fputs("; do\n", scriptfile);
-    fputs("		if test -d \"$file\" -o -f \"$file\" -o -h \"$file\"; then\n", scriptfile);
-    fputs("			mv -f \"$file\" \"$file.O\"\n", scriptfile);
-    fputs("		fi\n", scriptfile);
-    fputs("	done\n", scriptfile);
-    fputs("fi\n", scriptfile);
+    write_permissions(scriptfile, fileindex->num_types[INDEX_DIR],
+                      fileindex->types[INDEX_DIR], "dD", PERMS_MODE);
   }
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (tolower(file->type) == 'd' && file->subpackage == subpackage)
-      break;
+  fputs("echo Installing software...\n", scriptfile);
 
-  if (i)
+  if (UnpackProgram)
   {
-    fputs("echo Creating installation directories...\n", scriptfile);
+   /*
+    * The runtime backs up the old files, extracts the / and /usr archives
+    * in parallel, and sets up the config files and permissions...
+    */
 
-    for (; i > 0; i --, file ++)
-      if (tolower(file->type) == 'd' && file->subpackage == subpackage)
-      {
-	qprintf(scriptfile, "if test ! -d %s -a ! -f %s -a ! -h %s; then\n",
-        	file->dst, file->dst, file->dst);
-	qprintf(scriptfile, "	mkdir -p %s\n", file->dst);
-	fputs("else\n", scriptfile);
-	qprintf(scriptfile, "	if test -f %s; then\n", file->dst);
-	qprintf(scriptfile, "		echo Error: %s already exists as a regular file!\n",
-	        file->dst);
-	fputs("		exit 1\n", scriptfile);
-	fputs("	fi\n", scriptfile);
-	fputs("fi\n", scriptfile);
-	qprintf(scriptfile, "chown %s %s\n", file->user, file->dst);
-	qprintf(scriptfile, "chgrp %s %s\n", file->group, file->dst);
-	qprintf(scriptfile, "chmod %o %s\n", file->mode, file->dst);
-      }
+    fputs("if test \"x$ac_unpack\" != x; then\n", scriptfile);
+    if (rootsize)
+      fprintf(scriptfile, "	ac_archives=\"%s.sw\"\n", prodfull);
+    else
+      fputs("	ac_archives=\"\"\n", scriptfile);
+    if (usrsize)
+    {
+      fputs("	if echo Write Test >/usr/.writetest 2>/dev/null; then\n", scriptfile);
+      fputs("		rm -f /usr/.writetest\n", scriptfile);
+      fprintf(scriptfile, "		ac_archives=\"$ac_archives %s.ss\"\n", prodfull);
+      fputs("	fi\n", scriptfile);
+    }
+    fprintf(scriptfile, "	$ac_unpack $ac_oldfiles %s.files $ac_archives || exit 1\n",
+            prodfull);
+    fputs("else\n", scriptfile);
   }
 
-  fputs("echo Installing software...\n", scriptfile);
-
   if (rootsize)
   {
     if (CompressFiles)
@@ -1925,6 +2508,9 @@ write_install(dist_t     *dist,		/* I - Software distribution */
     fputs("fi\n", scriptfile);
   }
 
+  if (UnpackProgram)
+    fputs("fi\n", scriptfile);
+
   fprintf(scriptfile, "if test -d %s; then\n", SoftwareDir);
   fprintf(scriptfile, "	rm -f %s/%s.remove\n", SoftwareDir, prodfull);
   fputs("else\n", scriptfile);
@@ -1932,70 +2518,45 @@ write_install(dist_t     *dist,		/* I - Software distribution */
   fputs("fi\n", scriptfile);
   fprintf(scriptfile, "cp %s.remove %s\n", prodfull, SoftwareDir);
   fprintf(scriptfile, "chmod 544 %s/%s.remove\n", SoftwareDir, prodfull);
+  write_inventory(scriptfile, prodfull, 1);
+  fprintf(scriptfile, "rm -f %s/%s.files\n", SoftwareDir, prodfull);
+  fprintf(scriptfile, "if test -f %s.files; then\n", prodfull);
+  fprintf(scriptfile, "	cp %s.files %s\n", prodfull, SoftwareDir);
+  fprintf(scriptfile, "	chmod 444 %s/%s.files\n", SoftwareDir, prodfull);
+  fputs("fi\n", scriptfile);
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (tolower(file->type) == 'c' && file->subpackage == subpackage)
-      break;
+  if (UnpackProgram)
+    fputs("if test \"x$ac_unpack\" = x; then\n", scriptfile);
 
-  if (i)
+  if (fileindex->num_types[INDEX_CONFIG])
   {
     fputs("echo Checking configuration files...\n", scriptfile);
-
-    col = fputs("for file in", scriptfile);
-    for (; i > 0; i --, file ++)
-      if (tolower(file->type) == 'c' && file->subpackage == subpackage)
-      {
-        if (col > 80)
-	  col = qprintf(scriptfile, " \\\n%s", file->dst) - 2;
-	else
-          col += qprintf(scriptfile, " %s", file->dst);
-      }
-
-    fputs("; do\n", scriptfile);
-    fputs("	if test ! -f \"$file\"; then\n", scriptfile);
-    fputs("		cp \"$file.N\" \"$file\"\n", scriptfile);
-    fputs("	fi\n", scriptfile);
-    fputs("done\n", scriptfile);
+    fprintf(scriptfile, "epm_files %s.files '\n", prodfull);
+    fputs("case \"$file\" in\n", scriptfile);
+    fputs("	c*) ;;\n", scriptfile);
+    fputs("	*) continue ;;\n", scriptfile);
+    fputs("esac\n", scriptfile);
+    fputs("file=\"/${file#*/}\"\n", scriptfile);
+    fputs("if test ! -f \"$file\"; then\n", scriptfile);
+    fputs("	cp \"$file.N\" \"$file\"\n", scriptfile);
+    fputs("fi'\n", scriptfile);
   }
 
   fputs("echo Updating file permissions...\n", scriptfile);
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (strncmp(file->dst, "/usr", 4) != 0 &&
-        strcmp(file->user, "root") != 0 && file->subpackage == subpackage)
-      switch (tolower(file->type))
-      {
-	case 'c' :
-	    qprintf(scriptfile, "chown %s %s.N\n", file->user, file->dst);
-	    qprintf(scriptfile, "chgrp %s %s.N\n", file->group, file->dst);
-	case 'f' :
-	    qprintf(scriptfile, "chown %s %s\n", file->user, file->dst);
-	    qprintf(scriptfile, "chgrp %s %s\n", file->group, file->dst);
-	    break;
-      }
+  write_permissions(scriptfile, fileindex->num_parts[INDEX_ROOT],
+                    fileindex->parts[INDEX_ROOT], "cCfF", PERMS_NEW);
 
   fputs("if test -f /usr/.writetest; then\n", scriptfile);
   fputs("	rm -f /usr/.writetest\n", scriptfile);
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (strncmp(file->dst, "/usr", 4) == 0 &&
-        strcmp(file->user, "root") != 0 && file->subpackage == subpackage)
-      switch (tolower(file->type))
-      {
-	case 'c' :
-	    qprintf(scriptfile, "	chown %s %s.N\n", file->user, file->dst);
-	    qprintf(scriptfile, "	chgrp %s %s.N\n", file->group, file->dst);
-	case 'f' :
-	    qprintf(scriptfile, "	chown %s %s\n", file->user, file->dst);
-	    qprintf(scriptfile, "	chgrp %s %s\n", file->group, file->dst);
-	    break;
-      }
+  write_permissions(scriptfile, fileindex->num_parts[INDEX_USR],
+                    fileindex->parts[INDEX_USR], "cCfF", PERMS_NEW);
   fputs("fi\n", scriptfile);
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-      break;
+  if (UnpackProgram)
+    fputs("fi\n", scriptfile);
 
-  if (i)
+  if (fileindex->num_types[INDEX_INIT])
   {
     fputs("echo Setting up init scripts...\n", scriptfile);
 
@@ -2013,9 +2574,11 @@ write_install(dist_t     *dist,		/* I - Software distribution */
     fputs("if test \"$rcdir\" = \"\" ; then\n", scriptfile);
     fputs("	if test -d /usr/local/etc/rc.d; then\n", scriptfile);
     fputs("		for file in", scriptfile);
-    for (; i > 0; i --, file ++)
-      if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-        qprintf(scriptfile, " %s", file->dst);
+    for (i = fileindex->num_types[INDEX_INIT],
+             fileptr = fileindex->types[INDEX_INIT];
+	 i > 0;
+	 i --, fileptr ++)
+      qprintf(scriptfile, " %s", (*fileptr)->dst);
     fputs("; do\n", scriptfile);
     fputs("			rm -f /usr/local/etc/rc.d/$file.sh\n", scriptfile);
     qprintf(scriptfile, "			ln -s %s/init.d/$file "
@@ -2026,61 +2589,69 @@ write_install(dist_t     *dist,		/* I - Software distribution */
     fputs("		echo Unable to determine location of startup scripts!\n", scriptfile);
     fputs("	fi\n", scriptfile);
     fputs("else\n", scriptfile);
-    for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-      if (tolower(file->type) == 'i' && file->subpackage == subpackage)
+    for (i = fileindex->num_types[INDEX_INIT],
+             fileptr = fileindex->types[INDEX_INIT];
+	 i > 0;
+	 i --, fileptr ++)
+    {
+      file = *fileptr;
+
+      fputs("	if test -d $rcdir/init.d; then\n", scriptfile);
+      qprintf(scriptfile, "		/bin/rm -f $rcdir/init.d/%s\n", file->dst);
+      qprintf(scriptfile, "		/bin/ln -s %s/init.d/%s "
+		  "$rcdir/init.d/%s\n", SoftwareDir, file->dst, file->dst);
+      fputs("	else\n", scriptfile);
+      fputs("		if test -d /etc/init.d; then\n", scriptfile);
+      qprintf(scriptfile, "			/bin/rm -f /etc/init.d/%s\n", file->dst);
+      qprintf(scriptfile, "			/bin/ln -s %s/init.d/%s "
+		  "/etc/init.d/%s\n", SoftwareDir, file->dst, file->dst);
+      fputs("		fi\n", scriptfile);
+      fputs("	fi\n", scriptfile);
+
+      for (runlevels = get_runlevels(file, "0235");
+	   isdigit(*runlevels & 255);
+	   runlevels ++)
       {
-	fputs("	if test -d $rcdir/init.d; then\n", scriptfile);
-	qprintf(scriptfile, "		/bin/rm -f $rcdir/init.d/%s\n", file->dst);
+	if (*runlevels == '0')
+	  number = get_stop(file, 0);
+	else
+	  number = get_start(file, 99);
+
+	fprintf(scriptfile, "	if test -d $rcdir/rc%c.d; then\n", *runlevels);
+	qprintf(scriptfile, "		/bin/rm -f $rcdir/rc%c.d/%c%02d%s\n",
+		*runlevels, *runlevels == '0' ? 'K' : 'S', number, file->dst);
 	qprintf(scriptfile, "		/bin/ln -s %s/init.d/%s "
-                    "$rcdir/init.d/%s\n", SoftwareDir, file->dst, file->dst);
-	fputs("	else\n", scriptfile);
-	fputs("		if test -d /etc/init.d; then\n", scriptfile);
-	qprintf(scriptfile, "			/bin/rm -f /etc/init.d/%s\n", file->dst);
-	qprintf(scriptfile, "			/bin/ln -s %s/init.d/%s "
-                    "/etc/init.d/%s\n", SoftwareDir, file->dst, file->dst);
-	fputs("		fi\n", scriptfile);
+			    "$rcdir/rc%c.d/%c%02d%s\n",
+		SoftwareDir, file->dst, *runlevels,
+		*runlevels == '0' ? 'K' : 'S', number, file->dst);
 	fputs("	fi\n", scriptfile);
-
-	for (runlevels = get_runlevels(dist->files + i, "0235");
-             isdigit(*runlevels & 255);
-	     runlevels ++)
-	{
-	  if (*runlevels == '0')
-            number = get_stop(file, 0);
-	  else
-	    number = get_start(file, 99);
-
-          fprintf(scriptfile, "	if test -d $rcdir/rc%c.d; then\n", *runlevels);
-	  qprintf(scriptfile, "		/bin/rm -f $rcdir/rc%c.d/%c%02d%s\n",
-	          *runlevels, *runlevels == '0' ? 'K' : 'S', number, file->dst);
-	  qprintf(scriptfile, "		/bin/ln -s %s/init.d/%s "
-                              "$rcdir/rc%c.d/%c%02d%s\n",
-                  SoftwareDir, file->dst, *runlevels,
-		  *runlevels == '0' ? 'K' : 'S', number, file->dst);
-	  fputs("	fi\n", scriptfile);
-        }
+      }
 
 #ifdef __sgi
-        fputs("	if test -x /etc/chkconfig; then\n", scriptfile);
-        qprintf(scriptfile, "		/etc/chkconfig -f %s on\n", file->dst);
-        fputs("	fi\n", scriptfile);
+      fputs("	if test -x /etc/chkconfig; then\n", scriptfile);
+      qprintf(scriptfile, "		/etc/chkconfig -f %s on\n", file->dst);
+      fputs("	fi\n", scriptfile);
 #endif /* __sgi */
-
-      }
+    }
 
     fputs("fi\n", scriptfile);
   }
 
   write_commands(dist, scriptfile, COMMAND_POST_INSTALL, subpackage);
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-      qprintf(scriptfile, "%s/init.d/%s start\n", SoftwareDir, file->dst);
+  for (i = fileindex->num_types[INDEX_INIT],
+           fileptr = fileindex->types[INDEX_INIT];
+       i > 0;
+       i --, fileptr ++)
+    qprintf(scriptfile, "%s/init.d/%s start\n", SoftwareDir,
+            (*fileptr)->dst);
 
   fputs("echo Installation is complete.\n", scriptfile);
 
   fclose(scriptfile);
 
+  free(spaces);
+
   return (0);
 }
 
@@ -2133,7 +2704,7 @@ write_instfiles(tarf_t     *tarfile,	/* I - Distribution tar file */
       return (-1);
     }
 
-    if (tar_file(tarfile, srcname) < 0)
+    if (tar_file(tarfile, srcname, NULL) < 0)
       return (-1);
 
     if (Verbosity)
@@ -2145,6 +2716,68 @@ write_instfiles(tarf_t     *tarfile,	/* I - Distribution tar file */
 }
 
 
+/*
+ * 'write_inventory()' - Write commands to update the software inventory.
+ *
+ * The inventory ("SoftwareDir/.index") holds the "#%" header lines of each
+ * installed removal script, prefixed by the product name, so the setup and
+ * uninstall programs do not need to read every removal script.  Products
+ * may be installed at the same time, so the update is done while holding
+ * a lock directory that contains the PID of the script holding it.  A lock
+ * is only removed when that process is gone.  If the lock cannot be taken
+ * the inventory is left alone; the setup and uninstall programs check it
+ * against the removal scripts, so it is only slower to load.
+ */
+
+static void
+write_inventory(FILE       *fp,		/* I - Script file */
+                const char *prodfull,	/* I - Full product name */
+		int        add)		/* I - 1 to add product, 0 to remove */
+{
+  fprintf(fp, "ac_lock=%s/.index.lock\n", SoftwareDir);
+  fputs("ac_locked=no\n", fp);
+  fputs("ac_count=0\n", fp);
+  fputs("while test $ac_count -lt 30; do\n", fp);
+  fputs("	if mkdir $ac_lock 2>/dev/null; then\n", fp);
+  fputs("		echo $$ >$ac_lock/pid\n", fp);
+  fputs("		ac_locked=yes\n", fp);
+  fputs("		break\n", fp);
+  fputs("	fi\n", fp);
+  fputs("	ac_count=`expr $ac_count + 1`\n", fp);
+  fputs("	ac_pid=`cat $ac_lock/pid 2>/dev/null`\n", fp);
+  fputs("	if test \"x$ac_pid\" != x && kill -0 $ac_pid 2>/dev/null; then\n", fp);
+  fputs("		sleep 1\n", fp);
+  fputs("	elif test \"x$ac_pid\" != x -o $ac_count = 30; then\n", fp);
+  fputs("		# The script holding the lock is gone, remove the lock unless\n", fp);
+  fputs("		# another script replaced it first...\n", fp);
+  fputs("		if mv $ac_lock $ac_lock.$$ 2>/dev/null; then\n", fp);
+  fputs("			if test \"x`cat $ac_lock.$$/pid 2>/dev/null`\" = \"x$ac_pid\"; then\n", fp);
+  fputs("				rm -rf $ac_lock.$$\n", fp);
+  fputs("			else\n", fp);
+  fputs("				mv $ac_lock.$$ $ac_lock\n", fp);
+  fputs("			fi\n", fp);
+  fputs("		fi\n", fp);
+  fputs("	else\n", fp);
+  fputs("		sleep 1\n", fp);
+  fputs("	fi\n", fp);
+  fputs("done\n", fp);
+  fputs("if test $ac_locked = yes; then\n", fp);
+  fprintf(fp, "	(if test -f %s/.index; then\n", SoftwareDir);
+  fprintf(fp, "		awk '$1 != \"%s\"' %s/.index\n", prodfull, SoftwareDir);
+  fputs("	fi\n", fp);
+  if (add)
+    fprintf(fp, "	sed -n -e '/^[^#]/q' -e 's/^#%%/%s #%%/p' %s/%s.remove\n",
+            prodfull, SoftwareDir, prodfull);
+  fprintf(fp, "	) >%s/.index.N$$ && mv %s/.index.N$$ %s/.index\n", SoftwareDir,
+          SoftwareDir, SoftwareDir);
+  fputs("	rm -rf $ac_lock\n", fp);
+  fputs("else\n", fp);
+  fprintf(fp, "	echo Unable to lock %s/.index, software inventory not updated.\n",
+          SoftwareDir);
+  fputs("fi\n", fp);
+}
+
+
 /*
  * 'write_patch()' - Write the patch script.
  */
@@ -2154,6 +2787,7 @@ write_patch(dist_t     *dist,		/* I - Software distribution */
             const char *prodname,	/* I - Product name */
             int        rootsize,	/* I - Size of root files in kbytes */
 	    int        usrsize,		/* I - Size of /usr files in kbytes */
+	    int        deltas,		/* I - 1 if there are binary patches */
 	    const char *directory,	/* I - Directory */
 	    const char *subpackage)	/* I - Subpackage */
 {
@@ -2161,14 +2795,21 @@ write_patch(dist_t     *dist,		/* I - Software distribution */
   FILE		*scriptfile;		/* Patch script */
   char		filename[1024];		/* Name of temporary file */
   char		prodfull[255];		/* Full product name */
-  file_t	*file;			/* Software file */
+  file_t	*file,			/* Software file */
+		**fileptr;		/* Pointer into file index */
+  fileindex_t	*fileindex;		/* File index for subpackage */
+  int		num_spaces;		/* Number of directories */
+  space_t	*spaces;		/* Space needed in directories */
   const char	*runlevels;		/* Run levels */
   int		number;			/* Start/stop number */
+  int		removed[3];		/* Removed config, init, and other files */
 
 
   if (Verbosity)
     puts("Writing patch script...");
 
+  fileindex = get_index(dist, subpackage);
+
   if (subpackage)
     snprintf(prodfull, sizeof(prodfull), "%s-%s", prodname, subpackage);
   else
@@ -2176,11 +2817,15 @@ write_patch(dist_t     *dist,		/* I - Software distribution */
 
   snprintf(filename, sizeof(filename), "%s/%s.patch", directory, prodfull);
 
-  if ((scriptfile = write_common(dist, "Patch", rootsize, usrsize,
-                                 filename, subpackage)) == NULL)
+  num_spaces = get_spaces(fileindex, 1, &spaces);
+
+  if ((scriptfile = write_common(dist, prodname, "Patch", rootsize, usrsize,
+                                 num_spaces, spaces, filename,
+				 subpackage)) == NULL)
   {
     fprintf(stderr, "epm: Unable to create patch script \"%s\" -\n"
                     "     %s\n", filename, strerror(errno));
+    free(spaces);
     return (-1);
   }
 
@@ -2231,8 +2876,8 @@ write_patch(dist_t     *dist,		/* I - Software distribution */
 
   fputs("fi\n", scriptfile);
 
-  write_space_checks(prodfull, scriptfile, rootsize ? "psw" : NULL,
-                     usrsize ? "pss" : NULL, rootsize, usrsize);
+  snprintf(filename, sizeof(filename), "%s.patch", prodfull);
+  write_space_checks(scriptfile, filename, num_spaces, spaces);
   write_depends(prodname, dist, scriptfile, subpackage);
 
   fprintf(scriptfile, "if test ! -x %s/%s.remove; then\n",
@@ -2243,22 +2888,38 @@ write_patch(dist_t     *dist,		/* I - Software distribution */
   fputs("	exit 1\n", scriptfile);
   fputs("fi\n", scriptfile);
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-      qprintf(scriptfile, "%s/init.d/%s stop\n", SoftwareDir, file->dst);
+  if (deltas)
+  {
+    fputs("if ./epmunpack -t >/dev/null 2>&1; then\n", scriptfile);
+    fputs("	:\n", scriptfile);
+    fputs("else\n", scriptfile);
+    fputs("	echo Unable to run the installer runtime needed to apply binary patches!\n", scriptfile);
+    fputs("	exit 1\n", scriptfile);
+    fputs("fi\n", scriptfile);
+  }
+
+  for (i = fileindex->num_types[INDEX_INIT],
+           fileptr = fileindex->types[INDEX_INIT];
+       i > 0;
+       i --, fileptr ++)
+    qprintf(scriptfile, "%s/init.d/%s stop\n", SoftwareDir,
+            (*fileptr)->dst);
 
   write_commands(dist, scriptfile, COMMAND_PRE_PATCH, subpackage);
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (file->type == 'D' && file->subpackage == subpackage)
+  for (i = fileindex->num_types[INDEX_DIR],
+           fileptr = fileindex->types[INDEX_DIR];
+       i > 0;
+       i --, fileptr ++)
+    if ((*fileptr)->type == 'D')
       break;
 
   if (i)
   {
     fputs("echo Creating new installation directories...\n", scriptfile);
 
-    for (; i > 0; i --, file ++)
-      if (file->type == 'D' && file->subpackage == subpackage)
+    for (; i > 0; i --, fileptr ++)
+      if ((file = *fileptr)->type == 'D')
       {
 	qprintf(scriptfile, "if test ! -d %s -a ! -f %s -a ! -h %s; then\n",
         	file->dst, file->dst, file->dst);
@@ -2270,14 +2931,37 @@ write_patch(dist_t     *dist,		/* I - Software distribution */
 	fputs("		exit 1\n", scriptfile);
 	fputs("	fi\n", scriptfile);
 	fputs("fi\n", scriptfile);
-	qprintf(scriptfile, "chown %s %s\n", file->user, file->dst);
-	qprintf(scriptfile, "chgrp %s %s\n", file->group, file->dst);
-	qprintf(scriptfile, "chmod %o %s\n", file->mode, file->dst);
       }
+
+    write_permissions(scriptfile, fileindex->num_types[INDEX_DIR],
+                      fileindex->types[INDEX_DIR], "D", PERMS_MODE);
+  }
+
+  if (deltas)
+  {
+   /*
+    * Apply the binary patches first; the runtime verifies every old and
+    * new file before replacing any of them...
+    */
+
+    fputs("echo Applying binary patches...\n", scriptfile);
+    fputs("if echo Write Test >/usr/.writetest 2>/dev/null; then\n", scriptfile);
+    fprintf(scriptfile, "	./epmunpack -d %s.psd || exit 1\n", prodfull);
+    fputs("else\n", scriptfile);
+    fprintf(scriptfile, "	./epmunpack -d -r %s.psd || exit 1\n", prodfull);
+    fputs("fi\n", scriptfile);
   }
 
   fputs("echo Patching software...\n", scriptfile);
 
+  snprintf(filename, sizeof(filename), "%s/%s.psw", directory, prodfull);
+  if (access(filename, 0))
+    rootsize = 0;
+
+  snprintf(filename, sizeof(filename), "%s/%s.pss", directory, prodfull);
+  if (access(filename, 0))
+    usrsize = 0;
+
   if (rootsize)
   {
     if (CompressFiles)
@@ -2299,38 +2983,29 @@ write_patch(dist_t     *dist,		/* I - Software distribution */
   fprintf(scriptfile, "rm -f %s/%s.remove\n", SoftwareDir, prodfull);
   fprintf(scriptfile, "cp %s.remove %s\n", prodfull, SoftwareDir);
   fprintf(scriptfile, "chmod 544 %s/%s.remove\n", SoftwareDir, prodfull);
+  write_inventory(scriptfile, prodfull, 1);
+  fprintf(scriptfile, "rm -f %s/%s.files\n", SoftwareDir, prodfull);
+  fprintf(scriptfile, "if test -f %s.files; then\n", prodfull);
+  fprintf(scriptfile, "	cp %s.files %s\n", prodfull, SoftwareDir);
+  fprintf(scriptfile, "	chmod 444 %s/%s.files\n", SoftwareDir, prodfull);
+  fputs("fi\n", scriptfile);
 
   fputs("echo Updating file permissions...\n", scriptfile);
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (strncmp(file->dst, "/usr", 4) != 0 &&
-        strcmp(file->user, "root") != 0 && file->subpackage == subpackage)
-      switch (file->type)
-      {
-	case 'C' :
-	case 'F' :
-	    qprintf(scriptfile, "chown %s %s\n", file->user, file->dst);
-	    qprintf(scriptfile, "chgrp %s %s\n", file->group, file->dst);
-	    break;
-      }
+  write_permissions(scriptfile, fileindex->num_parts[INDEX_ROOT],
+                    fileindex->parts[INDEX_ROOT], "CF", 0);
 
   fputs("if test -f /usr/.writetest; then\n", scriptfile);
   fputs("	rm -f /usr/.writetest\n", scriptfile);
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (strncmp(file->dst, "/usr", 4) == 0 &&
-        strcmp(file->user, "root") != 0 && file->subpackage == subpackage)
-      switch (file->type)
-      {
-	case 'C' :
-	case 'F' :
-	    qprintf(scriptfile, "	chown %s %s\n", file->user, file->dst);
-	    qprintf(scriptfile, "	chgrp %s %s\n", file->group, file->dst);
-	    break;
-      }
+  write_permissions(scriptfile, fileindex->num_parts[INDEX_USR],
+                    fileindex->parts[INDEX_USR], "CF", 0);
   fputs("fi\n", scriptfile);
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (file->type == 'C' && file->subpackage == subpackage)
+  for (i = fileindex->num_types[INDEX_CONFIG],
+           fileptr = fileindex->types[INDEX_CONFIG];
+       i > 0;
+       i --, fileptr ++)
+    if ((*fileptr)->type == 'C')
       break;
 
   if (i)
@@ -2338,9 +3013,9 @@ write_patch(dist_t     *dist,		/* I - Software distribution */
     fputs("echo Checking configuration files...\n", scriptfile);
 
     fputs("for file in", scriptfile);
-    for (; i > 0; i --, file ++)
-      if (file->type == 'C' && file->subpackage == subpackage)
-        qprintf(scriptfile, " %s", file->dst);
+    for (; i > 0; i --, fileptr ++)
+      if ((*fileptr)->type == 'C')
+        qprintf(scriptfile, " %s", (*fileptr)->dst);
 
     fputs("; do\n", scriptfile);
     fputs("	if test ! -f \"$file\"; then\n", scriptfile);
@@ -2349,29 +3024,119 @@ write_patch(dist_t     *dist,		/* I - Software distribution */
     fputs("done\n", scriptfile);
   }
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (file->type == 'R' && file->subpackage == subpackage)
-      break;
-
-  if (i)
+  if (fileindex->num_types[INDEX_REMOVE])
   {
-    fputs("echo Removing files that are no longer used...\n", scriptfile);
+   /*
+    * Removed files keep their previous type in the source path...
+    */
 
-    fputs("for file in", scriptfile);
-    for (; i > 0; i --, file ++)
-      if (file->type == 'R' && file->subpackage == subpackage)
-        qprintf(scriptfile, " %s", file->dst);
+    memset(removed, 0, sizeof(removed));
 
-    fputs("; do\n", scriptfile);
-    fputs("	rm -f \"$file\"\n", scriptfile);
-    fputs("	if test -d \"$file.O\" -o -f \"$file.O\" -o -h \"$file.O\"; then\n", scriptfile);
-    fputs("		mv -f \"$file.O\" \"$file\"\n", scriptfile);
-    fputs("	fi\n", scriptfile);
-    fputs("done\n", scriptfile);
+    for (i = fileindex->num_types[INDEX_REMOVE],
+             fileptr = fileindex->types[INDEX_REMOVE];
+	 i > 0;
+	 i --, fileptr ++)
+      if ((*fileptr)->src[0] == 'c')
+        removed[0] ++;
+      else if ((*fileptr)->src[0] == 'i')
+        removed[1] ++;
+      else
+        removed[2] ++;
+
+    if (removed[2])
+    {
+      fputs("echo Removing files that are no longer used...\n", scriptfile);
+
+      fputs("for file in", scriptfile);
+      for (i = fileindex->num_types[INDEX_REMOVE],
+               fileptr = fileindex->types[INDEX_REMOVE];
+	   i > 0;
+	   i --, fileptr ++)
+	if ((*fileptr)->src[0] != 'c' && (*fileptr)->src[0] != 'i')
+	  qprintf(scriptfile, " %s", (*fileptr)->dst);
+
+      fputs("; do\n", scriptfile);
+      fputs("	rm -f \"$file\"\n", scriptfile);
+      fputs("	if test -d \"$file.O\" -o -f \"$file.O\" -o -h \"$file.O\"; then\n", scriptfile);
+      fputs("		mv -f \"$file.O\" \"$file\"\n", scriptfile);
+      fputs("	fi\n", scriptfile);
+      fputs("done\n", scriptfile);
+    }
+
+    if (removed[0])
+    {
+     /*
+      * Config files are only removed when they have not been changed,
+      * the same as the removal script...
+      */
+
+      fputs("echo Removing configuration files that are no longer used...\n", scriptfile);
+      fputs("ac_sha=\"\"\n", scriptfile);
+      fputs("if sha256sum </dev/null >/dev/null 2>&1; then\n", scriptfile);
+      fputs("	ac_sha=sha256sum\n", scriptfile);
+      fputs("elif shasum -a 256 </dev/null >/dev/null 2>&1; then\n", scriptfile);
+      fputs("	ac_sha=\"shasum -a 256\"\n", scriptfile);
+      fputs("fi\n", scriptfile);
+
+      fputs("for file in", scriptfile);
+      for (i = fileindex->num_types[INDEX_REMOVE],
+               fileptr = fileindex->types[INDEX_REMOVE];
+	   i > 0;
+	   i --, fileptr ++)
+	if ((*fileptr)->src[0] == 'c')
+	  qprintf(scriptfile, " %s%s", (*fileptr)->sha256, (*fileptr)->dst);
+
+      fputs("; do\n", scriptfile);
+      fputs("	sum=\"${file%%/*}\"\n", scriptfile);
+      fputs("	file=\"/${file#*/}\"\n", scriptfile);
+      fputs("	if test -f \"$file\"; then\n", scriptfile);
+      fputs("		if test \"x$sum\" != x -a \"x$ac_sha\" != x; then\n", scriptfile);
+      fputs("			current=`$ac_sha <\"$file\" 2>/dev/null`\n", scriptfile);
+      fputs("			if test \"x${current%% *}\" = \"x$sum\"; then\n", scriptfile);
+      fputs("				rm -f \"$file\"\n", scriptfile);
+      fputs("			fi\n", scriptfile);
+      fputs("		elif cmp -s \"$file\" \"$file.N\"; then\n", scriptfile);
+      fputs("			rm -f \"$file\"\n", scriptfile);
+      fputs("		fi\n", scriptfile);
+      fputs("	fi\n", scriptfile);
+      fputs("	rm -f \"$file.N\"\n", scriptfile);
+      fputs("done\n", scriptfile);
+    }
+
+    if (removed[1])
+    {
+     /*
+      * Init scripts are stopped and removed along with their links...
+      */
+
+      fputs("echo Removing init scripts that are no longer used...\n", scriptfile);
+
+      fputs("for file in", scriptfile);
+      for (i = fileindex->num_types[INDEX_REMOVE],
+               fileptr = fileindex->types[INDEX_REMOVE];
+	   i > 0;
+	   i --, fileptr ++)
+	if ((*fileptr)->src[0] == 'i')
+	  qprintf(scriptfile, " %s", (*fileptr)->dst);
+
+      fputs("; do\n", scriptfile);
+      fprintf(scriptfile, "	if test -x %s/init.d/$file; then\n", SoftwareDir);
+      fprintf(scriptfile, "		%s/init.d/$file stop\n", SoftwareDir);
+      fputs("	fi\n", scriptfile);
+      fprintf(scriptfile, "	rm -f %s/init.d/$file /usr/local/etc/rc.d/$file.sh\n",
+              SoftwareDir);
+      fputs("	for dir in /sbin/rc.d /sbin /etc/rc.d /etc; do\n", scriptfile);
+      fputs("		rm -f $dir/init.d/$file $dir/rc?.d/[KS][0-9][0-9]$file\n", scriptfile);
+      fputs("	done\n", scriptfile);
+      fputs("done\n", scriptfile);
+    }
   }
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (file->type == 'I' && file->subpackage == subpackage)
+  for (i = fileindex->num_types[INDEX_INIT],
+           fileptr = fileindex->types[INDEX_INIT];
+       i > 0;
+       i --, fileptr ++)
+    if ((*fileptr)->type == 'I')
       break;
 
   if (i)
@@ -2392,9 +3157,9 @@ write_patch(dist_t     *dist,		/* I - Software distribution */
     fputs("if test \"$rcdir\" = \"\" ; then\n", scriptfile);
     fputs("	if test -d /usr/local/etc/rc.d; then\n", scriptfile);
     fputs("		for file in", scriptfile);
-    for (; i > 0; i --, file ++)
-      if (tolower(file->type) == 'I' && file->subpackage == subpackage)
-        qprintf(scriptfile, " %s", file->dst);
+    for (; i > 0; i --, fileptr ++)
+      if ((*fileptr)->type == 'I')
+        qprintf(scriptfile, " %s", (*fileptr)->dst);
     fputs("; do\n", scriptfile);
     fputs("			rm -f /usr/local/etc/rc.d/$file.sh\n", scriptfile);
     qprintf(scriptfile, "			ln -s %s/init.d/$file "
@@ -2405,60 +3170,184 @@ write_patch(dist_t     *dist,		/* I - Software distribution */
     fputs("		echo Unable to determine location of startup scripts!\n", scriptfile);
     fputs("	fi\n", scriptfile);
     fputs("else\n", scriptfile);
-    for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-      if (tolower(file->type) == 'i' && file->subpackage == subpackage)
+    for (i = fileindex->num_types[INDEX_INIT],
+             fileptr = fileindex->types[INDEX_INIT];
+	 i > 0;
+	 i --, fileptr ++)
+    {
+      file = *fileptr;
+
+      fputs("	if test -d $rcdir/init.d; then\n", scriptfile);
+      qprintf(scriptfile, "		/bin/rm -f $rcdir/init.d/%s\n", file->dst);
+      qprintf(scriptfile, "		/bin/ln -s %s/init.d/%s "
+		  "$rcdir/init.d/%s\n", SoftwareDir, file->dst, file->dst);
+      fputs("	else\n", scriptfile);
+      fputs("		if test -d /etc/init.d; then\n", scriptfile);
+      qprintf(scriptfile, "			/bin/rm -f /etc/init.d/%s\n", file->dst);
+      qprintf(scriptfile, "			/bin/ln -s %s/init.d/%s "
+		  "/etc/init.d/%s\n", SoftwareDir, file->dst, file->dst);
+      fputs("		fi\n", scriptfile);
+      fputs("	fi\n", scriptfile);
+
+      for (runlevels = get_runlevels(file, "0235");
+	   isdigit(*runlevels & 255);
+	   runlevels ++)
       {
-	fputs("	if test -d $rcdir/init.d; then\n", scriptfile);
-	qprintf(scriptfile, "		/bin/rm -f $rcdir/init.d/%s\n", file->dst);
+	if (*runlevels == '0')
+	  number = get_stop(file, 0);
+	else
+	  number = get_start(file, 99);
+
+	fprintf(scriptfile, "	if test -d $rcdir/rc%c.d; then\n", *runlevels);
+	qprintf(scriptfile, "		/bin/rm -f $rcdir/rc%c.d/%c%02d%s\n",
+		*runlevels, *runlevels == '0' ? 'K' : 'S', number, file->dst);
 	qprintf(scriptfile, "		/bin/ln -s %s/init.d/%s "
-                    "$rcdir/init.d/%s\n", SoftwareDir, file->dst, file->dst);
-	fputs("	else\n", scriptfile);
-	fputs("		if test -d /etc/init.d; then\n", scriptfile);
-	qprintf(scriptfile, "			/bin/rm -f /etc/init.d/%s\n", file->dst);
-	qprintf(scriptfile, "			/bin/ln -s %s/init.d/%s "
-                    "/etc/init.d/%s\n", SoftwareDir, file->dst, file->dst);
-	fputs("		fi\n", scriptfile);
+			    "$rcdir/rc%c.d/%c%02d%s\n",
+		SoftwareDir, file->dst, *runlevels,
+		*runlevels == '0' ? 'K' : 'S', number, file->dst);
 	fputs("	fi\n", scriptfile);
-
-	for (runlevels = get_runlevels(dist->files + i, "0235");
-             isdigit(*runlevels & 255);
-	     runlevels ++)
-	{
-	  if (*runlevels == '0')
-            number = get_stop(file, 0);
-	  else
-	    number = get_start(file, 99);
-
-          fprintf(scriptfile, "	if test -d $rcdir/rc%c.d; then\n", *runlevels);
-	  qprintf(scriptfile, "		/bin/rm -f $rcdir/rc%c.d/%c%02d%s\n",
-	          *runlevels, *runlevels == '0' ? 'K' : 'S', number, file->dst);
-	  qprintf(scriptfile, "		/bin/ln -s %s/init.d/%s "
-                              "$rcdir/rc%c.d/%c%02d%s\n",
-		  SoftwareDir, file->dst, *runlevels,
-		  *runlevels == '0' ? 'K' : 'S', number, file->dst);
-	  fputs("	fi\n", scriptfile);
-        }
+      }
 
 #ifdef __sgi
-        fputs("	if test -x /etc/chkconfig; then\n", scriptfile);
-        qprintf(scriptfile, "		/etc/chkconfig -f %s on\n", file->dst);
-        fputs("	fi\n", scriptfile);
+      fputs("	if test -x /etc/chkconfig; then\n", scriptfile);
+      qprintf(scriptfile, "		/etc/chkconfig -f %s on\n", file->dst);
+      fputs("	fi\n", scriptfile);
 #endif /* __sgi */
-      }
+    }
 
     fputs("fi\n", scriptfile);
   }
 
   write_commands(dist, scriptfile, COMMAND_POST_PATCH, subpackage);
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-      qprintf(scriptfile, "%s/init.d/%s start\n", SoftwareDir, file->dst);
+  for (i = fileindex->num_types[INDEX_INIT],
+           fileptr = fileindex->types[INDEX_INIT];
+       i > 0;
+       i --, fileptr ++)
+    qprintf(scriptfile, "%s/init.d/%s start\n", SoftwareDir,
+            (*fileptr)->dst);
 
   fputs("echo Patching is complete.\n", scriptfile);
 
   fclose(scriptfile);
 
+  free(spaces);
+
+  return (0);
+}
+
+
+/*
+ * 'write_permissions()' - Write commands to set the ownership and mode of
+ *                         files in bulk.
+ *
+ * Files are grouped by owner, group, and mode so that each group is
+ * updated by a single chown, chgrp, or chmod command that reads the
+ * filenames from a here document using xargs.  Files owned by root
+ * are skipped unless PERMS_MODE is specified, since tar already
+ * extracted them with the right ownership and mode.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+write_permissions(FILE       *fp,	/* I - Script file */
+                  int        num_files,	/* I - Number of files */
+                  file_t     **files,	/* I - Files */
+		  const char *types,	/* I - File types to include */
+		  int        flags)	/* I - PERMS_MODE and/or PERMS_NEW */
+{
+  int		i, j,			/* Looping vars */
+		num_perms,		/* Number of matching files */
+		pass;			/* Current command */
+  file_t	**perms,		/* Matching files */
+		*file;			/* Current file */
+  const char	*value;			/* Value for current group */
+  char		mode[16];		/* Mode string */
+
+
+ /*
+  * Collect the matching files...
+  */
+
+  if (num_files == 0)
+    return (0);
+
+  if ((perms = calloc((size_t)num_files, sizeof(file_t *))) == NULL)
+  {
+    perror("epm: Out of memory writing file permissions");
+    return (-1);
+  }
+
+  for (i = num_files, num_perms = 0; i > 0; i --, files ++)
+  {
+    file = *files;
+
+    if (!strchr(types, file->type))
+      continue;
+
+    if (!(flags & PERMS_MODE) && !strcmp(file->user, "root"))
+      continue;
+
+    perms[num_perms ++] = file;
+  }
+
+ /*
+  * Then write one command for each owner, group, and mode...
+  */
+
+  for (pass = 0; pass < 3 && num_perms > 0; pass ++)
+  {
+    if (pass == 2 && !(flags & PERMS_MODE))
+      break;
+
+    if (num_perms > 1)
+      qsort(perms, (size_t)num_perms, sizeof(file_t *),
+            pass == 0 ? compare_user : pass == 1 ? compare_group :
+	                compare_mode);
+
+    for (i = 0; i < num_perms; i = j)
+    {
+      file = perms[i];
+
+      switch (pass)
+      {
+        case 0 :
+	    value = file->user;
+	    qprintf(fp, "xargs chown %s <<'EOF'\n", value);
+	    break;
+	case 1 :
+	    value = file->group;
+	    qprintf(fp, "xargs chgrp %s <<'EOF'\n", value);
+	    break;
+	default :
+	    snprintf(mode, sizeof(mode), "%o", file->mode);
+	    value = mode;
+	    fprintf(fp, "xargs chmod %s <<'EOF'\n", value);
+	    break;
+      }
+
+      for (j = i; j < num_perms; j ++)
+      {
+        file = perms[j];
+
+        if (pass == 0 && strcmp(file->user, value))
+	  break;
+        else if (pass == 1 && strcmp(file->group, value))
+	  break;
+        else if (pass == 2 && file->mode != perms[i]->mode)
+	  break;
+
+        if ((flags & PERMS_NEW) && tolower(file->type) == 'c')
+	  qprintf(fp, "%s.N\n", file->dst);
+
+        qprintf(fp, "%s\n", file->dst);
+      }
+
+      fputs("EOF\n", fp);
+    }
+  }
+
+  free(perms);
+
   return (0);
 }
 
@@ -2476,11 +3365,14 @@ write_remove(dist_t     *dist,		/* I - Software distribution */
 	     const char *subpackage)	/* I - Subpackage */
 {
   int		i;			/* Looping var */
-  int		col;			/* Current column */
   FILE		*scriptfile;		/* Remove script */
   char		filename[1024];		/* Name of temporary file */
   char		prodfull[255];		/* Full product name */
-  file_t	*file;			/* Software file */
+  file_t	*file,			/* Software file */
+		**fileptr;		/* Pointer into file index */
+  fileindex_t	*fileindex;		/* File index for subpackage */
+  int		num_spaces;		/* Number of directories */
+  space_t	*spaces;		/* Space needed in directories */
   const char	*runlevels;		/* Run levels */
   int		number;			/* Start/stop number */
 
@@ -2488,6 +3380,8 @@ write_remove(dist_t     *dist,		/* I - Software distribution */
   if (Verbosity)
     puts("Writing removal script...");
 
+  fileindex = get_index(dist, subpackage);
+
   if (subpackage)
     snprintf(prodfull, sizeof(prodfull), "%s-%s", prodname, subpackage);
   else
@@ -2495,15 +3389,32 @@ write_remove(dist_t     *dist,		/* I - Software distribution */
 
   snprintf(filename, sizeof(filename), "%s/%s.remove", directory, prodfull);
 
-  if ((scriptfile = write_common(dist, "Removal", rootsize, usrsize,
-                                 filename, subpackage)) == NULL)
+  num_spaces = get_spaces(fileindex, 0, &spaces);
+
+  if ((scriptfile = write_common(dist, NULL, "Removal", rootsize, usrsize,
+                                 num_spaces, spaces, filename,
+				 subpackage)) == NULL)
   {
     fprintf(stderr, "epm: Unable to create removal script \"%s\" -\n"
                     "     %s\n", filename, strerror(errno));
+    free(spaces);
     return (-1);
   }
 
-  fputs("if test ! \"$*\" = \"now\"; then\n", scriptfile);
+  write_filesfunc(scriptfile);
+
+ /*
+  * "upgrade" is used by the install script of a new version when the
+  * installer runtime replaces the files; only the commands are run and the
+  * files, file list, and inventory are left for the new version...
+  */
+
+  fputs("if test \"$*\" = \"upgrade\"; then\n", scriptfile);
+  fputs("	ac_upgrade=yes\n", scriptfile);
+  fputs("else\n", scriptfile);
+  fputs("	ac_upgrade=no\n", scriptfile);
+  fputs("fi\n", scriptfile);
+  fputs("if test ! \"$*\" = \"now\" -a $ac_upgrade = no; then\n", scriptfile);
   fputs("	echo \"\"\n", scriptfile);
   qprintf(scriptfile, "	echo This removal script will remove the %s\n",
           dist->product);
@@ -2531,17 +3442,16 @@ write_remove(dist_t     *dist,		/* I - Software distribution */
   * Find any removal commands in the list file...
   */
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-      qprintf(scriptfile, "%s/init.d/%s stop\n", SoftwareDir, file->dst);
+  for (i = fileindex->num_types[INDEX_INIT],
+           fileptr = fileindex->types[INDEX_INIT];
+       i > 0;
+       i --, fileptr ++)
+    qprintf(scriptfile, "%s/init.d/%s stop\n", SoftwareDir,
+            (*fileptr)->dst);
 
   write_commands(dist, scriptfile, COMMAND_PRE_REMOVE, subpackage);
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-      break;
-
-  if (i)
+  if (fileindex->num_types[INDEX_INIT])
   {
     fputs("echo Cleaning up init scripts...\n", scriptfile);
 
@@ -2559,9 +3469,11 @@ write_remove(dist_t     *dist,		/* I - Software distribution */
     fputs("if test \"$rcdir\" = \"\" ; then\n", scriptfile);
     fputs("	if test -d /usr/local/etc/rc.d; then\n", scriptfile);
     fputs("		for file in", scriptfile);
-    for (; i > 0; i --, file ++)
-      if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-        qprintf(scriptfile, " %s", file->dst);
+    for (i = fileindex->num_types[INDEX_INIT],
+             fileptr = fileindex->types[INDEX_INIT];
+	 i > 0;
+	 i --, fileptr ++)
+      qprintf(scriptfile, " %s", (*fileptr)->dst);
     fputs("; do\n", scriptfile);
     fputs("			rm -f /usr/local/etc/rc.d/$file.sh\n", scriptfile);
     fputs("		done\n", scriptfile);
@@ -2569,242 +3481,414 @@ write_remove(dist_t     *dist,		/* I - Software distribution */
     fputs("		echo Unable to determine location of startup scripts!\n", scriptfile);
     fputs("	fi\n", scriptfile);
     fputs("else\n", scriptfile);
-    for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-      if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-      {
-        qprintf(scriptfile, "	%s/init.d/%s stop\n", SoftwareDir, file->dst);
-
-	fputs("	if test -d $rcdir/init.d; then\n", scriptfile);
-	qprintf(scriptfile, "		/bin/rm -f $rcdir/init.d/%s\n", file->dst);
-	fputs("	else\n", scriptfile);
-	fputs("		if test -d /etc/init.d; then\n", scriptfile);
-	qprintf(scriptfile, "			/bin/rm -f /etc/init.d/%s\n", file->dst);
-	fputs("		fi\n", scriptfile);
-	fputs("	fi\n", scriptfile);
-
-	for (runlevels = get_runlevels(dist->files + i, "0235");
-             isdigit(*runlevels & 255);
-	     runlevels ++)
-	{
-	  if (*runlevels == '0')
-            number = get_stop(file, 0);
-	  else
-	    number = get_start(file, 99);
-
-          fprintf(scriptfile, "	if test -d $rcdir/rc%c.d; then\n", *runlevels);
-	  qprintf(scriptfile, "		/bin/rm -f $rcdir/rc%c.d/%c%02d%s\n",
-	          *runlevels, *runlevels == '0' ? 'K' : 'S', number, file->dst);
-	  fputs("	fi\n", scriptfile);
-        }
-
-#ifdef __sgi
-        fputs("	if test -x /etc/chkconfig; then\n", scriptfile);
-        qprintf(scriptfile, "		rm -f /etc/config/%s\n", file->dst);
-        fputs("	fi\n", scriptfile);
-#endif /* __sgi */
-      }
-
-    fputs("fi\n", scriptfile);
-  }
+    for (i = fileindex->num_types[INDEX_INIT],
+             fileptr = fileindex->types[INDEX_INIT];
+	 i > 0;
+	 i --, fileptr ++)
+    {
+      file = *fileptr;
 
-  fputs("echo Removing/restoring installed files...\n", scriptfile);
+      qprintf(scriptfile, "	%s/init.d/%s stop\n", SoftwareDir, file->dst);
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if ((tolower(file->type) == 'f' || tolower(file->type) == 'l') &&
-        strncmp(file->dst, "/usr", 4) != 0 && file->subpackage == subpackage)
-      break;
+      fputs("	if test -d $rcdir/init.d; then\n", scriptfile);
+      qprintf(scriptfile, "		/bin/rm -f $rcdir/init.d/%s\n", file->dst);
+      fputs("	else\n", scriptfile);
+      fputs("		if test -d /etc/init.d; then\n", scriptfile);
+      qprintf(scriptfile, "			/bin/rm -f /etc/init.d/%s\n", file->dst);
+      fputs("		fi\n", scriptfile);
+      fputs("	fi\n", scriptfile);
 
-  if (i)
-  {
-    col = fputs("for file in", scriptfile);
-    for (; i > 0; i --, file ++)
-      if ((tolower(file->type) == 'f' || tolower(file->type) == 'l') &&
-          strncmp(file->dst, "/usr", 4) != 0 && file->subpackage == subpackage)
+      for (runlevels = get_runlevels(file, "0235");
+	   isdigit(*runlevels & 255);
+	   runlevels ++)
       {
-        if (col > 80)
-	  col = qprintf(scriptfile, " \\\n%s", file->dst) - 2;
+	if (*runlevels == '0')
+	  number = get_stop(file, 0);
 	else
-          col += qprintf(scriptfile, " %s", file->dst);
-      }
-
-    fputs("; do\n", scriptfile);
-    fputs("	rm -f \"$file\"\n", scriptfile);
-    fputs("	if test -d \"$file.O\" -o -f \"$file.O\" -o -h \"$file.O\"; then\n", scriptfile);
-    fputs("		mv -f \"$file.O\" \"$file\"\n", scriptfile);
-    fputs("	fi\n", scriptfile);
-    fputs("done\n", scriptfile);
-  }
-
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if ((tolower(file->type) == 'f' || tolower(file->type) == 'l') &&
-        strncmp(file->dst, "/usr", 4) == 0 && file->subpackage == subpackage)
-      break;
+	  number = get_start(file, 99);
 
-  if (i)
-  {
-    fputs("if test -w /usr ; then\n", scriptfile);
-    col = fputs("	for file in", scriptfile);
-    for (; i > 0; i --, file ++)
-      if ((tolower(file->type) == 'f' || tolower(file->type) == 'l') &&
-          strncmp(file->dst, "/usr", 4) == 0 && file->subpackage == subpackage)
-      {
-        if (col > 80)
-	  col = qprintf(scriptfile, " \\\n%s", file->dst) - 2;
-	else
-          col += qprintf(scriptfile, " %s", file->dst);
+	fprintf(scriptfile, "	if test -d $rcdir/rc%c.d; then\n", *runlevels);
+	qprintf(scriptfile, "		/bin/rm -f $rcdir/rc%c.d/%c%02d%s\n",
+		*runlevels, *runlevels == '0' ? 'K' : 'S', number, file->dst);
+	fputs("	fi\n", scriptfile);
       }
 
-    fputs("; do\n", scriptfile);
-    fputs("		rm -f \"$file\"\n", scriptfile);
-    fputs("		if test -d \"$file.O\" -o -f \"$file.O\" -o -h \"$file.O\"; then\n", scriptfile);
-    fputs("			mv -f \"$file.O\" \"$file\"\n", scriptfile);
-    fputs("		fi\n", scriptfile);
-    fputs("	done\n", scriptfile);
+#ifdef __sgi
+      fputs("	if test -x /etc/chkconfig; then\n", scriptfile);
+      qprintf(scriptfile, "		rm -f /etc/config/%s\n", file->dst);
+      fputs("	fi\n", scriptfile);
+#endif /* __sgi */
+    }
+
     fputs("fi\n", scriptfile);
   }
 
-  fputs("echo Checking configuration files...\n", scriptfile);
-
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (tolower(file->type) == 'c' && file->subpackage == subpackage)
-      break;
-
-  if (i)
+  if (fileindex->num_types[INDEX_CONFIG] || fileindex->num_types[INDEX_FILE] ||
+      fileindex->num_types[INDEX_LINK])
   {
-    col = fputs("for file in", scriptfile);
-    for (; i > 0; i --, file ++)
-      if (tolower(file->type) == 'c' && file->subpackage == subpackage)
-      {
-        if (col > 80)
-	  col = qprintf(scriptfile, " \\\n%s", file->dst) - 2;
-	else
-          col += qprintf(scriptfile, " %s", file->dst);
-      }
+    if (fileindex->num_types[INDEX_CONFIG])
+    {
+     /*
+      * Config files are compared against the digest in the file list
+      * when there is a SHA-256 command, otherwise against the .N copy...
+      */
+
+      fputs("ac_sha=\"\"\n", scriptfile);
+      fputs("if sha256sum </dev/null >/dev/null 2>&1; then\n", scriptfile);
+      fputs("	ac_sha=sha256sum\n", scriptfile);
+      fputs("elif shasum -a 256 </dev/null >/dev/null 2>&1; then\n", scriptfile);
+      fputs("	ac_sha=\"shasum -a 256\"\n", scriptfile);
+      fputs("fi\n", scriptfile);
+      fputs("export ac_sha\n", scriptfile);
+    }
 
-    fputs("; do\n", scriptfile);
-    fputs("	if cmp -s \"$file\" \"$file.N\"; then\n", scriptfile);
-    fputs("		# Config file not changed\n", scriptfile);
-    fputs("		rm -f \"$file\"\n", scriptfile);
-    fputs("	fi\n", scriptfile);
-    fputs("	rm -f \"$file.N\"\n", scriptfile);
-    fputs("done\n", scriptfile);
+    fprintf(scriptfile, "if test $ac_upgrade = no -a -f %s/%s.files; then\n",
+            SoftwareDir, prodfull);
+    fputs("echo Removing/restoring installed files...\n", scriptfile);
+    fprintf(scriptfile, "epm_files %s/%s.files '\n", SoftwareDir, prodfull);
+    fputs("case \"$file\" in\n", scriptfile);
+    fputs("	c*)\n", scriptfile);
+    fputs("		sum=\"${file#?}\"\n", scriptfile);
+    fputs("		sum=\"${sum%%/*}\"\n", scriptfile);
+    fputs("		file=\"/${file#*/}\"\n", scriptfile);
+    fputs("		if test -f \"$file\"; then\n", scriptfile);
+    fputs("			if test \"x$sum\" != x -a \"x$ac_sha\" != x; then\n", scriptfile);
+    fputs("				current=`$ac_sha <\"$file\" 2>/dev/null`\n", scriptfile);
+    fputs("				if test \"x${current%% *}\" = \"x$sum\"; then\n", scriptfile);
+    fputs("					# Config file not changed\n", scriptfile);
+    fputs("					rm -f \"$file\"\n", scriptfile);
+    fputs("				fi\n", scriptfile);
+    fputs("			elif cmp -s \"$file\" \"$file.N\"; then\n", scriptfile);
+    fputs("				# Config file not changed\n", scriptfile);
+    fputs("				rm -f \"$file\"\n", scriptfile);
+    fputs("			fi\n", scriptfile);
+    fputs("		fi\n", scriptfile);
+    fputs("		rm -f \"$file.N\"\n", scriptfile);
+    fputs("		continue\n", scriptfile);
+    fputs("		;;\n", scriptfile);
+    fputs("	[fl]/usr*) test -w /usr || continue ;;\n", scriptfile);
+    fputs("	[fl]*) ;;\n", scriptfile);
+    fputs("	*) continue ;;\n", scriptfile);
+    fputs("esac\n", scriptfile);
+    fputs("file=\"${file#?}\"\n", scriptfile);
+    fputs("rm -f \"$file\"\n", scriptfile);
+    fputs("if test -d \"$file.O\" -o -f \"$file.O\" -o -h \"$file.O\"; then\n", scriptfile);
+    fputs("	mv -f \"$file.O\" \"$file\"\n", scriptfile);
+    fputs("fi' removing\n", scriptfile);
+    fputs("fi\n", scriptfile);
   }
 
-  for (i = dist->num_files, file = dist->files + i - 1; i > 0; i --, file --)
-    if (tolower(file->type) == 'd' && file->subpackage == subpackage)
-      break;
-
-  if (i)
+  if (fileindex->num_types[INDEX_DIR])
   {
+    fputs("if test $ac_upgrade = no; then\n", scriptfile);
     fputs("echo Removing empty installation directories...\n", scriptfile);
 
-    for (; i > 0; i --, file --)
-      if (tolower(file->type) == 'd' && file->subpackage == subpackage)
-      {
-	qprintf(scriptfile, "if test -d %s; then\n", file->dst);
-	qprintf(scriptfile, "	rmdir %s >/dev/null 2>&1\n", file->dst);
-	fputs("fi\n", scriptfile);
-      }
+    for (i = fileindex->num_types[INDEX_DIR],
+             fileptr = fileindex->types[INDEX_DIR] + i - 1;
+	 i > 0;
+	 i --, fileptr --)
+    {
+      qprintf(scriptfile, "if test -d %s; then\n", (*fileptr)->dst);
+      qprintf(scriptfile, "	rmdir %s >/dev/null 2>&1\n", (*fileptr)->dst);
+      fputs("fi\n", scriptfile);
+    }
+
+    fputs("fi\n", scriptfile);
   }
 
   write_commands(dist, scriptfile, COMMAND_POST_REMOVE, subpackage);
 
+  fputs("if test $ac_upgrade = yes; then\n", scriptfile);
+  fputs("	exit 0\n", scriptfile);
+  fputs("fi\n", scriptfile);
+  fprintf(scriptfile, "rm -f %s/%s.files\n", SoftwareDir, prodfull);
   fprintf(scriptfile, "rm -f %s/%s.remove\n", SoftwareDir, prodfull);
+  write_inventory(scriptfile, prodfull, 0);
 
   fputs("echo Removal is complete.\n", scriptfile);
 
   fclose(scriptfile);
 
+  free(spaces);
+
   return (0);
 }
 
 
 /*
  * 'write_space_checks()' - Write disk space checks for the installer.
+ *
+ * The installer runtime checks the "#%space" lines in the script using
+ * statvfs(); otherwise the space available on the filesystem for each
+ * directory is found with the POSIX "df -P" output and compared against
+ * the space needed with 4k blocks.
  */
 
 static int				/* O - 0 on success, -1 on error */
-write_space_checks(const char *prodname,/* I - Distribution name */
-                   FILE       *fp,	/* I - File to write to */
-                   const char *sw,	/* I - / archive */
-		   const char *ss,	/* I - /usr archive */
-		   int        rootsize,	/* I - / install size in kbytes */
-		   int        usrsize)	/* I - /usr install size in kbytes */
+write_space_checks(FILE       *fp,	/* I - File to write to */
+                   const char *script,	/* I - Script filename */
+		   int        num_spaces,/* I - Number of directories */
+		   space_t    *spaces)	/* I - Space needed in directories */
 {
-  fputs("case `uname` in\n", fp);
-  fputs("	AIX)\n", fp);
-  fputs("	dfroot=`df -k / | tr '\\n' ' '`\n", fp);
-  fputs("	dfusr=`df -k /usr | tr '\\n' ' '`\n", fp);
-  fputs("	fsroot=`echo $dfroot | awk '{print $15}'`\n", fp);
-  fputs("	sproot=`echo $dfroot | awk '{print $11}'`\n", fp);
-  fputs("	fsusr=`echo $dfusr | awk '{print $15}'`\n", fp);
-  fputs("	spusr=`echo $dfusr | awk '{print $11}'`\n", fp);
-  fputs("	;;\n\n", fp);
-  fputs("	HP-UX)\n", fp);
-  fputs("	dfroot=`df -k / | tr '\\n' ' '`\n", fp);
-  fputs("	dfusr=`df -k /usr | tr '\\n' ' '`\n", fp);
-  fputs("	fsroot=`echo $dfroot | awk '{print $1}'`\n", fp);
-  fputs("	sproot=`echo $dfroot | awk '{print $9}'`\n", fp);
-  fputs("	fsusr=`echo $dfusr | awk '{print $1}'`\n", fp);
-  fputs("	spusr=`echo $dfusr | awk '{print $9}'`\n", fp);
-  fputs("	;;\n\n", fp);
-  fputs("	IRIX*)\n", fp);
-  fputs("	dfroot=`df -k / | tr '\\n' ' '`\n", fp);
-  fputs("	dfusr=`df -k /usr | tr '\\n' ' '`\n", fp);
-  fputs("	fsroot=`echo $dfroot | awk '{print $15}'`\n", fp);
-  fputs("	sproot=`echo $dfroot | awk '{print $13}'`\n", fp);
-  fputs("	fsusr=`echo $dfusr | awk '{print $15}'`\n", fp);
-  fputs("	spusr=`echo $dfusr | awk '{print $13}'`\n", fp);
-  fputs("	;;\n\n", fp);
-  fputs("	SCO*)\n", fp);
-  fputs("	dfroot=`df -k -B / | tr '\\n' ' '`\n", fp);
-  fputs("	dfusr=`df -k -B /usr | tr '\\n' ' '`\n", fp);
-  fputs("	fsroot=`echo $dfroot | awk '{print $13}'`\n", fp);
-  fputs("	sproot=`echo $dfroot | awk '{print $11}'`\n", fp);
-  fputs("	fsusr=`echo $dfusr | awk '{print $13}'`\n", fp);
-  fputs("	spusr=`echo $dfusr | awk '{print $11}'`\n", fp);
-  fputs("	;;\n\n", fp);
-  fputs("	*)\n", fp);
-  fputs("	dfroot=`df -k / | tr '\\n' ' '`\n", fp);
-  fputs("	dfusr=`df -k /usr | tr '\\n' ' '`\n", fp);
-  fputs("	fsroot=`echo $dfroot | awk '{print $13}'`\n", fp);
-  fputs("	sproot=`echo $dfroot | awk '{print $11}'`\n", fp);
-  fputs("	fsusr=`echo $dfusr | awk '{print $13}'`\n", fp);
-  fputs("	spusr=`echo $dfusr | awk '{print $11}'`\n", fp);
-  fputs("	;;\n", fp);
-  fputs("esac\n", fp);
-  fputs("\n", fp);
+  int	i;				/* Looping var */
 
-  fputs("if test x$sproot = x -o x$spusr = x; then\n", fp);
-  fputs("	echo WARNING: Unable to determine available disk space\\; "
-        "installing blindly...\n", fp);
-  fputs("else\n", fp);
-  fputs("	if test x$fsroot = x$fsusr; then\n", fp);
-  fprintf(fp, "		if test %d -gt $sproot; then\n", rootsize + usrsize);
-  fputs("			echo Not enough free disk space for "
-        "software:\n", fp);
-  fprintf(fp, "			echo You need %d kbytes but only have "
-              "$sproot kbytes available.\n", rootsize + usrsize);
-  fputs("			exit 1\n", fp);
-  fputs("		fi\n", fp);
-  fputs("	else\n", fp);
-  fprintf(fp, "		if test %d -gt $sproot; then\n", rootsize);
-  fputs("			echo Not enough free disk space for "
-        "software:\n", fp);
-  fprintf(fp, "			echo You need %d kbytes in / but only have "
-              "$sproot kbytes available.\n", rootsize);
-  fputs("			exit 1\n", fp);
-  fputs("		fi\n", fp);
-  fputs("\n", fp);
-  fprintf(fp, "		if test %d -gt $spusr; then\n", usrsize);
-  fputs("			echo Not enough free disk space for "
-        "software:\n", fp);
-  fprintf(fp, "			echo You need %d kbytes in /usr but only have "
-              "$spusr kbytes available.\n", usrsize);
-  fputs("			exit 1\n", fp);
-  fputs("		fi\n", fp);
-  fputs("	fi\n", fp);
+
+  if (num_spaces == 0)
+    return (0);
+
+  if (UnpackProgram)
+  {
+    fputs("if ./epmunpack -t >/dev/null 2>&1; then\n", fp);
+    fprintf(fp, "	./epmunpack -s %s || exit 1\n", script);
+    fputs("else\n", fp);
+  }
+
+  fputs("epm_space() {\n", fp);
+  fputs("	ac_dir=\"$1\"\n", fp);
+  fputs("	while test ! -d \"$ac_dir\"; do\n", fp);
+  fputs("		ac_dir=`dirname \"$ac_dir\"`\n", fp);
+  fputs("	done\n", fp);
+  fputs("	df -Pk \"$ac_dir\" 2>/dev/null | "
+        "awk -v need=\"$2\" 'NR == 2 {"
+	"for (i = 5; i < NF && $i !~ /%$/; i ++); "
+	"m = $0; for (j = 0; j < i; j ++) sub(/^ *[^ ]+ +/, \"\", m); "
+	"printf \"%s\\t%s\\t%s\\n\", m, $(i - 1), need}'\n", fp);
+  fputs("}\n", fp);
+
+  fputs("ac_space=`(\n", fp);
+  for (i = 0; i < num_spaces; i ++)
+  {
+    qprintf(fp, "epm_space %s", spaces[i].dst);
+    fprintf(fp, " %lld\n", spaces[i].kbytes[1]);
+  }
+  fputs(") | awk -F '\\t' '{avail[$1] = $2; need[$1] += $3} "
+        "END {for (m in need) if (need[m] > avail[m]) "
+	"printf \"%s\\t%.0f\\t%.0f\\n\", m, need[m], avail[m]}'`\n", fp);
+
+  fputs("if test \"x$ac_space\" != x; then\n", fp);
+  fputs("	echo Not enough free disk space for software:\n", fp);
+  fputs("	echo \"$ac_space\" | "
+        "while IFS='\t' read ac_mount ac_need ac_avail; do\n", fp);
+  fputs("		echo \"You need $ac_need kbytes in $ac_mount but only have "
+        "$ac_avail kbytes available.\"\n", fp);
+  fputs("	done\n", fp);
+  fputs("	exit 1\n", fp);
   fputs("fi\n", fp);
 
+  if (UnpackProgram)
+    fputs("fi\n", fp);
+
+  return (0);
+}
+
+
+/*
+ * 'write_suite()' - Write the installation script for all subpackages.
+ *
+ * The packages are grouped by their "%requires" dependencies on each other
+ * so that each group only needs packages from earlier groups.  The packages
+ * in a group are installed at the same time and the output of each is shown
+ * once it finishes.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+write_suite(dist_t     *dist,		/* I - Software distribution */
+            const char *prodname,	/* I - Product name */
+            const char *directory)	/* I - Directory */
+{
+  int		i, j, k,		/* Looping vars */
+		num_packages,		/* Number of packages */
+		*levels,		/* Install level of each package */
+		level,			/* Current level */
+		max_level,		/* Highest level */
+		changed;		/* Did a level change? */
+  char		**names,		/* Name of each package */
+		filename[1024];		/* Name of script */
+  const char	*product;		/* Required product */
+  depend_t	*d;			/* Current dependency */
+  FILE		*scriptfile;		/* Suite script */
+
+
+  if (Verbosity)
+    puts("Writing suite installation script...");
+
+  num_packages = dist->num_subpackages + 1;
+
+  if ((levels = calloc((size_t)num_packages, sizeof(int))) == NULL ||
+      (names = calloc((size_t)num_packages, sizeof(char *))) == NULL)
+  {
+    fputs("epm: Out of memory for suite installation script.\n", stderr);
+    free(levels);
+    return (-1);
+  }
+
+  for (i = 0; i < num_packages; i ++)
+  {
+    if (i)
+      snprintf(filename, sizeof(filename), "%s-%s", prodname,
+               dist->subpackages[i - 1]);
+    else
+      strlcpy(filename, prodname, sizeof(filename));
+
+    names[i] = strdup(filename);
+  }
+
+ /*
+  * Each package goes one level after the packages it requires; if the
+  * requirements loop, just install the packages one at a time...
+  */
+
+  for (level = 0, changed = 1; changed && level <= num_packages; level ++)
+    for (i = 0, changed = 0; i < num_packages; i ++)
+      for (j = dist->num_depends, d = dist->depends; j > 0; j --, d ++)
+      {
+        if (d->type != DEPEND_REQUIRES ||
+	    d->subpackage != (i ? dist->subpackages[i - 1] : NULL))
+	  continue;
+
+        product = strcmp(d->product, "_self") ? d->product : prodname;
+
+        for (k = 0; k < num_packages; k ++)
+	  if (names[k] && !strcmp(names[k], product))
+	    break;
+
+        if (k < num_packages && k != i && levels[i] <= levels[k])
+	{
+	  levels[i] = levels[k] + 1;
+	  changed   = 1;
+	}
+      }
+
+  if (changed)
+    for (i = 0; i < num_packages; i ++)
+      levels[i] = i;
+
+  for (i = 0, max_level = 0; i < num_packages; i ++)
+    if (levels[i] > max_level)
+      max_level = levels[i];
+
+ /*
+  * Write the script...
+  */
+
+  snprintf(filename, sizeof(filename), "%s/%s.suite", directory, prodname);
+
+  if ((scriptfile = write_common(dist, NULL, "Installation", 0, 0, 0, NULL,
+                                 filename, NULL)) == NULL)
+  {
+    fprintf(stderr, "epm: Unable to create suite installation script \"%s\" -\n"
+                    "     %s\n", filename, strerror(errno));
+
+    for (i = 0; i < num_packages; i ++)
+      free(names[i]);
+    free(names);
+    free(levels);
+
+    return (-1);
+  }
+
+  fputs("if test \"$*\" != \"now\"; then\n", scriptfile);
+  fputs("	echo \"\"\n", scriptfile);
+  qprintf(scriptfile, "	echo This installation script will install all of the %s\n",
+          dist->product);
+  qprintf(scriptfile, "	echo software version %s on your system.\n",
+          dist->version);
+  fputs("	echo \"\"\n", scriptfile);
+  fputs("	while true ; do\n", scriptfile);
+  fputs("		echo $ac_n \"Do you wish to continue? $ac_c\"\n", scriptfile);
+  fputs("		read yesno\n", scriptfile);
+  fputs("		case \"$yesno\" in\n", scriptfile);
+  fputs("			y | yes | Y | Yes | YES)\n", scriptfile);
+  fputs("			break\n", scriptfile);
+  fputs("			;;\n", scriptfile);
+  fputs("			n | no | N | No | NO)\n", scriptfile);
+  fputs("			exit 1\n", scriptfile);
+  fputs("			;;\n", scriptfile);
+  fputs("			*)\n", scriptfile);
+  fputs("			echo Please enter yes or no.\n", scriptfile);
+  fputs("			;;\n", scriptfile);
+  fputs("		esac\n", scriptfile);
+  fputs("	done\n", scriptfile);
+
+  if (dist->license[0])
+  {
+    fprintf(scriptfile, "	more %s.license\n", prodname);
+    fputs("	echo \"\"\n", scriptfile);
+    fputs("	while true ; do\n", scriptfile);
+    fputs("		echo $ac_n \"Do you agree with the terms of this license? $ac_c\"\n", scriptfile);
+    fputs("		read yesno\n", scriptfile);
+    fputs("		case \"$yesno\" in\n", scriptfile);
+    fputs("			y | yes | Y | Yes | YES)\n", scriptfile);
+    fputs("			break\n", scriptfile);
+    fputs("			;;\n", scriptfile);
+    fputs("			n | no | N | No | NO)\n", scriptfile);
+    fputs("			exit 1\n", scriptfile);
+    fputs("			;;\n", scriptfile);
+    fputs("			*)\n", scriptfile);
+    fputs("			echo Please enter yes or no.\n", scriptfile);
+    fputs("			;;\n", scriptfile);
+    fputs("		esac\n", scriptfile);
+    fputs("	done\n", scriptfile);
+  }
+
+  fputs("fi\n", scriptfile);
+
+  fprintf(scriptfile, "ac_logs=${TMPDIR:-/tmp}/%s.$$\n", prodname);
+  fputs("rm -rf $ac_logs\n", scriptfile);
+  fputs("mkdir $ac_logs || exit 1\n", scriptfile);
+  fputs("ac_failed=\"\"\n", scriptfile);
+
+  for (level = 0; level <= max_level; level ++)
+  {
+    for (i = 0, j = 0; i < num_packages; i ++)
+      if (levels[i] == level)
+        j ++;
+
+    if (!j)
+      continue;
+
+    if (level)
+      fputs("if test \"x$ac_failed\" = x; then\n", scriptfile);
+
+    for (i = 0; i < num_packages; i ++)
+      if (levels[i] == level)
+      {
+	fprintf(scriptfile, "echo Installing %s software...\n", names[i]);
+	fprintf(scriptfile, "./%s.install now >$ac_logs/%s.log 2>&1 &\n",
+	        names[i], names[i]);
+	fprintf(scriptfile, "ac_pid%d=$!\n", i);
+      }
+
+    for (i = 0; i < num_packages; i ++)
+      if (levels[i] == level)
+      {
+	fprintf(scriptfile, "if wait $ac_pid%d; then\n", i);
+	fprintf(scriptfile, "	sed -e 's/^/%s: /' $ac_logs/%s.log\n", names[i],
+	        names[i]);
+	fputs("else\n", scriptfile);
+	fprintf(scriptfile, "	sed -e 's/^/%s: /' $ac_logs/%s.log 1>&2\n",
+	        names[i], names[i]);
+	fprintf(scriptfile, "	ac_failed=\"$ac_failed %s\"\n", names[i]);
+	fputs("fi\n", scriptfile);
+      }
+
+    if (level)
+      fputs("fi\n", scriptfile);
+  }
+
+  fputs("rm -rf $ac_logs\n", scriptfile);
+  fputs("if test \"x$ac_failed\" != x; then\n", scriptfile);
+  fputs("	echo Installation failed for:$ac_failed 1>&2\n", scriptfile);
+  fputs("	exit 1\n", scriptfile);
+  fputs("fi\n", scriptfile);
+  fputs("echo Installation is complete.\n", scriptfile);
+
+  fclose(scriptfile);
+
+  for (i = 0; i < num_packages; i ++)
+    free(names[i]);
+  free(names);
+  free(levels);
+
   return (0);
 }
@@ -59,7 +59,12 @@ make_rpm(int            format,		/* I - Subformat */
   char		absdir[1024];		/* Absolute directory */
   char		rpmdir[1024];		/* RPMDIR env var */
   char		release[256];		/* Release: number */
-  const char	*build_option;		/* Additional rpmbuild option */
+  const char	*arch;			/* Architecture for rpmbuild */
+  char		buildroot[1024],	/* Build root directory */
+		target[256],		/* Target option */
+		*ptr,			/* Pointer into target option */
+		*argv[10];		/* rpmbuild command */
+  int		argc;			/* Number of arguments */
 
 
   if (Verbosity)
@@ -81,6 +86,8 @@ make_rpm(int            format,		/* I - Subformat */
   * Write the spec file for RPM...
   */
 
+  stats_phase("scripts");
+
   if (Verbosity)
     puts("Creating spec file...");
 
@@ -106,6 +113,12 @@ make_rpm(int            format,		/* I - Subformat */
   fprintf(fp, "Packager: %s\n", dist->packager);
   fprintf(fp, "Vendor: %s\n", dist->vendor);
 
+ /*
+  * Use SHA-256 file digests so the RPM header matches the EPM manifest...
+  */
+
+  fputs("%define _binary_filedigest_algorithm 8\n", fp);
+
  /*
   * Tell RPM to put the distributions in the output directory...
   */
@@ -163,6 +176,8 @@ make_rpm(int            format,		/* I - Subformat */
   * Copy the files over...
   */
 
+  stats_phase("stage");
+
   if (Verbosity)
     puts("Copying temporary distribution files...");
 
@@ -181,7 +196,7 @@ make_rpm(int            format,		/* I - Subformat */
 	  if (Verbosity > 1)
 	    printf("%s -> %s...\n", file->src, filename);
 
-	  if (copy_file(filename, file->src, 0, -1, -1))
+	  if (copy_file(filename, file->src, 0, -1, -1, file))
 	    return (1);
           break;
       case 'i' :
@@ -190,7 +205,7 @@ make_rpm(int            format,		/* I - Subformat */
 	  if (Verbosity > 1)
 	    printf("%s -> %s...\n", file->src, filename);
 
-	  if (copy_file(filename, file->src, 0, -1, -1))
+	  if (copy_file(filename, file->src, 0, -1, -1, file))
 	    return (1);
           break;
       case 'd' :
@@ -216,31 +231,54 @@ make_rpm(int            format,		/* I - Subformat */
   * Build the distribution from the spec file...
   */
 
+  stats_phase("build");
+
   if (Verbosity)
     puts("Building RPM binary distribution...");
 
-  if (format == PACKAGE_RPM_SIGNED)
-    build_option = "-signed ";
+  if (!strcmp(platform->machine, "intel"))
+    arch = "i386";
+  else if (!strcmp(platform->machine, "ppc"))
+    arch = "ppc";
   else
-    build_option = "";
+    arch = platform->machine;
 
-  if (!strcmp(platform->machine, "intel"))
+  snprintf(buildroot, sizeof(buildroot), "%s/buildroot", absdir);
+
+  argc          = 0;
+  argv[argc ++] = EPM_RPMBUILD;
+  argv[argc ++] = "-bb";
+  argv[argc ++] = "--buildroot";
+  argv[argc ++] = buildroot;
+
+ /*
+  * EPM_RPMARCH is either an option that is followed by the architecture
+  * ("--target ") or one that ends with it ("--target=")...
+  */
+
+  strlcpy(target, EPM_RPMARCH, sizeof(target));
+
+  if ((ptr = target + strlen(target)) > target && ptr[-1] == '=')
   {
-    if (run_command(NULL, EPM_RPMBUILD " -bb --buildroot \"%s/buildroot\" "
-                          EPM_RPMARCH "i386 %s%s", absdir, build_option,
-			  specname))
-      return (1);
+    strlcat(target, arch, sizeof(target));
+    argv[argc ++] = target;
   }
-  else if (!strcmp(platform->machine, "ppc"))
+  else
   {
-    if (run_command(NULL, EPM_RPMBUILD " -bb --buildroot \"%s/buildroot\" "
-                          EPM_RPMARCH "ppc %s%s", absdir, build_option,
-			  specname))
-      return (1);
+    while (ptr > target && isspace(ptr[-1] & 255))
+      *--ptr = '\0';
+
+    argv[argc ++] = target;
+    argv[argc ++] = (char *)arch;
   }
-  else if (run_command(NULL, EPM_RPMBUILD " -bb --buildroot \"%s/buildroot\" "
-                       EPM_RPMARCH "%s %s%s", absdir, platform->machine,
-		       build_option, specname))
+
+  if (format == PACKAGE_RPM_SIGNED)
+    argv[argc ++] = "-signed";
+
+  argv[argc ++] = specname;
+  argv[argc]    = NULL;
+
+  if (run_argv(NULL, argv))
     return (1);
 
  /*
@@ -261,6 +299,8 @@ make_rpm(int            format,		/* I - Subformat */
 
   if (dist->num_subpackages || setup)
   {
+    stats_phase("archive");
+
    /*
     * Figure out the full name of the distribution...
     */
@@ -315,7 +355,7 @@ make_rpm(int            format,		/* I - Subformat */
 	return (-1);
       }
 
-      if (tar_file(tarfile, SetupProgram) < 0)
+      if (tar_file(tarfile, SetupProgram, NULL) < 0)
       {
 	tar_close(tarfile);
 	return (-1);
@@ -346,7 +386,7 @@ make_rpm(int            format,		/* I - Subformat */
 	return (-1);
       }
 
-      if (tar_file(tarfile, setup) < 0)
+      if (tar_file(tarfile, setup, NULL) < 0)
       {
 	tar_close(tarfile);
 	return (-1);
@@ -370,7 +410,7 @@ make_rpm(int            format,		/* I - Subformat */
 	  return (-1);
 	}
 
-	if (tar_file(tarfile, types) < 0)
+	if (tar_file(tarfile, types, NULL) < 0)
 	{
           tar_close(tarfile);
 	  return (-1);
@@ -399,7 +439,7 @@ make_rpm(int            format,		/* I - Subformat */
 	return (-1);
       }
 
-      if (tar_file(tarfile, UninstProgram) < 0)
+      if (tar_file(tarfile, UninstProgram, NULL) < 0)
       {
 	tar_close(tarfile);
 	return (-1);
@@ -485,7 +525,9 @@ move_rpms(const char     *prodname,	/* I - Product short name */
 	  const char     *release)	/* I - Release: value */
 {
   char		rpmname[1024];		/* RPM name */
+  char		srcname[1024];		/* RPM built by rpmbuild */
   char		prodfull[1024];		/* Full product name */
+  char		*argv[4];		/* mv command */
   struct stat	rpminfo;		/* RPM file info */
 
 
@@ -515,21 +557,26 @@ move_rpms(const char     *prodname,	/* I - Product short name */
   strlcat(rpmname, ".rpm", sizeof(rpmname));
 
   if (!strcmp(platform->machine, "intel"))
-    run_command(NULL, "/bin/mv %s/RPMS/i386/%s-%s-%s.i386.rpm %s",
-		rpmdir, prodfull, dist->version, release,
-		rpmname);
+    snprintf(srcname, sizeof(srcname), "%s/RPMS/i386/%s-%s-%s.i386.rpm",
+	     rpmdir, prodfull, dist->version, release);
   else if (!strcmp(platform->sysname, "aix") && !strcmp(platform->machine, "ppc"))
-    run_command(NULL, "/bin/mv %s/RPMS/ppc/%s-%s-%s.%s%s.ppc.rpm %s",
-		rpmdir, prodfull, dist->version, release, platform->sysname, platform->release,
-		rpmname);
+    snprintf(srcname, sizeof(srcname), "%s/RPMS/ppc/%s-%s-%s.%s%s.ppc.rpm",
+	     rpmdir, prodfull, dist->version, release, platform->sysname,
+	     platform->release);
   else if (!strcmp(platform->machine, "ppc"))
-    run_command(NULL, "/bin/mv %s/RPMS/powerpc/%s-%s-%s.powerpc.rpm %s",
-		rpmdir, prodfull, dist->version, release,
-		rpmname);
+    snprintf(srcname, sizeof(srcname), "%s/RPMS/powerpc/%s-%s-%s.powerpc.rpm",
+	     rpmdir, prodfull, dist->version, release);
   else
-    run_command(NULL, "/bin/mv %s/RPMS/%s/%s-%s-%s.%s.rpm %s",
-		rpmdir, platform->machine, prodfull, dist->version,
-		release, platform->machine, rpmname);
+    snprintf(srcname, sizeof(srcname), "%s/RPMS/%s/%s-%s-%s.%s.rpm",
+	     rpmdir, platform->machine, prodfull, dist->version, release,
+	     platform->machine);
+
+  argv[0] = "/bin/mv";
+  argv[1] = srcname;
+  argv[2] = rpmname;
+  argv[3] = NULL;
+
+  run_argv(NULL, argv);
 
   if (Verbosity)
   {
@@ -556,7 +603,9 @@ write_spec(int        format,		/* I - Subformat */
   int		i;			/* Looping var */
   char		name[1024];		/* Full product name */
   const char	*product;		/* Product to depend on */
-  file_t	*file;			/* Current distribution file */
+  fileindex_t	*fileindex;		/* File index for subpackage */
+  file_t	**fileptr,		/* Pointer into file index */
+		*file;			/* Current distribution file */
   command_t	*c;			/* Current command */
   depend_t	*d;			/* Current dependency */
   const char	*runlevels;		/* Run levels */
@@ -573,6 +622,8 @@ write_spec(int        format,		/* I - Subformat */
   else
     name[0] = '\0';
 
+  fileindex = get_index(dist, subpackage);
+
  /*
   * Common stuff...
   */
@@ -693,11 +744,7 @@ write_spec(int        format,		/* I - Subformat */
   else
     have_commands = 0;
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-      break;
-
-  if (i)
+  if (fileindex->num_types[INDEX_INIT])
   {
     if (!have_commands)
       fprintf(fp, "%%post%s\n", name);
@@ -718,43 +765,45 @@ write_spec(int        format,		/* I - Subformat */
     fputs("	if test \"$rcdir\" = \"\" ; then\n", fp);
     fputs("		echo Unable to determine location of startup scripts!\n", fp);
     fputs("	else\n", fp);
-    for (; i > 0; i --, file ++)
+    for (i = fileindex->num_types[INDEX_INIT],
+             fileptr = fileindex->types[INDEX_INIT];
+         i > 0;
+	 i --, fileptr ++)
     {
-      if (tolower(file->type) == 'i' && file->subpackage == subpackage)
+      file = *fileptr;
+
+      fputs("		if test -d $rcdir/init.d; then\n", fp);
+      qprintf(fp, "			/bin/rm -f $rcdir/init.d/%s\n", file->dst);
+      qprintf(fp, "			/bin/ln -s %s/init.d/%s "
+		  "$rcdir/init.d/%s\n", SoftwareDir, file->dst, file->dst);
+      fputs("		else\n", fp);
+      fputs("			if test -d /etc/init.d; then\n", fp);
+      qprintf(fp, "				/bin/rm -f /etc/init.d/%s\n", file->dst);
+      qprintf(fp, "				/bin/ln -s %s/init.d/%s "
+		  "/etc/init.d/%s\n", SoftwareDir, file->dst, file->dst);
+      fputs("			fi\n", fp);
+      fputs("		fi\n", fp);
+
+      for (runlevels = get_runlevels(file, "0123456");
+	   isdigit(*runlevels & 255);
+	   runlevels ++)
       {
-	fputs("		if test -d $rcdir/init.d; then\n", fp);
-	qprintf(fp, "			/bin/rm -f $rcdir/init.d/%s\n", file->dst);
-	qprintf(fp, "			/bin/ln -s %s/init.d/%s "
-		    "$rcdir/init.d/%s\n", SoftwareDir, file->dst, file->dst);
-	fputs("		else\n", fp);
-	fputs("			if test -d /etc/init.d; then\n", fp);
-	qprintf(fp, "				/bin/rm -f /etc/init.d/%s\n", file->dst);
-	qprintf(fp, "				/bin/ln -s %s/init.d/%s "
-		    "/etc/init.d/%s\n", SoftwareDir, file->dst, file->dst);
-	fputs("			fi\n", fp);
-	fputs("		fi\n", fp);
-
-	for (runlevels = get_runlevels(dist->files + i, "0123456");
-	     isdigit(*runlevels & 255);
-	     runlevels ++)
-	{
-	  if (*runlevels == '0')
-	    number = get_stop(file, 0);
-	  else
-	    number = get_start(file, 99);
-
-	  qprintf(fp, "		/bin/rm -f $rcdir/rc%c.d/%c%02d%s\n", *runlevels,
-		  (*runlevels == '0' || *runlevels == '1' ||
-		   *runlevels == '6') ? 'K' : 'S', number, file->dst);
-	  qprintf(fp, "		/bin/ln -s %s/init.d/%s "
-		      "$rcdir/rc%c.d/%c%02d%s\n", SoftwareDir, file->dst,
-		  *runlevels,
-		  (*runlevels == '0' || *runlevels == '1' ||
-		   *runlevels == '6') ? 'K' : 'S', number, file->dst);
-	}
-
-	qprintf(fp, "		%s/init.d/%s start\n", SoftwareDir, file->dst);
+	if (*runlevels == '0')
+	  number = get_stop(file, 0);
+	else
+	  number = get_start(file, 99);
+
+	qprintf(fp, "		/bin/rm -f $rcdir/rc%c.d/%c%02d%s\n", *runlevels,
+		(*runlevels == '0' || *runlevels == '1' ||
+		 *runlevels == '6') ? 'K' : 'S', number, file->dst);
+	qprintf(fp, "		/bin/ln -s %s/init.d/%s "
+		    "$rcdir/rc%c.d/%c%02d%s\n", SoftwareDir, file->dst,
+		*runlevels,
+		(*runlevels == '0' || *runlevels == '1' ||
+		 *runlevels == '6') ? 'K' : 'S', number, file->dst);
       }
+
+      qprintf(fp, "		%s/init.d/%s start\n", SoftwareDir, file->dst);
     }
 
     fputs("	fi\n", fp);
@@ -762,11 +811,7 @@ write_spec(int        format,		/* I - Subformat */
     fputs("fi\n", fp);
   }
 
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (tolower(file->type) == 'i' && file->subpackage == subpackage)
-      break;
-
-  if (i)
+  if (fileindex->num_types[INDEX_INIT])
   {
     have_commands = 1;
 
@@ -787,33 +832,35 @@ write_spec(int        format,		/* I - Subformat */
     fputs("	if test \"$rcdir\" = \"\" ; then\n", fp);
     fputs("		echo Unable to determine location of startup scripts!\n", fp);
     fputs("	else\n", fp);
-    for (; i > 0; i --, file ++)
+    for (i = fileindex->num_types[INDEX_INIT],
+             fileptr = fileindex->types[INDEX_INIT];
+         i > 0;
+	 i --, fileptr ++)
     {
-      if (tolower(file->type) == 'i' && file->subpackage == subpackage)
+      file = *fileptr;
+
+      qprintf(fp, "		%s/init.d/%s stop\n", SoftwareDir, file->dst);
+
+      fputs("		if test -d $rcdir/init.d; then\n", fp);
+      qprintf(fp, "			/bin/rm -f $rcdir/init.d/%s\n", file->dst);
+      fputs("		else\n", fp);
+      fputs("			if test -d /etc/init.d; then\n", fp);
+      qprintf(fp, "				/bin/rm -f /etc/init.d/%s\n", file->dst);
+      fputs("			fi\n", fp);
+      fputs("		fi\n", fp);
+
+      for (runlevels = get_runlevels(file, "0123456");
+	   isdigit(*runlevels & 255);
+	   runlevels ++)
       {
-	qprintf(fp, "		%s/init.d/%s stop\n", SoftwareDir, file->dst);
-
-	fputs("		if test -d $rcdir/init.d; then\n", fp);
-	qprintf(fp, "			/bin/rm -f $rcdir/init.d/%s\n", file->dst);
-	fputs("		else\n", fp);
-	fputs("			if test -d /etc/init.d; then\n", fp);
-	qprintf(fp, "				/bin/rm -f /etc/init.d/%s\n", file->dst);
-	fputs("			fi\n", fp);
-	fputs("		fi\n", fp);
-
-	for (runlevels = get_runlevels(dist->files + i, "0123456");
-	     isdigit(*runlevels & 255);
-	     runlevels ++)
-	{
-	  if (*runlevels == '0')
-	    number = get_stop(file, 0);
-	  else
-	    number = get_start(file, 99);
-
-	  qprintf(fp, "		/bin/rm -f $rcdir/rc%c.d/%c%02d%s\n", *runlevels,
-		  (*runlevels == '0' || *runlevels == '1' ||
-		   *runlevels == '6') ? 'K' : 'S', number, file->dst);
-	}
+	if (*runlevels == '0')
+	  number = get_stop(file, 0);
+	else
+	  number = get_start(file, 99);
+
+	qprintf(fp, "		/bin/rm -f $rcdir/rc%c.d/%c%02d%s\n", *runlevels,
+		(*runlevels == '0' || *runlevels == '1' ||
+		 *runlevels == '6') ? 'K' : 'S', number, file->dst);
       }
     }
 
@@ -872,27 +919,32 @@ write_spec(int        format,		/* I - Subformat */
   */
 
   fprintf(fp, "%%files%s\n", name);
-  for (i = dist->num_files, file = dist->files; i > 0; i --, file ++)
-    if (file->subpackage == subpackage)
-      switch (tolower(file->type))
-      {
-	case 'c' :
-            fprintf(fp, "%%attr(%04o,%s,%s) %%config(noreplace) \"%s\"\n",
-	            file->mode, file->user, file->group, file->dst);
-            break;
-	case 'd' :
-            fprintf(fp, "%%attr(%04o,%s,%s) %%dir \"%s\"\n", file->mode,
-	            file->user, file->group, file->dst);
-            break;
-	case 'f' :
-	case 'l' :
-            fprintf(fp, "%%attr(%04o,%s,%s) \"%s\"\n", file->mode, file->user,
-	            file->group, file->dst);
-            break;
-	case 'i' :
-	    fprintf(fp, "%%attr(0555,root,root) \"%s/init.d/%s\"\n", SoftwareDir, file->dst);
-            break;
-      }
+  for (i = fileindex->num_files, fileptr = fileindex->files;
+       i > 0;
+       i --, fileptr ++)
+  {
+    file = *fileptr;
+
+    switch (tolower(file->type))
+    {
+      case 'c' :
+	  fprintf(fp, "%%attr(%04o,%s,%s) %%config(noreplace) \"%s\"\n",
+		  file->mode, file->user, file->group, file->dst);
+	  break;
+      case 'd' :
+	  fprintf(fp, "%%attr(%04o,%s,%s) %%dir \"%s\"\n", file->mode,
+		  file->user, file->group, file->dst);
+	  break;
+      case 'f' :
+      case 'l' :
+	  fprintf(fp, "%%attr(%04o,%s,%s) \"%s\"\n", file->mode, file->user,
+		  file->group, file->dst);
+	  break;
+      case 'i' :
+	  fprintf(fp, "%%attr(0555,root,root) \"%s/init.d/%s\"\n", SoftwareDir, file->dst);
+	  break;
+    }
+  }
 
   return (0);
 }
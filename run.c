@@ -19,123 +19,311 @@
  * Include necessary headers...
  */
 
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE			/* posix_spawn_file_actions_addchdir_np() */
+#endif /* !_GNU_SOURCE */
 #include "epm.h"
-#include <stdarg.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/wait.h>
+#ifdef HAVE_POSIX_SPAWN
+#  include <spawn.h>
+extern char **environ;
+#endif /* HAVE_POSIX_SPAWN */
 
 
 /*
- * 'run_command()' - Run an external program.
+ * Local constants...
+ */
+
+#define MAX_JOBS	64		/* Maximum number of running commands */
+#define MAX_OUTPUT	65536		/* Maximum output saved per command */
+
+
+/*
+ * Local types...
+ */
+
+typedef struct				/**** Running command ****/
+{
+  pid_t		pid;			/* Process ID */
+  int		fd;			/* Output pipe or -1 */
+  char		command[1024],		/* Command line for messages */
+		*output;		/* Captured output */
+  size_t	outused,		/* Bytes of output */
+		outsize;		/* Size of output buffer */
+  int		truncated;		/* Was output dropped? */
+  int		background;		/* Collected by wait_commands()? */
+} job_t;
+
+
+/*
+ * Globals...
+ */
+
+int		MaxJobs = 1;		/* Maximum number of concurrent commands */
+
+
+/*
+ * Local globals...
+ */
+
+static int	num_jobs = 0;		/* Number of running commands */
+static job_t	jobs[MAX_JOBS];		/* Running commands */
+static int	job_status = 0;		/* First failed exit status */
+
+
+/*
+ * Local functions...
+ */
+
+static int	finish_job(job_t *job, int status);
+static pid_t	start_job(const char *directory, char *argv[],
+		          int background);
+static int	wait_jobs(pid_t pid);
+
+
+/*
+ * 'run_argv()' - Run an external program and wait for it to finish.
  */
 
 int					/* O - Exit status */
-run_command(const char *directory,	/* I - Directory for command or NULL */
-            const char *command,	/* I - Command string */
-            ...)			/* I - Additional arguments as needed */
+run_argv(const char *directory,		/* I - Directory for command or NULL */
+         char       *argv[])		/* I - Command and arguments */
+{
+  pid_t	pid;				/* Process ID */
+
+
+  if ((pid = start_job(directory, argv, 0)) < 0)
+    return (1);
+
+  return (wait_jobs(pid));
+}
+
+
+/*
+ * 'start_argv()' - Start an external program without waiting for it.
+ *
+ * At most MaxJobs programs run at the same time; if the limit has been
+ * reached this waits for one of the running programs to finish first.
+ * Output is captured unless Verbosity > 1 and is shown if the program
+ * fails.  Call wait_commands() to wait for all programs to finish.
+ */
+
+int					/* O - 0 on success, -1 on error */
+start_argv(const char *directory,	/* I - Directory for command or NULL */
+           char       *argv[])		/* I - Command and arguments */
 {
-  va_list	ap;			/* Argument pointer */
-  int		pid,			/* Child process ID */
-		status,			/* Status of child */
-		argc;			/* Number of arguments */
-  char		argbuf[10240],		/* Argument buffer */
-		*argptr,		/* Argument string pointer */
-		*argv[100];		/* Argument strings */
+  return (start_job(directory, argv, 1) < 0 ? -1 : 0);
+}
 
 
+/*
+ * 'wait_commands()' - Wait for all running programs to finish.
+ */
+
+int					/* O - 0 on success, first failed status otherwise */
+wait_commands(void)
+{
+  int	status;				/* Exit status */
+
+
+  wait_jobs(0);
+
+  status     = job_status;
+  job_status = 0;
+
+  return (status);
+}
+
+
+/*
+ * 'finish_job()' - Report the exit status of a program and remove the job.
+ */
+
+static int				/* O - Exit status */
+finish_job(job_t *job,			/* I - Job */
+           int   status)		/* I - Status from waitpid() */
+{
+  if (WIFSIGNALED(status))
+    status = -WTERMSIG(status);
+  else
+    status = WEXITSTATUS(status);
+
+  if (status)
+  {
+    if (status < 0)
+      fprintf(stderr, "epm: \"%s\" crashed on signal %d.\n", job->command,
+              -status);
+    else
+      fprintf(stderr, "epm: \"%s\" failed with exit status %d.\n",
+              job->command, status);
+
+    if (job->outused > 0)
+    {
+      fwrite(job->output, 1, job->outused, stderr);
+
+      if (job->truncated)
+        fputs("epm: (output truncated)\n", stderr);
+    }
+
+    if (job->background && !job_status)
+      job_status = status;
+  }
+
+  if (job->fd >= 0)
+    close(job->fd);
+
+  free(job->output);
+
  /*
-  * Format the command string...
+  * Remove the job from the list...
   */
 
-  va_start(ap, command);
-  vsnprintf(argbuf, sizeof(argbuf) - 1, command, ap);
-  argbuf[sizeof(argbuf) - 1] = '\0';
+  num_jobs --;
+
+  if (job < (jobs + num_jobs))
+    memmove(job, job + 1, (size_t)(jobs + num_jobs - job) * sizeof(job_t));
+
+  return (status);
+}
+
+
+/*
+ * 'start_job()' - Start an external program.
+ */
+
+static pid_t				/* O - Process ID or -1 on error */
+start_job(const char *directory,	/* I - Directory for command or NULL */
+          char       *argv[],		/* I - Command and arguments */
+	  int        background)	/* I - Collected by wait_commands()? */
+{
+  int		i;			/* Looping var */
+  job_t		*job;			/* New job */
+  int		fds[2];			/* Output pipe */
+  pid_t		pid;			/* Process ID */
+#ifdef HAVE_POSIX_SPAWN
+  posix_spawn_file_actions_t actions;	/* Spawn file actions */
+  int		err;			/* Spawn error */
+#endif /* HAVE_POSIX_SPAWN */
 
-  if (Verbosity > 1)
-    puts(argbuf);
 
  /*
-  * Parse the argument string; arguments can be separated by whitespace
-  * and quoted by " and '...
+  * Wait for a free job slot...
   */
 
-  argv[0] = argbuf;
+  while (num_jobs > 0 &&
+         (num_jobs >= MaxJobs || num_jobs >= MAX_JOBS))
+    wait_jobs(-1);
 
-  for (argptr = argbuf, argc = 1; *argptr != '\0' && argc < 99; argptr ++)
-    if (isspace(*argptr & 255))
-    {
-      *argptr++ = '\0';
+  job = jobs + num_jobs;
 
-      while (isspace(*argptr & 255))
-        argptr ++;
+  memset(job, 0, sizeof(job_t));
+  job->fd         = -1;
+  job->background = background;
 
-      if (*argptr != '\0')
-      {
-        argv[argc] = argptr;
-	argc ++;
-      }
+  for (i = 0; argv[i]; i ++)
+  {
+    if (i)
+      strlcat(job->command, " ", sizeof(job->command));
+    strlcat(job->command, argv[i], sizeof(job->command));
+  }
 
-      argptr --;
-    }
-    else if (*argptr == '\'')
-    {
-      if (argptr == argv[argc - 1])
-        argv[argc - 1] ++;
+  if (Verbosity > 1)
+    puts(job->command);
+
+  IOStats.commands ++;
 
-      for (argptr ++; *argptr && *argptr != '\''; argptr ++)
-        if (*argptr == '\\' && argptr[1])
-	  memmove(argptr, argptr + 1, strlen(argptr));
+ /*
+  * Create a pipe for the program's output...
+  */
 
-      if (*argptr == '\'')
-        memmove(argptr, argptr + 1, strlen(argptr));
+  fds[0] = fds[1] = -1;
 
-      argptr --;
-    }
-    else if (*argptr == '\"')
+  if (Verbosity < 2)
+  {
+    if (pipe(fds))
     {
-      if (argptr == argv[argc - 1])
-        argv[argc - 1] ++;
+      perror("epm: Unable to create pipe");
+      return (-1);
+    }
 
-      for (argptr ++; *argptr && *argptr != '\"'; argptr ++)
-        if (*argptr == '\\' && argptr[1])
-	  memmove(argptr, argptr + 1, strlen(argptr));
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+  }
+
+#ifdef HAVE_POSIX_SPAWN
+#  ifndef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP
+  if (!directory)
+#  endif /* !HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP */
+  {
+   /*
+    * Spawn the program without copying our address space...
+    */
 
-      if (*argptr == '\"')
-        memmove(argptr, argptr + 1, strlen(argptr));
+    posix_spawn_file_actions_init(&actions);
 
-      argptr --;
+    if (fds[1] >= 0)
+    {
+      posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+      posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+      posix_spawn_file_actions_adddup2(&actions, fds[1], 2);
     }
 
-  argv[argc] = NULL;
+#  ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP
+    if (directory)
+      posix_spawn_file_actions_addchdir_np(&actions, directory);
+#  endif /* HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP */
 
- /*
-  * Execute the command...
-  */
+    err = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
 
+    if (err)
+    {
+      fprintf(stderr, "epm: Unable to execute \"%s\" program: %s\n", argv[0],
+              strerror(err));
+
+      if (fds[0] >= 0)
+      {
+        close(fds[0]);
+	close(fds[1]);
+      }
+
+      return (-1);
+    }
+  }
+#  ifndef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP
+  else
+#  endif /* !HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP */
+#endif /* HAVE_POSIX_SPAWN */
+#if !defined(HAVE_POSIX_SPAWN) || !defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP)
   if ((pid = fork()) == 0)
   {
    /*
-    * Child comes here...  Redirect stdin, stdout, and stderr to /dev/null
-    * if !Verbosity...
+    * Child comes here...  Redirect stdin to /dev/null and stdout and stderr
+    * to the output pipe as needed...
     */
 
-    if (Verbosity < 2)
+    if (fds[1] >= 0)
     {
       close(0);
-      close(1);
-      close(2);
+      open("/dev/null", O_RDONLY);
 
-      open("/dev/null", O_RDWR);
-      dup(0);
-      dup(0);
+      if (dup2(fds[1], 1) < 0 || dup2(fds[1], 2) < 0)
+        _exit(errno);
     }
 
    /*
     * Change directories...
     */
 
-    if (directory)
-      chdir(directory);
+    if (directory && chdir(directory))
+    {
+      fprintf(stderr, "epm: Unable to change to directory \"%s\": %s\n",
+              directory, strerror(errno));
+      _exit(errno);
+    }
 
    /*
     * Execute the program; if an error occurs, exit with the UNIX error...
@@ -144,7 +332,7 @@ run_command(const char *directory,	/* I - Directory for command or NULL */
     execvp(argv[0], argv);
     fprintf(stderr, "epm: Unable to execute \"%s\" program: %s\n", argv[0],
             strerror(errno));
-    exit(errno);
+    _exit(errno);
   }
   else if (pid < 0)
   {
@@ -153,20 +341,164 @@ run_command(const char *directory,	/* I - Directory for command or NULL */
     */
 
     perror("epm: fork failed");
-    return (1);
+
+    if (fds[0] >= 0)
+    {
+      close(fds[0]);
+      close(fds[1]);
+    }
+
+    return (-1);
   }
+#endif /* !HAVE_POSIX_SPAWN || !HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP */
 
  /*
-  * Fork successful - wait for the child and return the error status...
+  * Program started - close the write end of the pipe and add the job...
   */
 
-  if (wait(&status) != pid)
+  if (fds[1] >= 0)
+    close(fds[1]);
+
+  job->pid = pid;
+  job->fd  = fds[0];
+
+  num_jobs ++;
+
+  return (pid);
+}
+
+
+/*
+ * 'wait_jobs()' - Collect program output and wait for programs to finish.
+ *
+ * If "pid" is positive, wait for that program.  If "pid" is 0, wait for all
+ * programs.  Otherwise wait for any one program.
+ */
+
+static int				/* O - Exit status */
+wait_jobs(pid_t pid)			/* I - Process ID, 0 = all, -1 = any */
+{
+  int		i,			/* Looping var */
+		nfds,			/* Number of pipes */
+		status,			/* Exit status */
+		jobnums[MAX_JOBS];	/* Job for each pipe */
+  job_t		*job;			/* Current job */
+  struct pollfd	pfds[MAX_JOBS];		/* Pipes to poll */
+  ssize_t	bytes;			/* Bytes read */
+  char		buffer[8192];		/* Output buffer */
+
+
+  while (num_jobs > 0)
   {
-    fputs("epm: Got exit status from wrong program!\n", stderr);
-    return (1);
+   /*
+    * Read output from any programs that have some...
+    */
+
+    for (i = 0, nfds = 0, job = jobs; i < num_jobs; i ++, job ++)
+      if (job->fd >= 0)
+      {
+        pfds[nfds].fd      = job->fd;
+	pfds[nfds].events  = POLLIN;
+	pfds[nfds].revents = 0;
+	jobnums[nfds]      = i;
+	nfds ++;
+      }
+
+    if (nfds > 0)
+    {
+      if (poll(pfds, (nfds_t)nfds, -1) < 0)
+      {
+        if (errno == EINTR)
+	  continue;
+
+        perror("epm: Unable to poll command output");
+	return (1);
+      }
+
+      for (i = 0; i < nfds; i ++)
+      {
+        if (!pfds[i].revents)
+	  continue;
+
+        job = jobs + jobnums[i];
+
+        if ((bytes = read(job->fd, buffer, sizeof(buffer))) > 0)
+	{
+	 /*
+	  * Save the output, up to MAX_OUTPUT bytes...
+	  */
+
+	  if ((job->outused + (size_t)bytes) > job->outsize &&
+	      job->outsize < MAX_OUTPUT)
+	  {
+	    char	*temp;		/* New buffer */
+	    size_t	tempsize;	/* New size */
+
+            tempsize = job->outsize ? 2 * job->outsize : sizeof(buffer);
+	    if (tempsize > MAX_OUTPUT)
+	      tempsize = MAX_OUTPUT;
+
+	    if ((temp = realloc(job->output, tempsize)) != NULL)
+	    {
+	      job->output  = temp;
+	      job->outsize = tempsize;
+	    }
+	  }
+
+          if ((size_t)bytes > (job->outsize - job->outused))
+	  {
+	    bytes          = (ssize_t)(job->outsize - job->outused);
+	    job->truncated = 1;
+	  }
+
+          if (bytes > 0)
+	  {
+	    memcpy(job->output + job->outused, buffer, (size_t)bytes);
+	    job->outused += (size_t)bytes;
+	  }
+	}
+	else if (bytes == 0 || (errno != EINTR && errno != EAGAIN))
+	{
+	 /*
+	  * End of output...
+	  */
+
+	  close(job->fd);
+	  job->fd = -1;
+	}
+      }
+    }
+
+   /*
+    * Wait for programs whose output is closed...
+    */
+
+    for (i = 0, job = jobs; i < num_jobs;)
+    {
+      pid_t	jobpid;			/* Process ID of job */
+
+      if (job->fd >= 0)
+      {
+        i ++;
+	job ++;
+	continue;
+      }
+
+      jobpid = job->pid;
+
+      while (waitpid(jobpid, &status, 0) < 0)
+        if (errno != EINTR)
+	{
+	  status = 1 << 8;
+	  break;
+	}
+
+      status = finish_job(job, status);
+
+      if (pid < 0 || jobpid == pid)
+        return (status);
+    }
   }
-  else if (WIFSIGNALED(status))
-    return (-WTERMSIG(status));
-  else
-    return (WEXITSTATUS(status));
+
+  return (0);
 }
@@ -32,6 +32,10 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 
+#ifdef HAVE_PTHREAD_H
+#  include <pthread.h>
+#endif // HAVE_PTHREAD_H
+
 #ifdef HAVE_SYS_PARAM_H
 #  include <sys/param.h>
 #endif // HAVE_SYS_PARAM_H
@@ -76,6 +80,16 @@ AuthorizationRef SetupAuthorizationRef;
 #define PANE_INSTALL	5
 
 
+//
+// Install job states...
+//
+
+#define JOB_PENDING	0		// Waiting to install
+#define JOB_RUNNING	1		// Installing
+#define JOB_DONE	2		// Installed
+#define JOB_FAILED	3		// Failed to install
+
+
 //
 // Define a C API function type for comparisons...
 //
@@ -85,17 +99,69 @@ typedef int (*compare_func_t)(const void *, const void *);
 }
 
 
+//
+// Local types...
+//
+
+struct install_job_t			//// Product being installed
+{
+  gui_dist_t		*dist;		// Distribution
+  int			state;		// Job state
+  int			fd;		// Pipe from install script or -1
+#ifdef __APPLE__
+  FILE			*fp;		// Pipe from install script
+#else
+  int			pid;		// Process ID
+#endif // __APPLE__
+  long long		size;		// Size in bytes
+  gui_progress_t	progress;	// Install progress
+  int			bufused;	// Number of bytes in buffer
+  char			buffer[8193];	// Output from install script
+};
+
+
+//
+// Local globals...
+//
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t	ScanMutex = PTHREAD_MUTEX_INITIALIZER;
+					// Mutex for ScanDone
+#endif // HAVE_PTHREAD_H
+static int		ScanDone = 0;	// Software scan done?
+static int		MaxInstalls = 1;// Maximum number of products to install
+					// at the same time
+static int		NumJobs = 0;	// Number of products to install
+static install_job_t	*Jobs = NULL;	// Products to install
+static gui_progress_t	Progress;	// Install progress
+static char		ProgressTitle[1024],
+					// Title of current products
+			ProgressLabel[1024];
+					// Progress label
+
+
 //
 // Local functions...
 //
 
-void	get_dists(const char *d);
-int	install_dist(const gui_dist_t *dist);
+void	add_log(install_job_t *job, const char *line);
+int	check_sizes(void);
+int	depends_on(const gui_dist_t *dist, const gui_dist_t *other);
+void	finish_install(install_job_t *job, int status);
+void	get_dists(void);
+void	get_rpms(int num_rpms, char **rpms);
+int	get_sizes(fsspace_t **fs);
+int	install_dist(install_job_t *job);
+int	install_dists(void);
 int	license_dist(const gui_dist_t *dist);
+void	list_dists(const char *d);
 void	load_image(void);
 void	load_readme(void);
 void	load_types(void);
-void	log_cb(int fd, int *fdptr);
+void	log_cb(int fd, install_job_t *job);
+int	scan_done(void);
+void	*scan_dists(void *data);
+void	show_progress(void);
 void	update_sizes(void);
 
 
@@ -107,14 +173,39 @@ int				// O - Exit status
 main(int  argc,			// I - Number of command-line arguments
      char *argv[])		// I - Command-line arguments
 {
+  int		i;		// Looping var
   Fl_Window	*w;		// Main window...
-  const char	*distdir = ".";	// Distribution directory
+  const char	*distdir = ".",	// Distribution directory
+		*dirarg = NULL;	// Directory on command-line
 
 
   // Use GTK+ scheme for all operating systems...
   Fl::background(230, 230, 230);
   Fl::scheme("gtk+");
 
+  // Ask the install scripts for progress records...
+  putenv((char *)"EPM_PROGRESS=1");
+
+  // Install independent products at the same time, one per CPU up to 4 by
+  // default...
+#ifdef _SC_NPROCESSORS_ONLN
+  if ((MaxInstalls = (int)sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+    MaxInstalls = 1;
+  else if (MaxInstalls > 4)
+    MaxInstalls = 4;
+#endif // _SC_NPROCESSORS_ONLN
+
+  // Parse the command-line...
+  for (i = 1; i < argc; i ++)
+    if (!strcmp(argv[i], "-j") && (i + 1) < argc)
+    {
+      i ++;
+      if ((MaxInstalls = atoi(argv[i])) < 1)
+        MaxInstalls = 1;
+    }
+    else if (argv[i][0] != '-' && !dirarg)
+      dirarg = argv[i];
+
 #ifdef __APPLE__
   // macOS uses the setup program in a bundle, so get the bundle's directory.
   CFBundleRef mainBundle = CFBundleGetMainBundle();
@@ -139,8 +230,23 @@ main(int  argc,			// I - Number of command-line arguments
 #endif // __APPLE__
 
   // Get the directory that has the software in it...
-  if (argc > 1 && argv[1][0] != '-')
-    distdir = argv[1];
+  if (dirarg)
+    distdir = dirarg;
+
+  if (chdir(distdir))
+  {
+    fprintf(stderr, "setup: Unable to change to distribution directory \"%s\": %s\n", distdir, strerror(errno));
+    exit(1);
+  }
+
+  // Scan the installed and available software while the window comes up...
+#ifdef HAVE_PTHREAD_H
+  pthread_t	scan;			// Software scan thread
+  int		scanning;		// Scan thread running?
+
+  if ((scanning = !pthread_create(&scan, NULL, scan_dists, NULL)) == 0)
+#endif // HAVE_PTHREAD_H
+  scan_dists(NULL);
 
   w = make_window();
 
@@ -148,17 +254,21 @@ main(int  argc,			// I - Number of command-line arguments
   PrevButton->deactivate();
   NextButton->deactivate();
 
-  gui_get_installed();
-  get_dists(distdir);
-
   load_image();
-  load_readme();
-  load_types();
 
   w->show();
 
-  while (!w->visible())
-    Fl::wait();
+  while (!w->visible() || !scan_done())
+    Fl::wait(0.1);
+
+#ifdef HAVE_PTHREAD_H
+  if (scanning)
+    pthread_join(scan, NULL);
+#endif // HAVE_PTHREAD_H
+
+  list_dists(distdir);
+  load_readme();
+  load_types();
 
 #ifdef __APPLE__
   OSStatus status;
@@ -206,32 +316,172 @@ main(int  argc,			// I - Number of command-line arguments
 }
 
 
+//
+// 'add_log()' - Add a line from an install script to the log.
+//
+// Progress records update the progress bar instead.  Lines are prefixed
+// with the product name when several products may be installing at once.
+//
+
+void
+add_log(install_job_t *job,		// I - Install job
+        const char    *line)		// I - Line from install script
+{
+  char	message[1024];			// Message for log
+
+
+  if (gui_update_progress(&(job->progress), line))
+  {
+    strlcpy(Progress.phase, job->progress.phase, sizeof(Progress.phase));
+    show_progress();
+  }
+  else if (MaxInstalls > 1 && NumJobs > 1)
+  {
+    snprintf(message, sizeof(message), "%s: %s", job->dist->product, line);
+    InstallLog->add(message);
+  }
+  else
+    InstallLog->add(line);
+}
+
+
+//
+// 'check_sizes()' - Make sure there is enough disk space for the selected
+//                   software.
+//
+
+int					// O - 1 if there is room, 0 otherwise
+check_sizes(void)
+{
+  int		i;			// Looping var
+  int		num_fs;			// Number of filesystems
+  fsspace_t	*fs;			// Filesystems
+
+
+  if ((num_fs = get_sizes(&fs)) <= 0)
+  {
+    free(fs);
+    return (1);
+  }
+
+  for (i = 0; i < num_fs; i ++)
+    if (fs[i].needed > fs[i].available ||
+        (fs[i].free_inodes >= 0 && fs[i].inodes > fs[i].free_inodes))
+      break;
+
+  if (i < num_fs)
+  {
+    if (fs[i].needed > fs[i].available)
+      fl_alert("Not enough free disk space for software!\n\n"
+               "You need %dk in %s but only have %dk available.",
+	       (int)fs[i].needed, fs[i].mount, (int)fs[i].available);
+    else
+      fl_alert("Not enough free disk space for software!\n\n"
+               "You need %ld files in %s but only have %ld available.",
+	       fs[i].inodes, fs[i].mount, fs[i].free_inodes);
+  }
+
+  free(fs);
+
+  return (i >= num_fs);
+}
+
+
+//
+// 'depends_on()' - Check whether a distribution requires another.
+//
+
+int					// O - 1 if required, 0 otherwise
+depends_on(const gui_dist_t *dist,	// I - Distribution
+           const gui_dist_t *other)	// I - Other distribution
+{
+  int		i, j;			// Looping vars
+  gui_depend_t	*depend,		// Current requirement
+		*provide;		// Current provided name
+
+
+  for (i = dist->num_depends, depend = dist->depends; i > 0; i --, depend ++)
+  {
+    if (depend->type != DEPEND_REQUIRES)
+      continue;
+
+    if (!strcmp(depend->product, other->product))
+      return (1);
+
+    for (j = other->num_depends, provide = other->depends;
+         j > 0;
+	 j --, provide ++)
+      if (provide->type == DEPEND_PROVIDES &&
+          !strcmp(depend->product, provide->product))
+        return (1);
+  }
+
+  return (0);
+}
+
+
+//
+// 'finish_install()' - Finish installing a distribution.
+//
+
+void
+finish_install(install_job_t *job,	// I - Install job
+               int           status)	// I - Exit status
+{
+  char	message[1024];			// Message for log
+
+
+  // Read any output that is still in the pipe...
+  if (job->fd >= 0)
+  {
+    fcntl(job->fd, F_SETFL, O_NONBLOCK);
+
+    while (job->fd >= 0)		// log_cb() will close and clear job->fd...
+      log_cb(job->fd, job);
+  }
+
+#ifdef __APPLE__
+  fclose(job->fp);
+#endif // __APPLE__
+
+  if (status)
+  {
+    snprintf(message, sizeof(message), "Unable to install %s!",
+             job->dist->name);
+    InstallLog->add(message);
+    InstallLog->bottomline(InstallLog->size());
+
+    job->state = JOB_FAILED;
+  }
+  else
+    job->state = JOB_DONE;
+
+  show_progress();
+}
+
+
 //
 // 'get_dists()' - Get a list of available software products.
 //
+// Only the "#%" header lines of the installation and patch scripts are
+// read, and all RPM packages are queried at once.
+//
 
 void
-get_dists(const char *d)	// I - Directory to look in
+get_dists(void)
 {
   int		i;		// Looping var
   int		num_files;	// Number of files
   dirent	**files;	// Files
   const char	*ext;		// Extension
-  gui_dist_t	*temp,		// Pointer to current distribution
-		*installed;	// Pointer to installed product
+  gui_dist_t	*temp;		// Pointer to current distribution
   FILE		*fp;		// File to read from
-  char		line[1024],	// Line from file...
-		product[64];	// Product name...
-  int		lowver, hiver;	// Version numbers for dependencies
+  char		line[1024];	// Line from file...
+  int		num_rpms;	// Number of RPM packages
+  char		**rpms;		// RPM packages
 
 
-  // Get the files in the specified directory...
-  if (chdir(d))
-  {
-    fprintf(stderr, "setup: Unable to change to distribution directory \"%s\": %s\n", d, strerror(errno));
-    exit(1);
-  }
-
+  // Get the files in the distribution directory...
   if ((num_files = fl_filename_list(".", &files)) == 0)
   {
     fputs("setup: Error - no software products found!\n", stderr);
@@ -241,6 +491,13 @@ get_dists(const char *d)	// I - Directory to look in
   // Build a distribution list...
   NumDists = 0;
   Dists    = (gui_dist_t *)0;
+  num_rpms = 0;
+
+  if ((rpms = (char **)malloc((size_t)num_files * sizeof(char *))) == NULL)
+  {
+    perror("setup: Unable to allocate memory");
+    exit(1);
+  }
 
   for (i = 0; i < num_files; i ++)
   {
@@ -262,8 +519,9 @@ get_dists(const char *d)	// I - Directory to look in
       strncpy(temp->product, files[i]->d_name, sizeof(temp->product) - 1);
       *strrchr(temp->product, '.') = '\0';	// Drop .install
 
-      // Read info from the installation script...
-      while (fgets(line, sizeof(line), fp) != NULL)
+      // Read info from the installation script header, which ends with the
+      // first line that isn't a comment...
+      while (fgets(line, sizeof(line), fp) != NULL && line[0] == '#')
       {
         // Only read distribution info lines...
         if (strncmp(line, "#%", 2))
@@ -273,53 +531,126 @@ get_dists(const char *d)	// I - Directory to look in
         line[strlen(line) - 1] = '\0';
 
         // Copy data as needed...
-	if (strncmp(line, "#%product ", 10) == 0)
-	  strncpy(temp->name, line + 10, sizeof(temp->name) - 1);
-	else if (strncmp(line, "#%version ", 10) == 0)
-	  sscanf(line + 10, "%31s%d", temp->version, &(temp->vernumber));
-	else if (strncmp(line, "#%rootsize ", 11) == 0)
-	  temp->rootsize = atoi(line + 11);
-	else if (strncmp(line, "#%usrsize ", 10) == 0)
-	  temp->usrsize = atoi(line + 10);
-	else if (strncmp(line, "#%incompat ", 11) == 0 ||
-	         strncmp(line, "#%requires ", 11) == 0)
-	{
-	  lowver = 0;
-	  hiver  = 0;
-
-	  if (sscanf(line + 11, "%s%*s%d%*s%d", product, &lowver, &hiver) > 0)
-	    gui_add_depend(temp, (line[2] == 'i') ? DEPEND_INCOMPAT :
-	                                            DEPEND_REQUIRES,
-	        	   product, lowver, hiver);
-        }
+        gui_add_info(temp, line);
       }
 
       fclose(fp);
     }
     else if (!strcmp(ext, ".rpm"))
     {
-      // Found an RPM package...
-      char	*version,		// Version number
+      // Found an RPM package, query it with the others below...
+      rpms[num_rpms ++] = files[i]->d_name;
+    }
+  }
+
+  if (num_rpms > 0)
+    get_rpms(num_rpms, rpms);
+
+  for (i = 0; i < num_files; i ++)
+    free(files[i]);
+
+  free(files);
+  free(rpms);
+
+  if (NumDists > 1)
+    qsort(Dists, NumDists, sizeof(gui_dist_t), (compare_func_t)gui_sort_dists);
+
+  gui_changed_dists();
+}
+
+
+//
+// 'get_rpms()' - Get the product information for RPM packages.
+//
+// The packages are queried using a single "rpm -qp" command.  If rpm cannot
+// read one of the packages, the rest are queried one at a time.
+//
+
+void
+get_rpms(int  num_rpms,			// I - Number of packages
+         char **rpms)			// I - Package filenames
+{
+  int		i;			// Looping var
+  int		num_lines;		// Number of lines
+  char		**lines;		// Lines from rpm
+  char		*command,		// rpm command
+		*cmdptr,		// Pointer into command
+		*rpmptr;		// Pointer into filename
+  size_t	cmdsize;		// Size of command
+  FILE		*fp;			// rpm output
+  char		line[1024],		// Line from rpm
+		*version,		// Version number
 		*size,			// Size of package
 		*description;		// Summary string
+  gui_dist_t	*temp;			// Pointer to current distribution
+  int		status;			// Exit status of rpm
 
 
-      // Get the package information...
-      snprintf(line, sizeof(line),
-               "rpm -qp --qf '%%{NAME}|%%{VERSION}|%%{SIZE}|%%{SUMMARY}\\n' %s",
-	       files[i]->d_name);
+  // Build the command, quoting each filename...
+  cmdsize = 80;
+  for (i = 0; i < num_rpms; i ++)
+    cmdsize += 4 * strlen(rpms[i]) + 3;
 
-      if ((fp = popen(line, "r")) == NULL)
-      {
-        free(files[i]);
-	continue;
-      }
+  if ((command = (char *)malloc(cmdsize)) == NULL ||
+      (lines = (char **)calloc((size_t)num_rpms, sizeof(char *))) == NULL)
+  {
+    perror("setup: Unable to allocate memory");
+    exit(1);
+  }
+
+  strcpy(command, "rpm -qp --qf '%{NAME}|%{VERSION}|%{SIZE}|%{SUMMARY}\\n'");
+  cmdptr = command + strlen(command);
 
-      if (!fgets(line, sizeof(line), fp))
+  for (i = 0; i < num_rpms; i ++)
+  {
+    *cmdptr++ = ' ';
+    *cmdptr++ = '\'';
+
+    for (rpmptr = rpms[i]; *rpmptr; rpmptr ++)
+    {
+      if (*rpmptr == '\'')
       {
-        free(files[i]);
-	continue;
+        memcpy(cmdptr, "'\\''", 4);
+	cmdptr += 4;
       }
+      else
+        *cmdptr++ = *rpmptr;
+    }
+
+    *cmdptr++ = '\'';
+  }
+
+  *cmdptr = '\0';
+
+  // Read one line per package...
+  num_lines = 0;
+
+  if ((fp = popen(command, "r")) != NULL)
+  {
+    while (fgets(line, sizeof(line), fp))
+    {
+      if (num_lines < num_rpms)
+        lines[num_lines] = strdup(line);
+
+      num_lines ++;
+    }
+
+    status = pclose(fp);
+  }
+  else
+    status = -1;
+
+  free(command);
+
+  if (num_lines == num_rpms && !status)
+  {
+    // Add the packages...
+    for (i = 0; i < num_rpms; i ++)
+    {
+      if (!lines[i])
+        continue;
+
+      strlcpy(line, lines[i], sizeof(line));
 
       // Drop the trailing newline...
       line[strlen(line) - 1] = '\0';
@@ -340,73 +671,97 @@ get_dists(const char *d)	// I - Directory to look in
       // Add a new distribution entry...
       temp           = gui_add_dist(&NumDists, &Dists);
       temp->type     = PACKAGE_RPM;
-      temp->filename = strdup(files[i]->d_name);
+      temp->filename = strdup(rpms[i]);
 
       strlcpy(temp->product, line, sizeof(temp->product));
       strlcpy(temp->name, description, sizeof(temp->name));
       strlcpy(temp->version, version, sizeof(temp->version));
       temp->vernumber = get_vernumber(version);
       temp->rootsize  = (int)(atof(size) / 1024.0 + 0.5);
-
-      pclose(fp);
     }
-
-    free(files[i]);
   }
-
-  free(files);
-
-  if (NumDists == 0)
+  else if (num_rpms > 1 && num_lines > 0)
   {
-//    fl_alert("No software found to install!");
-    fl_alert("No software found to install in \"%s\".", d);
-    exit(1);
+    // Some packages could not be read, so query them one at a time...
+    for (i = 0; i < num_rpms; i ++)
+      get_rpms(1, rpms + i);
   }
 
-  if (NumDists > 1)
-    qsort(Dists, NumDists, sizeof(gui_dist_t), (compare_func_t)gui_sort_dists);
+  for (i = 0; i < num_rpms; i ++)
+    free(lines[i]);
 
-  for (i = 0, temp = Dists; i < NumDists; i ++, temp ++)
-  {
-    sprintf(line, "%s v%s", temp->name, temp->version);
+  free(lines);
+}
 
-    if ((installed = gui_find_dist(temp->product, NumInstalled,
-                                   Installed)) == NULL)
-    {
-      strcat(line, " (new)");
-      SoftwareList->add(line, 0);
-    }
-    else if (installed->vernumber > temp->vernumber)
-    {
-      strcat(line, " (downgrade)");
-      SoftwareList->add(line, 0);
-    }
-    else if (installed->vernumber == temp->vernumber)
-    {
-      strcat(line, " (installed)");
-      SoftwareList->add(line, 0);
-    }
-    else
+
+//
+// 'get_sizes()' - Get the space needed on each filesystem for the selected
+//                 software.
+//
+// Returns -1 if any of the selected software has no per-directory sizes or
+// the available space cannot be determined.
+//
+
+int					// O - Number of filesystems or -1
+get_sizes(fsspace_t **fs)		// O - Filesystems
+{
+  int		i, j;			// Looping vars
+  int		num_fs;			// Number of filesystems
+  int		num_spaces;		// Number of directories
+  space_t	*spaces,		// Space needed in directories
+		*space;			// Current directory
+  gui_dist_t	*dist,			// Distribution
+		*installed;		// Installed distribution
+
+
+  *fs        = NULL;
+  num_spaces = 0;
+  spaces     = NULL;
+
+  for (i = 0, dist = Dists; i < NumDists; i ++, dist ++)
+    if (SoftwareList->checked(i + 1))
     {
-      strcat(line, " (upgrade)");
-      SoftwareList->add(line, 1);
+      if (dist->num_spaces == 0)
+      {
+        free(spaces);
+	return (-1);
+      }
+
+      for (j = dist->num_spaces, space = dist->spaces; j > 0; j --, space ++)
+        add_space(&num_spaces, &spaces, space->dst, space->inodes,
+	          space->kbytes[0], space->kbytes[1]);
+
+      // Subtract the space used by the installed version, if any...
+      if ((installed = gui_find_dist(dist->product, NumInstalled,
+                                     Installed)) != NULL)
+        for (j = installed->num_spaces, space = installed->spaces;
+	     j > 0;
+	     j --, space ++)
+          add_space(&num_spaces, &spaces, space->dst, -space->inodes,
+	            -space->kbytes[0], -space->kbytes[1]);
     }
-  }
 
-  update_sizes();
+  if (num_spaces == 0)
+    return (-1);
+
+  num_fs = get_fsspace(num_spaces, spaces, fs);
+
+  free(spaces);
+
+  return (num_fs);
 }
 
 
 //
-// 'install_dist()' - Install a distribution...
+// 'install_dist()' - Start installing a distribution...
 //
 
-int					// O - Install status
-install_dist(const gui_dist_t *dist)	// I - Distribution to install
+int					// O - 0 if started, 1 on error
+install_dist(install_job_t *job)	// I - Install job
 {
+  gui_dist_t	*dist = job->dist;	// Distribution to install
   char		command[1024];		// Command string
   int		fds[2];			// Pipe FDs
-  int		status = 0;		// Exit status
 #ifndef __APPLE__
   int		pid;			// Process ID
 #endif // !__APPLE__
@@ -417,7 +772,6 @@ install_dist(const gui_dist_t *dist)	// I - Distribution to install
 
 #ifdef __APPLE__
   // Run the install script using Apple's authorization API...
-  FILE		*fp = NULL;
   char		*args[2] = { (char *)"now", NULL };
   OSStatus	astatus;
 
@@ -425,7 +779,7 @@ install_dist(const gui_dist_t *dist)	// I - Distribution to install
   astatus = AuthorizationExecuteWithPrivileges(SetupAuthorizationRef,
                                                dist->filename,
                                                kAuthorizationFlagDefaults,
-                                               args, &fp);
+                                               args, &(job->fp));
 
   if (astatus != errAuthorizationSuccess)
   {
@@ -433,7 +787,7 @@ install_dist(const gui_dist_t *dist)	// I - Distribution to install
     return (1);
   }
 
-  fds[0] = fileno(fp);
+  fds[0] = fileno(job->fp);
 #else
   // Fork the command and redirect errors and info to stdout...
   pipe(fds);
@@ -473,50 +827,177 @@ install_dist(const gui_dist_t *dist)	// I - Distribution to install
     return (1);
   }
 
-  // Close the output pipe (used by the child)...
+  // Close the output pipe (used by the child) and keep the input pipe out
+  // of the other install scripts...
   close(fds[1]);
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+
+  job->pid = pid;
 #endif // __APPLE__
 
   // Listen for data on the input pipe...
-  Fl::add_fd(fds[0], (void (*)(int, void *))log_cb, fds);
+  job->fd    = fds[0];
+  job->state = JOB_RUNNING;
+
+  Fl::add_fd(job->fd, (void (*)(int, void *))log_cb, job);
+
+  return (0);
+}
+
+
+//
+// 'install_dists()' - Install the selected distributions.
+//
+// Products are installed as soon as the products they require are
+// installed, with up to MaxInstalls install scripts running at the same time.
+// RPM packages are installed one at a time since RPM locks its database.
+// If the requirements form a loop, the first waiting product is installed
+// anyway.  No more products are started once an install fails.
+//
+
+int					// O - 0 on success, 1 on error
+install_dists(void)
+{
+  int		i, j;			// Looping vars
+  install_job_t	*job,			// Current job
+		*other;			// Other job
+  int		error,			// Errors?
+		status,			// Exit status
+		running,		// Number of jobs running
+		pending,		// Number of jobs waiting
+		rpm;			// RPM job running?
+  long long	total;			// Total bytes to install
+
+
+  // Create a job for each selected product...
+  for (i = 0, NumJobs = 0; i < NumDists; i ++)
+    if (SoftwareList->checked(i + 1))
+      NumJobs ++;
+
+  if (NumJobs == 0)
+    return (0);
+
+  Jobs = new install_job_t[NumJobs];
+  memset(Jobs, 0, (size_t)NumJobs * sizeof(install_job_t));
+
+  for (i = 0, job = Jobs, total = 0; i < NumDists; i ++)
+    if (SoftwareList->checked(i + 1))
+    {
+      job->dist = Dists + i;
+      job->fd   = -1;
+      job->size = (Dists[i].rootsize + Dists[i].usrsize) * 1024LL;
+
+      gui_start_progress(&(job->progress), job->size, 0);
+
+      total += job->size;
+      job ++;
+    }
+
+  // Track progress using the number of bytes to install; products that
+  // don't report progress just advance when they are done...
+  gui_start_progress(&Progress, total, 0);
 
   // Show the user that we're busy...
   SetupWindow->cursor(FL_CURSOR_WAIT);
 
-  // Loop until the child is done...
-  while (fds[0])	// log_cb() will close and zero fds[0]...
+  for (error = 0;;)
   {
-    // Wait for events...
-    Fl::wait();
+    // See what is running...
+    for (i = NumJobs, job = Jobs, running = 0, pending = 0, rpm = 0;
+         i > 0;
+	 i --, job ++)
+      if (job->state == JOB_RUNNING)
+      {
+        running ++;
 
-#ifndef __APPLE__
-    // Check to see if the child went away...
-    if (waitpid(0, &status, WNOHANG) == pid)
+	if (job->dist->type != PACKAGE_PORTABLE)
+	  rpm = 1;
+      }
+      else if (job->state == JOB_PENDING)
+        pending ++;
+
+    // Start the products whose requirements are installed...
+    for (i = 0, job = Jobs; !error && i < NumJobs && running < MaxInstalls;
+         i ++, job ++)
+    {
+      if (job->state != JOB_PENDING ||
+          (job->dist->type != PACKAGE_PORTABLE && rpm))
+        continue;
+
+      for (j = NumJobs, other = Jobs; j > 0; j --, other ++)
+        if (other != job && other->state != JOB_DONE &&
+	    depends_on(job->dist, other->dist))
+	  break;
+
+      if (j > 0)
+        continue;			// Still waiting for a required product
+
+      if (install_dist(job))
+      {
+        job->state = JOB_FAILED;
+	error      = 1;
+	break;
+      }
+
+      running ++;
+
+      if (job->dist->type != PACKAGE_PORTABLE)
+        rpm = 1;
+    }
+
+    if (!error && !running && pending)
+    {
+      // Nothing can start, so the requirements form a loop; install the
+      // first waiting product...
+      for (job = Jobs; job->state != JOB_PENDING; job ++);
+
+      if (install_dist(job))
+      {
+        job->state = JOB_FAILED;
+	error      = 1;
+      }
+      else
+        running ++;
+    }
+
+    if (!running)
       break;
-#endif // !__APPLE__
-  }
+
+    show_progress();
+
+    // Wait for output from the install scripts...
+    Fl::wait(0.25);
+
+    // Check to see if any of the children went away...
+    for (i = NumJobs, job = Jobs; i > 0; i --, job ++)
+    {
+      if (job->state != JOB_RUNNING)
+        continue;
 
 #ifdef __APPLE__
-  fclose(fp);
-#endif // __APPLE__
+      if (job->fd < 0)	// log_cb() closes the pipe when the script exits...
+        finish_install(job, 0);
+#else
+      if (waitpid(job->pid, &status, WNOHANG) == job->pid)
+      {
+        finish_install(job, status);
 
-  if (fds[0])
-  {
-    // Close the pipe - have all the data from the child...
-    Fl::remove_fd(fds[0]);
-    close(fds[0]);
-  }
-  else
-  {
-    // Get the child's exit status...
-    wait(&status);
+	if (status)
+	  error = 1;
+      }
+#endif // __APPLE__
+    }
   }
 
   // Show the user that we're ready...
   SetupWindow->cursor(FL_CURSOR_DEFAULT);
 
-  // Return...
-  return (status);
+  delete[] Jobs;
+
+  Jobs    = NULL;
+  NumJobs = 0;
+
+  return (error);
 }
 
 
@@ -682,6 +1163,57 @@ list_cb(Fl_Check_Browser *, void *)
 }
 
 
+//
+// 'list_dists()' - Show the available software products.
+//
+
+void
+list_dists(const char *d)		// I - Distribution directory
+{
+  int		i;			// Looping var
+  gui_dist_t	*temp,			// Pointer to current distribution
+		*installed;		// Pointer to installed product
+  char		line[1024];		// Line for list
+
+
+  if (NumDists == 0)
+  {
+//    fl_alert("No software found to install!");
+    fl_alert("No software found to install in \"%s\".", d);
+    exit(1);
+  }
+
+  for (i = 0, temp = Dists; i < NumDists; i ++, temp ++)
+  {
+    snprintf(line, sizeof(line), "%s v%s", temp->name, temp->version);
+
+    if ((installed = gui_find_dist(temp->product, NumInstalled,
+                                   Installed)) == NULL)
+    {
+      strlcat(line, " (new)", sizeof(line));
+      SoftwareList->add(line, 0);
+    }
+    else if (installed->vernumber > temp->vernumber)
+    {
+      strlcat(line, " (downgrade)", sizeof(line));
+      SoftwareList->add(line, 0);
+    }
+    else if (installed->vernumber == temp->vernumber)
+    {
+      strlcat(line, " (installed)", sizeof(line));
+      SoftwareList->add(line, 0);
+    }
+    else
+    {
+      strlcat(line, " (upgrade)", sizeof(line));
+      SoftwareList->add(line, 1);
+    }
+  }
+
+  update_sizes();
+}
+
+
 //
 // 'load_image()' - Load the setup image file (setup.gif/xpm)...
 //
@@ -882,45 +1414,53 @@ load_types(void)
 //
 
 void
-log_cb(int fd,			// I - Pipe to read from
-       int *fdptr)		// O - Pipe to read from
+log_cb(int           fd,		// I - Pipe to read from
+       install_job_t *job)		// I - Install job
 {
-  int		bytes;		// Bytes read/to read
-  char		*bufptr;	// Pointer into buffer
-  static int	bufused = 0;	// Number of bytes used
-  static char	buffer[8193];	// Buffer
+  int		bytes;			// Bytes read/to read
+  char		*bufptr;		// Pointer into buffer
 
 
-  bytes = 8192 - bufused;
-  if ((bytes = read(fd, buffer + bufused, bytes)) <= 0)
+  if (job->bufused >= 8192)
   {
-    // End of file; zero the FD to tell the install_dist() function to
-    // stop...
+    // Line too long for the buffer, add it as is...
+    job->buffer[job->bufused] = '\0';
+    add_log(job, job->buffer);
+    job->bufused = 0;
+  }
+
+  bytes = 8192 - job->bufused;
+  if ((bytes = read(fd, job->buffer + job->bufused, bytes)) <= 0)
+  {
+    // End of file; clear the FD to tell the install_dists() function the
+    // script is done...
 
     Fl::remove_fd(fd);
+#ifndef __APPLE__
     close(fd);
-    *fdptr = 0;
+#endif // !__APPLE__
+    job->fd = -1;
 
-    if (bufused > 0)
+    if (job->bufused > 0)
     {
       // Add remaining text...
-      buffer[bufused] = '\0';
-      InstallLog->add(buffer);
-      bufused = 0;
+      job->buffer[job->bufused] = '\0';
+      add_log(job, job->buffer);
+      job->bufused = 0;
     }
   }
   else
   {
     // Add bytes to the buffer, then add lines as needed...
-    bufused += bytes;
-    buffer[bufused] = '\0';
+    job->bufused += bytes;
+    job->buffer[job->bufused] = '\0';
 
-    while ((bufptr = strchr(buffer, '\n')) != NULL)
+    while ((bufptr = strchr(job->buffer, '\n')) != NULL)
     {
       *bufptr++ = '\0';
-      InstallLog->add(buffer);
-      strcpy(buffer, bufptr);
-      bufused -= bufptr - buffer;
+      add_log(job, job->buffer);
+      memmove(job->buffer, bufptr, strlen(bufptr) + 1);
+      job->bufused -= bufptr - job->buffer;
     }
   }
 
@@ -936,9 +1476,7 @@ void
 next_cb(Fl_Button *, void *)
 {
   int		i;			// Looping var
-  int		progress;		// Progress so far...
   int		error;			// Errors?
-  static char	message[1024];		// Progress message...
   static char	install_type[1024];	// EPM_INSTALL_TYPE env variable
   static int	installing = 0;		// Installing software?
 
@@ -992,7 +1530,7 @@ next_cb(Fl_Button *, void *)
     // Show the licenses for each of the selected software packages...
     installing = 1;
 
-    for (i = 0, progress = 0, error = 0; i < NumDists; i ++)
+    for (i = 0, error = 0; i < NumDists; i ++)
       if (SoftwareList->checked(i + 1) && license_dist(Dists + i))
       {
         InstallPercent->label("Installation Canceled!");
@@ -1005,26 +1543,27 @@ next_cb(Fl_Button *, void *)
 	return;
       }
 
+    // Make sure there is enough disk space before installing anything...
+    if (!check_sizes())
+    {
+      InstallPercent->label("Installation Canceled!");
+      Pane[PANE_INSTALL]->redraw();
+
+      CancelButton->label("Close");
+      CancelButton->activate();
+
+      fl_beep();
+
+      installing = 0;
+      return;
+    }
+
     // Then do the installs...
     NextButton->deactivate();
     CancelButton->deactivate();
     CancelButton->label("Close");
 
-    for (i = 0, progress = 0, error = 0; i < NumDists; i ++)
-      if (SoftwareList->checked(i + 1))
-      {
-        sprintf(message, "Installing %s v%s...", Dists[i].name,
-	        Dists[i].version);
-
-        InstallPercent->value(100.0 * progress / SoftwareList->nchecked());
-	InstallPercent->label(message);
-	Pane[PANE_INSTALL]->redraw();
-
-        if ((error = install_dist(Dists + i)) != 0)
-	  break;
-
-	progress ++;
-      }
+    error = install_dists();
 
     InstallPercent->value(100.0);
 
@@ -1055,6 +1594,100 @@ next_cb(Fl_Button *, void *)
 }
 
 
+//
+// 'scan_done()' - Check whether the software scan is done.
+//
+
+int					// O - 1 if done, 0 otherwise
+scan_done(void)
+{
+  int	done;				// Scan done?
+
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&ScanMutex);
+  done = ScanDone;
+  pthread_mutex_unlock(&ScanMutex);
+#else
+  done = ScanDone;
+#endif // HAVE_PTHREAD_H
+
+  return (done);
+}
+
+
+//
+// 'scan_dists()' - Scan the installed and available software.
+//
+// This runs in a separate thread, when available, so the GUI must not be
+// updated here.
+//
+
+void *					// O - Thread exit status
+scan_dists(void *)			// I - Unused
+{
+  gui_get_installed();
+  get_dists();
+  gui_get_installed_rpms(NumDists, Dists);
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&ScanMutex);
+  ScanDone = 1;
+  pthread_mutex_unlock(&ScanMutex);
+#else
+  ScanDone = 1;
+#endif // HAVE_PTHREAD_H
+
+  return (NULL);
+}
+
+
+//
+// 'show_progress()' - Show the install progress.
+//
+
+void
+show_progress(void)
+{
+  int		i;			// Looping var
+  install_job_t	*job,			// Current job
+		*current;		// Running job
+  int		running;		// Number of jobs running
+
+
+  // Add up the progress of each product, not letting a product that is
+  // bigger than expected count for more than its size...
+  for (i = NumJobs, job = Jobs, current = NULL, running = 0, Progress.done = 0;
+       i > 0;
+       i --, job ++)
+    if (job->state == JOB_DONE)
+      Progress.done += job->size;
+    else if (job->state == JOB_RUNNING)
+    {
+      Progress.done += job->progress.done < job->size ? job->progress.done :
+                                                        job->size;
+      current       = job;
+      running ++;
+    }
+
+  if (running == 1)
+  {
+    snprintf(ProgressTitle, sizeof(ProgressTitle), "Installing %s v%s",
+             current->dist->name, current->dist->version);
+    strlcpy(Progress.phase, current->progress.phase, sizeof(Progress.phase));
+  }
+  else if (running > 1)
+    snprintf(ProgressTitle, sizeof(ProgressTitle), "Installing %d products",
+             running);
+
+  InstallPercent->value(gui_format_progress(&Progress, ProgressTitle,
+                                            ProgressLabel,
+					    sizeof(ProgressLabel)));
+  InstallPercent->label(ProgressLabel);
+  Pane[PANE_INSTALL]->redraw();
+}
+
+
 //
 // 'type_cb()' - Handle selections in the type list.
 //
@@ -1114,10 +1747,43 @@ update_sizes(void)
 		usrpart;	// Available /usr partition
   int		rootfree,	// Free space on root partition
 		usrfree;	// Free space on /usr partition
+  int		num_fs;		// Number of filesystems
+  fsspace_t	*fs;		// Filesystems
+  char		*ptr;		// Pointer into label
   static char	sizelabel[1024];// Label for selected sizes...
 
 
-  // Get the sizes for the selected products...
+  // Show the space needed on each filesystem when the scripts list it...
+  if ((num_fs = get_sizes(&fs)) > 0)
+  {
+    for (i = 0, ptr = sizelabel; i < num_fs; i ++)
+    {
+      if (fs[i].needed >= 1024 || fs[i].needed <= -1024)
+        snprintf(ptr, sizeof(sizelabel) - (size_t)(ptr - sizelabel),
+	         "%s%+.1fm required on %s, %dm available", i ? ",\n" : "",
+		 fs[i].needed / 1024.0, fs[i].mount,
+		 (int)(fs[i].available / 1024));
+      else
+        snprintf(ptr, sizeof(sizelabel) - (size_t)(ptr - sizelabel),
+	         "%s%+dk required on %s, %dm available", i ? ",\n" : "",
+		 (int)fs[i].needed, fs[i].mount,
+		 (int)(fs[i].available / 1024));
+
+      ptr += strlen(ptr);
+    }
+
+    strlcat(sizelabel, ".", sizeof(sizelabel));
+
+    free(fs);
+
+    SoftwareSize->label(sizelabel);
+    SoftwareSize->redraw();
+    return;
+  }
+
+  free(fs);
+
+  // Otherwise get the sizes for the selected products...
   for (i = 0, dist = Dists, rootsize = 0, usrsize = 0;
        i < NumDists;
        i ++, dist ++)
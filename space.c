@@ -0,0 +1,213 @@
+/*
+ * Disk space functions for the ESP Package Manager (EPM).
+ *
+ * Copyright 2020 by Michael R Sweet
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "epm.h"
+
+#ifdef HAVE_SYS_STATVFS_H
+#  include <sys/statvfs.h>
+#endif /* HAVE_SYS_STATVFS_H */
+
+
+/*
+ * 'add_space()' - Add disk space for a destination directory.
+ *
+ * Space for the same directory is combined into one entry.  Negative
+ * values can be used to subtract the space used by installed software.
+ */
+
+void
+add_space(int        *num_spaces,	/* IO - Number of directories */
+          space_t    **spaces,		/* IO - Directories */
+	  const char *dst,		/* I - Destination directory */
+	  long       inodes,		/* I - Number of files, directories, and links */
+	  long long  kbytes1,		/* I - Size using 1k blocks */
+	  long long  kbytes4)		/* I - Size using 4k blocks */
+{
+  int		i;			/* Looping var */
+  space_t	*space;			/* Current directory */
+
+
+  if (*num_spaces > 0 && !strcmp((*spaces)[*num_spaces - 1].dst, dst))
+  {
+   /*
+    * Files are usually added in sorted order, so check the last directory
+    * first...
+    */
+
+    i     = 1;
+    space = *spaces + *num_spaces - 1;
+  }
+  else
+  {
+    for (i = *num_spaces, space = *spaces; i > 0; i --, space ++)
+      if (!strcmp(space->dst, dst))
+        break;
+  }
+
+  if (i == 0)
+  {
+    if ((*num_spaces & 15) == 0)
+    {
+      if ((space = realloc(*spaces, (size_t)(*num_spaces + 16) *
+                                    sizeof(space_t))) == NULL)
+      {
+        perror("epm: Out of memory allocating disk space");
+	exit(1);
+      }
+
+      *spaces = space;
+    }
+
+    space = *spaces + *num_spaces;
+    (*num_spaces) ++;
+
+    memset(space, 0, sizeof(space_t));
+    strlcpy(space->dst, dst, sizeof(space->dst));
+  }
+
+  space->inodes    += inodes;
+  space->kbytes[0] += kbytes1;
+  space->kbytes[1] += kbytes4;
+}
+
+
+/*
+ * 'get_fsspace()' - Get the space needed and available on each filesystem.
+ *
+ * Each destination directory (or the closest existing parent directory) is
+ * looked up with statvfs(), and the space needed on each filesystem is
+ * computed using the filesystem's block size.
+ */
+
+int					/* O - Number of filesystems or -1 */
+get_fsspace(int        num_spaces,	/* I - Number of directories */
+            space_t    *spaces,		/* I - Directories */
+	    fsspace_t  **fs)		/* O - Filesystems */
+{
+#ifdef HAVE_SYS_STATVFS_H
+  int		i, j,			/* Looping vars */
+		num_fs;			/* Number of filesystems */
+  space_t	*space;			/* Current directory */
+  fsspace_t	*current;		/* Current filesystem */
+  char		dir[1024],		/* Existing directory */
+		parent[1024],		/* Parent directory */
+		*ptr;			/* Pointer into directory */
+  struct stat	dirinfo,		/* Directory information */
+		parentinfo;		/* Parent directory information */
+  struct statvfs fsinfo;		/* Filesystem information */
+  unsigned long	bsize;			/* Block size */
+  long long	needed;			/* Space needed in kbytes */
+
+
+  *fs    = NULL;
+  num_fs = 0;
+
+  if (num_spaces <= 0)
+    return (0);
+
+  if ((*fs = calloc((size_t)num_spaces, sizeof(fsspace_t))) == NULL)
+    return (-1);
+
+  for (i = num_spaces, space = spaces; i > 0; i --, space ++)
+  {
+   /*
+    * Find the closest directory that exists...
+    */
+
+    strlcpy(dir, space->dst, sizeof(dir));
+
+    while (stat(dir, &dirinfo) && dir[1])
+    {
+      if ((ptr = strrchr(dir, '/')) == NULL || ptr == dir)
+        strlcpy(dir, "/", sizeof(dir));
+      else
+        *ptr = '\0';
+    }
+
+    if (statvfs(dir, &fsinfo) || stat(dir, &dirinfo))
+      continue;
+
+    if ((bsize = fsinfo.f_frsize) == 0)
+      bsize = fsinfo.f_bsize;
+
+   /*
+    * Compute the space needed using the filesystem block size...
+    */
+
+    if (bsize <= 1024)
+      needed = space->kbytes[0];
+    else if (bsize <= 4096)
+      needed = space->kbytes[1];
+    else
+      needed = space->kbytes[1] + space->inodes * (long long)((bsize - 4096) / 1024);
+
+   /*
+    * Add it to the filesystem...
+    */
+
+    for (j = 0, current = *fs; j < num_fs; j ++, current ++)
+      if (current->device == dirinfo.st_dev)
+        break;
+
+    if (j == num_fs)
+    {
+      num_fs ++;
+
+      current->device      = dirinfo.st_dev;
+      current->available   = (long long)fsinfo.f_bavail * (long long)bsize / 1024;
+      current->free_inodes = fsinfo.f_files ? (long)fsinfo.f_favail : -1;
+
+     /*
+      * Find the mount point...
+      */
+
+      while (strcmp(dir, "/"))
+      {
+        strlcpy(parent, dir, sizeof(parent));
+
+	if ((ptr = strrchr(parent, '/')) == NULL || ptr == parent)
+	  strlcpy(parent, "/", sizeof(parent));
+	else
+	  *ptr = '\0';
+
+        if (stat(parent, &parentinfo) || parentinfo.st_dev != dirinfo.st_dev)
+	  break;
+
+	strlcpy(dir, parent, sizeof(dir));
+      }
+
+      strlcpy(current->mount, dir, sizeof(current->mount));
+    }
+
+    current->needed += needed;
+    current->inodes += space->inodes;
+  }
+
+  return (num_fs);
+
+#else
+  REF(num_spaces);
+  REF(spaces);
+
+  *fs = NULL;
+
+  return (-1);
+#endif /* HAVE_SYS_STATVFS_H */
+}
@@ -0,0 +1,247 @@
+/*
+ * Build statistics functions for the ESP Package Manager (EPM).
+ *
+ * Copyright 2020 by Michael R Sweet
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "epm.h"
+#include <sys/time.h>
+#include <sys/resource.h>
+
+
+/*
+ * Local constants...
+ */
+
+#define MAX_PHASES	16		/* Maximum number of phases */
+
+
+/*
+ * Local types...
+ */
+
+typedef struct				/**** Build phase ****/
+{
+  const char	*name;			/* Name of phase */
+  double	wall,			/* Wall clock time */
+		user,			/* User CPU time */
+		sys,			/* System CPU time */
+		child;			/* Child process CPU time */
+  iostats_t	io;			/* I/O counters */
+} phase_t;
+
+typedef struct				/**** Point-in-time snapshot ****/
+{
+  double	wall,			/* Wall clock time */
+		user,			/* User CPU time */
+		sys,			/* System CPU time */
+		child;			/* Child process CPU time */
+  iostats_t	io;			/* I/O counters */
+} snapshot_t;
+
+
+/*
+ * Globals...
+ */
+
+iostats_t	IOStats;		/* I/O counters */
+
+
+/*
+ * Local globals...
+ */
+
+static int		num_phases = 0;	/* Number of phases */
+static phase_t		phases[MAX_PHASES];
+					/* Phases */
+static phase_t		*current = NULL;/* Current phase */
+static snapshot_t	start;		/* Start of current phase */
+
+
+/*
+ * Local functions...
+ */
+
+static void	get_snapshot(snapshot_t *s);
+
+
+/*
+ * 'stats_phase()' - Start a new build phase.
+ *
+ * The time and I/O since the previous call are charged to the previous
+ * phase.  Phases with the same name accumulate.  Pass NULL to end the
+ * current phase.
+ */
+
+void
+stats_phase(const char *name)		/* I - Name of phase or NULL */
+{
+  int		i;			/* Looping var */
+  snapshot_t	now;			/* Current snapshot */
+
+
+  get_snapshot(&now);
+
+ /*
+  * Charge the previous phase...
+  */
+
+  if (current)
+  {
+    current->wall  += now.wall - start.wall;
+    current->user  += now.user - start.user;
+    current->sys   += now.sys - start.sys;
+    current->child += now.child - start.child;
+
+    current->io.files_read    += now.io.files_read - start.io.files_read;
+    current->io.files_written += now.io.files_written - start.io.files_written;
+    current->io.bytes_read    += now.io.bytes_read - start.io.bytes_read;
+    current->io.bytes_written += now.io.bytes_written - start.io.bytes_written;
+    current->io.stat_calls    += now.io.stat_calls - start.io.stat_calls;
+    current->io.commands      += now.io.commands - start.io.commands;
+  }
+
+ /*
+  * Find or add the new phase...
+  */
+
+  current = NULL;
+  start   = now;
+
+  if (!name)
+    return;
+
+  for (i = 0; i < num_phases; i ++)
+    if (!strcmp(phases[i].name, name))
+    {
+      current = phases + i;
+      return;
+    }
+
+  if (num_phases < MAX_PHASES)
+  {
+    current       = phases + num_phases;
+    current->name = name;
+    num_phases ++;
+  }
+}
+
+
+/*
+ * 'stats_report()' - Write a report of the build phases.
+ */
+
+void
+stats_report(FILE *fp,			/* I - File to write to */
+             int  json)			/* I - Write JSON instead of a table? */
+{
+  int		i;			/* Looping var */
+  phase_t	*phase,			/* Current phase */
+		total;			/* Totals */
+
+
+  stats_phase(NULL);
+
+  memset(&total, 0, sizeof(total));
+  total.name = "total";
+
+  for (i = num_phases, phase = phases; i > 0; i --, phase ++)
+  {
+    total.wall  += phase->wall;
+    total.user  += phase->user;
+    total.sys   += phase->sys;
+    total.child += phase->child;
+
+    total.io.files_read    += phase->io.files_read;
+    total.io.files_written += phase->io.files_written;
+    total.io.bytes_read    += phase->io.bytes_read;
+    total.io.bytes_written += phase->io.bytes_written;
+    total.io.stat_calls    += phase->io.stat_calls;
+    total.io.commands      += phase->io.commands;
+  }
+
+  if (json)
+  {
+    fputs("{\n  \"phases\": [\n", fp);
+
+    for (i = 0, phase = phases; i <= num_phases; i ++, phase ++)
+    {
+      if (i == num_phases)
+      {
+        fputs("  ],\n  \"total\":\n", fp);
+        phase = &total;
+      }
+
+      fprintf(fp, "    { \"name\": \"%s\", \"wall\": %.3f, \"user\": %.3f, "
+                  "\"sys\": %.3f, \"child\": %.3f, \"files_read\": %ld, "
+		  "\"bytes_read\": %lld, \"files_written\": %ld, "
+		  "\"bytes_written\": %lld, \"stat_calls\": %ld, "
+		  "\"commands\": %ld }%s\n",
+              phase->name, phase->wall, phase->user, phase->sys, phase->child,
+	      phase->io.files_read, phase->io.bytes_read,
+	      phase->io.files_written, phase->io.bytes_written,
+	      phase->io.stat_calls, phase->io.commands,
+	      (i + 1) < num_phases ? "," : "");
+    }
+
+    fputs("}\n", fp);
+  }
+  else
+  {
+    fprintf(fp, "%-10s %9s %9s %9s %9s %8s %12s %8s %12s %8s %5s\n", "Phase",
+            "Wall", "User", "Sys", "Child", "Files-R", "Bytes-R", "Files-W",
+	    "Bytes-W", "Stats", "Cmds");
+
+    for (i = 0, phase = phases; i <= num_phases; i ++, phase ++)
+    {
+      if (i == num_phases)
+        phase = &total;
+
+      fprintf(fp, "%-10s %9.3f %9.3f %9.3f %9.3f %8ld %12lld %8ld %12lld "
+                  "%8ld %5ld\n",
+              phase->name, phase->wall, phase->user, phase->sys, phase->child,
+	      phase->io.files_read, phase->io.bytes_read,
+	      phase->io.files_written, phase->io.bytes_written,
+	      phase->io.stat_calls, phase->io.commands);
+    }
+  }
+}
+
+
+/*
+ * 'get_snapshot()' - Get the current times and counters.
+ */
+
+static void
+get_snapshot(snapshot_t *s)		/* O - Snapshot */
+{
+  struct timeval	tv;		/* Current time */
+  struct rusage		self,		/* Usage for this process */
+			children;	/* Usage for child processes */
+
+
+  gettimeofday(&tv, NULL);
+  getrusage(RUSAGE_SELF, &self);
+  getrusage(RUSAGE_CHILDREN, &children);
+
+  s->wall  = tv.tv_sec + 0.000001 * tv.tv_usec;
+  s->user  = self.ru_utime.tv_sec + 0.000001 * self.ru_utime.tv_usec;
+  s->sys   = self.ru_stime.tv_sec + 0.000001 * self.ru_stime.tv_usec;
+  s->child = children.ru_utime.tv_sec + 0.000001 * children.ru_utime.tv_usec +
+             children.ru_stime.tv_sec + 0.000001 * children.ru_stime.tv_usec;
+  s->io    = IOStats;
+}
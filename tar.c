@@ -20,6 +20,7 @@
  */
 
 #include "epm.h"
+#include <fcntl.h>
 
 
 /*
@@ -98,6 +99,7 @@ tar_close(tarf_t *fp)			/* I - File to write to */
   else if (fclose(fp->file))
     status = -1;
 
+  free_contents(&(fp->contents));
   free(fp);
 
   return (status);
@@ -213,7 +215,7 @@ tar_directory(tarf_t     *tar,		/* I - Tar file to write to */
                      srcinfo.st_mtime, "root", "sys", dst, NULL))
         goto fail;
 
-      if (tar_file(tar, src))
+      if (tar_file(tar, src, NULL))
         goto fail;
     }
   }
@@ -228,19 +230,161 @@ tar_directory(tarf_t     *tar,		/* I - Tar file to write to */
 }
 
 
+/*
+ * 'tar_dist_file()' - Archive a distribution file.
+ *
+ * Regular files whose contents, permissions, and ownership match a file
+ * that is already in the archive are written as hard links so that the
+ * data is only read and compressed once.
+ */
+
+int					/* O - 0 on success, -1 on error */
+tar_dist_file(tarf_t     *tar,		/* I - Tar file to write to */
+              file_t     *file,		/* I - Distribution file */
+	      off_t      size,		/* I - File size */
+	      time_t     mtime,		/* I - File modification time */
+	      const char *pathname)	/* I - Archive pathname */
+{
+  content_t	*content;		/* Matching contents */
+  tar_t		record;			/* Used for the linkname size */
+
+
+  if (tolower(file->type) != 'f')
+    content = NULL;
+  else if ((content = find_content(&(tar->contents), file, size,
+                                   pathname)) != NULL &&
+           strlen(content->path) >= sizeof(record.header.linkname))
+    content = NULL;
+
+  if (content)
+  {
+    if (Verbosity > 1)
+      printf("%s == %s...\n", pathname, content->path);
+
+    return (tar_header(tar, TAR_LINK, file->mode, 0, mtime, file->user,
+                       file->group, pathname, content->path));
+  }
+
+  if (tar_header(tar, TAR_NORMAL, file->mode, size, mtime, file->user,
+                 file->group, pathname, NULL) < 0)
+    return (-1);
+
+  if (tar_file(tar, file->src, file) < 0)
+    return (-1);
+
+  if (tolower(file->type) == 'f')
+    add_content(&(tar->contents), file, size, pathname);
+
+  return (0);
+}
+
+
+/*
+ * 'tar_extract()' - Extract the contents of the current member.
+ *
+ * Pass NULL for "dst" to skip the contents.
+ */
+
+int					/* O - 0 on success, -1 on error */
+tar_extract(tarf_t     *tar,		/* I - Tar file to read from */
+            const char *dst,		/* I - Destination file or NULL */
+	    mode_t     mode)		/* I - Permissions */
+{
+  int		fd;			/* Destination file */
+  size_t	bytes,			/* Bytes to read */
+		count;			/* Bytes to write */
+  char		buffer[8192];		/* Copy buffer */
+
+
+  if (dst)
+  {
+    if ((fd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, mode)) < 0)
+    {
+      fprintf(stderr, "epm: Unable to create \"%s\": %s\n", dst,
+              strerror(errno));
+      return (-1);
+    }
+
+    IOStats.files_written ++;
+  }
+  else
+    fd = -1;
+
+  while (tar->remaining > 0)
+  {
+   /*
+    * Read whole blocks so the padding after the data is consumed too...
+    */
+
+    if (tar->remaining > (off_t)sizeof(buffer))
+      count = sizeof(buffer);
+    else
+      count = (size_t)tar->remaining;
+
+    bytes = (count + TAR_BLOCK - 1) & ~(size_t)(TAR_BLOCK - 1);
+
+    if (fread(buffer, 1, bytes, tar->file) < bytes)
+    {
+      fprintf(stderr, "epm: Unexpected end of archive reading \"%s\".\n",
+              last_pathname);
+
+      if (fd >= 0)
+        close(fd);
+
+      return (-1);
+    }
+
+    IOStats.bytes_read += bytes;
+    tar->remaining     -= count;
+
+    if (fd >= 0)
+    {
+      if (write(fd, buffer, count) < (ssize_t)count)
+      {
+	fprintf(stderr, "epm: Unable to write \"%s\": %s\n", dst,
+		strerror(errno));
+	close(fd);
+	return (-1);
+      }
+
+      IOStats.bytes_written += count;
+
+      if (tar->progress)
+        (*tar->progress)();
+    }
+  }
+
+  if (fd >= 0)
+  {
+    fchmod(fd, mode);
+
+    if (close(fd))
+    {
+      fprintf(stderr, "epm: Unable to write \"%s\": %s\n", dst,
+              strerror(errno));
+      return (-1);
+    }
+  }
+
+  return (0);
+}
+
+
 /*
  * 'tar_file()' - Write the contents of a file...
  */
 
 int					/* O - 0 on success, -1 on error */
 tar_file(tarf_t     *fp,		/* I - Tar file to write to */
-         const char *filename)		/* I - File to write */
+         const char *filename,		/* I - File to write */
+	 file_t     *distfile)		/* I - Distribution file to digest or NULL */
 {
   FILE		*file;			/* File to write */
   size_t	nbytes,			/* Number of bytes read */
 		tbytes,			/* Total bytes read/written */
 		fill;			/* Number of fill bytes needed */
   char		buffer[8192];		/* Copy buffer */
+  digest_t	digest;			/* Content digest */
 
 
  /*
@@ -259,8 +403,18 @@ tar_file(tarf_t     *fp,		/* I - Tar file to write to */
 
   tbytes = 0;
 
+  IOStats.files_read ++;
+
+  if (distfile)
+    digest_init(&digest);
+
   while ((nbytes = fread(buffer, 1, sizeof(buffer), file)) > 0)
   {
+    if (distfile)
+      digest_update(&digest, buffer, nbytes);
+
+    IOStats.bytes_read += nbytes;
+
    /*
     * Zero fill the file to a 512 byte record as needed.
     */
@@ -289,6 +443,8 @@ tar_file(tarf_t     *fp,		/* I - Tar file to write to */
 
     tbytes     += nbytes;
     fp->blocks += nbytes / TAR_BLOCK;
+
+    IOStats.bytes_written += nbytes;
   }
 
  /*
@@ -296,6 +452,10 @@ tar_file(tarf_t     *fp,		/* I - Tar file to write to */
   */
 
   fclose(file);
+
+  if (distfile)
+    digest_finish(&digest, distfile);
+
   return (0);
 }
 
@@ -321,20 +481,8 @@ tar_header(tarf_t     *fp,		/* I - Tar file to write to */
   int		i,			/* Looping var... */
 		sum;			/* Checksum */
   unsigned char	*sumptr;		/* Pointer into header record */
-  struct passwd	*pwd;			/* Pointer to user record */
-  struct group	*grp;			/* Pointer to group record */
 
 
- /*
-  * Find the username and groupname IDs...
-  */
-
-  pwd = getpwnam(user);
-  grp = getgrnam(group);
-
-  endpwent();
-  endgrent();
-
  /*
   * Format the header...
   */
@@ -402,13 +550,13 @@ tar_header(tarf_t     *fp,		/* I - Tar file to write to */
   }
 
   snprintf(record.header.mode, sizeof(record.header.mode), "%-6o ", (unsigned)mode);
-  snprintf(record.header.uid, sizeof(record.header.uid), "%o ", pwd == NULL ? 0 : (unsigned)pwd->pw_uid);
-  snprintf(record.header.gid, sizeof(record.header.gid), "%o ", grp == NULL ? 0 : (unsigned)grp->gr_gid);
+  snprintf(record.header.uid, sizeof(record.header.uid), "%o ", (unsigned)get_user_id(user, 0));
+  snprintf(record.header.gid, sizeof(record.header.gid), "%o ", (unsigned)get_group_id(group, 0));
   snprintf(record.header.size, sizeof(record.header.size), "%011o", (unsigned)size);
   snprintf(record.header.mtime, sizeof(record.header.mtime), "%011o", (unsigned)mtime);
   memset(&(record.header.chksum), ' ', sizeof(record.header.chksum));
   record.header.linkflag = type;
-  if (type == TAR_SYMLINK)
+  if (type == TAR_SYMLINK || type == TAR_LINK)
     strlcpy(record.header.linkname, linkname, sizeof(record.header.linkname));
   strlcpy(record.header.magic, TAR_MAGIC, sizeof(record.header.magic));
   memcpy(record.header.version, TAR_VERSION, 2);
@@ -448,11 +596,96 @@ tar_header(tarf_t     *fp,		/* I - Tar file to write to */
 
   strlcpy(last_pathname, pathname, sizeof(last_pathname));
 
+  IOStats.files_written ++;
+  IOStats.bytes_written += sizeof(record);
+
   fp->blocks ++;
   return (0);
 }
 
 
+/*
+ * 'tar_next()' - Read the next TAR header.
+ *
+ * Any unread contents of the previous member are skipped.  The full
+ * pathname, including the prefix, is copied to "pathname".
+ */
+
+int					/* O - 1 on success, 0 at end, -1 on error */
+tar_next(tarf_t *tar,			/* I - Tar file to read from */
+         tar_t  *record,		/* O - TAR header record */
+	 char   *pathname,		/* O - Pathname */
+	 size_t pathsize)		/* I - Size of pathname buffer */
+{
+  int		i,			/* Looping var */
+		sum;			/* Checksum */
+  unsigned char	*sumptr;		/* Pointer into header record */
+
+
+  if (tar->remaining > 0 && tar_extract(tar, NULL, 0))
+    return (-1);
+
+  if (fread(record, 1, sizeof(tar_t), tar->file) < sizeof(tar_t))
+    return (0);
+
+  IOStats.bytes_read += sizeof(tar_t);
+
+  if (!record->header.pathname[0])
+  {
+   /*
+    * End of archive; read the padding so that gzip can finish cleanly...
+    */
+
+    while (fread(record, 1, sizeof(tar_t), tar->file) > 0);
+
+    return (0);
+  }
+
+ /*
+  * Verify the checksum, which is computed with the checksum field set to
+  * spaces...
+  */
+
+  for (i = sizeof(tar_t), sumptr = record->all, sum = 0; i > 0; i --, sumptr ++)
+    if (sumptr >= (unsigned char *)record->header.chksum &&
+        sumptr < (unsigned char *)record->header.chksum +
+	         sizeof(record->header.chksum))
+      sum += ' ';
+    else
+      sum += *sumptr;
+
+  if (sum != (int)strtol(record->header.chksum, NULL, 8))
+  {
+    fprintf(stderr, "epm: Bad checksum in archive after \"%s\".\n",
+            last_pathname);
+    return (-1);
+  }
+
+ /*
+  * Get the pathname and size...
+  */
+
+  if (record->header.prefix[0])
+    snprintf(pathname, pathsize, "%.155s/%.100s", record->header.prefix,
+             record->header.pathname);
+  else
+    snprintf(pathname, pathsize, "%.100s", record->header.pathname);
+
+  strlcpy(last_pathname, pathname, sizeof(last_pathname));
+
+  if (record->header.linkflag == TAR_NORMAL ||
+      record->header.linkflag == TAR_OLDNORMAL ||
+      record->header.linkflag == TAR_CONTIG)
+    tar->remaining = (off_t)strtoll(record->header.size, NULL, 8);
+  else
+    tar->remaining = 0;
+
+  IOStats.files_read ++;
+
+  return (1);
+}
+
+
 /*
  * 'tar_open()' - Open a TAR file for writing.
  */
@@ -504,6 +737,55 @@ tar_open(const char *filename,		/* I - File to create */
 }
 
 
+/*
+ * 'tar_open_read()' - Open a TAR file for reading.
+ *
+ * Compressed files are read through gzip.
+ */
+
+tarf_t *				/* O - Tar file or NULL on error */
+tar_open_read(const char *filename)	/* I - File to open */
+{
+  tarf_t	*fp;			/* Tar file */
+  unsigned char	magic[2];		/* Magic number */
+  char		command[1024];		/* Decompression command */
+
+
+  if ((fp = calloc(sizeof(tarf_t), 1)) == NULL)
+    return (NULL);
+
+  if ((fp->file = fopen(filename, "rb")) == NULL)
+  {
+    free(fp);
+    return (NULL);
+  }
+
+ /*
+  * Look for the gzip magic number...
+  */
+
+  if (fread(magic, 1, sizeof(magic), fp->file) == sizeof(magic) &&
+      magic[0] == 0x1f && magic[1] == 0x8b)
+  {
+    fclose(fp->file);
+
+    snprintf(command, sizeof(command), EPM_GZIP " -dc <\"%s\"", filename);
+    fp->file       = popen(command, "r");
+    fp->compressed = 1;
+  }
+  else
+    rewind(fp->file);
+
+  if (fp->file == NULL)
+  {
+    free(fp);
+    return (NULL);
+  }
+
+  return (fp);
+}
+
+
 /*
  * 'tar_package()' - Archive a package file.
  */
@@ -570,5 +852,5 @@ tar_package(tarf_t     *tar,		/* I - Tar file */
                  filestat.st_mtime, "root", "root", name, NULL))
     return (-1);
 
-  return (tar_file(tar, filename));
+  return (tar_file(tar, filename, NULL));
 }
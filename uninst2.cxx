@@ -74,15 +74,29 @@ AuthorizationRef SetupAuthorizationRef;
 #define PANE_REMOVE	3
 
 
+//
+// Local globals...
+//
+
+static gui_progress_t	Progress;	// Removal progress
+static long long	ProgressEnd = 0;// Progress at end of current product
+static char		ProgressTitle[1024],
+					// Title of current product
+			ProgressLabel[1024];
+					// Progress label
+
+
 //
 // Local functions...
 //
 
+int	count_files(const gui_dist_t *dist);
 void	load_image(void);
 void	load_readme(void);
 void	log_cb(int fd, int *fdptr);
 int	remove_dist(const gui_dist_t *dist);
 void	show_installed(void);
+void	show_progress(void);
 void	update_sizes(void);
 
 
@@ -101,6 +115,9 @@ main(int  argc,			// I - Number of command-line arguments
   Fl::background(230, 230, 230);
   Fl::scheme("gtk+");
 
+  // Ask the removal scripts for progress records...
+  putenv((char *)"EPM_PROGRESS=1");
+
 #ifdef __APPLE__
   // macOS uses the setup program in a bundle, so get the bundle's directory.
   CFBundleRef mainBundle = CFBundleGetMainBundle();
@@ -130,6 +147,7 @@ main(int  argc,			// I - Number of command-line arguments
   NextButton->deactivate();
 
   gui_get_installed();
+  gui_get_installed_rpms(0, NULL);
   show_installed();
 
   load_image();
@@ -186,6 +204,39 @@ main(int  argc,			// I - Number of command-line arguments
 }
 
 
+//
+// 'count_files()' - Count the files installed by a distribution.
+//
+// Distributions without a file list count as one file so that they still
+// advance the progress bar.
+//
+
+int					// O - Number of files
+count_files(const gui_dist_t *dist)	// I - Distribution
+{
+  FILE		*fp;			// File list
+  int		ch;			// Character from file list
+  int		count;			// Number of files
+  char		filename[1024];		// File list filename
+
+
+  snprintf(filename, sizeof(filename), EPM_SOFTWARE "/%s.files",
+           dist->product);
+
+  if ((fp = fopen(filename, "rb")) == NULL)
+    return (1);
+
+  // The file list contains nul-terminated entries...
+  for (count = 0; (ch = getc(fp)) != EOF;)
+    if (!ch)
+      count ++;
+
+  fclose(fp);
+
+  return (count > 0 ? count : 1);
+}
+
+
 //
 // 'list_cb()' - Handle selections in the software list.
 //
@@ -381,7 +432,8 @@ log_cb(int fd,			// I - Pipe to read from
     {
       // Add remaining text...
       buffer[bufused] = '\0';
-      RemoveLog->add(buffer);
+      if (!gui_update_progress(&Progress, buffer))
+        RemoveLog->add(buffer);
       bufused = 0;
     }
   }
@@ -394,7 +446,13 @@ log_cb(int fd,			// I - Pipe to read from
     while ((bufptr = strchr(buffer, '\n')) != NULL)
     {
       *bufptr++ = '\0';
-      RemoveLog->add(buffer);
+
+      // Progress records update the progress bar instead of the log...
+      if (gui_update_progress(&Progress, buffer))
+        show_progress();
+      else
+        RemoveLog->add(buffer);
+
       strcpy(buffer, bufptr);
       bufused -= bufptr - buffer;
     }
@@ -412,9 +470,9 @@ void
 next_cb(Fl_Button *, void *)
 {
   int		i;		// Looping var
-  int		progress;	// Progress so far...
   int		error;		// Errors?
-  static char	message[1024];	// Progress message...
+  int		*counts;	// Files to remove for each product
+  long long	total;		// Total files to remove
   static int	removing = 0;	// Removing software?
 
 
@@ -440,22 +498,34 @@ next_cb(Fl_Button *, void *)
     CancelButton->deactivate();
     CancelButton->label("Close");
 
-    for (i = 0, progress = 0, error = 0; i < NumInstalled; i ++)
+    // Track progress using the number of files to remove; products that
+    // don't report progress just advance when they are done...
+    counts = new int[NumInstalled];
+
+    for (i = 0, total = 0; i < NumInstalled; i ++)
+      if (SoftwareList->checked(i + 1))
+        total += (counts[i] = count_files(Installed + i));
+
+    gui_start_progress(&Progress, total, 1);
+
+    for (i = 0, error = 0; i < NumInstalled; i ++)
       if (SoftwareList->checked(i + 1))
       {
-        sprintf(message, "Removing %s v%s...", Installed[i].name,
-	        Installed[i].version);
+        snprintf(ProgressTitle, sizeof(ProgressTitle), "Removing %s v%s",
+	         Installed[i].name, Installed[i].version);
 
-        RemovePercent->value(100.0 * progress / SoftwareList->nchecked());
-	RemovePercent->label(message);
-	Pane[PANE_REMOVE]->redraw();
+        ProgressEnd       = Progress.done + counts[i];
+        Progress.phase[0] = '\0';
+        show_progress();
 
         if ((error = remove_dist(Installed + i)) != 0)
 	  break;
 
-	progress ++;
+        Progress.done = ProgressEnd;
       }
 
+    delete[] counts;
+
     RemovePercent->value(100.0);
 
     if (error)
@@ -630,6 +700,25 @@ show_installed()
 }
 
 
+//
+// 'show_progress()' - Show the removal progress for the current product.
+//
+
+void
+show_progress(void)
+{
+  // Don't let a product with more files than expected run into the next...
+  if (Progress.done > ProgressEnd)
+    Progress.done = ProgressEnd;
+
+  RemovePercent->value(gui_format_progress(&Progress, ProgressTitle,
+                                           ProgressLabel,
+					   sizeof(ProgressLabel)));
+  RemovePercent->label(ProgressLabel);
+  Pane[PANE_REMOVE]->redraw();
+}
+
+
 //
 // 'update_size()' - Update the total +/- sizes of the installations.
 //